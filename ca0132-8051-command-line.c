@@ -40,6 +40,25 @@
  * pin   - Prints out HDA node pin values. Not sure what they represent.
  * codec - Takes a codec number value, seems to print out the codecs power state.
  * q     - Prints out the high water mark of the verb buffer.
+ *
+ * If a script file is given, its commands are run in batch mode. Commands
+ * are pipelined, with as many in flight as fit in the input buffer, and
+ * each result is printed as a record:
+ *
+ * cmd <command>
+ * res <response, with non-printable characters escaped>
+ * val <each hex value found in the response>
+ * err <timeout, if the response never arrived>
+ * end
+ *
+ * Besides console commands, scripts can contain:
+ * sweep <start> <end> <step> <command-format> - Run the command once for each
+ *         address, with the address filled in with a printf style
+ *         conversion, e.g. "sweep 0x1000 0x10ff 1 xmem %x".
+ * Lines starting with '#' are ignored.
+ *
+ * A script with errors isn't run. The exit status is non-zero if the script
+ * couldn't be loaded, or any command timed out.
  */
 #include "ca0132_defs.h"
 
@@ -54,6 +73,26 @@
 #define IN_BUF_LEN      0x80
 #define OUT_BUF_LEN     0x100
 
+/*
+ * Response polling. Start polling after a few microseconds, doubling the
+ * wait each time nothing has changed. Multi-line responses have a carriage
+ * return at the end of each line, so once the output ends in one, wait a
+ * short settle time for more lines before considering it done.
+ */
+#define POLL_MIN_WAIT_US 20
+#define POLL_MAX_WAIT_US 12500
+#define POLL_SETTLE_US   1000
+#define POLL_TIMEOUT_US  2000000
+
+struct serial_response_tracker {
+	uint8_t read_ptr;
+	uint8_t last_byte;
+	uint32_t byte_cnt;
+
+	uint32_t wait_us;
+	uint32_t idle_us;
+};
+
 struct serial_buffer_offset {
 	uint32_t part1_cnt;
 	uint32_t part2_cnt;
@@ -61,16 +100,61 @@ struct serial_buffer_offset {
 	uint32_t write_ptr;
 };
 
+/*
+ * Batch mode. Pipelined commands are expected to respond with a single
+ * line, and are matched to responses in order. Commands that respond with
+ * multiple lines are run alone, and finish the same way interactive ones
+ * do. The number in flight is also limited so their output doesn't overrun
+ * the output buffer before it's read.
+ */
+#define BATCH_MAX_IN_FLIGHT 8
+#define BATCH_LINE_LEN      0x200
+
+enum batch_cmd_mode {
+	BATCH_CMD_LINE,
+	BATCH_CMD_SOLO,
+};
+
+struct batch_cmd {
+	char str[IN_BUF_LEN];
+	uint32_t mode;
+};
+
+struct batch_state {
+	struct batch_cmd *cmds;
+	uint32_t cmd_cnt, cmd_alloc;
+	uint32_t next_cmd;
+
+	uint32_t in_flight[BATCH_MAX_IN_FLIGHT];
+	uint32_t flight_head, flight_cnt;
+
+	uint8_t in_write_ptr;
+	uint8_t out_read_ptr;
+
+	char line[BATCH_LINE_LEN];
+	uint32_t line_len;
+	uint8_t last_byte;
+
+	uint32_t wait_us;
+	uint32_t idle_us;
+
+	uint32_t timeout_cnt;
+};
+
+/* Multi-line commands, and those that are only multi-line without arguments. */
+static const char *batch_solo_cmds[] = { "ver", "log", "pin" };
+static const char *batch_solo_no_arg_cmds[] = { "flag", "ctrl" };
+
 static void usage(char *pname)
 {
-	fprintf(stderr, "usage: %s <hwdep-device>\n", pname);
+	fprintf(stderr, "usage: %s <hwdep-device> [script-file]\n", pname);
 }
 
 static void get_serial_buffer_offset(struct serial_buffer_offset *data,
 		uint32_t start_ptr, uint32_t cnt, uint32_t buf_size)
 {
 	memset(data, 0, sizeof(*data));
-	if (start_ptr + cnt > buf_size) {
+	if (start_ptr + cnt >= buf_size) {
 		data->part1_cnt = buf_size - start_ptr;
 		data->part2_cnt = (cnt - data->part1_cnt);
 		data->write_ptr = data->part2_cnt;
@@ -116,69 +200,455 @@ static void write_serial_buffer_cmd(int fd, uint8_t *buf)
 	write_input_serial_buffer(fd, len, buf);
 }
 
-static void print_serial_buffer_cmd_response(int fd, uint8_t base_ptr,
-		uint8_t write_ptr)
+/* Lines end in a carriage return, sometimes followed by a new-line. */
+static int is_line_end(uint8_t byte)
+{
+	return byte == 0x0d || byte == '\n';
+}
+
+static void poll_wait(uint32_t us)
+{
+	struct timespec ts;
+
+	ts.tv_sec = us / 1000000;
+	ts.tv_nsec = (us % 1000000) * 1000;
+	nanosleep(&ts, NULL);
+}
+
+/*
+ * Read anything new in the output ring buffer since read_ptr into buf, and
+ * return how many bytes there were.
+ */
+static uint32_t read_serial_output(int fd, uint8_t *read_ptr, uint8_t *buf)
 {
 	struct serial_buffer_offset data;
-	uint8_t buf[0x100];
+	uint8_t write_ptr;
 	uint32_t cnt;
 
-	if (write_ptr < base_ptr) {
-		cnt = 0x100 - base_ptr;
-		cnt += write_ptr;
-	} else {
-		cnt = write_ptr - base_ptr;
-	}
+	write_ptr = chipio_8051_read_exram_at_addr(fd, OUT_BUF_WRITE_PTR);
+	cnt = (uint8_t)(write_ptr - *read_ptr);
+	if (!cnt)
+		return 0;
 
-	get_serial_buffer_offset(&data, base_ptr, cnt, OUT_BUF_LEN);
-	chipio_8051_read_exram_data_range(fd, OUT_BUF_ADDR + base_ptr, data.part1_cnt, buf);
+	get_serial_buffer_offset(&data, *read_ptr, cnt, OUT_BUF_LEN);
+	chipio_8051_read_exram_data_range(fd, OUT_BUF_ADDR + *read_ptr,
+			data.part1_cnt, buf);
 	if (data.part2_cnt) {
 		chipio_8051_read_exram_data_range(fd, OUT_BUF_ADDR, data.part2_cnt,
 				&buf[data.part1_cnt]);
 	}
 
-	buf[cnt] = '\0';
+	*read_ptr = write_ptr;
+
+	return cnt;
+}
+
+/* Print anything new in the output ring buffer since the last read. */
+static uint32_t read_serial_response(int fd, struct serial_response_tracker *resp)
+{
+	uint8_t buf[OUT_BUF_LEN];
+	uint32_t cnt;
+
+	cnt = read_serial_output(fd, &resp->read_ptr, buf);
+	if (!cnt)
+		return 0;
+
+	if (!resp->byte_cnt)
+		printf("Response:\n");
+
+	fwrite(buf, 1, cnt, stdout);
+	fflush(stdout);
+
+	resp->last_byte = buf[cnt - 1];
+	resp->byte_cnt += cnt;
 
-	printf("Response:\n%s\n\n", buf);
+	return cnt;
 }
 
-static int check_out_buffer_change(int fd, uint8_t base_ptr)
+/*
+ * Stream the response as it's written into the output buffer, until it ends
+ * in a carriage return and has settled, or nothing new shows up before the
+ * timeout. Returns the number of bytes received.
+ */
+static uint32_t track_serial_response(int fd, uint8_t start_ptr)
 {
-	uint32_t i, ret;
+	struct serial_response_tracker resp;
+
+	memset(&resp, 0, sizeof(resp));
+	resp.read_ptr = start_ptr;
+	resp.wait_us = POLL_MIN_WAIT_US;
+	while (resp.idle_us < POLL_TIMEOUT_US) {
+		poll_wait(resp.wait_us);
+		if (read_serial_response(fd, &resp)) {
+			resp.wait_us = POLL_MIN_WAIT_US;
+			resp.idle_us = 0;
+			continue;
+		}
 
-	ca0132_command_wait();
-	for (i = 0; i < 4; i++) {
-		ret = chipio_8051_read_exram_at_addr(fd, OUT_BUF_WRITE_PTR);
-		if (ret != base_ptr)
-			return 0;
+		resp.idle_us += resp.wait_us;
+		if (resp.byte_cnt && is_line_end(resp.last_byte) &&
+				resp.idle_us >= POLL_SETTLE_US)
+			break;
 
-		ca0132_command_wait();
+		resp.wait_us *= 2;
+		if (resp.wait_us > POLL_MAX_WAIT_US)
+			resp.wait_us = POLL_MAX_WAIT_US;
 	}
 
-	return 1;
+	if (resp.byte_cnt)
+		printf("\n\n");
 
+	return resp.byte_cnt;
 }
 
+/*
+ * Track the response from the output buffer's current write pointer, so
+ * that only output from this command is printed.
+ */
 static void send_serial_cmd(int fd, uint8_t *buf)
 {
-	uint8_t out_buf_base_ptr, out_buf_write_ptr;
+	uint8_t out_buf_write_ptr;
 
-	out_buf_base_ptr = chipio_8051_read_exram_at_addr(fd, OUT_BUF_BASE_PTR);
+	out_buf_write_ptr = chipio_8051_read_exram_at_addr(fd, OUT_BUF_WRITE_PTR);
 	write_serial_buffer_cmd(fd, buf);
 
-	if (check_out_buffer_change(fd, out_buf_base_ptr)) {
+	if (!track_serial_response(fd, out_buf_write_ptr))
 		printf("No response.\n");
-		return;
+}
+
+/*
+ * Batch mode functions.
+ */
+static int batch_add_cmd(struct batch_state *batch, const char *str)
+{
+	char word[0x10], arg[0x10];
+	struct batch_cmd *cmd, *tmp;
+	uint32_t i, has_arg, alloc;
+
+	if (strlen(str) > IN_BUF_LEN - 3) {
+		fprintf(stderr, "Command too long: %s\n", str);
+		return 1;
+	}
+
+	if (batch->cmd_cnt == batch->cmd_alloc) {
+		alloc = batch->cmd_alloc ? batch->cmd_alloc * 2 : 0x100;
+		tmp = realloc(batch->cmds, alloc * sizeof(*cmd));
+		if (!tmp) {
+			fprintf(stderr, "Failed to allocate script commands.\n");
+			return 1;
+		}
+
+		batch->cmds = tmp;
+		batch->cmd_alloc = alloc;
 	}
 
-	out_buf_write_ptr = chipio_8051_read_exram_at_addr(fd,
-			OUT_BUF_WRITE_PTR);
-	print_serial_buffer_cmd_response(fd, out_buf_base_ptr,
-			out_buf_write_ptr);
+	cmd = &batch->cmds[batch->cmd_cnt++];
+	strcpy(cmd->str, str);
+	cmd->mode = BATCH_CMD_LINE;
+
+	word[0] = '\0';
+	has_arg = sscanf(str, "%15s %15s", word, arg) == 2;
+	for (i = 0; i < ARRAY_SIZE(batch_solo_cmds); i++) {
+		if (!strcmp(word, batch_solo_cmds[i]))
+			cmd->mode = BATCH_CMD_SOLO;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(batch_solo_no_arg_cmds); i++) {
+		if (!strcmp(word, batch_solo_no_arg_cmds[i]) && !has_arg)
+			cmd->mode = BATCH_CMD_SOLO;
+	}
+
+	return 0;
+}
+
+/* Only allow a single integer conversion in a sweep's command format. */
+static int check_sweep_format(const char *fmt)
+{
+	const char *tmp;
+
+	tmp = strchr(fmt, '%');
+	if (!tmp || strchr(tmp + 1, '%'))
+		return 1;
+
+	tmp += 1 + strspn(tmp + 1, "0123456789");
+
+	return !strchr("xXdu", *tmp) || !*tmp;
+}
+
+/*
+ * Load a script's commands. Every line with an error is reported, and 1 is
+ * returned if there were any.
+ */
+static int batch_load_script(struct batch_state *batch, char *file_name)
+{
+	uint32_t start, end, step, addr;
+	char line[0x100], cmd[0x100];
+	int fmt_offset, ret;
+	FILE *file;
+
+	file = fopen(file_name, "r");
+	if (!file) {
+		fprintf(stderr, "Failed to open script file.\n");
+		return 1;
+	}
+
+	ret = 0;
+	while (fgets(line, sizeof(line), file)) {
+		line[strcspn(line, "\r\n")] = '\0';
+		if (!line[0] || line[0] == '#')
+			continue;
+
+		if (strncmp(line, "sweep ", 6)) {
+			ret |= batch_add_cmd(batch, line);
+			continue;
+		}
+
+		fmt_offset = 0;
+		if (sscanf(line, "sweep %i %i %i %n", &start, &end, &step,
+				&fmt_offset) != 3 || !fmt_offset || !step ||
+				check_sweep_format(&line[fmt_offset])) {
+			fprintf(stderr, "Invalid sweep: %s\n", line);
+			ret = 1;
+			continue;
+		}
+
+		for (addr = start; addr <= end; addr += step) {
+			snprintf(cmd, sizeof(cmd), &line[fmt_offset], addr);
+			if (batch_add_cmd(batch, cmd)) {
+				ret = 1;
+				break;
+			}
+
+			if (addr + step < addr)
+				break;
+		}
+	}
+
+	fclose(file);
+
+	return ret;
+}
+
+static void print_escaped(const char *str, uint32_t len)
+{
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		if (isprint((uint8_t)str[i]) && str[i] != '\\')
+			putchar(str[i]);
+		else
+			printf("\\x%02x", (uint8_t)str[i]);
+	}
+}
+
+/* Anything that looks like a hex value: 0x prefixed, or hex digits only. */
+static void print_hex_vals(const char *str, uint32_t len)
+{
+	char tmp[BATCH_LINE_LEN + 1], *tok, *save;
+	const char *digits;
+
+	memcpy(tmp, str, len);
+	tmp[len] = '\0';
+	for (tok = strtok_r(tmp, " \t\r\n:=,", &save); tok;
+			tok = strtok_r(NULL, " \t\r\n:=,", &save)) {
+		digits = tok;
+		if (!strncmp(tok, "0x", 2) || !strncmp(tok, "0X", 2))
+			digits += 2;
+		else if (!strpbrk(tok, "0123456789"))
+			continue;
+
+		if (!*digits || strspn(digits, "0123456789abcdefABCDEF") != strlen(digits))
+			continue;
+
+		printf("val 0x%s\n", digits);
+	}
+}
+
+static void batch_print_result(struct batch_state *batch, uint32_t timeout)
+{
+	struct batch_cmd *cmd;
+
+	cmd = &batch->cmds[batch->in_flight[batch->flight_head]];
+	batch->flight_head = (batch->flight_head + 1) % BATCH_MAX_IN_FLIGHT;
+	batch->flight_cnt--;
+
+	printf("cmd %s\nres ", cmd->str);
+	print_escaped(batch->line, batch->line_len);
+	putchar('\n');
+	print_hex_vals(batch->line, batch->line_len);
+	if (timeout) {
+		printf("err timeout\n");
+		batch->timeout_cnt++;
+	}
+
+	printf("end\n");
+	fflush(stdout);
+
+	batch->line_len = 0;
+}
+
+/*
+ * If the current line is the echo of a command in flight, return how far it
+ * is from the oldest command in flight, otherwise return -1.
+ */
+static int batch_find_echo(struct batch_state *batch)
+{
+	struct batch_cmd *cmd;
+	uint32_t i;
+
+	for (i = 0; i < batch->flight_cnt; i++) {
+		cmd = &batch->cmds[batch->in_flight[(batch->flight_head + i) %
+				BATCH_MAX_IN_FLIGHT]];
+		if (batch->line_len == strlen(cmd->str) &&
+				!memcmp(batch->line, cmd->str, batch->line_len))
+			return i;
+	}
+
+	return -1;
+}
+
+/*
+ * Split the output of pipelined commands into lines, and match each to the
+ * oldest command in flight. Empty lines and command echoes are skipped, and
+ * an echo of a newer command means the older ones had no output. Solo
+ * commands take everything until they've settled.
+ */
+static void batch_handle_output(struct batch_state *batch, const uint8_t *buf,
+		uint32_t cnt)
+{
+	struct batch_cmd *cmd;
+	uint32_t i;
+	int echo;
+
+	for (i = 0; i < cnt && batch->flight_cnt; i++) {
+		cmd = &batch->cmds[batch->in_flight[batch->flight_head]];
+		batch->last_byte = buf[i];
+
+		if (cmd->mode == BATCH_CMD_SOLO || (buf[i] != 0x0d && buf[i] != '\n')) {
+			if (batch->line_len < BATCH_LINE_LEN)
+				batch->line[batch->line_len++] = buf[i];
+
+			continue;
+		}
+
+		if (buf[i] == '\n')
+			continue;
+
+		if (!batch->line_len)
+			continue;
+
+		echo = batch_find_echo(batch);
+		if (echo < 0) {
+			batch_print_result(batch, 0);
+			continue;
+		}
+
+		batch->line_len = 0;
+		while (echo--)
+			batch_print_result(batch, 0);
+	}
+}
+
+static uint32_t batch_send_cmds(int fd, struct batch_state *batch)
+{
+	struct serial_buffer_offset data;
+	struct batch_cmd *cmd;
+	uint8_t buf[IN_BUF_LEN], base_ptr;
+	uint32_t len, used, sent;
+
+	base_ptr = chipio_8051_read_exram_at_addr(fd, IN_BUF_BASE_PTR);
+	used = (batch->in_write_ptr - base_ptr) & (IN_BUF_LEN - 1);
+	sent = 0;
+	while (batch->next_cmd < batch->cmd_cnt &&
+			batch->flight_cnt < BATCH_MAX_IN_FLIGHT) {
+		cmd = &batch->cmds[batch->next_cmd];
+
+		/* Solo commands wait for everything else to finish, and vice versa. */
+		if (batch->flight_cnt && (cmd->mode == BATCH_CMD_SOLO ||
+				batch->cmds[batch->in_flight[batch->flight_head]].mode ==
+				BATCH_CMD_SOLO))
+			break;
+
+		len = strlen(cmd->str);
+		memcpy(buf, cmd->str, len);
+		buf[len++] = 0x0d;
+		if (used + len > IN_BUF_LEN - 1)
+			break;
+
+		get_serial_buffer_offset(&data, batch->in_write_ptr, len, IN_BUF_LEN);
+		chipio_8051_write_exram_data_range(fd, IN_BUF_ADDR + batch->in_write_ptr,
+				data.part1_cnt, buf);
+		if (data.part2_cnt) {
+			chipio_8051_write_exram_data_range(fd, IN_BUF_ADDR,
+					data.part2_cnt, &buf[data.part1_cnt]);
+		}
+
+		batch->in_write_ptr = data.write_ptr;
+		batch->in_flight[(batch->flight_head + batch->flight_cnt) %
+				BATCH_MAX_IN_FLIGHT] = batch->next_cmd;
+		batch->flight_cnt++;
+		batch->next_cmd++;
+		used += len;
+		sent++;
+	}
+
+	/* Only update the write pointer once, after the whole batch. */
+	if (sent)
+		chipio_8051_write_exram_at_addr(fd, IN_BUF_WRITE_PTR, batch->in_write_ptr);
+
+	return sent;
+}
+
+static void run_batch(int fd, struct batch_state *batch)
+{
+	uint8_t buf[OUT_BUF_LEN];
+	uint32_t cnt, solo;
+
+	batch->in_write_ptr = chipio_8051_read_exram_at_addr(fd, IN_BUF_WRITE_PTR);
+	batch->out_read_ptr = chipio_8051_read_exram_at_addr(fd, OUT_BUF_WRITE_PTR);
+	batch->wait_us = POLL_MIN_WAIT_US;
+
+	while (batch->next_cmd < batch->cmd_cnt || batch->flight_cnt) {
+		if (batch_send_cmds(fd, batch)) {
+			batch->wait_us = POLL_MIN_WAIT_US;
+			batch->idle_us = 0;
+		}
+
+		poll_wait(batch->wait_us);
+		cnt = read_serial_output(fd, &batch->out_read_ptr, buf);
+		if (cnt) {
+			batch_handle_output(batch, buf, cnt);
+			batch->wait_us = POLL_MIN_WAIT_US;
+			batch->idle_us = 0;
+			continue;
+		}
+
+		batch->idle_us += batch->wait_us;
+		solo = batch->flight_cnt &&
+			batch->cmds[batch->in_flight[batch->flight_head]].mode == BATCH_CMD_SOLO;
+		if (solo && batch->line_len && is_line_end(batch->last_byte) &&
+				batch->idle_us >= POLL_SETTLE_US) {
+			batch_print_result(batch, 0);
+			continue;
+		}
+
+		/* Nothing is coming, so whatever's in flight has been lost. */
+		if (batch->idle_us >= POLL_TIMEOUT_US) {
+			while (batch->flight_cnt)
+				batch_print_result(batch, 1);
+
+			batch->idle_us = 0;
+		}
+
+		batch->wait_us *= 2;
+		if (batch->wait_us > POLL_MAX_WAIT_US)
+			batch->wait_us = POLL_MAX_WAIT_US;
+	}
 }
 
 int main(int argc, char **argv)
 {
+	struct batch_state batch;
 	char buf[0x100];
 	int fd, ret;
 
@@ -191,6 +661,23 @@ int main(int argc, char **argv)
 	if (ret)
 		return ret;
 
+	if (argc > 2) {
+		memset(&batch, 0, sizeof(batch));
+		ret = batch_load_script(&batch, argv[2]);
+		if (!ret) {
+			run_batch(fd, &batch);
+			if (batch.timeout_cnt) {
+				fprintf(stderr, "%d commands timed out.\n", batch.timeout_cnt);
+				ret = 1;
+			}
+		}
+
+		free(batch.cmds);
+		close(fd);
+
+		return ret;
+	}
+
 	while (1) {
 		if (!fgets(buf, IN_BUF_LEN - 3, stdin))
 			continue;
@@ -201,5 +688,3 @@ int main(int argc, char **argv)
 
 	return 0;
 }
-
-
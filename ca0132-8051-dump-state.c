@@ -2,6 +2,10 @@
  * ca0132-dump-state:
  * Create a simulator state by dumping the contents of a running ca0132.
  * Then, you can enter the main loop and simulate from there.
+ *
+ * If a previous save state is given, only the 256 byte pages whose hash
+ * computed on the 8051 differs from the previous state's are read, unless
+ * 'full' is given to read everything.
  */
 #include "ca0132_defs.h"
 
@@ -23,17 +27,23 @@ enum dump_func_id {
 	DUMP_FUNC_XRAM,
 	DUMP_FUNC_IRAM,
 	DUMP_FUNC_SIGNAL,
+	DUMP_FUNC_HASH_PMEM,
+	DUMP_FUNC_HASH_XRAM,
 };
 
 enum dump_handler_id {
 	DUMP_HANDLER_PMEM_B0,
 	DUMP_HANDLER_PMEM_B1,
 	DUMP_HANDLER_XRAM_IRAM_SFR,
+	DUMP_HANDLER_HASH_PMEM,
+	DUMP_HANDLER_HASH_PMEM_B0,
+	DUMP_HANDLER_HASH_PMEM_B1,
+	DUMP_HANDLER_HASH_XRAM,
 	DUMP_HANDLER_JMP_TBL,
 };
 
 struct ca0132_dump_state_data {
-	uint16_t dump_func_addr[4];
+	uint16_t dump_func_addr[6];
 	uint16_t entry_addr;
 	uint16_t exit_addr;
 	uint16_t jmp_tbl_addr;
@@ -63,13 +73,16 @@ struct ca0132_dump_state_data {
 
 static const uint8_t main_func_entry_addr[2] = { 0xf3, 0x00 };
 
-#define ARR_BLOCK_SIZE            100
 #define GEN_FUNC_START            0xf100
 #define VAL_HANDLER_START         0xf200
 #define MAIN_FUNC_ENTRY           0xf300
 #define EXRAM_SIGNAL_ADDR         0xf1ff
 #define PARAM_ID_36_HANDLER_ADDR  0x1759
 #define DUMP_PARAM_ID             0x24
+#define HASH_TBL_ADDR             0x4200
+#define HASH_PAGE_SIZE            0x100
+#define HASH_SIZE                 4
+#define HASH_MAX_PAGES            0x80
 
 /*
  * Generic functions:
@@ -167,6 +180,81 @@ static const uint8_t mem_dump_func3[] = {
 	0x90, 0xf1, 0xff, 0x74, 0xff, 0xf0, 0x22,
 };
 
+/* PMEM page hash function.
+ * Hashes r0 pages of 256 bytes starting at dptr0, storing a four byte
+ * Fletcher style hash for each page at exram 0x4200. r3:r2 is the 16-bit
+ * sum of the page's bytes, and r5:r4 the 16-bit sum of r3:r2 after each
+ * byte, both stored low byte first.
+ * c0 a8    ; push IE
+ * 75 a8 00 ; set  IE to #0x00.
+ * 05 86    ; inc  dp_tgl
+ * 90 42 00 ; move dptr   #0x4200
+ * 05 86    ; inc  dp_tgl
+ * 7a 00    ; move r2     #0x00
+ * 7b 00    ; move r3     #0x00
+ * 7c 00    ; move r4     #0x00
+ * 7d 00    ; move r5     #0x00
+ * 79 00    ; move r1     #0x00
+ * e4       ; clr A
+ * 93       ; movc acc    dptr
+ * a3       ; inc  dptr
+ * 2a       ; add  acc    r2
+ * fa       ; move r2     acc
+ * e4       ; clr A
+ * 3b       ; addc acc    r3
+ * fb       ; move r3     acc
+ * ec       ; move acc    r4
+ * 2a       ; add  acc    r2
+ * fc       ; move r4     acc
+ * ed       ; move acc    r5
+ * 3b       ; addc acc    r3
+ * fd       ; move r5     acc
+ * d9 f0    ; djnz r1     to clr A
+ * 05 86    ; inc  dp_tgl
+ * ea       ; move acc    r2
+ * f0       ; movx dptr   acc
+ * a3       ; inc  dptr
+ * eb       ; move acc    r3
+ * f0       ; movx dptr   acc
+ * a3       ; inc  dptr
+ * ec       ; move acc    r4
+ * f0       ; movx dptr   acc
+ * a3       ; inc  dptr
+ * ed       ; move acc    r5
+ * f0       ; movx dptr   acc
+ * a3       ; inc  dptr
+ * 05 86    ; inc  dp_tgl
+ * d8 d4    ; djnz r0     to move r2 #0x00
+ * 75 86 00 : set  dp_tgl to 0x00
+ * d0 a8    ; pop IE.
+ * 22       ; ret.
+ */
+static const uint8_t mem_hash_func0[] = {
+	0xc0, 0xa8, 0x75, 0xa8, 0x00, 0x05, 0x86, 0x90,
+	0x42, 0x00, 0x05, 0x86, 0x7a, 0x00, 0x7b, 0x00,
+	0x7c, 0x00, 0x7d, 0x00, 0x79, 0x00, 0xe4, 0x93,
+	0xa3, 0x2a, 0xfa, 0xe4, 0x3b, 0xfb, 0xec, 0x2a,
+	0xfc, 0xed, 0x3b, 0xfd, 0xd9, 0xf0, 0x05, 0x86,
+	0xea, 0xf0, 0xa3, 0xeb, 0xf0, 0xa3, 0xec, 0xf0,
+	0xa3, 0xed, 0xf0, 0xa3, 0x05, 0x86, 0xd8, 0xd4,
+	0x75, 0x86, 0x00, 0xd0, 0xa8, 0x22,
+};
+
+/* XRAM page hash function.
+ * Same as the PMEM hash function, but with a movx instead of a movc.
+ * e0       ; movx acc    dptr
+ */
+static const uint8_t mem_hash_func1[] = {
+	0xc0, 0xa8, 0x75, 0xa8, 0x00, 0x05, 0x86, 0x90,
+	0x42, 0x00, 0x05, 0x86, 0x7a, 0x00, 0x7b, 0x00,
+	0x7c, 0x00, 0x7d, 0x00, 0x79, 0x00, 0xe4, 0xe0,
+	0xa3, 0x2a, 0xfa, 0xe4, 0x3b, 0xfb, 0xec, 0x2a,
+	0xfc, 0xed, 0x3b, 0xfd, 0xd9, 0xf0, 0x05, 0x86,
+	0xea, 0xf0, 0xa3, 0xeb, 0xf0, 0xa3, 0xec, 0xf0,
+	0xa3, 0xed, 0xf0, 0xa3, 0x05, 0x86, 0xd8, 0xd4,
+	0x75, 0x86, 0x00, 0xd0, 0xa8, 0x22,
+};
+
 /*
  * PARAM HANDLER FUNCTIONS:
  * Mem dump functions start at 0xf100.
@@ -246,6 +334,53 @@ static const uint8_t mem_dump_handler2_exit[] = {
 	0xfa, 0xf0,
 };
 
+/*
+ * Handler 3.
+ * Hash pmem entry.
+ * 90 00 00 ; move dptr   #0x0000
+ * 78 80    ; move r0     #0x80
+ */
+static const uint8_t mem_hash_handler3_entry[] = {
+	0x90, 0x00, 0x00, 0x78, 0x80,
+};
+
+/*
+ * Handler 4.
+ * Hash pmem bank 0 entry.
+ * c0 fa    ; push 0xfa
+ * 75 fa 15 ; move 0xfa #0x15
+ * 90 80 00 ; move dptr   #0x8000
+ * 78 60    ; move r0     #0x60
+ */
+static const uint8_t mem_hash_handler4_entry[] = {
+	0xc0, 0xfa, 0x75, 0xfa, 0x15, 0x90, 0x80, 0x00,
+	0x78, 0x60,
+};
+
+/*
+ * Handler 5.
+ * Hash pmem bank 1 entry.
+ * c0 fa    ; push 0xfa
+ * 75 fa 2a ; move 0xfa #0x2a
+ * 90 80 00 ; move dptr   #0x8000
+ * 78 60    ; move r0     #0x60
+ */
+static const uint8_t mem_hash_handler5_entry[] = {
+	0xc0, 0xfa, 0x75, 0xfa, 0x2a, 0x90, 0x80, 0x00,
+	0x78, 0x60,
+};
+
+/*
+ * Handler 6.
+ * Hash exram entry. Starts at 0xe000, and wraps around to 0x0000, so both
+ * the upper and lower exram areas we save are hashed in one go.
+ * 90 e0 00 ; move dptr   #0xe000
+ * 78 40    ; move r0     #0x40
+ */
+static const uint8_t mem_hash_handler6_entry[] = {
+	0x90, 0xe0, 0x00, 0x78, 0x40,
+};
+
 /*
  * MAIN ENTRY/EXIT FUNCTIONS:
  * Starts at 0xf300.
@@ -303,107 +438,9 @@ static const uint8_t main_func_exit[] = {
 	0x22,
 };
 
-/* Structure from ca0132 8051 simulator. */
-struct emu8051_dev {
-        uint16_t pc;
-
-        uint8_t pmem[0x8000];
-        uint8_t pmem_b0[0x6000];
-        uint8_t pmem_b1[0x6000];
-
-        uint8_t xram[0x10000];
-        uint8_t iram[0x100];
-        uint8_t sfr[0x80];
-
-        struct op_change *op_ch;
-};
-
 static void usage(char *pname)
 {
-        fprintf(stderr, "usage: %s <hwdep-device> <savestate-name>\n", pname);
-}
-
-/* Simulator save state creation functions. */
-static const char *file_sections[] = {"8051", "PMEM", "PMB0", "PMB1", "XRAM", "IRAM", "SFR ", "BKOP"};
-enum file_section_enum {
-        FILE_HEADER,
-        PMEM_SEC,
-        PMEM_B0_SEC,
-        PMEM_B1_SEC,
-        XRAM_SEC,
-        IRAM_SEC,
-        SFR_SEC,
-        BKOP_SEC,
-        NUM_OF_SECS,
-};
-
-struct op_change {
-        uint16_t pc;
-
-        uint8_t changes;
-        uint16_t change_type[6];
-        uint16_t change_val[6];
-};
-
-struct arr_block {
-        struct op_change op[ARR_BLOCK_SIZE];
-};
-
-void write_header(FILE *save_file, uint8_t section)
-{
-        const char *tmp = file_sections[section];
-
-        fwrite(tmp, strlen(tmp), 1, save_file);
-}
-
-void write_simulator_save_state(struct emu8051_dev *emu_dev, char *file_name)
-{
-	FILE *save_file = NULL;
-	uint32_t i, tmp;
-
-	save_file = fopen(file_name, "w+");
-	if (!save_file)
-		return;
-
-        write_header(save_file, FILE_HEADER);
-        fwrite(&emu_dev->pc, sizeof(uint16_t), 1, save_file);
-
-        write_header(save_file, PMEM_SEC);
-        fwrite(emu_dev->pmem, sizeof(emu_dev->pmem), 1, save_file);
-
-        write_header(save_file, PMEM_B0_SEC);
-        fwrite(emu_dev->pmem_b0, sizeof(emu_dev->pmem_b0), 1, save_file);
-
-        write_header(save_file, PMEM_B1_SEC);
-        fwrite(emu_dev->pmem_b1, sizeof(emu_dev->pmem_b1), 1, save_file);
-
-        write_header(save_file, XRAM_SEC);
-        fwrite(emu_dev->xram, sizeof(emu_dev->xram), 1, save_file);
-
-        write_header(save_file, IRAM_SEC);
-        fwrite(emu_dev->iram, sizeof(emu_dev->iram), 1, save_file);
-
-        write_header(save_file, SFR_SEC);
-        fwrite(emu_dev->sfr, sizeof(emu_dev->sfr), 1, save_file);
-
-	/* Just write dumby data here so it doesn't break anything. */
-	write_header(save_file, BKOP_SEC);
-
-	/* Set current count to 0. */
-	tmp = 0;
-        fwrite(&tmp, sizeof(uint32_t), 1, save_file);
-
-	/* Starting backops = 1000, always an extra 1000 for the deque. */
-	tmp = 11;
-        fwrite(&tmp, sizeof(uint32_t), 1, save_file);
-
-	/* Start offset = 0. */
-	tmp = 0;
-        fwrite(&tmp, sizeof(uint32_t), 1, save_file);
-        for (i = 0; i < 11; i++)
-                fwrite(&tmp, sizeof(struct arr_block), 1, save_file);
-
-	fclose(save_file);
+        fprintf(stderr, "usage: %s <hwdep-device> <savestate-name> [prev-savestate] [full]\n", pname);
 }
 
 static void write_8051_func_call(int fd, uint16_t start_addr, uint16_t func_addr)
@@ -463,6 +500,17 @@ static void write_8051_mem_dump_functions(int fd, struct ca0132_dump_state_data
 	chipio_8051_write_exram_data_range(fd, offset,
 			ARRAY_SIZE(mem_dump_func3), mem_dump_func3);
 	offset += ARRAY_SIZE(mem_dump_func3);
+
+	/* Page hash functions, for only reading what's changed. */
+	data->dump_func_addr[DUMP_FUNC_HASH_PMEM] = offset;
+	chipio_8051_write_exram_data_range(fd, offset,
+			ARRAY_SIZE(mem_hash_func0), mem_hash_func0);
+	offset += ARRAY_SIZE(mem_hash_func0);
+
+	data->dump_func_addr[DUMP_FUNC_HASH_XRAM] = offset;
+	chipio_8051_write_exram_data_range(fd, offset,
+			ARRAY_SIZE(mem_hash_func1), mem_hash_func1);
+	offset += ARRAY_SIZE(mem_hash_func1);
 }
 
 static void write_8051_mem_dump_handlers(int fd, struct ca0132_dump_state_data *data)
@@ -608,6 +656,44 @@ static void setup_8051_dump_handler_structs(struct ca0132_dump_state_data *data)
 
 	tmp->handler_exit = mem_dump_handler2_exit;
 	tmp->exit_size = ARRAY_SIZE(mem_dump_handler2_exit);
+
+	/* Program memory hash handler. Value 3. */
+	tmp = &data->param_handler[DUMP_HANDLER_HASH_PMEM];
+	tmp->handler_entry = mem_hash_handler3_entry;
+	tmp->entry_size = ARRAY_SIZE(mem_hash_handler3_entry);
+
+	tmp->func_calls[0] = DUMP_FUNC_HASH_PMEM;
+	tmp->func_call_cnt = 1;
+
+	/* Program memory bank 0 hash handler. Value 4. */
+	tmp = &data->param_handler[DUMP_HANDLER_HASH_PMEM_B0];
+	tmp->handler_entry = mem_hash_handler4_entry;
+	tmp->entry_size = ARRAY_SIZE(mem_hash_handler4_entry);
+
+	tmp->func_calls[0] = DUMP_FUNC_HASH_PMEM;
+	tmp->func_call_cnt = 1;
+
+	tmp->handler_exit = mem_dump_handler0_exit;
+	tmp->exit_size = ARRAY_SIZE(mem_dump_handler0_exit);
+
+	/* Program memory bank 1 hash handler. Value 5. */
+	tmp = &data->param_handler[DUMP_HANDLER_HASH_PMEM_B1];
+	tmp->handler_entry = mem_hash_handler5_entry;
+	tmp->entry_size = ARRAY_SIZE(mem_hash_handler5_entry);
+
+	tmp->func_calls[0] = DUMP_FUNC_HASH_PMEM;
+	tmp->func_call_cnt = 1;
+
+	tmp->handler_exit = mem_dump_handler1_exit;
+	tmp->exit_size = ARRAY_SIZE(mem_dump_handler1_exit);
+
+	/* XRAM hash handler. Value 6. */
+	tmp = &data->param_handler[DUMP_HANDLER_HASH_XRAM];
+	tmp->handler_entry = mem_hash_handler6_entry;
+	tmp->entry_size = ARRAY_SIZE(mem_hash_handler6_entry);
+
+	tmp->func_calls[0] = DUMP_FUNC_HASH_XRAM;
+	tmp->func_call_cnt = 1;
 }
 
 static void write_8051_exploits(int fd)
@@ -717,29 +803,148 @@ static void dump_8051_pmem(struct emu8051_dev *dev, int fd)
 	fflush(stdout);
 }
 
-/* SFR's to pull from exram 0x4100. */
-static const uint8_t sfr_addrs[8] = { 0x80, 0x81, 0x90, 0xa0,
-				      0xa8, 0xb0, 0xb8, 0xfa };
-/* SFR's to pull off the stack. */
-static const uint8_t sfr_stack[8] = { 0xd0, 0x86, 0x84, 0x85,
-				      0x82, 0x83, 0xf0, 0xe0 };
-
-static void read_8051_ram_and_registers(struct emu8051_dev *dev, int fd)
+/*
+ * Host side version of the 8051 page hash functions, so that the previous
+ * save state's pages can be compared against the hashes read back.
+ *
+ * A 256 byte page can't overflow the first sum, so any change to the sum
+ * of a page's bytes is caught, as is any single byte change or swap of two
+ * differing bytes. Other changes get through about once in 2^32.
+ */
+static void get_page_hash(const uint8_t *page, uint8_t *hash)
 {
-	uint32_t i, stack_ptr;
-	uint8_t tmp[8];
+	uint16_t sum1, sum2;
+	uint32_t i;
 
-	/* Dump exram/iram/sfrs. */
+	sum1 = 0;
+	sum2 = 0;
+	for (i = 0; i < HASH_PAGE_SIZE; i++) {
+		sum1 += page[i];
+		sum2 += sum1;
+	}
 
-	printf("Reading xram_lo [");
-	fflush(stdout);
+	hash[0] = sum1 & 0xff;
+	hash[1] = sum1 >> 8;
+	hash[2] = sum2 & 0xff;
+	hash[3] = sum2 >> 8;
+}
 
-	chipio_set_control_param(fd, DUMP_PARAM_ID, 2);
+/*
+ * Run a hash handler, and compare each page hash against the previous save
+ * state's data, which starts at start within mem and wraps at size. Marks
+ * the changed pages, and returns how many there are, or -1 on failure.
+ */
+static int get_changed_pages(int fd, uint32_t handler, const uint8_t *mem,
+		uint32_t size, uint32_t start, uint32_t page_cnt, uint8_t *changed)
+{
+	uint8_t hashes[HASH_MAX_PAGES * HASH_SIZE], hash[HASH_SIZE];
+	uint32_t i;
+	int cnt;
+
+	chipio_set_control_param(fd, DUMP_PARAM_ID, handler);
 	if (check_dump_status(fd) < 0) {
 		printf("Failed to get proper dump status!\n");
-		return;
+		return -1;
+	}
+
+	chipio_8051_read_exram_data_range(fd, HASH_TBL_ADDR, page_cnt * HASH_SIZE,
+			hashes);
+
+	cnt = 0;
+	for (i = 0; i < page_cnt; i++) {
+		get_page_hash(&mem[(start + (i * HASH_PAGE_SIZE)) % size], hash);
+		changed[i] = memcmp(hash, &hashes[i * HASH_SIZE], sizeof(hash)) != 0;
+		cnt += changed[i];
+	}
+
+	return cnt;
+}
+
+static void read_changed_pages(int fd, uint32_t pmem, uint16_t src_addr,
+		uint8_t *dst, const uint8_t *changed, uint32_t page_cnt)
+{
+	uint32_t i;
+
+	for (i = 0; i < page_cnt; i++) {
+		if (!changed[i])
+			continue;
+
+		if (pmem)
+			chipio_8051_read_pmem_data_range(fd, src_addr + (i * HASH_PAGE_SIZE),
+					HASH_PAGE_SIZE, &dst[i * HASH_PAGE_SIZE]);
+		else
+			chipio_8051_read_exram_data_range(fd, src_addr + (i * HASH_PAGE_SIZE),
+					HASH_PAGE_SIZE, &dst[i * HASH_PAGE_SIZE]);
+
+		putchar('.');
+		fflush(stdout);
+	}
+}
+
+/*
+ * Program memory banks can only be read after being copied to exram, so
+ * only do the copy if a page has changed.
+ */
+static int dump_8051_pmem_bank_delta(int fd, uint32_t hash_handler,
+		uint32_t dump_handler, uint8_t *mem, const char *name)
+{
+	uint8_t changed[EMU8051_PMEM_BANK_SIZE / HASH_PAGE_SIZE];
+	int cnt;
+
+	cnt = get_changed_pages(fd, hash_handler, mem, EMU8051_PMEM_BANK_SIZE, 0,
+			ARRAY_SIZE(changed), changed);
+	if (cnt < 0)
+		return -1;
+
+	printf("Reading %s, %d of %zu pages changed [", name, cnt, ARRAY_SIZE(changed));
+	fflush(stdout);
+	if (cnt) {
+		chipio_set_control_param(fd, DUMP_PARAM_ID, dump_handler);
+		if (check_dump_status(fd) < 0) {
+			printf("Failed to get proper dump status!\n");
+			return -1;
+		}
+
+		read_changed_pages(fd, 0, 0x2000, mem, changed, ARRAY_SIZE(changed));
 	}
 
+	printf("]\n");
+	fflush(stdout);
+
+	return 0;
+}
+
+static void dump_8051_pmem_delta(struct emu8051_dev *dev, int fd)
+{
+	uint8_t changed[EMU8051_PMEM_SIZE / HASH_PAGE_SIZE];
+	int cnt;
+
+	cnt = get_changed_pages(fd, DUMP_HANDLER_HASH_PMEM, dev->pmem,
+			sizeof(dev->pmem), 0, ARRAY_SIZE(changed), changed);
+	if (cnt < 0)
+		return;
+
+	printf("Reading pmem_lo, %d of %zu pages changed [", cnt, ARRAY_SIZE(changed));
+	fflush(stdout);
+	read_changed_pages(fd, 1, 0x0000, dev->pmem, changed, ARRAY_SIZE(changed));
+	printf("]\n");
+	fflush(stdout);
+
+	if (dump_8051_pmem_bank_delta(fd, DUMP_HANDLER_HASH_PMEM_B0,
+			DUMP_HANDLER_PMEM_B0, dev->pmem_b0, "pmem_b0") < 0)
+		return;
+
+	dump_8051_pmem_bank_delta(fd, DUMP_HANDLER_HASH_PMEM_B1,
+			DUMP_HANDLER_PMEM_B1, dev->pmem_b1, "pmem_b1");
+}
+
+static void read_8051_xram(struct emu8051_dev *dev, int fd)
+{
+	uint32_t i;
+
+	printf("Reading xram_lo [");
+	fflush(stdout);
+
 	for (i = 0; i < 0x4; i++) {
 		chipio_8051_read_exram_data_range(fd, 0x2000 + (i * 0x800),
 			0x800, &dev->xram[i * 0x800]);
@@ -761,6 +966,54 @@ static void read_8051_ram_and_registers(struct emu8051_dev *dev, int fd)
 
 	printf("]\n");
 	fflush(stdout);
+}
+
+/*
+ * The hash handler covers xram_hi first, then wraps around into xram_lo.
+ * Changed xram_lo pages are read from the copy the dump handler made.
+ */
+static void read_8051_xram_delta(struct emu8051_dev *dev, int fd)
+{
+	uint8_t changed[0x40];
+	int cnt;
+
+	cnt = get_changed_pages(fd, DUMP_HANDLER_HASH_XRAM, dev->xram,
+			sizeof(dev->xram), 0xe000, ARRAY_SIZE(changed), changed);
+	if (cnt < 0)
+		return;
+
+	printf("Reading xram, %d of %zu pages changed [", cnt, ARRAY_SIZE(changed));
+	fflush(stdout);
+	read_changed_pages(fd, 0, 0xe000, &dev->xram[0xe000], changed, 0x20);
+	read_changed_pages(fd, 0, 0x2000, dev->xram, &changed[0x20], 0x20);
+	printf("]\n");
+	fflush(stdout);
+}
+
+/* SFR's to pull from exram 0x4100. */
+static const uint8_t sfr_addrs[8] = { 0x80, 0x81, 0x90, 0xa0,
+				      0xa8, 0xb0, 0xb8, 0xfa };
+/* SFR's to pull off the stack. */
+static const uint8_t sfr_stack[8] = { 0xd0, 0x86, 0x84, 0x85,
+				      0x82, 0x83, 0xf0, 0xe0 };
+
+static void read_8051_ram_and_registers(struct emu8051_dev *dev, int fd,
+		uint32_t delta)
+{
+	uint32_t i, stack_ptr;
+	uint8_t tmp[8];
+
+	/* Dump exram/iram/sfrs. */
+	chipio_set_control_param(fd, DUMP_PARAM_ID, 2);
+	if (check_dump_status(fd) < 0) {
+		printf("Failed to get proper dump status!\n");
+		return;
+	}
+
+	if (delta)
+		read_8051_xram_delta(dev, fd);
+	else
+		read_8051_xram(dev, fd);
 
 	chipio_8051_read_exram_data_range(fd, 0x4000, 0x100, dev->iram);
 
@@ -790,6 +1043,7 @@ static void read_8051_ram_and_registers(struct emu8051_dev *dev, int fd)
 int main(int argc, char **argv)
 {
 	struct emu8051_dev dev;
+	uint32_t delta;
         int fd;
 
 	if (argc < 3) {
@@ -797,19 +1051,36 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
-	open_hwdep(argv[1], &fd);
-
 	memset(&dev, 0, sizeof(dev));
 
+	/*
+	 * Start from the previous save state, if we have one, unless a full
+	 * dump was asked for.
+	 */
+	delta = 0;
+	if (argc > 3 && strcmp(argv[argc - 1], "full")) {
+		if (emu8051_save_state_load(&dev, argv[3]))
+			return 1;
+
+		delta = 1;
+	}
+
+	open_hwdep(argv[1], &fd);
+
 	/* Install exploit to dump the internal memory. */
 	write_8051_exploits(fd);
 
 	/* Run the exploits. */
-	dump_8051_pmem(&dev, fd);
-	read_8051_ram_and_registers(&dev, fd);
+	if (delta)
+		dump_8051_pmem_delta(&dev, fd);
+	else
+		dump_8051_pmem(&dev, fd);
+
+	read_8051_ram_and_registers(&dev, fd, delta);
 
 	/* Create save state file. */
-	write_simulator_save_state(&dev, argv[2]);
+	if (emu8051_save_state_write(&dev, argv[2]))
+		printf("Failed to write save state.\n");
 
 	close(fd);
 
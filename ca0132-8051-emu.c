@@ -0,0 +1,188 @@
+/*
+ * ca0132-8051-emu.c:
+ * Loads a save state created by ca0132-8051-dump-state, and runs the 8051
+ * firmware in it offline. Commands are read from a script file, or from
+ * stdin if none is given, one per line:
+ *
+ * verb <verb> <param>      - Send a ChipIO verb, and print the response.
+ * param <param-id> <value> - Set a ChipIO ParamID, running its handler.
+ * run <insn-cnt>           - Run from the current PC.
+ * call <addr>              - Call a function, and run until it returns.
+ * pc <addr>                - Set the PC.
+ * regs                     - Print the CPU registers.
+ * xram/iram <addr> [cnt]   - Print XRAM/IRAM contents.
+ * save <file>              - Write the current state to a new save state.
+ */
+#include "ca0132_defs.h"
+
+#define DEFAULT_CALL_MAX_INSNS 10000000
+
+static void usage(char *pname)
+{
+	fprintf(stderr, "usage: %s <savestate> [script-file]\n", pname);
+}
+
+static void print_run_result(struct emu8051_dev *dev, uint32_t ret,
+		uint64_t start_cnt, double elapsed)
+{
+	uint64_t cnt = dev->insn_cnt - start_cnt;
+
+	printf("%s after %lu instructions, PC 0x%04x", emu8051_get_stop_str(ret),
+			(unsigned long)cnt, dev->pc);
+	if (elapsed > 0.0)
+		printf(", %.2f MIPS", (cnt / elapsed) / 1000000.0);
+
+	printf(".\n");
+}
+
+static void print_regs(struct emu8051_dev *dev)
+{
+	uint8_t *regs;
+	uint32_t i;
+
+	regs = &dev->iram[dev->sfr[0xd0 - 0x80] & 0x18];
+	printf("PC 0x%04x ACC 0x%02x B 0x%02x PSW 0x%02x SP 0x%02x\n", dev->pc,
+			dev->sfr[0xe0 - 0x80], dev->sfr[0xf0 - 0x80],
+			dev->sfr[0xd0 - 0x80], dev->sfr[0x81 - 0x80]);
+	printf("DPTR0 0x%02x%02x DPTR1 0x%02x%02x DPS 0x%02x BANK 0x%02x\n",
+			dev->sfr[0x83 - 0x80], dev->sfr[0x82 - 0x80],
+			dev->sfr[0x85 - 0x80], dev->sfr[0x84 - 0x80],
+			dev->sfr[0x86 - 0x80], dev->sfr[0xfa - 0x80]);
+
+	for (i = 0; i < 8; i++)
+		printf("R%d 0x%02x%s", i, regs[i], (i == 7) ? "\n" : " ");
+}
+
+static void print_mem(const uint8_t *mem, uint32_t size, uint32_t addr,
+		uint32_t cnt)
+{
+	uint32_t i;
+
+	for (i = 0; i < cnt && (addr + i) < size; i++) {
+		if (!(i % 16))
+			printf("%s0x%04x:", i ? "\n" : "", addr + i);
+
+		printf(" %02x", mem[addr + i]);
+	}
+
+	printf("\n");
+}
+
+static uint32_t run_timed(struct emu8051_dev *dev, uint32_t call, uint32_t addr,
+		uint64_t cnt)
+{
+	uint64_t start_cnt = dev->insn_cnt;
+	double start;
+	uint32_t ret;
+
+	start = get_monotonic_time();
+	if (call)
+		ret = emu8051_call(dev, addr, cnt);
+	else
+		ret = emu8051_run(dev, cnt);
+
+	print_run_result(dev, ret, start_cnt, get_monotonic_time() - start);
+
+	return ret;
+}
+
+static void send_verb(struct emu8051_dev *dev, uint32_t verb, uint32_t param)
+{
+	uint32_t res;
+
+	if (emu8051_chipio_verb(dev, verb, param, &res))
+		printf("Verb 0x%03x isn't emulated.\n", verb);
+	else
+		printf("Verb 0x%03x param 0x%02x: res 0x%08x.\n", verb, param, res);
+}
+
+/* Returns 1 if the emulator should exit. */
+static int handle_command(struct emu8051_dev *dev, char *line)
+{
+	char cmd[0x20], arg_str[0x100];
+	uint32_t args[2], arg_cnt, res;
+	uint64_t start_cnt;
+	double start;
+
+	memset(args, 0, sizeof(args));
+	arg_str[0] = '\0';
+	if (sscanf(line, "%31s", cmd) != 1 || cmd[0] == '#')
+		return 0;
+
+	arg_cnt = sscanf(line, "%*s %i %i", &args[0], &args[1]);
+	if (arg_cnt > 2)
+		arg_cnt = 0;
+
+	if (!strcmp(cmd, "verb") && arg_cnt == 2) {
+		send_verb(dev, args[0], args[1]);
+	} else if (!strcmp(cmd, "param") && arg_cnt == 2) {
+		start_cnt = dev->insn_cnt;
+		start = get_monotonic_time();
+		emu8051_chipio_verb(dev, CHIPIO_PARAM_EX_ID_SET, args[0], &res);
+		emu8051_chipio_verb(dev, CHIPIO_PARAM_EX_VAL_SET, args[1], &res);
+		print_run_result(dev, dev->stop_reason, start_cnt, get_monotonic_time() - start);
+	} else if (!strcmp(cmd, "run") && arg_cnt == 1) {
+		run_timed(dev, 0, 0, args[0]);
+	} else if (!strcmp(cmd, "call") && arg_cnt == 1) {
+		run_timed(dev, 1, args[0], DEFAULT_CALL_MAX_INSNS);
+	} else if (!strcmp(cmd, "pc") && arg_cnt == 1) {
+		dev->pc = args[0];
+	} else if (!strcmp(cmd, "regs")) {
+		print_regs(dev);
+	} else if (!strcmp(cmd, "xram") && arg_cnt) {
+		print_mem(dev->xram, sizeof(dev->xram), args[0], (arg_cnt > 1) ? args[1] : 1);
+	} else if (!strcmp(cmd, "iram") && arg_cnt) {
+		print_mem(dev->iram, sizeof(dev->iram), args[0], (arg_cnt > 1) ? args[1] : 1);
+	} else if (!strcmp(cmd, "save") && sscanf(line, "%*s %255s", arg_str) == 1) {
+		if (emu8051_save_state_write(dev, arg_str))
+			printf("Failed to write save state.\n");
+	} else if (!strcmp(cmd, "quit")) {
+		return 1;
+	} else {
+		printf("Invalid command: %s", line);
+	}
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct emu8051_dev *dev;
+	FILE *script = stdin;
+	char line[0x200];
+	int ret = 0;
+
+	if (argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	dev = calloc(1, sizeof(*dev));
+	if (emu8051_save_state_load(dev, argv[1])) {
+		ret = 1;
+		goto exit;
+	}
+
+	if (argc > 2) {
+		script = fopen(argv[2], "r");
+		if (!script) {
+			fprintf(stderr, "Failed to open script file.\n");
+			ret = 1;
+			goto exit;
+		}
+	}
+
+	printf("Loaded save state, PC 0x%04x.\n", dev->pc);
+	while (fgets(line, sizeof(line), script)) {
+		if (handle_command(dev, line))
+			break;
+	}
+
+	if (script != stdin)
+		fclose(script);
+
+exit:
+	free(dev);
+
+	return ret;
+}
@@ -0,0 +1,231 @@
+/*
+ * ca0132-8051-state:
+ * Inspect, convert and compare 8051 save states.
+ *
+ * 'info' prints the section directory of an indexed save state, and checks
+ * each section's digest.
+ *
+ * 'convert' writes a save state of either format as either the original
+ * format used by the simulator, or an indexed save state with or without
+ * compression.
+ *
+ * 'diff' compares two indexed save states. Sections with matching digests
+ * are skipped without being read, the rest are compared in 256 byte pages.
+ */
+#include "ca0132_defs.h"
+
+#define DIFF_PAGE_SIZE 0x100
+
+static void usage(char *pname)
+{
+	fprintf(stderr, "usage: %s info <savestate>\n", pname);
+	fprintf(stderr, "       %s convert <in-savestate> <out-savestate> [legacy|raw|lz]\n", pname);
+	fprintf(stderr, "       %s diff <savestate-a> <savestate-b>\n", pname);
+}
+
+static int state_info(int argc, char **argv)
+{
+	const struct emu8051_state_section *sec;
+	struct emu8051_state_file state;
+	uint32_t i, bad;
+	uint8_t *buf;
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (emu8051_state_open(&state, argv[2]))
+		return 1;
+
+	printf("Version %d, %d sections, %ld bytes.\n", state.hdr->version,
+			state.hdr->section_cnt, (long)state.map_size);
+	printf("tag  codec   offset     size  raw_size  digest\n");
+
+	bad = 0;
+	buf = malloc(EMU8051_XRAM_SIZE);
+	for (i = 0; i < state.hdr->section_cnt; i++) {
+		sec = &state.sections[i];
+		printf("%.4s %-5s 0x%06x 0x%06x  0x%06x  0x%016lx", sec->tag,
+				emu8051_state_get_codec_str(sec->codec), sec->offset,
+				sec->size, sec->raw_size, (unsigned long)sec->digest);
+
+		if (sec->raw_size > EMU8051_XRAM_SIZE ||
+				emu8051_state_read_section(&state, sec, buf, sec->raw_size)) {
+			printf(" BAD\n");
+			bad++;
+		} else {
+			printf(" ok\n");
+		}
+	}
+
+	free(buf);
+	emu8051_state_close(&state);
+
+	return bad ? 1 : 0;
+}
+
+static int state_convert(int argc, char **argv)
+{
+	struct emu8051_dev *dev;
+	char *format = "lz";
+	int ret;
+
+	if (argc < 4) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (argc > 4)
+		format = argv[4];
+
+	dev = calloc(1, sizeof(*dev));
+	if (emu8051_save_state_load(dev, argv[2])) {
+		free(dev);
+		return 1;
+	}
+
+	if (!strcmp(format, "legacy")) {
+		ret = emu8051_save_state_write(dev, argv[3]);
+	} else if (!strcmp(format, "raw")) {
+		ret = emu8051_state_write(dev, argv[3], EMU8051_STATE_CODEC_RAW);
+	} else if (!strcmp(format, "lz")) {
+		ret = emu8051_state_write(dev, argv[3], EMU8051_STATE_CODEC_LZ);
+	} else {
+		usage(argv[0]);
+		ret = 1;
+	}
+
+	if (ret)
+		fprintf(stderr, "Failed to write save state.\n");
+
+	free(dev);
+
+	return ret;
+}
+
+/*
+ * Get a section's data, straight from the mapping if it's uncompressed,
+ * otherwise decompressed into buf.
+ */
+static const uint8_t *get_section_data(struct emu8051_state_file *state,
+		const struct emu8051_state_section *sec, uint8_t *buf)
+{
+	const uint8_t *data;
+
+	data = emu8051_state_map_section(state, sec);
+	if (data)
+		return data;
+
+	if (emu8051_state_read_section(state, sec, buf, sec->raw_size))
+		return NULL;
+
+	return buf;
+}
+
+static uint32_t diff_section(struct emu8051_state_file *state_a,
+		const struct emu8051_state_section *sec_a,
+		struct emu8051_state_file *state_b,
+		const struct emu8051_state_section *sec_b, uint8_t *buf_a, uint8_t *buf_b)
+{
+	const uint8_t *data_a, *data_b;
+	uint32_t i, len, cnt;
+
+	if (sec_a->raw_size != sec_b->raw_size || sec_a->raw_size > EMU8051_XRAM_SIZE) {
+		printf("%.4s: size differs.\n", sec_a->tag);
+		return 1;
+	}
+
+	if (sec_a->digest == sec_b->digest)
+		return 0;
+
+	data_a = get_section_data(state_a, sec_a, buf_a);
+	data_b = get_section_data(state_b, sec_b, buf_b);
+	if (!data_a || !data_b)
+		return 1;
+
+	cnt = 0;
+	for (i = 0; i < sec_a->raw_size; i += DIFF_PAGE_SIZE) {
+		len = sec_a->raw_size - i;
+		if (len > DIFF_PAGE_SIZE)
+			len = DIFF_PAGE_SIZE;
+
+		if (memcmp(&data_a[i], &data_b[i], len)) {
+			printf("%.4s: page 0x%04x differs.\n", sec_a->tag, i);
+			cnt++;
+		}
+	}
+
+	return cnt;
+}
+
+static int state_diff(int argc, char **argv)
+{
+	const struct emu8051_state_section *sec_a, *sec_b;
+	struct emu8051_state_file state_a, state_b;
+	uint8_t *buf_a, *buf_b;
+	uint32_t i, cnt;
+
+	if (argc < 4) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!emu8051_state_is_indexed(argv[2]) || !emu8051_state_is_indexed(argv[3])) {
+		fprintf(stderr, "Both save states need to be indexed, use convert first.\n");
+		return 1;
+	}
+
+	if (emu8051_state_open(&state_a, argv[2]))
+		return 1;
+
+	if (emu8051_state_open(&state_b, argv[3])) {
+		emu8051_state_close(&state_a);
+		return 1;
+	}
+
+	buf_a = malloc(EMU8051_XRAM_SIZE);
+	buf_b = malloc(EMU8051_XRAM_SIZE);
+	cnt = 0;
+	for (i = 0; i < state_a.hdr->section_cnt; i++) {
+		sec_a = &state_a.sections[i];
+		sec_b = emu8051_state_find_section(&state_b, sec_a->tag);
+		if (!sec_b) {
+			printf("%.4s: missing from %s.\n", sec_a->tag, argv[3]);
+			cnt++;
+			continue;
+		}
+
+		cnt += diff_section(&state_a, sec_a, &state_b, sec_b, buf_a, buf_b);
+	}
+
+	printf("%d differences.\n", cnt);
+
+	free(buf_a);
+	free(buf_b);
+	emu8051_state_close(&state_a);
+	emu8051_state_close(&state_b);
+
+	return cnt ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!strcmp(argv[1], "info"))
+		return state_info(argc, argv);
+
+	if (!strcmp(argv[1], "convert"))
+		return state_convert(argc, argv);
+
+	if (!strcmp(argv[1], "diff"))
+		return state_diff(argc, argv);
+
+	usage(argv[0]);
+
+	return 1;
+}
@@ -1,12 +1,19 @@
 /*
  * ca0132-8051-write-exram-from-file:
  * Writes a range of 8051 exram data from a file.
+ *
+ * In diff mode, only the bytes that differ from what's currently in exram
+ * are written and verified. The current contents come from the cache file
+ * if it matches the range and a sample of it matches the device, otherwise
+ * they're read from the device. The cache file is updated after a
+ * successful write.
  */
 #include "ca0132_defs.h"
 
 static void usage(char *pname)
 {
-        fprintf(stderr, "usage: %s <hwdep-device> <start-addr> <file-to-read>\n", pname);
+        fprintf(stderr, "usage: %s <hwdep-device> <start-addr> <file-to-read> [diff] [cache-file]\n",
+			pname);
 }
 
 static uint32_t get_file_size(FILE *file)
@@ -20,6 +27,38 @@ static uint32_t get_file_size(FILE *file)
 	return tmp;
 }
 
+static void diff_write(int fd, uint32_t start_addr, uint32_t data_size,
+		uint8_t *buf, char *cache_file)
+{
+	struct chipio_diff_write_stats stats;
+	uint8_t *cur = &buf[data_size];
+	uint32_t mismatch;
+	int use_cache;
+
+	use_cache = 0;
+	if (cache_file && !read_diff_cache_file(cache_file, start_addr, cur, data_size)) {
+		mismatch = chipio_8051_check_exram_cache(fd, start_addr, data_size, cur);
+		if (mismatch)
+			fprintf(stderr, "WARNING: Cache file is stale, %d sampled bytes differ from exram. Reading exram instead.\n",
+					mismatch);
+		else
+			use_cache = 1;
+	}
+
+	if (use_cache)
+		printf("Using cached exram contents.\n");
+	else
+		chipio_8051_read_exram_data_range(fd, start_addr, data_size, cur);
+
+	chipio_8051_diff_write_exram(fd, start_addr, data_size, buf, cur, &stats);
+	printf("Wrote %d of %d bytes in %d runs, %d failed to verify.\n",
+			stats.write_cnt, data_size, stats.run_cnt, stats.verify_fail);
+
+	if (cache_file && !stats.verify_fail &&
+			write_diff_cache_file(cache_file, start_addr, buf, data_size))
+		printf("Failed to write cache file.\n");
+}
+
 int main(int argc, char **argv)
 {
 	uint32_t data_size, start_addr, i;
@@ -27,7 +66,7 @@ int main(int argc, char **argv)
 	uint8_t *buf;
         int fd, ret;
 
-        if (argc < 3) {
+        if (argc < 4) {
                 usage(argv[0]);
                 return 1;
         }
@@ -60,6 +99,11 @@ int main(int argc, char **argv)
 		goto exit;
 	}
 
+	if (argc > 4 && !strcmp(argv[4], "diff")) {
+		diff_write(fd, start_addr, data_size, buf, (argc > 5) ? argv[5] : NULL);
+		goto exit;
+	}
+
 	chipio_8051_write_exram_data_range(fd, start_addr, data_size, buf);
 	chipio_8051_read_exram_data_range(fd, start_addr, data_size, &buf[data_size]);
 
@@ -0,0 +1,335 @@
+/*
+ * ca0132-dsp-bench.c:
+ * Times an assembled DSP program snippet using the DSP's own timer
+ * registers. The snippet is bracketed with timer counter reads that get
+ * stored into XRAM/YRAM, run at full speed on DSP0 a given number of times,
+ * and the cycles per iteration are reported. Overhead of the bracket itself
+ * is measured with an empty snippet first, and subtracted.
+ *
+ * Like ca0132-dsp-op-test, this overwrites DSP program memory and registers,
+ * so the DSP context is saved beforehand and restored on exit.
+ */
+#include "ca0132_defs.h"
+#include <math.h>
+
+#define DSP_FUNC_PMEM_DSP_ADDR 0xdf00
+#define DSP_FUNC_PMEM_HIC_ADDR (DSP_FUNC_PMEM_DSP_ADDR * 0x4) + 0x80000
+
+/* Start stamp is stored in XRAM, end stamp in YRAM, both at this address. */
+#define BENCH_STAMP_DSP_ADDR   0x4a00
+#define BENCH_STAMP_X_HIC_ADDR (BENCH_STAMP_DSP_ADDR * 0x4)
+#define BENCH_STAMP_Y_HIC_ADDR (YRAM_START_ADDRESS + (BENCH_STAMP_DSP_ADDR * 0x4))
+#define BENCH_STAMP_INVALID    0xdeadbeef
+
+#define BENCH_RUN_POLL_CNT     16
+
+struct dsp_bench_result {
+	uint32_t runs;
+	double mean, variance;
+	uint32_t min, max;
+};
+
+struct dsp_bench_data {
+	uint32_t pgm_data[0x400];
+	uint32_t pgm_len;
+	uint32_t spin_addr;
+
+	uint32_t *snippet;
+	uint32_t snippet_len;
+
+	uint32_t timer;
+	uint32_t iterations;
+	uint32_t *cycles;
+
+	struct dsp_context ctx;
+};
+
+static void usage(char *pname)
+{
+	fprintf(stderr, "usage: %s <hwdep-device> <snippet-file> <iterations> [timer]\n", pname);
+}
+
+static uint32_t get_file_size(FILE *file)
+{
+	uint32_t tmp;
+
+	fseek(file, 0, SEEK_END);
+	tmp = ftell(file);
+	rewind(file);
+
+	return tmp;
+}
+
+/* Assemble a single string, and append it to the program. */
+static void bench_assemble_str(struct dsp_bench_data *data, const char *str)
+{
+	dsp_asm_data asm_data;
+	char buf[0x100];
+	uint32_t len;
+
+	memset(&asm_data, 0, sizeof(asm_data));
+	memset(buf, 0, sizeof(buf));
+	strcpy(buf, str);
+
+	get_asm_data_from_str(&asm_data, buf);
+
+	len = get_dsp_op_len(asm_data.opcode[0]);
+	memcpy(data->pgm_data + data->pgm_len, asm_data.opcode, sizeof(uint32_t) * len);
+	data->pgm_len += len;
+}
+
+/*
+ * Program layout:
+ * Disable interrupts, store the start timer stamp, run the snippet, store
+ * the end timer stamp, then spin in place until the host halts us.
+ */
+static void create_bench_program(struct dsp_bench_data *data, uint32_t *snippet,
+		uint32_t snippet_len)
+{
+	char buf[0x100];
+
+	data->pgm_len = 0;
+
+	bench_assemble_str(data, "INT_DISABLE;");
+	sprintf(buf, "MOV R00, TIME%d_COUNTER;", data->timer);
+	bench_assemble_str(data, buf);
+	sprintf(buf, "MOV @#0x%04x_X, R00;", BENCH_STAMP_DSP_ADDR);
+	bench_assemble_str(data, buf);
+
+	if (snippet_len) {
+		memcpy(data->pgm_data + data->pgm_len, snippet,
+				sizeof(uint32_t) * snippet_len);
+		data->pgm_len += snippet_len;
+	}
+
+	sprintf(buf, "MOV R00, TIME%d_COUNTER;", data->timer);
+	bench_assemble_str(data, buf);
+	sprintf(buf, "MOV @#0x%04x_Y, R00;", BENCH_STAMP_DSP_ADDR);
+	bench_assemble_str(data, buf);
+
+	data->spin_addr = DSP_FUNC_PMEM_DSP_ADDR + data->pgm_len;
+	bench_assemble_str(data, "S_JMP #0x0f, #0x00;");
+}
+
+/*
+ * Run the program once at full speed. Wait until DSP0's PC reaches the spin
+ * loop, then put it back into single step mode and pull the stamps.
+ */
+static int run_bench_program(int fd, struct dsp_bench_data *data, uint32_t *cycles)
+{
+	uint32_t i, pc, start, end;
+	int32_t diff;
+
+	chipio_hic_write_at_addr(fd, BENCH_STAMP_X_HIC_ADDR, BENCH_STAMP_INVALID);
+	chipio_hic_write_at_addr(fd, BENCH_STAMP_Y_HIC_ADDR, BENCH_STAMP_INVALID);
+
+	set_dsp_pc(fd, 0, DSP_FUNC_PMEM_DSP_ADDR);
+	set_dsp_dbg_single_step(fd, 0);
+
+	for (i = 0; i < BENCH_RUN_POLL_CNT; i++) {
+		pc = chipio_hic_read_at_addr(fd, DSP0PROGCOUNT);
+		if (pc == data->spin_addr)
+			break;
+
+		ca0132_command_wait();
+	}
+
+	set_dsp_dbg_single_step(fd, 1);
+
+	if (i == BENCH_RUN_POLL_CNT) {
+		printf("Snippet never finished, PC 0x%04x.\n", pc);
+		return 1;
+	}
+
+	start = chipio_hic_read_at_addr(fd, BENCH_STAMP_X_HIC_ADDR);
+	end = chipio_hic_read_at_addr(fd, BENCH_STAMP_Y_HIC_ADDR);
+	if ((start == BENCH_STAMP_INVALID) || (end == BENCH_STAMP_INVALID)) {
+		printf("Timer stamps weren't stored.\n");
+		return 1;
+	}
+
+	/* Timers may count down, so only the magnitude matters. */
+	diff = end - start;
+	if (diff < 0)
+		diff = -diff;
+
+	*cycles = diff;
+
+	return 0;
+}
+
+static void get_bench_result(struct dsp_bench_data *data, uint32_t runs,
+		struct dsp_bench_result *res)
+{
+	double sum, tmp;
+	uint32_t i;
+
+	memset(res, 0, sizeof(*res));
+	if (!runs)
+		return;
+
+	res->runs = runs;
+	res->min = res->max = data->cycles[0];
+	sum = 0.0;
+	for (i = 0; i < runs; i++) {
+		sum += data->cycles[i];
+		if (data->cycles[i] < res->min)
+			res->min = data->cycles[i];
+		if (data->cycles[i] > res->max)
+			res->max = data->cycles[i];
+	}
+
+	res->mean = sum / runs;
+	sum = 0.0;
+	for (i = 0; i < runs; i++) {
+		tmp = data->cycles[i] - res->mean;
+		sum += tmp * tmp;
+	}
+
+	res->variance = sum / runs;
+}
+
+/* Write out a program, and run it the requested number of times. */
+static uint32_t bench_snippet(int fd, struct dsp_bench_data *data,
+		uint32_t *snippet, uint32_t snippet_len, struct dsp_bench_result *res)
+{
+	uint32_t i;
+
+	create_bench_program(data, snippet, snippet_len);
+	chipio_hic_write_data_range(fd, DSP_FUNC_PMEM_HIC_ADDR, data->pgm_len,
+			data->pgm_data);
+
+	for (i = 0; i < data->iterations; i++) {
+		if (run_bench_program(fd, data, &data->cycles[i]))
+			break;
+	}
+
+	get_bench_result(data, i, res);
+
+	return i;
+}
+
+static int read_snippet_file(struct dsp_bench_data *data, char *file_name)
+{
+	FILE *file;
+
+	file = fopen(file_name, "r");
+	if (!file) {
+		fprintf(stderr, "Failed to open snippet file.\n");
+		return 1;
+	}
+
+	data->snippet_len = get_file_size(file) / 4;
+	if (!data->snippet_len || (data->snippet_len > 0x300)) {
+		fprintf(stderr, "Snippet file is empty or too large.\n");
+		fclose(file);
+		return 1;
+	}
+
+	data->snippet = calloc(data->snippet_len, sizeof(uint32_t));
+	if (fread(data->snippet, sizeof(uint32_t), data->snippet_len, file) !=
+			data->snippet_len) {
+		fprintf(stderr, "Failed to read snippet file.\n");
+		fclose(file);
+		return 1;
+	}
+
+	fclose(file);
+
+	return 0;
+}
+
+/*
+ * Save the PMEM the largest program will use, the timer stamp words, and
+ * DSP0's registers. This also halts the DSP's.
+ */
+static int bench_save_context(int fd, struct dsp_bench_data *data)
+{
+	struct dsp_context *ctx = &data->ctx;
+
+	create_bench_program(data, data->snippet, data->snippet_len);
+
+	dsp_context_init(ctx, 0);
+	if (dsp_context_add_range(ctx, DSP_FUNC_PMEM_HIC_ADDR, data->pgm_len) ||
+	    dsp_context_add_range(ctx, BENCH_STAMP_X_HIC_ADDR, 1) ||
+	    dsp_context_add_range(ctx, BENCH_STAMP_Y_HIC_ADDR, 1))
+		return 1;
+
+	if (dsp_context_add_reg_ranges(ctx))
+		return 1;
+
+	return dsp_context_save(fd, ctx);
+}
+
+int main(int argc, char **argv)
+{
+	struct dsp_bench_result overhead, res;
+	struct dsp_bench_data data;
+	int fd, ret;
+
+	if (argc < 4) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	memset(&data, 0, sizeof(data));
+	data.iterations = strtol(argv[3], NULL, 0);
+	if (argc > 4)
+		data.timer = strtol(argv[4], NULL, 0);
+
+	if (!data.iterations || data.timer > 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (read_snippet_file(&data, argv[2]))
+		return 1;
+
+	ret = open_hwdep(argv[1], &fd);
+	if (ret)
+		goto exit;
+
+	data.cycles = calloc(data.iterations, sizeof(uint32_t));
+
+	printf("TIME%d_PER_ENB: 0x%08x.\n", data.timer,
+			chipio_hic_read_at_addr(fd, TIME0PERENBDSP0 + (data.timer * 8)));
+
+	/* Save the DSP context, which also sets the DSP into single step mode. */
+	if (bench_save_context(fd, &data)) {
+		printf("Failed to save DSP context.\n");
+		ret = 1;
+		goto exit_fd;
+	}
+
+	/* Measure the bracket overhead with an empty snippet. */
+	if (!bench_snippet(fd, &data, NULL, 0, &overhead)) {
+		printf("Failed to run empty snippet.\n");
+		ret = 1;
+		goto exit_fd;
+	}
+
+	if (!overhead.max)
+		printf("Timer %d doesn't seem to be running.\n", data.timer);
+
+	bench_snippet(fd, &data, data.snippet, data.snippet_len, &res);
+	if (!res.runs) {
+		printf("Failed to run snippet.\n");
+		ret = 1;
+		goto exit_fd;
+	}
+
+	printf("Overhead: %.2f cycles (%d runs).\n", overhead.mean, overhead.runs);
+	printf("Snippet:  %.2f cycles per iteration, variance %.2f, stddev %.2f, raw min %d, raw max %d (%d runs).\n",
+			res.mean - overhead.mean, res.variance, sqrt(res.variance),
+			res.min, res.max, res.runs);
+
+exit_fd:
+	dsp_context_restore(fd, &data.ctx);
+	dsp_context_free(&data.ctx);
+	free(data.cycles);
+	close(fd);
+exit:
+	free(data.snippet);
+
+	return ret;
+}
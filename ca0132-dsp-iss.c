@@ -0,0 +1,348 @@
+/*
+ * ca0132-dsp-iss.c:
+ * Runs assembled DSP programs on the host, using the instruction set
+ * simulator in ca0132_dsp_iss.c. No hardware is needed.
+ *
+ * 'run' loads a program file into PMEM and runs it until it halts, hits an
+ * op the simulator can't handle, or reaches the step limit.
+ *
+ * 'validate' replays a record file written by ca0132-dsp-op-test, setting
+ * the simulator's registers to the recorded pre-op values, stepping the op
+ * once, and comparing against the recorded post-op values.
+ */
+#include "ca0132_defs.h"
+
+#define ISS_DEFAULT_MAX_STEPS 100000
+#define ISS_RECORD_REG_MAX    0x200
+
+struct dsp_iss_record_reg {
+	char name[0x20];
+	uint32_t pre, post;
+};
+
+struct dsp_iss_record {
+	uint32_t op[4];
+	uint32_t op_len;
+	uint32_t start_pc, end_pc;
+
+	struct dsp_iss_record_reg regs[ISS_RECORD_REG_MAX];
+	uint32_t reg_cnt;
+};
+
+struct dsp_iss_validate_stats {
+	uint32_t pass, fail, skip;
+};
+
+static void usage(char *pname)
+{
+	fprintf(stderr, "usage: %s run <pmem-file> [load-addr] [max-steps] [trace]\n", pname);
+	fprintf(stderr, "       %s validate <record-file>\n", pname);
+}
+
+static uint32_t get_file_size(FILE *file)
+{
+	uint32_t tmp;
+
+	fseek(file, 0, SEEK_END);
+	tmp = ftell(file);
+	rewind(file);
+
+	return tmp;
+}
+
+static int load_pmem_file(struct dsp_iss_state *state, char *file_name,
+		uint32_t addr)
+{
+	uint32_t *data, cnt;
+	FILE *file;
+
+	file = fopen(file_name, "r");
+	if (!file) {
+		fprintf(stderr, "Failed to open program file.\n");
+		return 1;
+	}
+
+	cnt = get_file_size(file) / 4;
+	if (!cnt || (cnt + addr) > DSP_ISS_PMEM_WORDS) {
+		fprintf(stderr, "Program file is empty or too large.\n");
+		fclose(file);
+		return 1;
+	}
+
+	data = calloc(cnt, sizeof(uint32_t));
+	if (!data) {
+		fprintf(stderr, "Failed to allocate program buffer.\n");
+		fclose(file);
+		return 1;
+	}
+
+	if (fread(data, sizeof(uint32_t), cnt, file) != cnt) {
+		fprintf(stderr, "Failed to read program file.\n");
+		free(data);
+		fclose(file);
+		return 1;
+	}
+
+	dsp_iss_load_pmem(state, addr, data, cnt);
+
+	free(data);
+	fclose(file);
+
+	return 0;
+}
+
+static void print_iss_state(struct dsp_iss_state *state)
+{
+	uint32_t i, val;
+
+	printf("Stopped: %s", dsp_iss_get_stop_str(state->stop_reason));
+	if (state->stop_msg[0])
+		printf(" (%s)", state->stop_msg);
+
+	printf(", %lu steps, PC 0x%04x.\n", (unsigned long)state->steps, state->pc);
+
+	/* R00-R15, address registers and their modifiers. */
+	for (i = 0; i < 0x20; i++) {
+		val = dsp_iss_reg_read(state, i);
+		if (val)
+			printf("%-10s 0x%08x\n", get_dsp_operand_str(i), val);
+	}
+
+	printf("%-10s 0x%08x\n", "COND_REG", dsp_iss_reg_read(state, 0x80));
+}
+
+static int iss_run(int argc, char **argv)
+{
+	struct dsp_iss_state *state;
+	uint32_t addr, trace;
+	uint64_t max_steps;
+	int ret;
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	addr = 0;
+	max_steps = ISS_DEFAULT_MAX_STEPS;
+	trace = 0;
+	if (argc > 3)
+		addr = strtol(argv[3], NULL, 0) & (DSP_ISS_PMEM_WORDS - 1);
+	if (argc > 4)
+		max_steps = strtoull(argv[4], NULL, 0);
+	if (argc > 5) {
+		if (strcmp(argv[5], "trace")) {
+			usage(argv[0]);
+			return 1;
+		}
+
+		trace = 1;
+	}
+
+	state = dsp_iss_create(0);
+	if (!state)
+		return 1;
+
+	if (load_pmem_file(state, argv[2], addr)) {
+		dsp_iss_destroy(state);
+		return 1;
+	}
+
+	state->pc = addr;
+	if (trace) {
+		while (state->steps < max_steps) {
+			printf("0x%04x: 0x%08x\n", state->pc, state->pmem[state->pc]);
+			if (dsp_iss_step(state))
+				break;
+		}
+
+		/* Out of steps, let dsp_iss_run() set the stop reason. */
+		if (state->stop_reason == DSP_ISS_RUNNING)
+			dsp_iss_run(state, 0);
+	} else {
+		dsp_iss_run(state, max_steps);
+	}
+
+	print_iss_state(state);
+	ret = state->stop_reason != DSP_ISS_STOP_HALT;
+	dsp_iss_destroy(state);
+
+	return ret;
+}
+
+/*
+ * Read a single record. Returns 1 if a record was read, 0 at the end of the
+ * file, and -1 if the record's op line is malformed.
+ */
+static int read_record(FILE *file, struct dsp_iss_record *rec)
+{
+	struct dsp_iss_record_reg *reg;
+	char line[0x100];
+	int in_record, ret;
+
+	memset(rec, 0, sizeof(*rec));
+	in_record = 0;
+	while (fgets(line, sizeof(line), file)) {
+		if (!strncmp(line, "op", 2)) {
+			ret = sscanf(line + 2, "%x %x %x %x", &rec->op[0],
+					&rec->op[1], &rec->op[2], &rec->op[3]);
+			if (ret < 1 || ret > 4) {
+				fprintf(stderr, "Malformed op line: %s", line);
+				return -1;
+			}
+
+			rec->op_len = ret;
+			in_record = 1;
+		} else if (!strncmp(line, "pc", 2)) {
+			sscanf(line + 2, "%x %x", &rec->start_pc, &rec->end_pc);
+		} else if (!strncmp(line, "reg", 3)) {
+			if (rec->reg_cnt >= ISS_RECORD_REG_MAX)
+				continue;
+
+			reg = &rec->regs[rec->reg_cnt];
+			if (sscanf(line + 3, "%31s %x %x", reg->name, &reg->pre,
+					&reg->post) == 3)
+				rec->reg_cnt++;
+		} else if (!strncmp(line, "end", 3) && in_record) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* Timer counters and the PC register are never going to match. */
+static int skip_record_reg(const char *name)
+{
+	return !strncmp(name, "TIME", 4) || !strcmp(name, "PROG_CNT_REG");
+}
+
+/*
+ * Set registers first, then the indirect address registers, as those
+ * become writes to memory at the address registers' values.
+ */
+static void set_record_pre_state(struct dsp_iss_state *state,
+		struct dsp_iss_record *rec)
+{
+	uint32_t i, pass;
+
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0; i < rec->reg_cnt; i++) {
+			if ((rec->regs[i].name[0] == '@') != pass)
+				continue;
+
+			dsp_iss_set_named_val(state, rec->regs[i].name, rec->regs[i].pre);
+		}
+	}
+}
+
+static void validate_record(struct dsp_iss_state *state, struct dsp_iss_record *rec,
+		struct dsp_iss_validate_stats *stats)
+{
+	uint32_t i, val, fail;
+
+	dsp_iss_reset(state);
+	set_record_pre_state(state, rec);
+	dsp_iss_load_pmem(state, rec->start_pc, rec->op, rec->op_len);
+	state->pc = rec->start_pc;
+
+	printf("op 0x%08x: ", rec->op[0]);
+	dsp_iss_step(state);
+	if (state->stop_reason == DSP_ISS_STOP_UNIMPL ||
+			state->stop_reason == DSP_ISS_STOP_UNKNOWN_OP) {
+		printf("SKIP (%s)\n", state->stop_msg);
+		stats->skip++;
+		return;
+	}
+
+	fail = 0;
+	if (state->pc != rec->end_pc) {
+		printf("%sPC: expected 0x%04x, got 0x%04x.\n", fail ? "  " : "FAIL\n  ",
+				rec->end_pc, state->pc);
+		fail++;
+	}
+
+	for (i = 0; i < rec->reg_cnt; i++) {
+		if (skip_record_reg(rec->regs[i].name))
+			continue;
+
+		if (dsp_iss_get_named_val(state, rec->regs[i].name, &val))
+			continue;
+
+		if (val != rec->regs[i].post) {
+			printf("%sreg[%s]: expected 0x%08x, got 0x%08x.\n",
+					fail ? "  " : "FAIL\n  ", rec->regs[i].name,
+					rec->regs[i].post, val);
+			fail++;
+		}
+	}
+
+	if (fail) {
+		stats->fail++;
+	} else {
+		printf("PASS\n");
+		stats->pass++;
+	}
+}
+
+static int iss_validate(int argc, char **argv)
+{
+	struct dsp_iss_validate_stats stats;
+	struct dsp_iss_state *state;
+	struct dsp_iss_record *rec;
+	FILE *file;
+	int ret;
+
+	if (argc < 3) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	file = fopen(argv[2], "r");
+	if (!file) {
+		fprintf(stderr, "Failed to open record file.\n");
+		return 1;
+	}
+
+	state = dsp_iss_create(0);
+	rec = calloc(1, sizeof(*rec));
+	if (!state || !rec) {
+		fprintf(stderr, "Failed to allocate simulator state.\n");
+		free(rec);
+		if (state)
+			dsp_iss_destroy(state);
+		fclose(file);
+		return 1;
+	}
+
+	memset(&stats, 0, sizeof(stats));
+	while ((ret = read_record(file, rec)) > 0)
+		validate_record(state, rec, &stats);
+
+	printf("%d passed, %d failed, %d skipped.\n", stats.pass, stats.fail,
+			stats.skip);
+
+	free(rec);
+	dsp_iss_destroy(state);
+	fclose(file);
+
+	return (ret < 0 || stats.fail) ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (!strcmp(argv[1], "run"))
+		return iss_run(argc, argv);
+
+	if (!strcmp(argv[1], "validate"))
+		return iss_validate(argc, argv);
+
+	usage(argv[0]);
+
+	return 1;
+}
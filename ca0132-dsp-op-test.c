@@ -3,14 +3,27 @@
  * Assembles a register dumping program, and allows for testing individual ops
  * to see their results. Takes a hexadecimal opcode.
  *
- * Once this has been run, you'll need to reset the DSP with a restart or a
- * suspend/resume cycle to get it running again.
+ * The DSP context that gets overwritten (program memory, the register dump
+ * area, the stack used by the dump functions, and DSP0's registers) is saved
+ * beforehand and restored on exit, so the DSP's keep running afterwards.
+ * Entering anything that isn't a hexadecimal op exits.
+ *
+ * If a record file is given, the op, PC and every dumped register's value
+ * before and after the op are appended to it, for checking the simulator in
+ * ca0132-dsp-iss against.
  */
 #include "ca0132_defs.h"
 
 #define DSP_FUNC_PMEM_DSP_ADDR 0xdf00
 #define DSP_FUNC_PMEM_HIC_ADDR (DSP_FUNC_PMEM_DSP_ADDR * 0x4) + 0x80000
 
+/* X/YRAM register dump areas, as set in A_R6 by the dump functions. */
+#define PRE_OP_DUMP_HIC_ADDR   (0x4800 * 0x4)
+#define POST_OP_DUMP_HIC_ADDR  (0x4900 * 0x4)
+
+/* Words pushed onto the A_R7 stack by the dump entry function. */
+#define REG_DUMP_STACK_WORDS   7
+
 struct dsp_op_test_data {
 	uint32_t pre_op_func, post_op_func;
 	uint32_t op_cnt;
@@ -24,11 +37,16 @@ struct dsp_op_test_data {
 	uint32_t post_op_pc;
 	char **reg_dump_strs;
 	uint32_t reg_dump_str_cnt;
+
+	struct dsp_step_stats step_stats;
+	struct dsp_context ctx;
+
+	FILE *record;
 };
 
 static void usage(char *pname)
 {
-        fprintf(stderr, "usage: %s <hwdep-device>\n", pname);
+        fprintf(stderr, "usage: %s <hwdep-device> [record-file]\n", pname);
 }
 
 /*
@@ -576,6 +594,13 @@ static uint32_t get_test_op_from_str(char *buf, uint32_t *test_op)
 	return get_dsp_op_len(test_op[0]);
 }
 
+static void op_test_run_steps_at_addr(int fd, struct dsp_op_test_data *data,
+		uint32_t addr, uint32_t step_cnt)
+{
+	set_dsp_pc(fd, 0, addr);
+	dsp_run_steps_batched(fd, step_cnt, &data->step_stats);
+}
+
 static void read_x_y_ram_dump(int fd, uint32_t addr, uint32_t cnt, uint32_t *data)
 {
 	uint32_t tmp_x[0x400];
@@ -602,10 +627,12 @@ static void get_test_op_registers(int fd, struct dsp_op_test_data *data)
 	memset(data->post_op_data, 0, sizeof(data->post_op_data));
 
 	/* Get pre-op register dump data. */
-	read_x_y_ram_dump(fd, 0x12000, data->reg_dump_str_cnt, data->pre_op_data);
+	read_x_y_ram_dump(fd, PRE_OP_DUMP_HIC_ADDR, data->reg_dump_str_cnt,
+			data->pre_op_data);
 
 	/* Get post-op registers. */
-	read_x_y_ram_dump(fd, 0x12400, data->reg_dump_str_cnt, data->post_op_data);
+	read_x_y_ram_dump(fd, POST_OP_DUMP_HIC_ADDR, data->reg_dump_str_cnt,
+			data->post_op_data);
 
 	printf("\nStart PC 0x%04x, PC after 0x%04x.\n", DSP_FUNC_PMEM_DSP_ADDR + data->pgm_len,
 			data->post_op_pc);
@@ -619,6 +646,63 @@ static void get_test_op_registers(int fd, struct dsp_op_test_data *data)
 	}
 }
 
+/*
+ * Append a test result to the record file. Format is one item per line:
+ * 'op' followed by the op words, 'pc' with the start and end PC, a 'reg' line
+ * with the pre and post op value of each dumped register, and then 'end'.
+ */
+static void write_op_test_record(struct dsp_op_test_data *data, uint32_t *test_op,
+		uint32_t op_len)
+{
+	uint32_t i;
+
+	if (!data->record)
+		return;
+
+	fprintf(data->record, "op");
+	for (i = 0; i < op_len; i++)
+		fprintf(data->record, " 0x%08x", test_op[i]);
+
+	fprintf(data->record, "\npc 0x%04x 0x%04x\n", DSP_FUNC_PMEM_DSP_ADDR + data->pgm_len,
+			data->post_op_pc);
+	for (i = 0; i < data->reg_dump_str_cnt; i++) {
+		fprintf(data->record, "reg %s 0x%08x 0x%08x\n", data->reg_dump_strs[i],
+				data->pre_op_data[i], data->post_op_data[i]);
+	}
+
+	fprintf(data->record, "end\n");
+	fflush(data->record);
+}
+
+/*
+ * Save everything we're going to overwrite: the program and test op in PMEM,
+ * both register dump areas in X/YRAM, the words the entry function pushes
+ * onto the A_R7 stack, and DSP0's registers. This also halts the DSP's.
+ */
+static int op_test_save_context(int fd, struct dsp_op_test_data *data)
+{
+	struct dsp_context *ctx = &data->ctx;
+	uint32_t dump_len;
+
+	dump_len = (data->reg_dump_str_cnt + 1) / 2;
+
+	dsp_context_init(ctx, 0);
+	if (dsp_context_add_range(ctx, DSP_FUNC_PMEM_HIC_ADDR, data->pgm_len + 4))
+		return 1;
+
+	if (dsp_context_add_range(ctx, PRE_OP_DUMP_HIC_ADDR, dump_len) ||
+	    dsp_context_add_range(ctx, YRAM_START_ADDRESS + PRE_OP_DUMP_HIC_ADDR, dump_len) ||
+	    dsp_context_add_range(ctx, POST_OP_DUMP_HIC_ADDR, dump_len) ||
+	    dsp_context_add_range(ctx, YRAM_START_ADDRESS + POST_OP_DUMP_HIC_ADDR, dump_len))
+		return 1;
+
+	dsp_context_add_stack_range(ctx, REG_DUMP_STACK_WORDS);
+	if (dsp_context_add_reg_ranges(ctx))
+		return 1;
+
+	return dsp_context_save(fd, ctx);
+}
+
 int main(int argc, char **argv)
 {
 	uint32_t i, buf_len, op_len;
@@ -632,24 +716,35 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	memset(&data, 0, sizeof(data));
+	if (argc > 2) {
+		data.record = fopen(argv[2], "a");
+		if (!data.record) {
+			fprintf(stderr, "Failed to open record file.\n");
+			return 1;
+		}
+	}
+
 	ret = open_hwdep(argv[1], &fd);
 	if (ret)
-		return ret;
-
-	memset(&data, 0, sizeof(data));
+		goto exit_record;
 
 	/* Assemble register dump program functions. */
 	data.pgm_len = create_reg_dump_function(&data, data.pgm_data);
 
+	/* Save the DSP context, which also sets the DSP into single step mode. */
+	if (op_test_save_context(fd, &data)) {
+		printf("Failed to save DSP context.\n");
+		ret = 1;
+		goto exit;
+	}
+
 	/* Write our assembled program out to the DSP. */
 	chipio_hic_write_data_range(fd, DSP_FUNC_PMEM_HIC_ADDR, data.pgm_len, data.pgm_data);
 
-	/* Set the DSP into single step mode. */
-	set_dsp_dbg_single_step(fd, 1);
-
 	/* Run pre-op/post-op dump functions to populate memory. */
-	dsp_run_steps_at_addr(fd, 0, data.pre_op_func, data.op_cnt);
-	dsp_run_steps_at_addr(fd, 0, data.post_op_func, data.op_cnt);
+	op_test_run_steps_at_addr(fd, &data, data.pre_op_func, data.op_cnt);
+	op_test_run_steps_at_addr(fd, &data, data.post_op_func, data.op_cnt);
 
 	while (1) {
 		memset(buf, 0, sizeof(buf));
@@ -675,25 +770,38 @@ int main(int argc, char **argv)
 				op_len, test_op);
 
 		/* Run pre-op register dump function. */
-		dsp_run_steps_at_addr(fd, 0, data.pre_op_func, data.op_cnt);
+		op_test_run_steps_at_addr(fd, &data, data.pre_op_func, data.op_cnt);
 
 		/* Run op to test. */
-		dsp_run_steps_at_addr(fd, 0, DSP_FUNC_PMEM_DSP_ADDR + data.pgm_len, 1);
+		op_test_run_steps_at_addr(fd, &data, DSP_FUNC_PMEM_DSP_ADDR + data.pgm_len, 1);
 		data.post_op_pc = chipio_hic_read_at_addr(fd, 0x100e2c);
 
 		/* Run post-op register dump function. */
-		dsp_run_steps_at_addr(fd, 0, data.post_op_func, data.op_cnt);
+		op_test_run_steps_at_addr(fd, &data, data.post_op_func, data.op_cnt);
 
 		/* Pull the register data and compare. */
 		get_test_op_registers(fd, &data);
+		write_op_test_record(&data, test_op, op_len);
 	}
 
+	printf("Ran %d steps in %f seconds, %.1f steps/sec.\n",
+			data.step_stats.steps, data.step_stats.elapsed,
+			data.step_stats.steps_per_sec);
+
+	printf("Restoring DSP context.\n");
+	dsp_context_restore(fd, &data.ctx);
+
+exit:
+	dsp_context_free(&data.ctx);
 	for (i = 0; i < data.reg_dump_str_cnt; i++)
 		free(data.reg_dump_strs[i]);
 
 	free(data.reg_dump_strs);
 	close(fd);
+exit_record:
+	if (data.record)
+		fclose(data.record);
 
-	return 0;
+	return ret;
 }
 
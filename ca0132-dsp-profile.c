@@ -0,0 +1,284 @@
+/*
+ * ca0132-dsp-profile.c:
+ * Samples the program counter of each DSP while they're running, without
+ * halting them. Builds a per-address histogram for each DSP, and prints it
+ * as a flat profile with the op at each address pulled from PMEM and
+ * disassembled the same way as ca0132-dsp-disassembler. Optionally
+ * writes a folded-stack style file that can be fed to flame graph tools.
+ */
+#include "ca0132_defs.h"
+
+#define DSP_CNT            4
+#define DSP_PMEM_WORDS     0x10000
+#define FLAT_PROFILE_LINES 40
+
+struct dsp_profile_entry {
+	uint16_t addr;
+	uint32_t cnt;
+};
+
+struct dsp_profile_data {
+	uint32_t *hist[DSP_CNT];
+	uint32_t samples[DSP_CNT];
+	uint32_t dsp_mask;
+
+	uint32_t sample_cnt;
+	uint32_t rate;
+	double elapsed;
+};
+
+static void usage(char *pname)
+{
+	fprintf(stderr, "usage: %s <hwdep-device> <sample-cnt> <rate-hz> [dsp-mask] [folded-file]\n",
+			pname);
+}
+
+/*
+ * Read the PC of each selected DSP once per sample period. If the verb
+ * interface can't keep up with the requested rate, we just sample as fast
+ * as it allows.
+ */
+static void sample_dsp_pcs(int fd, struct dsp_profile_data *data)
+{
+	double start, period, next;
+	uint32_t i, dsp, pc;
+
+	period = 1.0 / data->rate;
+	start = next = get_monotonic_time();
+
+	for (i = 0; i < data->sample_cnt; i++) {
+		for (dsp = 0; dsp < DSP_CNT; dsp++) {
+			if (!(data->dsp_mask & (1 << dsp)))
+				continue;
+
+			pc = chipio_hic_read_at_addr(fd, DSP0PROGCOUNT + (0x2000 * dsp));
+			data->hist[dsp][pc & (DSP_PMEM_WORDS - 1)]++;
+			data->samples[dsp]++;
+		}
+
+		if (!(i % (data->sample_cnt / 16 + 1))) {
+			putchar('.');
+			fflush(stdout);
+		}
+
+		next += period;
+		sleep_until_monotonic(next);
+	}
+
+	data->elapsed = get_monotonic_time() - start;
+	printf("]\n");
+}
+
+static int compare_profile_entries(const void *a, const void *b)
+{
+	const struct dsp_profile_entry *e0 = a, *e1 = b;
+
+	if (e0->cnt != e1->cnt)
+		return e0->cnt < e1->cnt ? 1 : -1;
+
+	return e0->addr - e1->addr;
+}
+
+/* Collect every address with at least one sample, sorted by count. */
+static uint32_t get_sorted_entries(struct dsp_profile_data *data, uint32_t dsp,
+		struct dsp_profile_entry *entries)
+{
+	uint32_t i, cnt;
+
+	for (i = cnt = 0; i < DSP_PMEM_WORDS; i++) {
+		if (!data->hist[dsp][i])
+			continue;
+
+		entries[cnt].addr = i;
+		entries[cnt].cnt = data->hist[dsp][i];
+		cnt++;
+	}
+
+	qsort(entries, cnt, sizeof(*entries), compare_profile_entries);
+
+	return cnt;
+}
+
+/*
+ * Disassembled ops can span multiple lines when they have a parallel op, so
+ * squash each run of whitespace into a single space to keep them on one.
+ */
+static void squash_op_str(char *str)
+{
+	char *src, *dst;
+
+	for (src = dst = str; *src; src++) {
+		if (isspace((uint8_t)*src)) {
+			if (dst != str && dst[-1] != ' ')
+				*dst++ = ' ';
+
+			continue;
+		}
+
+		*dst++ = *src;
+	}
+
+	if (dst != str && dst[-1] == ' ')
+		dst--;
+
+	*dst = '\0';
+}
+
+/* Pull the op at a PMEM address and disassemble it into str. */
+static void get_pmem_op_str(int fd, uint32_t addr, uint32_t *op_words,
+		char *str, size_t size)
+{
+	const dsp_op_info *op_info;
+	struct dsp_disasm disasm;
+	uint32_t len, op, hic_addr;
+
+	memset(op_words, 0, sizeof(uint32_t) * 4);
+	hic_addr = DSP_PMEM_ADDR_TO_HIC(addr);
+	op_words[0] = chipio_hic_read_at_addr(fd, hic_addr);
+
+	len = get_dsp_op_len(op_words[0]);
+	if (len > 1) {
+		chipio_hic_read_data_range(fd, hic_addr + 4, len - 1, &op_words[1]);
+		op = (op_words[0] & 0x007f8000) >> 15;
+	} else {
+		op = (op_words[0] & 0x00ff0000) >> 16;
+	}
+
+	op_info = get_dsp_op_info(op);
+	if (!op_info) {
+		snprintf(str, size, "UNK");
+		return;
+	}
+
+	memset(&disasm, 0, sizeof(disasm));
+	memcpy(disasm.cur_op, op_words, sizeof(disasm.cur_op));
+	disasm.cur_op_len = len;
+	disasm.cur_addr = addr;
+	disasm.out = fmemopen(str, size, "w");
+	if (!disasm.out) {
+		snprintf(str, size, "%s", op_info->op_str);
+		return;
+	}
+
+	dsp_disasm_print_op(&disasm, op_info);
+	if (disasm.offset_addr_op_set)
+		fprintf(disasm.out, " /* 0x%04x */", disasm.offset_addr);
+
+	fclose(disasm.out);
+	squash_op_str(str);
+}
+
+static int print_flat_profile(int fd, struct dsp_profile_data *data,
+		FILE *folded)
+{
+	struct dsp_profile_entry *entries;
+	uint32_t dsp, i, cnt, op_words[4];
+	char op_str[0x200];
+
+	entries = calloc(DSP_PMEM_WORDS, sizeof(*entries));
+	if (!entries) {
+		fprintf(stderr, "Failed to allocate profile entries.\n");
+		return 1;
+	}
+
+	for (dsp = 0; dsp < DSP_CNT; dsp++) {
+		if (!(data->dsp_mask & (1 << dsp)) || !data->samples[dsp])
+			continue;
+
+		cnt = get_sorted_entries(data, dsp, entries);
+
+		printf("\nDSP %d: %d samples, %d unique addresses.\n", dsp,
+				data->samples[dsp], cnt);
+		printf("    addr    samples      %%  word        op\n");
+		for (i = 0; i < cnt; i++) {
+			/* Only fetch ops for addresses we're going to print. */
+			if (i >= FLAT_PROFILE_LINES && !folded)
+				break;
+
+			get_pmem_op_str(fd, entries[i].addr, op_words, op_str,
+					sizeof(op_str));
+			if (i < FLAT_PROFILE_LINES) {
+				printf("    0x%04x %8d %6.2f  0x%08x  %s\n",
+						entries[i].addr, entries[i].cnt,
+						(entries[i].cnt * 100.0) / data->samples[dsp],
+						op_words[0], op_str);
+			}
+
+			/* Semicolons separate frames in folded stacks. */
+			if (folded) {
+				op_str[strcspn(op_str, ";")] = '\0';
+				fprintf(folded, "dsp%d;0x%04x_%s %d\n", dsp,
+						entries[i].addr, op_str, entries[i].cnt);
+			}
+		}
+	}
+
+	free(entries);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct dsp_profile_data data;
+	FILE *folded = NULL;
+	uint32_t i;
+	int fd, ret;
+
+	if (argc < 4) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	memset(&data, 0, sizeof(data));
+	data.sample_cnt = strtol(argv[2], NULL, 0);
+	data.rate = strtol(argv[3], NULL, 0);
+	data.dsp_mask = 0xf;
+	if (argc > 4)
+		data.dsp_mask = strtol(argv[4], NULL, 16) & 0xf;
+
+	if (!data.sample_cnt || !data.rate || !data.dsp_mask) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (argc > 5) {
+		folded = fopen(argv[5], "w+");
+		if (!folded) {
+			fprintf(stderr, "Failed to open folded output file.\n");
+			return 1;
+		}
+	}
+
+	ret = open_hwdep(argv[1], &fd);
+	if (ret)
+		goto exit;
+
+	for (i = 0; i < DSP_CNT; i++) {
+		data.hist[i] = calloc(DSP_PMEM_WORDS, sizeof(uint32_t));
+		if (!data.hist[i]) {
+			fprintf(stderr, "Failed to allocate histograms.\n");
+			ret = 1;
+			goto free_hist;
+		}
+	}
+
+	printf("Sampling [");
+	sample_dsp_pcs(fd, &data);
+	printf("Took %d samples in %f seconds, %.1f samples/sec.\n",
+			data.sample_cnt, data.elapsed, data.sample_cnt / data.elapsed);
+
+	ret = print_flat_profile(fd, &data, folded);
+
+free_hist:
+	for (i = 0; i < DSP_CNT; i++)
+		free(data.hist[i]);
+
+	close(fd);
+
+exit:
+	if (folded)
+		fclose(folded);
+
+	return ret;
+}
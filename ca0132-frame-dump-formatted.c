@@ -2,10 +2,47 @@
  * ca0132-frame-dump-formatted.c:
  * Takes a ca0132 frame dump file and prints it out in a more human readable
  * way. Makes it much easier to figure out which verbs were run.
+ *
+ * The capture is mapped and decoded in a single pass. The main codec and
+ * the DSP download count are found by scanning the raw frame words only
+ * for the verbs they need, the main codec from the end of the capture
+ * back, and the download count only once a download has been seen.
+ *
+ * If a codec, node or verb is given, only the frames that match it are
+ * decoded, along with a few frames of context before each one. Matching
+ * frames are found with a prefilter over the raw frame words, so the rest
+ * of the capture is never decoded.
+ *
+ * An index is kept next to the capture, see frame_index_build(), so repeat
+ * queries only scan the parts of the capture that can match. It also
+ * allows finding SCP transactions by target ID and request, and 8051 exram
+ * writes by address.
+ *
+ * Decoded verbs are turned into typed events, which can be filtered with an
+ * expression, see filter_compile(), and are written out as text, JSON Lines
+ * or binary records.
+ *
+ * Full decodes of large captures are split into segments and decoded on
+ * multiple threads, see decode_frames_parallel(). Captures can also be
+ * decoded from a pipe as they're written, see decode_stream().
  */
 #include "ca0132_defs.h"
+#include <sys/mman.h>
+#include <errno.h>
+#include <pthread.h>
 
-#define NODE_COUNT 0x18
+/* One entry for every 7-bit node ID a verb can address. */
+#define NODE_COUNT 0x80
+
+/* Frame word masks for finding verbs without decoding every frame. */
+#define FRAME_NODE_VERB_MASK 0x07ffff00
+#define FRAME_NODE_VERB(node, verb) (((node) << 20) | ((verb) << 8))
+#define FRAME_CODEC_MASK     0xf0000000
+#define FRAME_NODE_MASK      0x07f00000
+#define FRAME_VERB_MASK      0x000fff00
+#define FRAME_VERB_4BIT_MASK 0x000f0000
+
+#define DEFAULT_HIT_CONTEXT 8
 
 struct hda_verb {
 	uint32_t codec;
@@ -17,7 +54,7 @@ struct hda_verb {
 struct dsp_data {
 	struct scp_data scp_data;
 
-	uint32_t scp_start_addr;
+	uint64_t scp_start_addr;
 	uint8_t scp_set[2], scp_data_set[2];
 	uint32_t cur_data_cnt;
 	uint32_t low, high;
@@ -29,18 +66,23 @@ struct dsp_data {
 struct chipio_data {
 	uint8_t addr_set[2], data_set[2], read_set;
 	uint32_t chipio_addr, chipio_data;
-	uint32_t addr_set_start;
+	uint64_t addr_set_start;
 
 	uint8_t param_set;
-	uint32_t param_addr;
+	uint64_t param_addr;
 	uint32_t param;
 
 	uint8_t u_8051_addr_set[2], u_8051_data_set, u_8051_pll_set;
 	uint16_t u_8051_addr, u_8051_data;
-	uint32_t u_8051_addr_set_start;
-	uint32_t u_8051_data_run_len;
-	uint8_t u_8051_data_run[128];
-
+	uint64_t u_8051_addr_set_start;
+	/*
+	 * Data run buffer, kept between runs and grown as needed, so only
+	 * the longest run in the capture is ever allocated.
+	 */
+	uint8_t *u_8051_data_run;
+	uint32_t u_8051_data_run_len, u_8051_data_run_size;
+
+	uint8_t dsp_downloads_counted;
 	uint32_t dsp_downloads;
 	uint32_t port_free_count;
 };
@@ -48,31 +90,54 @@ struct chipio_data {
 struct generic_node {
 	uint32_t pincfg;
 	uint8_t  pin_ctl;
+	/* Bytes of pincfg, and pin_ctl, set since decoding started. */
+	uint8_t  pincfg_set, pin_ctl_set;
 };
 
+struct frame_index;
+struct event_filter;
+struct event_sink;
+struct frame_stats;
+
 struct ca0132_data {
-	FILE *frames;
+	const uint32_t *frames;
+	uint64_t frame_cnt, frame_pos, frame_end;
+	size_t map_size;
+	struct stat capture_st;
+	struct frame_index *index;
+	struct event_filter *filter;
+	const struct event_sink *sink;
+	struct frame_stats *stats;
+	const char *run_dir;
+	FILE *out;
+	uint8_t quiet;
 	uint8_t at_end;
 
 	uint32_t main_codec_id;
 	uint32_t codec_cnt;
 
-	uint32_t cur_data, cur_addr;
+	uint32_t cur_data;
+	uint64_t cur_addr;
 	struct hda_verb cur_verb;
 
 	struct dsp_data dsp_data;
 	struct chipio_data chipio_data;
 	struct generic_node nodes[NODE_COUNT];
+	/*
+	 * Frame after the last pincfg printed with bytes that weren't set
+	 * since decoding started, zero if there's been none.
+	 */
+	uint64_t pincfg_partial_end;
 };
 
 static void get_next_word(struct ca0132_data *data)
 {
-	if (!fread(&data->cur_data, sizeof(uint32_t), 1, data->frames))
-	{
+	if (data->frame_pos >= data->frame_end) {
 		data->at_end = 1;
 		return;
 	}
 
+	data->cur_data = data->frames[data->frame_pos++];
 	data->cur_addr += 0x4;
 }
 
@@ -91,7 +156,295 @@ static void get_next_verb(struct ca0132_data *data)
 	verb->data  = data->cur_data & 0xff;
 }
 
-static const struct hda_verb_info *find_verb_info(struct hda_verb *verb)
+/*
+ * Frame prefilter. Finds frame words matching a codec/node/verb pattern
+ * without decoding them. The x86 versions compare 4 (SSE2) or 8 (AVX2)
+ * words at a time, and only fall back to checking single words once a
+ * block has a match.
+ */
+struct frame_pattern {
+	uint32_t mask;
+	uint32_t match;
+};
+
+struct frame_hits {
+	uint64_t *idx;
+	uint64_t cnt, size;
+};
+
+typedef uint64_t (*frame_scan_func)(const uint32_t *frames, uint64_t start,
+		uint64_t end, const struct frame_pattern *pat);
+
+static uint64_t frame_scan_next_scalar(const uint32_t *frames, uint64_t start,
+		uint64_t end, const struct frame_pattern *pat)
+{
+	uint64_t i;
+
+	for (i = start; i < end; i++) {
+		if ((frames[i] & pat->mask) == pat->match)
+			break;
+	}
+
+	return i;
+}
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define FRAME_SCAN_X86
+#include <immintrin.h>
+
+static uint64_t frame_scan_next_sse2(const uint32_t *frames, uint64_t start,
+		uint64_t end, const struct frame_pattern *pat)
+{
+	__m128i mask = _mm_set1_epi32(pat->mask);
+	__m128i match = _mm_set1_epi32(pat->match);
+	__m128i a, b, c, d;
+	uint64_t i;
+
+	for (i = start; i + 16 <= end; i += 16) {
+		a = _mm_loadu_si128((const __m128i *)&frames[i]);
+		b = _mm_loadu_si128((const __m128i *)&frames[i + 4]);
+		c = _mm_loadu_si128((const __m128i *)&frames[i + 8]);
+		d = _mm_loadu_si128((const __m128i *)&frames[i + 12]);
+		a = _mm_cmpeq_epi32(_mm_and_si128(a, mask), match);
+		b = _mm_cmpeq_epi32(_mm_and_si128(b, mask), match);
+		c = _mm_cmpeq_epi32(_mm_and_si128(c, mask), match);
+		d = _mm_cmpeq_epi32(_mm_and_si128(d, mask), match);
+		a = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+		if (_mm_movemask_epi8(a))
+			break;
+	}
+
+	return frame_scan_next_scalar(frames, i, end, pat);
+}
+
+__attribute__((target("avx2")))
+static uint64_t frame_scan_next_avx2(const uint32_t *frames, uint64_t start,
+		uint64_t end, const struct frame_pattern *pat)
+{
+	__m256i mask = _mm256_set1_epi32(pat->mask);
+	__m256i match = _mm256_set1_epi32(pat->match);
+	__m256i a, b, c, d;
+	uint64_t i;
+
+	for (i = start; i + 32 <= end; i += 32) {
+		a = _mm256_loadu_si256((const __m256i *)&frames[i]);
+		b = _mm256_loadu_si256((const __m256i *)&frames[i + 8]);
+		c = _mm256_loadu_si256((const __m256i *)&frames[i + 16]);
+		d = _mm256_loadu_si256((const __m256i *)&frames[i + 24]);
+		a = _mm256_cmpeq_epi32(_mm256_and_si256(a, mask), match);
+		b = _mm256_cmpeq_epi32(_mm256_and_si256(b, mask), match);
+		c = _mm256_cmpeq_epi32(_mm256_and_si256(c, mask), match);
+		d = _mm256_cmpeq_epi32(_mm256_and_si256(d, mask), match);
+		a = _mm256_or_si256(_mm256_or_si256(a, b), _mm256_or_si256(c, d));
+		if (!_mm256_testz_si256(a, a))
+			break;
+	}
+
+	return frame_scan_next_scalar(frames, i, end, pat);
+}
+#endif
+
+static frame_scan_func frame_scan_next = frame_scan_next_scalar;
+
+/* Pick the scan function, either the best supported or the one named. */
+static int frame_scan_init(const char *name)
+{
+	if (name && !strcmp(name, "scalar")) {
+		frame_scan_next = frame_scan_next_scalar;
+		return 0;
+	}
+
+#ifdef FRAME_SCAN_X86
+	__builtin_cpu_init();
+	if (!name || !strcmp(name, "avx2")) {
+		if (__builtin_cpu_supports("avx2")) {
+			frame_scan_next = frame_scan_next_avx2;
+			return 0;
+		}
+
+		if (name)
+			return 1;
+	}
+
+	if (!name || !strcmp(name, "sse2")) {
+		frame_scan_next = frame_scan_next_sse2;
+		return 0;
+	}
+#else
+	if (!name)
+		return 0;
+#endif
+
+	return 1;
+}
+
+static const char *frame_scan_get_str(void)
+{
+#ifdef FRAME_SCAN_X86
+	if (frame_scan_next == frame_scan_next_avx2)
+		return "avx2";
+
+	if (frame_scan_next == frame_scan_next_sse2)
+		return "sse2";
+#endif
+
+	return "scalar";
+}
+
+/* Add the index of every frame matching the pattern to hits. */
+static void frame_scan_hits(const uint32_t *frames, uint64_t start, uint64_t end,
+		const struct frame_pattern *pat, struct frame_hits *hits)
+{
+	uint64_t i;
+
+	i = frame_scan_next(frames, start, end, pat);
+	while (i < end) {
+		if (hits->cnt >= hits->size) {
+			hits->size = hits->size ? hits->size * 2 : 0x1000;
+			hits->idx = realloc(hits->idx, hits->size * sizeof(*hits->idx));
+		}
+
+		hits->idx[hits->cnt++] = i;
+		i = frame_scan_next(frames, i + 1, end, pat);
+	}
+}
+
+/*
+ * Only needed once a download is seen, so the capture doesn't have to be
+ * scanned ahead of time.
+ */
+static void count_dsp_downloads(struct ca0132_data *data)
+{
+	struct chipio_data *chipio_data = &data->chipio_data;
+	struct frame_pattern pat;
+	struct frame_hits hits;
+
+	if (chipio_data->dsp_downloads_counted)
+		return;
+
+	pat.mask = FRAME_NODE_VERB_MASK;
+	pat.match = FRAME_NODE_VERB(0x15, VENDOR_CHIPIO_PORT_FREE_SET);
+	memset(&hits, 0, sizeof(hits));
+	frame_scan_hits(data->frames, 0, data->frame_cnt, &pat, &hits);
+
+	chipio_data->dsp_downloads = hits.cnt;
+	chipio_data->dsp_downloads_counted = 1;
+	free(hits.idx);
+}
+
+/*
+ * The last codec to have its ChipIO CT extensions enabled is the main
+ * codec. Scan back from the end of the capture a block at a time, it's
+ * usually found near the end.
+ */
+#define MAIN_CODEC_SCAN_BLOCK 0x10000
+static void find_main_codec(struct ca0132_data *data)
+{
+	struct frame_pattern pat;
+	uint64_t start, end, i, last;
+
+	pat.mask = FRAME_NODE_VERB_MASK;
+	pat.match = FRAME_NODE_VERB(0x15, CHIPIO_CT_EXTENSIONS_ENABLE);
+	for (end = data->frame_cnt; end > 0; end = start) {
+		start = (end > MAIN_CODEC_SCAN_BLOCK) ? end - MAIN_CODEC_SCAN_BLOCK : 0;
+
+		last = end;
+		i = frame_scan_next(data->frames, start, end, &pat);
+		while (i < end) {
+			last = i;
+			i = frame_scan_next(data->frames, i + 1, end, &pat);
+		}
+
+		if (last < end) {
+			data->main_codec_id = (data->frames[last] >> 28) & 0x0f;
+			break;
+		}
+	}
+}
+
+/*
+ * Decoded events. Handlers fill out an event for everything they'd print,
+ * and emit_event() checks it against the filter before formatting it.
+ */
+enum frame_event_type {
+	EVENT_VERB,
+	EVENT_SCP,
+	EVENT_SCP_BAD_FORMAT,
+	EVENT_FLAG_SET,
+	EVENT_PARAM_SET,
+	EVENT_PARAM_EX_SET,
+	EVENT_PARAM_GET,
+	EVENT_HIC_WRITE,
+	EVENT_HIC_READ,
+	EVENT_8051_DIRECT_WRITE,
+	EVENT_8051_RUN,
+	EVENT_8051_READ,
+	EVENT_8051_STRAY_WRITE,
+	EVENT_PLL_PMU_WRITE,
+	EVENT_DSP_DOWNLOAD_END,
+	EVENT_PINCFG,
+	EVENT_PINCTL,
+	EVENT_AMP,
+	EVENT_TYPE_CNT,
+};
+
+static const char *event_type_str[] = {
+	"verb",
+	"scp",
+	"scp_bad_format",
+	"flag_set",
+	"param_set",
+	"param_ex_set",
+	"param_get",
+	"hic_write",
+	"hic_read",
+	"8051_direct_write",
+	"8051_run",
+	"8051_read",
+	"8051_stray_write",
+	"pll_pmu_write",
+	"dsp_download_end",
+	"pincfg",
+	"pinctl",
+	"amp",
+};
+
+struct frame_event {
+	uint32_t type;
+	uint64_t offset;
+
+	/* Last verb of the event. */
+	struct hda_verb verb;
+
+	/*
+	 * HIC/8051/PLL address and data, flag/param ID and value, pin
+	 * config/control, or amp payload.
+	 */
+	uint32_t addr, val;
+
+	/* SCP transactions, and whether it was cut short after cnt values. */
+	const struct scp_data *scp;
+	uint8_t aborted;
+	uint32_t cnt;
+
+	/* 8051 data runs. */
+	const uint8_t *buf;
+	uint32_t len;
+
+	/* Matching frame of a query. */
+	uint8_t marked;
+};
+
+static void event_init(struct frame_event *ev, uint32_t type,
+		struct ca0132_data *data, uint64_t offset)
+{
+	memset(ev, 0, sizeof(*ev));
+	ev->type = type;
+	ev->offset = offset;
+	ev->verb = data->cur_verb;
+}
+
+static const struct hda_verb_info *find_verb_info(const struct hda_verb *verb)
 {
 	const struct hda_verb_info *verb_info;
 	uint32_t verb_val, tmp;
@@ -107,729 +460,3478 @@ static const struct hda_verb_info *find_verb_info(struct hda_verb *verb)
 	return verb_info;
 }
 
-static void print_cur_verb(struct ca0132_data *data)
+static void print_verb_text(FILE *out, const struct frame_event *ev)
 {
-	struct hda_verb *verb = &data->cur_verb;
+	const struct hda_verb *verb = &ev->verb;
 	const struct hda_verb_info *verb_info = NULL;
 
 	if (verb->node != 0x15 && verb->node != 0x16)
 		verb_info = find_verb_info(verb);
 
 	if (verb_info)
-		printf("0x%06x: codec 0x%02x, node 0x%02x, verb 0x%03x, data 0x%02x, name %s.\n", data->cur_addr - 0x4,
+		fprintf(out, "0x%06lx: codec 0x%02x, node 0x%02x, verb 0x%03x, data 0x%02x, name %s.\n", (unsigned long)ev->offset,
 				verb->codec, verb->node, verb->verb, verb->data, verb_info->name);
 	else
-		printf("0x%06x: codec 0x%02x, node 0x%02x, verb 0x%03x, data 0x%02x.\n", data->cur_addr - 0x4,
+		fprintf(out, "0x%06lx: codec 0x%02x, node 0x%02x, verb 0x%03x, data 0x%02x.\n", (unsigned long)ev->offset,
 				verb->codec, verb->node, verb->verb, verb->data);
 }
 
-static void print_scp_write_data(struct dsp_data *data)
+static void print_scp_text(FILE *out, const struct frame_event *ev)
 {
-	struct scp_data *scp_data = &data->scp_data;
+	const struct scp_data *scp_data = ev->scp;
 	const struct scp_cmd_info *scp_info;
 	uint32_t i;
 	float *tmp;
 
+	if (ev->aborted)
+		fprintf(out, "Aborting current scp, incorrect format, dsp_data->cur_data_cnt %d.\n",
+				ev->cnt);
+
 	scp_info = dsp_get_scp_cmd_info(scp_data->target_id, scp_data->req);
 	if (scp_data->target_id == 0x96 && scp_data->req == 0x3a) {
 		if (scp_data->val[0] == 0x3f800000) {
-			printf("--------------------------------------------------------------------------------\n");
-			printf("Begin output switch.\n");
+			fprintf(out, "--------------------------------------------------------------------------------\n");
+			fprintf(out, "Begin output switch.\n");
 		}
 	}
 
-	printf("0x%06x: size %d, err_flag %d, resp_flag %d, dev_flag %d, req 0x%02x,\n",
-			data->scp_start_addr, scp_data->data_size, scp_data->error_flag,
+	fprintf(out, "0x%06lx: size %d, err_flag %d, resp_flag %d, dev_flag %d, req 0x%02x,\n",
+			(unsigned long)ev->offset, scp_data->data_size, scp_data->error_flag,
 			scp_data->resp_flag, scp_data->device_flag, scp_data->req);
-	printf("                  get_flag %d, src_id 0x%02x,       target_id 0x%02x.\n",
+	fprintf(out, "                  get_flag %d, src_id 0x%02x,       target_id 0x%02x.\n",
 			scp_data->get_flag, scp_data->source_id, scp_data->target_id);
 
 
 	if (scp_info)
-		printf("                  ReqID: %s.\n", scp_info->name);
+		fprintf(out, "                  ReqID: %s.\n", scp_info->name);
 
 	for (i = 0; i < scp_data->data_size; ++i) {
 		tmp = (float *)&scp_data->val[i];
-		printf("Val[%d]: %f, %#08x.\n", i, *tmp, scp_data->val[i]);
+		fprintf(out, "Val[%d]: %f, %#08x.\n", i, *tmp, scp_data->val[i]);
 	}
 
 	if (scp_data->target_id == 0x96 && scp_data->req == 0x3a) {
 		if (!scp_data->val[0]) {
-			printf("Exit output switch.\n");
-			printf("--------------------------------------------------------------------------------\n");
+			fprintf(out, "Exit output switch.\n");
+			fprintf(out, "--------------------------------------------------------------------------------\n");
 		}
 	}
-	putchar('\n');
+	fputc('\n', out);
 }
 
-static uint16_t extract_16_bit_data(struct hda_verb *verb)
+static void get_pinctl_vals(uint32_t pinctl, uint32_t *hp_enable,
+		uint32_t *out_enable, uint32_t *in_enable, uint32_t *vref)
 {
-	return ((verb->verb & 0xff) << 8) | verb->data;
+	*hp_enable  = !!((pinctl >> 7) & 0x1);
+	*out_enable = !!((pinctl >> 6) & 0x1);
+	*in_enable  = !!((pinctl >> 5) & 0x1);
+	*vref = pinctl & 0x7;
 }
 
-static void dsp_scp_clear(struct dsp_data *data)
+#define AMP_DIR_OUT_SET_MASK 0x8000
+#define AMP_CH_LEFT_SET_MASK 0x2000
+static void print_event_text(FILE *out, const struct frame_event *ev)
 {
-	memset(data, 0, sizeof(*data));
+	const struct hda_verb *verb = &ev->verb;
+	uint32_t hp, out_en, in, vref, i;
+
+	if (ev->marked)
+		fprintf(out, "> ");
+
+	switch (ev->type) {
+	case EVENT_VERB:
+		print_verb_text(out, ev);
+		break;
+	case EVENT_SCP:
+		print_scp_text(out, ev);
+		break;
+	case EVENT_SCP_BAD_FORMAT:
+		fprintf(out, "scp isn't in correct format.\n");
+		print_verb_text(out, ev);
+		break;
+	case EVENT_FLAG_SET:
+		fprintf(out, "0x%06lx: Flag %s (%d), set %d.\n", (unsigned long)ev->offset,
+				chipio_get_flag_str(ev->addr), ev->addr, ev->val);
+		break;
+	case EVENT_PARAM_SET:
+		fprintf(out, "0x%06lx: Param %s (%d), set %d.\n", (unsigned long)ev->offset,
+				chipio_get_param_str(ev->addr), ev->addr, ev->val);
+		break;
+	case EVENT_PARAM_EX_SET:
+		fprintf(out, "0x%06lx: Param %s (%d), set 0x%02x.\n", (unsigned long)ev->offset,
+				chipio_get_param_str(ev->addr), ev->addr, ev->val);
+		break;
+	case EVENT_PARAM_GET:
+		fprintf(out, "0x%06lx: Get param %s (%d).\n", (unsigned long)ev->offset,
+				chipio_get_param_str(ev->addr), ev->addr);
+		break;
+	case EVENT_HIC_WRITE:
+		fprintf(out, "0x%06lx: HIC Addr 0x%06x, Data 0x%08x.\n", (unsigned long)ev->offset,
+			ev->addr, ev->val);
+		break;
+	case EVENT_HIC_READ:
+		fprintf(out, "0x%06lx: Readback HIC Addr 0x%06x.\n", (unsigned long)ev->offset,
+			ev->addr);
+		break;
+	case EVENT_8051_DIRECT_WRITE:
+		fprintf(out, "0x%06lx: 8051 write direct addr 0x%02x, value 0x%02x.\n", (unsigned long)ev->offset,
+		       	ev->addr, ev->val);
+		break;
+	case EVENT_8051_RUN:
+		fprintf(out, "0x%06lx: 8051_addr_start 0x%04x, %d bytes:\n", (unsigned long)ev->offset,
+				ev->addr, ev->len);
+		for (i = 0; i < ev->len; ++i) {
+			if (!(i % 16))
+				fprintf(out, "  0x%04x:", (ev->addr + i) & 0xffff);
+
+			fprintf(out, " %02x", ev->buf[i]);
+			if (i % 16 == 15 || i == ev->len - 1)
+				fputc('\n', out);
+		}
+		break;
+	case EVENT_8051_READ:
+		fprintf(out, "0x%06lx: 8051_addr_read 0x%04x.\n", (unsigned long)ev->offset, ev->addr);
+		break;
+	case EVENT_8051_STRAY_WRITE:
+		fprintf(out, "random 8051 data write!\n");
+		print_verb_text(out, ev);
+		break;
+	case EVENT_PLL_PMU_WRITE:
+		fprintf(out, "0x%06lx: PLL PMU write addr 0x%02x, data 0x%02x.\n",
+				(unsigned long)ev->offset, ev->addr, ev->val);
+		break;
+	case EVENT_DSP_DOWNLOAD_END:
+		fprintf(out, "\n----------END_DSP_DOWNLOAD------------\n\n");
+		break;
+	case EVENT_PINCFG:
+		fprintf(out, "Node 0x%02x pincfg 0x%08x.\n", verb->node, ev->val);
+		break;
+	case EVENT_PINCTL:
+		get_pinctl_vals(ev->val, &hp, &out_en, &in, &vref);
+		fprintf(out, "0x%06lx: codec 0x%02x, node 0x%02x, pinctl 0x%02x.\n", (unsigned long)ev->offset, verb->codec, verb->node,
+				ev->val);
+		fprintf(out, "pinctl: HP-Enable %d, Out-Enable %d, In-Enable %d, vref 0x%02x.\n", hp, out_en, in, vref);
+		break;
+	case EVENT_AMP:
+		fprintf(out, "0x%06lx: codec 0x%02x, node 0x%02x, dir %s, ch %s, mute %d, gain 0x%02x.\n", (unsigned long)ev->offset, verb->codec, verb->node,
+				(ev->val & AMP_DIR_OUT_SET_MASK) ? "OUT" : "IN",
+				(ev->val & AMP_CH_LEFT_SET_MASK) ? "LEFT" : "RIGHT",
+				!!(ev->val & 0x80), ev->val & 0x7f);
+		break;
+	}
 }
 
-static uint8_t dsp_scp_set(struct dsp_data *data)
+/*
+ * Filter expressions. Compiled once into a postfix program of comparisons
+ * and logic ops, which is run against each event. Grammar:
+ *
+ * expr    = and ("||" and)*
+ * and     = unary ("&&" unary)*
+ * unary   = "!" unary | "(" expr ")" | compare
+ * compare = field op value | field "in" "[" value "," value "]"
+ * op      = "==" | "!=" | "<" | "<=" | ">" | ">="
+ *
+ * Values are integers, or event type names when compared with 'type'. A
+ * comparison on a field that an event doesn't have is false.
+ */
+#define FILTER_MAX_OPS 0x80
+
+enum event_field {
+	FIELD_TYPE,
+	FIELD_OFFSET,
+	FIELD_CODEC,
+	FIELD_NODE,
+	FIELD_VERB,
+	FIELD_DATA,
+	FIELD_ADDR,
+	FIELD_VAL,
+	FIELD_SCP_MID,
+	FIELD_SCP_SRC,
+	FIELD_SCP_REQ,
+	FIELD_SCP_SIZE,
+	FIELD_SCP_GET,
+	FIELD_HIC_ADDR,
+	FIELD_HIC_DATA,
+	FIELD_8051_ADDR,
+	FIELD_8051_LEN,
+	FIELD_FLAG,
+	FIELD_PARAM,
+	FIELD_PINCFG,
+	FIELD_PINCTL,
+};
+
+static const struct {
+	const char *name;
+	uint32_t field;
+} event_field_names[] = {
+	{ "type",              FIELD_TYPE },
+	{ "offset",            FIELD_OFFSET },
+	{ "codec",             FIELD_CODEC },
+	{ "node",              FIELD_NODE },
+	{ "verb",              FIELD_VERB },
+	{ "data",              FIELD_DATA },
+	{ "addr",              FIELD_ADDR },
+	{ "val",               FIELD_VAL },
+	{ "scp.mid",           FIELD_SCP_MID },
+	{ "scp.src",           FIELD_SCP_SRC },
+	{ "scp.req",           FIELD_SCP_REQ },
+	{ "scp.size",          FIELD_SCP_SIZE },
+	{ "scp.get",           FIELD_SCP_GET },
+	{ "chipio.hic.addr",   FIELD_HIC_ADDR },
+	{ "chipio.hic.data",   FIELD_HIC_DATA },
+	{ "chipio.8051.addr",  FIELD_8051_ADDR },
+	{ "chipio.8051.len",   FIELD_8051_LEN },
+	{ "chipio.flag",       FIELD_FLAG },
+	{ "chipio.param",      FIELD_PARAM },
+	{ "pin.cfg",           FIELD_PINCFG },
+	{ "pin.ctl",           FIELD_PINCTL },
+};
+
+enum filter_op_type {
+	FILTER_OP_CMP,
+	FILTER_OP_AND,
+	FILTER_OP_OR,
+	FILTER_OP_NOT,
+};
+
+enum filter_cmp {
+	FILTER_CMP_EQ,
+	FILTER_CMP_NE,
+	FILTER_CMP_LT,
+	FILTER_CMP_LE,
+	FILTER_CMP_GT,
+	FILTER_CMP_GE,
+	FILTER_CMP_IN,
+};
+
+struct filter_op {
+	uint8_t type;
+	uint8_t cmp;
+	uint32_t field;
+	uint64_t val[2];
+};
+
+struct event_filter {
+	struct filter_op ops[FILTER_MAX_OPS];
+	uint32_t op_cnt;
+
+	/* Parser state. */
+	const char *str, *pos;
+	int err;
+};
+
+/* Returns 0 if the event doesn't have the field. */
+static int get_event_field(const struct frame_event *ev, uint32_t field,
+		uint64_t *val)
 {
-	return data->scp_set[0] && data->scp_set[1];
+	switch (field) {
+	case FIELD_TYPE:
+		*val = ev->type;
+		return 1;
+	case FIELD_OFFSET:
+		*val = ev->offset;
+		return 1;
+	case FIELD_CODEC:
+		*val = ev->verb.codec;
+		return 1;
+	case FIELD_NODE:
+		*val = ev->verb.node;
+		return 1;
+	case FIELD_VERB:
+		*val = ev->verb.verb;
+		return 1;
+	case FIELD_DATA:
+		*val = ev->verb.data;
+		return 1;
+	case FIELD_ADDR:
+	case FIELD_VAL:
+		switch (ev->type) {
+		case EVENT_VERB:
+		case EVENT_SCP:
+		case EVENT_SCP_BAD_FORMAT:
+		case EVENT_8051_STRAY_WRITE:
+		case EVENT_DSP_DOWNLOAD_END:
+			return 0;
+		case EVENT_PARAM_GET:
+		case EVENT_HIC_READ:
+		case EVENT_8051_RUN:
+		case EVENT_8051_READ:
+			if (field == FIELD_VAL)
+				return 0;
+			break;
+		case EVENT_PINCFG:
+		case EVENT_PINCTL:
+		case EVENT_AMP:
+			if (field == FIELD_ADDR)
+				return 0;
+			break;
+		}
+
+		*val = (field == FIELD_ADDR) ? ev->addr : ev->val;
+		return 1;
+	case FIELD_SCP_MID:
+	case FIELD_SCP_SRC:
+	case FIELD_SCP_REQ:
+	case FIELD_SCP_SIZE:
+	case FIELD_SCP_GET:
+		if (ev->type != EVENT_SCP)
+			return 0;
+
+		if (field == FIELD_SCP_MID)
+			*val = ev->scp->target_id;
+		else if (field == FIELD_SCP_SRC)
+			*val = ev->scp->source_id;
+		else if (field == FIELD_SCP_REQ)
+			*val = ev->scp->req;
+		else if (field == FIELD_SCP_SIZE)
+			*val = ev->scp->data_size;
+		else
+			*val = ev->scp->get_flag;
+		return 1;
+	case FIELD_HIC_ADDR:
+		if (ev->type != EVENT_HIC_WRITE && ev->type != EVENT_HIC_READ)
+			return 0;
+
+		*val = ev->addr;
+		return 1;
+	case FIELD_HIC_DATA:
+		if (ev->type != EVENT_HIC_WRITE)
+			return 0;
+
+		*val = ev->val;
+		return 1;
+	case FIELD_8051_ADDR:
+		if (ev->type != EVENT_8051_RUN && ev->type != EVENT_8051_READ &&
+				ev->type != EVENT_8051_DIRECT_WRITE)
+			return 0;
+
+		*val = ev->addr;
+		return 1;
+	case FIELD_8051_LEN:
+		if (ev->type != EVENT_8051_RUN)
+			return 0;
+
+		*val = ev->len;
+		return 1;
+	case FIELD_FLAG:
+		if (ev->type != EVENT_FLAG_SET)
+			return 0;
+
+		*val = ev->addr;
+		return 1;
+	case FIELD_PARAM:
+		if (ev->type != EVENT_PARAM_SET && ev->type != EVENT_PARAM_EX_SET &&
+				ev->type != EVENT_PARAM_GET)
+			return 0;
+
+		*val = ev->addr;
+		return 1;
+	case FIELD_PINCFG:
+		if (ev->type != EVENT_PINCFG)
+			return 0;
+
+		*val = ev->val;
+		return 1;
+	case FIELD_PINCTL:
+		if (ev->type != EVENT_PINCTL)
+			return 0;
+
+		*val = ev->val;
+		return 1;
+	}
+
+	return 0;
 }
 
-static void dsp_scp_read_check(struct dsp_data *data)
+static int filter_match(const struct event_filter *filter,
+		const struct frame_event *ev)
 {
-	if (data->scp_read_data_set_cnt == 4 && data->scp_post_read_cnt == 2)
-	{
-		print_scp_write_data(data);
-		dsp_scp_clear(data);
+	const struct filter_op *op;
+	uint8_t stack[FILTER_MAX_OPS];
+	uint32_t i, sp;
+	uint64_t val;
+	int res;
+
+	sp = 0;
+	for (i = 0; i < filter->op_cnt; i++) {
+		op = &filter->ops[i];
+		switch (op->type) {
+		case FILTER_OP_CMP:
+			res = get_event_field(ev, op->field, &val);
+			if (res) {
+				switch (op->cmp) {
+				case FILTER_CMP_EQ: res = val == op->val[0]; break;
+				case FILTER_CMP_NE: res = val != op->val[0]; break;
+				case FILTER_CMP_LT: res = val < op->val[0]; break;
+				case FILTER_CMP_LE: res = val <= op->val[0]; break;
+				case FILTER_CMP_GT: res = val > op->val[0]; break;
+				case FILTER_CMP_GE: res = val >= op->val[0]; break;
+				case FILTER_CMP_IN:
+					res = val >= op->val[0] && val <= op->val[1];
+					break;
+				}
+			}
+
+			stack[sp++] = res;
+			break;
+		case FILTER_OP_AND:
+			sp--;
+			stack[sp - 1] = stack[sp - 1] && stack[sp];
+			break;
+		case FILTER_OP_OR:
+			sp--;
+			stack[sp - 1] = stack[sp - 1] || stack[sp];
+			break;
+		case FILTER_OP_NOT:
+			stack[sp - 1] = !stack[sp - 1];
+			break;
+		}
 	}
+
+	return stack[0];
 }
 
-static void dsp_scp_write_check(struct dsp_data *data)
+static void filter_skip_space(struct event_filter *filter)
 {
-	print_scp_write_data(data);
-	dsp_scp_clear(data);
+	while (isspace(*filter->pos))
+		filter->pos++;
 }
 
-static void dsp_scp_check(struct dsp_data *data)
+static int filter_accept(struct event_filter *filter, const char *tok)
 {
-	if (dsp_scp_set(data)) {
-		if (data->cur_data_cnt == data->scp_data.data_size) {
-			if (data->scp_data.get_flag)
-				dsp_scp_read_check(data);
-			else
-				dsp_scp_write_check(data);
-		}
+	filter_skip_space(filter);
+	if (strncmp(filter->pos, tok, strlen(tok)))
+		return 0;
+
+	filter->pos += strlen(tok);
+
+	return 1;
+}
+
+static void filter_error(struct event_filter *filter, const char *msg)
+{
+	if (filter->err)
+		return;
+
+	fprintf(stderr, "Filter error at offset %d: %s.\n",
+			(int)(filter->pos - filter->str), msg);
+	filter->err = 1;
+}
+
+static struct filter_op *filter_add_op(struct event_filter *filter, uint32_t type)
+{
+	struct filter_op *op;
+
+	if (filter->op_cnt >= FILTER_MAX_OPS) {
+		filter_error(filter, "expression too long");
+		return NULL;
 	}
+
+	op = &filter->ops[filter->op_cnt++];
+	memset(op, 0, sizeof(*op));
+	op->type = type;
+
+	return op;
 }
 
-static void dsp_scp_handler(struct ca0132_data *data)
+static int filter_parse_value(struct event_filter *filter, uint32_t field,
+		uint64_t *val)
 {
-	struct hda_verb *verb = &data->cur_verb;
-	struct dsp_data *dsp_data = &data->dsp_data;
-	uint32_t tmp, tmp1;
+	const char *start;
+	char *end;
+	size_t len;
+	uint32_t i;
 
-	tmp =  verb->verb & 0xf00;
-	switch (tmp) {
-	case VENDOR_DSPIO_SCP_WRITE_DATA_LOW:
-		if (!dsp_scp_set(dsp_data)) {
-			if (dsp_data->scp_set[0])
-			{
-				printf("scp isn't in correct format.\n");
-				print_cur_verb(data);
-				dsp_scp_clear(dsp_data);
-				break;
+	filter_skip_space(filter);
+	start = filter->pos;
+
+	if (field == FIELD_TYPE) {
+		while (isalnum(*filter->pos) || *filter->pos == '_')
+			filter->pos++;
+
+		len = filter->pos - start;
+		for (i = 0; i < EVENT_TYPE_CNT; i++) {
+			if (strlen(event_type_str[i]) == len &&
+					!strncmp(event_type_str[i], start, len)) {
+				*val = i;
+				return 0;
 			}
-			dsp_scp_clear(dsp_data);
-			dsp_data->scp_start_addr = data->cur_addr - 0x4;
-			tmp1 = verb->data;
-			tmp1 |= (verb->verb & 0xff) << 8;
-			dsp_data->scp = tmp1;
-			dsp_data->scp_set[0] = 1;
-		} else if (dsp_data->scp_data.data_size != dsp_data->cur_data_cnt) {
-			dsp_data->scp_data_set[0] = dsp_data->scp_data_set[1] = 0;
-			tmp1 = verb->data;
-			tmp1 |= (verb->verb & 0xff) << 8;
-			dsp_data->data = tmp1;
-			dsp_data->scp_data_set[0] = 1;
-		} else {
-			printf("Aborting current scp, incorrect format, dsp_data->cur_data_cnt %d.\n",
-					dsp_data->cur_data_cnt);
-			print_scp_write_data(dsp_data);
-			dsp_scp_clear(dsp_data);
-			dsp_data->scp_start_addr = data->cur_addr - 0x4;
-			tmp1 = verb->data;
-			tmp1 |= (verb->verb & 0xff) << 8;
-			dsp_data->scp = tmp1;
-			dsp_data->scp_set[0] = 1;
 		}
-		break;
 
-	case VENDOR_DSPIO_SCP_WRITE_DATA_HIGH:
-		if (!dsp_scp_set(dsp_data)) {
-			if (!dsp_data->scp_set[0])
-			{
-				printf("scp isn't in correct format.\n");
-				print_cur_verb(data);
-				dsp_scp_clear(dsp_data);
-				break;
-			}
-			tmp1 = verb->data;
-			tmp1 |= (verb->verb & 0xff) << 8;
-			dsp_data->scp |= (tmp1 << 16);
-			dsp_data->scp_set[1] = 1;
-			get_scp_data(&dsp_data->scp_data, dsp_data->scp);
-			if (dsp_data->scp_data.data_size >= 4) {
-				printf("scp isn't in correct format.\n");
-				print_cur_verb(data);
-				dsp_scp_clear(dsp_data);
-				break;
-			}
-		} else if (dsp_data->scp_data.data_size != dsp_data->cur_data_cnt) {
-			if (!dsp_data->scp_data_set[0])
-			{
-				printf("scp isn't in correct format.\n");
-				dsp_scp_clear(dsp_data);
-				print_cur_verb(data);
-			}
-			tmp1 = verb->data;
-			tmp1 |= (verb->verb & 0xff) << 8;
-			dsp_data->data |= (tmp1 << 16);
-			dsp_data->scp_data_set[1] = 1;
-			if (dsp_data->cur_data_cnt >= 15)
-				break;
-
-			dsp_data->scp_data.val[dsp_data->cur_data_cnt++] = dsp_data->data;
-		}
+		filter->pos = start;
+		filter_error(filter, "unknown event type");
+		return 1;
+	}
 
-		break;
-	default:
-		break;
+	*val = strtoull(start, &end, 0);
+	if (end == start) {
+		filter_error(filter, "expected a number");
+		return 1;
 	}
 
-	dsp_scp_check(dsp_data);
+	filter->pos = end;
+
+	return 0;
 }
 
-static void dsp_verb_handler(struct ca0132_data *data)
+static void filter_parse_expr(struct event_filter *filter);
+
+static void filter_parse_compare(struct event_filter *filter)
 {
-	struct hda_verb *verb = &data->cur_verb;
-	uint32_t tmp;
+	static const struct {
+		const char *tok;
+		uint32_t cmp;
+	} cmps[] = {
+		{ "==", FILTER_CMP_EQ }, { "!=", FILTER_CMP_NE },
+		{ "<=", FILTER_CMP_LE }, { ">=", FILTER_CMP_GE },
+		{ "<",  FILTER_CMP_LT }, { ">",  FILTER_CMP_GT },
+		{ "in", FILTER_CMP_IN },
+	};
+	struct filter_op *op;
+	const char *start;
+	uint32_t i, field;
+	size_t len;
+
+	filter_skip_space(filter);
+	start = filter->pos;
+	while (isalnum(*filter->pos) || *filter->pos == '_' || *filter->pos == '.')
+		filter->pos++;
+
+	len = filter->pos - start;
+	for (i = 0; i < ARRAY_SIZE(event_field_names); i++) {
+		if (strlen(event_field_names[i].name) == len &&
+				!strncmp(event_field_names[i].name, start, len))
+			break;
+	}
 
-	tmp = (verb->verb >> 8) & 0xf;
+	if (i == ARRAY_SIZE(event_field_names)) {
+		filter->pos = start;
+		filter_error(filter, "unknown field");
+		return;
+	}
 
-	switch (tmp) {
-	case 0x0:
-	case 0x1:
-		dsp_scp_handler(data);
-		break;
-	case 0x7:
-		switch (verb->verb) {
-		case VENDOR_DSPIO_SCP_POST_READ_DATA:
-			data->dsp_data.scp_read_data_set_cnt++;
-			dsp_scp_handler(data);
-		case VENDOR_DSPIO_SCP_POST_COUNT_QUERY:
-			data->dsp_data.scp_post_read_cnt++;
-			dsp_scp_handler(data);
-			break;
-		default:
+	field = event_field_names[i].field;
+	for (i = 0; i < ARRAY_SIZE(cmps); i++) {
+		if (filter_accept(filter, cmps[i].tok))
 			break;
-		}
+	}
 
-		break;
-	case 0xf:
-		switch (verb->verb) {
-		case VENDOR_DSPIO_STATUS:
-			if (dsp_scp_set(&data->dsp_data))
-				break;
-			break;
-		case VENDOR_DSPIO_SCP_READ_DATA:
-			data->dsp_data.scp_read_data_set_cnt++;
-			dsp_scp_handler(data);
-			break;
-		case VENDOR_DSPIO_SCP_READ_COUNT:
-			data->dsp_data.scp_post_read_cnt++;
-			dsp_scp_handler(data);
-			break;
-		default:
-			print_cur_verb(data);
-			break;
-		}
-		break;
+	if (i == ARRAY_SIZE(cmps)) {
+		filter_error(filter, "expected a comparison");
+		return;
+	}
 
-	default:
-		print_cur_verb(data);
-		break;
+	op = filter_add_op(filter, FILTER_OP_CMP);
+	if (!op)
+		return;
+
+	op->field = field;
+	op->cmp = cmps[i].cmp;
+	if (op->cmp != FILTER_CMP_IN) {
+		filter_parse_value(filter, field, &op->val[0]);
+		return;
 	}
 
-}
+	if (!filter_accept(filter, "[")) {
+		filter_error(filter, "expected '['");
+		return;
+	}
 
-/* ChipIO flag related functions. */
-static void chipio_flag_set(struct ca0132_data *data)
-{
-	struct hda_verb *verb = &data->cur_verb;
-	uint32_t flag, val;
+	if (filter_parse_value(filter, field, &op->val[0]))
+		return;
+
+	if (!filter_accept(filter, ",")) {
+		filter_error(filter, "expected ','");
+		return;
+	}
 
-	flag = verb->data & 0x7f;
-	val = (verb->data >> 7) & 0x1;
+	if (filter_parse_value(filter, field, &op->val[1]))
+		return;
 
-	printf("0x%06x: Flag %s (%d), set %d.\n", data->cur_addr - 0x4,
-			chipio_get_flag_str(flag), flag, val);
+	if (!filter_accept(filter, "]"))
+		filter_error(filter, "expected ']'");
 }
 
-/* ChipIO param related functions. */
-static void chipio_param_extract(struct ca0132_data *data)
+static void filter_parse_unary(struct event_filter *filter)
 {
-	struct hda_verb *verb = &data->cur_verb;
-	uint32_t param, val;
-
-	param = verb->data & 0x1f;
-	val = (verb->data >> 5);
-
-	printf("0x%06x: Param %s (%d), set %d.\n", data->cur_addr - 0x4,
-			chipio_get_param_str(param), param, val);
+	if (filter_accept(filter, "!") ) {
+		filter_parse_unary(filter);
+		filter_add_op(filter, FILTER_OP_NOT);
+	} else if (filter_accept(filter, "(")) {
+		filter_parse_expr(filter);
+		if (!filter_accept(filter, ")"))
+			filter_error(filter, "expected ')'");
+	} else {
+		filter_parse_compare(filter);
+	}
 }
 
-static void chipio_param_write(struct ca0132_data *data)
+static void filter_parse_and(struct event_filter *filter)
 {
-	struct chipio_data *chipio_data = &data->chipio_data;
-	struct hda_verb *verb = &data->cur_verb;
+	filter_parse_unary(filter);
+	while (!filter->err && filter_accept(filter, "&&")) {
+		filter_parse_unary(filter);
+		filter_add_op(filter, FILTER_OP_AND);
+	}
+}
 
-	printf("0x%06x: Param %s (%d), set 0x%02x.\n", chipio_data->param_addr,
-			chipio_get_param_str(chipio_data->param), chipio_data->param, verb->data);
+static void filter_parse_expr(struct event_filter *filter)
+{
+	filter_parse_and(filter);
+	while (!filter->err && filter_accept(filter, "||")) {
+		filter_parse_and(filter);
+		filter_add_op(filter, FILTER_OP_OR);
+	}
 }
 
-static void chipio_param_get(struct ca0132_data *data)
+static int filter_compile(struct event_filter *filter, const char *str)
 {
-	struct hda_verb *verb = &data->cur_verb;
+	memset(filter, 0, sizeof(*filter));
+	filter->str = filter->pos = str;
 
-	printf("0x%06x: Get param %s (%d).\n", data->cur_addr - 0x4,
-			chipio_get_param_str(verb->data), verb->data);
+	filter_parse_expr(filter);
+	filter_skip_space(filter);
+	if (*filter->pos)
+		filter_error(filter, "unexpected text");
+
+	return filter->err;
 }
 
-/* ChipIO HIC related functions. */
-static void chipio_hic_clear(struct chipio_data *data)
+/*
+ * Event sinks. Text is the usual human readable listing, JSON Lines has one
+ * object per event, and binary is a stream of fixed size records each
+ * followed by a variable length payload, see struct event_record.
+ */
+#define EVENT_STREAM_MAGIC   "CA0132EV"
+#define EVENT_STREAM_VERSION 1
+
+#define EVENT_RECORD_MARKED  0x01
+#define EVENT_RECORD_ABORTED 0x02
+
+struct event_stream_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+};
+
+/*
+ * Payload is the SCP header word followed by its values for SCP events,
+ * and the data bytes for 8051 runs. For SCP events, val is the count of
+ * values received if it was aborted.
+ */
+struct event_record {
+	uint8_t type;
+	uint8_t flags;
+	uint16_t reserved;
+	uint32_t payload_len;
+	uint64_t offset;
+	uint32_t frame;
+	uint32_t addr;
+	uint32_t val;
+	uint32_t reserved1;
+};
+
+struct event_sink {
+	const char *name;
+	void (*begin)(FILE *out);
+	void (*write)(FILE *out, const struct frame_event *ev);
+	/* Called between discontiguous windows of decoded frames. */
+	void (*window_break)(FILE *out);
+};
+
+static void text_sink_write(FILE *out, const struct frame_event *ev)
 {
-	memset(data->addr_set, 0, sizeof(data->addr_set) * 2);
-	memset(data->data_set, 0, sizeof(data->data_set) * 2);
-	data->chipio_addr = data->chipio_data = 0;
-	data->addr_set_start = 0;
-	data->read_set = 0;
+	print_event_text(out, ev);
 }
 
-static uint8_t chipio_hic_complete(struct chipio_data *data)
+static void text_sink_window_break(FILE *out)
 {
-	return ((data->addr_set[0] && data->addr_set[1])
-			&& (data->data_set[0] && data->data_set[1]));
+	fprintf(out, "--\n");
 }
 
-static uint8_t chipio_hic_complete_read(struct chipio_data *data)
+static void json_print_field(FILE *out, const struct frame_event *ev, const char *name,
+		uint32_t field)
 {
-	return ((data->addr_set[0] && data->addr_set[1])
-			&& data->read_set);
+	uint64_t val;
+
+	if (get_event_field(ev, field, &val))
+		fprintf(out, ",\"%s\":%lu", name, (unsigned long)val);
 }
 
-static void chipio_hic_check(struct chipio_data *data)
+static void json_sink_write(FILE *out, const struct frame_event *ev)
 {
-	if (chipio_hic_complete(data)) {
-		printf("0x%06x: HIC Addr 0x%06x, Data 0x%08x.\n", data->addr_set_start,
-			data->chipio_addr, data->chipio_data);
+	const struct scp_data *scp = ev->scp;
+	const struct hda_verb_info *verb_info;
+	const struct scp_cmd_info *scp_info;
+	const char *name = NULL;
+	uint32_t i;
 
-		chipio_hic_clear(data);
+	fprintf(out, "{\"type\":\"%s\",\"offset\":%lu,\"codec\":%u,\"node\":%u,\"verb\":%u,\"data\":%u",
+			event_type_str[ev->type], (unsigned long)ev->offset,
+			ev->verb.codec, ev->verb.node, ev->verb.verb, ev->verb.data);
+	if (ev->marked)
+		fprintf(out, ",\"marked\":true");
+
+	json_print_field(out, ev, "addr", FIELD_ADDR);
+	json_print_field(out, ev, "val", FIELD_VAL);
+
+	switch (ev->type) {
+	case EVENT_VERB:
+		if (ev->verb.node != 0x15 && ev->verb.node != 0x16) {
+			verb_info = find_verb_info(&ev->verb);
+			if (verb_info)
+				name = verb_info->name;
+		}
+		break;
+	case EVENT_FLAG_SET:
+		name = chipio_get_flag_str(ev->addr);
+		break;
+	case EVENT_PARAM_SET:
+	case EVENT_PARAM_EX_SET:
+	case EVENT_PARAM_GET:
+		name = chipio_get_param_str(ev->addr);
+		break;
+	case EVENT_SCP:
+		fprintf(out, ",\"mid\":%u,\"src\":%u,\"req\":%u,\"size\":%u,\"get\":%u,\"err\":%u,\"resp\":%u,\"dev\":%u",
+				scp->target_id, scp->source_id, scp->req,
+				scp->data_size, scp->get_flag, scp->error_flag,
+				scp->resp_flag, scp->device_flag);
+		if (ev->aborted)
+			fprintf(out, ",\"aborted\":%u", ev->cnt);
+
+		fprintf(out, ",\"vals\":[");
+		for (i = 0; i < scp->data_size; i++)
+			fprintf(out, "%s%u", i ? "," : "", scp->val[i]);
+		fputc(']', out);
+
+		scp_info = dsp_get_scp_cmd_info(scp->target_id, scp->req);
+		if (scp_info)
+			name = scp_info->name;
+		break;
+	case EVENT_8051_RUN:
+		fprintf(out, ",\"len\":%u,\"bytes\":\"", ev->len);
+		for (i = 0; i < ev->len; i++)
+			fprintf(out, "%02x", ev->buf[i]);
+		fputc('"', out);
+		break;
 	}
+
+	if (name)
+		fprintf(out, ",\"name\":\"%s\"", name);
+
+	fprintf(out, "}\n");
 }
 
-static void chipio_hic_check_read(struct chipio_data *data)
+static void binary_sink_begin(FILE *out)
 {
-	if (chipio_hic_complete_read(data)) {
-		printf("0x%06x: Readback HIC Addr 0x%06x.\n", data->addr_set_start,
-			data->chipio_addr);
+	struct event_stream_hdr hdr;
 
-		chipio_hic_clear(data);
-	}
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, EVENT_STREAM_MAGIC, sizeof(hdr.magic));
+	hdr.version = EVENT_STREAM_VERSION;
+	hdr.record_size = sizeof(struct event_record);
+	fwrite(&hdr, sizeof(hdr), 1, out);
 }
 
-
-static void chipio_hic_handler(struct ca0132_data *data)
+static void binary_sink_write(FILE *out, const struct frame_event *ev)
 {
-	struct chipio_data *chipio_data = &data->chipio_data;
-	struct hda_verb *verb = &data->cur_verb;
-	uint32_t tmp;
+	const struct hda_verb *verb = &ev->verb;
+	struct event_record rec;
+	struct scp_data scp;
+	uint32_t header;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.type = ev->type;
+	rec.offset = ev->offset;
+	rec.frame = (verb->codec << 28) | (verb->node << 20) | (verb->verb << 8) | verb->data;
+	rec.addr = ev->addr;
+	rec.val = ev->val;
+	if (ev->marked)
+		rec.flags |= EVENT_RECORD_MARKED;
+
+	switch (ev->type) {
+	case EVENT_SCP:
+		if (ev->aborted) {
+			rec.flags |= EVENT_RECORD_ABORTED;
+			rec.val = ev->cnt;
+		}
 
-	tmp = (verb->verb >> 8) & 0xf;
-	switch (tmp) {
-	case 0x0:
-		chipio_hic_clear(chipio_data);
-		chipio_data->addr_set_start = data->cur_addr - 0x4;
-		chipio_data->chipio_addr = extract_16_bit_data(verb);
-		chipio_data->addr_set[0] = 1;
-		break;
-	case 0x1:
-		chipio_data->chipio_addr |= (extract_16_bit_data(verb) << 16);
-		chipio_data->addr_set[1] = 1;
+		rec.payload_len = (ev->scp->data_size + 1) * sizeof(uint32_t);
+		fwrite(&rec, sizeof(rec), 1, out);
 
+		scp = *ev->scp;
+		header = create_scp_header(&scp);
+		fwrite(&header, sizeof(header), 1, out);
+		fwrite(scp.val, sizeof(uint32_t), scp.data_size, out);
 		break;
-	case 0x3:
-		chipio_data->chipio_data = extract_16_bit_data(verb);
-		chipio_data->data_set[0] = 1;
+	case EVENT_8051_RUN:
+		rec.payload_len = ev->len;
+		fwrite(&rec, sizeof(rec), 1, out);
+		fwrite(ev->buf, 1, ev->len, out);
 		break;
-	case 0x4:
-		chipio_data->chipio_data |= (extract_16_bit_data(verb) << 16);
-		chipio_data->data_set[1] = 1;
+	default:
+		fwrite(&rec, sizeof(rec), 1, out);
 		break;
 	}
-
-	chipio_hic_check(chipio_data);
 }
 
-/* ChipIO 8051 related functions. */
-static void chipio_8051_direct_write(struct ca0132_data *data)
+static const struct event_sink event_sinks[] = {
+	{ .name = "text",   .write = text_sink_write,
+	  .window_break = text_sink_window_break },
+	{ .name = "json",   .write = json_sink_write },
+	{ .name = "binary", .begin = binary_sink_begin, .write = binary_sink_write },
+};
+
+static const struct event_sink *find_event_sink(const char *name)
 {
-	struct hda_verb *verb = &data->cur_verb;
+	uint32_t i;
 
-	printf("0x%06x: 8051 write direct addr 0x%02x, value 0x%02x.\n", data->cur_addr - 0x4,
-		       	verb->data, verb->verb & 0xff);
+	if (!name)
+		return &event_sinks[0];
+
+	for (i = 0; i < ARRAY_SIZE(event_sinks); i++) {
+		if (!strcmp(event_sinks[i].name, name))
+			return &event_sinks[i];
+	}
+
+	return NULL;
 }
 
-static void chipio_8051_data_clear(struct chipio_data *data)
+static void emit_window_break(struct ca0132_data *data)
 {
-	data->u_8051_addr_set[0] = data->u_8051_addr_set[1] = 0;
-	data->u_8051_data_set = data->u_8051_pll_set = 0;
-	data->u_8051_addr = data->u_8051_data = 0;
-	data->u_8051_addr_set_start = 0;
-	data->u_8051_data_run_len = 0;
-	memset(data->u_8051_data_run, 0, 128);
+	if (data->sink->window_break)
+		data->sink->window_break(data->out);
 }
 
-static uint8_t chipio_8051_complete_addr(struct chipio_data *data)
+/*
+ * Statistics mode. Instead of writing out events, counts frames per
+ * node/verb, SCP commands per target ID/request, HIC accesses per address
+ * region and 8051 writes, along with histograms of how long runs of the
+ * same verb and 8051 data runs are.
+ */
+#define STATS_NODE_CNT     0x80
+#define STATS_VERB_CNT     0x1000
+#define STATS_HIST_BUCKETS 20
+#define STATS_MAX_VERBS    64
+
+static const struct {
+	const char *name;
+	uint32_t start, end;
+} hic_regions[] = {
+	{ "DSP0 audio ring in",  AUDIORINGIPDSP0_START,        AUDIORINGIPDSP0_END + 4 },
+	{ "DSP0 audio ring out", AUDIORINGOPDSP0_START,        AUDIORINGOPDSP0_END + 4 },
+	{ "DSP0 param ring",     AUDPARARINGIODSP0_START,      AUDPARARINGIODSP0_END + 4 },
+	{ "DSP0 control regs",   DSP0LOCALHWREG_START,         DMADSPBASEADDRREG_STARTDSP0 },
+	{ "DSP0 DMA regs",       DMADSPBASEADDRREG_STARTDSP0,  DSP0XGPRAM_START },
+	{ "DSP0 X GPRAM",        DSP0XGPRAM_START,             DSP0XGPRAM_END + 4 },
+	{ "DSP0 Y GPRAM",        DSP0YGPRAM_START,             DSP0YGPRAM_END + 4 },
+	{ "DSP chip",            DSP_CHIP_START_ADDRESS,       DSP_CHIP_END_ADDRESS },
+	{ "DSP DMA config",      DSP_DMA_CONFIG_START_ADDRESS, DSP_DMA_CONFIG_END_ADDRESS },
+	{ "XRAM",                XRAM_START_ADDRESS,           XRAM_END_ADDRESS },
+	{ "AXRAM",               AXRAM_START_ADDRESS,          AXRAM_END_ADDRESS },
+	{ "YRAM",                YRAM_START_ADDRESS,           YRAM_END_ADDRESS },
+	{ "AYRAM",               AYRAM_START_ADDRESS,          AYRAM_END_ADDRESS },
+	{ "UC chip",             UC_CHIP_START_ADDRESS,        UC_CHIP_END_ADDRESS },
+	{ "Other",               0,                            0xffffffff },
+};
+
+struct frame_stats {
+	uint64_t frame_cnt;
+	uint64_t codec_frames[0x10];
+	uint64_t node_verb[STATS_NODE_CNT][STATS_VERB_CNT];
+
+	uint64_t scp[0x100][0x80];
+	uint64_t scp_vals, scp_aborted, scp_bad_format;
+
+	uint64_t hic_writes[ARRAY_SIZE(hic_regions)];
+	uint64_t hic_reads[ARRAY_SIZE(hic_regions)];
+
+	uint64_t u_8051_runs, u_8051_bytes, u_8051_longest_run;
+	uint64_t u_8051_direct_writes, u_8051_reads, u_8051_stray_writes;
+	uint64_t pll_pmu_writes;
+
+	/* Log2 buckets of run lengths. */
+	uint64_t verb_run_hist[STATS_HIST_BUCKETS];
+	uint64_t u_8051_run_hist[STATS_HIST_BUCKETS];
+	uint32_t prev_verb_key;
+	uint64_t verb_run;
+};
+
+/* Only verbs with 12-bit IDs keep their low byte, like find_verb_info(). */
+static uint32_t stats_get_verb_key(const struct hda_verb *verb)
 {
-	return data->u_8051_addr_set[0] && data->u_8051_addr_set[1];
+	uint32_t tmp = verb->verb >> 8;
+
+	if (tmp != 0x7 && tmp != 0xf)
+		return verb->verb & 0xf00;
+
+	return verb->verb;
 }
 
-static void chipio_8051_print_data_run(struct chipio_data *data)
+static void stats_add_hist(uint64_t *hist, uint64_t len)
 {
-	uint32_t i;
+	uint32_t bucket = 0;
+
+	while (len > 1 && bucket < STATS_HIST_BUCKETS - 1) {
+		len >>= 1;
+		bucket++;
+	}
 
-	printf("0x%06x: 8051_addr_start 0x%04x:\n", data->u_8051_addr_set_start, data->u_8051_addr);
-	for (i = 0; i < data->u_8051_data_run_len; ++i)
-		printf("Data: 0x%02x.\n", data->u_8051_data_run[i]);
+	hist[bucket]++;
 }
 
-static void chipio_8051_print_read(struct chipio_data *data)
+static void stats_add_frame(struct frame_stats *stats, struct ca0132_data *data)
 {
-	printf("0x%06x: 8051_addr_read 0x%04x.\n", data->u_8051_addr_set_start, data->u_8051_addr);
+	struct hda_verb *verb = &data->cur_verb;
+	uint32_t key;
+
+	stats->frame_cnt++;
+	stats->codec_frames[verb->codec]++;
+	if (verb->codec != data->main_codec_id)
+		return;
+
+	key = stats_get_verb_key(verb);
+	stats->node_verb[verb->node][key]++;
+
+	key |= verb->node << 12;
+	if (stats->verb_run && key == stats->prev_verb_key) {
+		stats->verb_run++;
+		return;
+	}
+
+	if (stats->verb_run)
+		stats_add_hist(stats->verb_run_hist, stats->verb_run);
+
+	stats->prev_verb_key = key;
+	stats->verb_run = 1;
 }
 
-static void chipio_8051_handler(struct ca0132_data *data)
+static uint32_t get_hic_region(uint32_t addr)
 {
-	struct chipio_data *chipio_data = &data->chipio_data;
-	struct hda_verb *verb = &data->cur_verb;
+	uint32_t i;
 
-	if (verb->verb != VENDOR_CHIPIO_8051_DATA_WRITE && chipio_data->u_8051_data_run_len)
-	{
-		chipio_8051_print_data_run(chipio_data);
-		chipio_8051_data_clear(chipio_data);
+	for (i = 0; i < ARRAY_SIZE(hic_regions) - 1; i++) {
+		if (addr >= hic_regions[i].start && addr < hic_regions[i].end)
+			break;
 	}
 
-	switch (verb->verb) {
-	case VENDOR_CHIPIO_8051_ADDRESS_LOW:
-		chipio_data->u_8051_addr_set_start = data->cur_addr - 0x4;
-		chipio_data->u_8051_addr = verb->data;
-		chipio_data->u_8051_addr_set[0] = 1;
+	return i;
+}
 
+static void stats_add_event(struct frame_stats *stats, const struct frame_event *ev)
+{
+	switch (ev->type) {
+	case EVENT_SCP:
+		stats->scp[ev->scp->target_id][ev->scp->req]++;
+		stats->scp_vals += ev->scp->data_size;
+		if (ev->aborted)
+			stats->scp_aborted++;
 		break;
-	case VENDOR_CHIPIO_8051_ADDRESS_HIGH:
-		if (chipio_data->u_8051_addr_set[0]) {
-			chipio_data->u_8051_addr |= (verb->data << 8);
-			chipio_data->u_8051_addr_set[1] = 1;
-		} else {
-			chipio_8051_data_clear(chipio_data);
-		}
+	case EVENT_SCP_BAD_FORMAT:
+		stats->scp_bad_format++;
 		break;
-	case VENDOR_CHIPIO_8051_DATA_WRITE:
-		if (chipio_8051_complete_addr(chipio_data))
-		{
-			chipio_data->u_8051_addr_set[0] = chipio_data->u_8051_addr_set[1] = 0;
-			chipio_data->u_8051_data_run[chipio_data->u_8051_data_run_len++] = verb->data;
-		} else if (chipio_data->u_8051_data_run_len) {
-			chipio_data->u_8051_data_run[chipio_data->u_8051_data_run_len++] = verb->data;
-		} else {
-			printf("random 8051 data write!\n");
-			print_cur_verb(data);
-		}
-
+	case EVENT_HIC_WRITE:
+		stats->hic_writes[get_hic_region(ev->addr)]++;
 		break;
-	case VENDOR_CHIPIO_PLL_PMU_WRITE:
-		if (chipio_data->u_8051_addr_set[0])
-		{
-			printf("0x%06x: PLL PMU write addr 0x%02x, data 0x%02x.\n",
-					chipio_data->u_8051_addr_set_start,
-					chipio_data->u_8051_addr, verb->data);
-		} else {
-			print_cur_verb(data);
-		}
-
-		chipio_8051_data_clear(chipio_data);
+	case EVENT_HIC_READ:
+		stats->hic_reads[get_hic_region(ev->addr)]++;
+		break;
+	case EVENT_8051_RUN:
+		stats->u_8051_runs++;
+		stats->u_8051_bytes += ev->len;
+		if (ev->len > stats->u_8051_longest_run)
+			stats->u_8051_longest_run = ev->len;
 
+		stats_add_hist(stats->u_8051_run_hist, ev->len);
 		break;
-	case VENDOR_CHIPIO_8051_DATA_READ:
-		if (chipio_8051_complete_addr(chipio_data)) {
-			chipio_8051_print_read(chipio_data);
-			chipio_8051_data_clear(chipio_data);
-		} else {
+	case EVENT_8051_DIRECT_WRITE:
+		stats->u_8051_direct_writes++;
+		break;
+	case EVENT_8051_READ:
+		stats->u_8051_reads++;
+		break;
+	case EVENT_8051_STRAY_WRITE:
+		stats->u_8051_stray_writes++;
+		break;
+	case EVENT_PLL_PMU_WRITE:
+		stats->pll_pmu_writes++;
+		break;
+	}
+}
+
+struct stats_entry {
+	uint64_t cnt;
+	uint32_t a, b;
+};
+
+static int stats_entry_cmp(const void *a, const void *b)
+{
+	const struct stats_entry *ea = a, *eb = b;
+
+	if (ea->cnt != eb->cnt)
+		return (ea->cnt < eb->cnt) ? 1 : -1;
+
+	if (ea->a != eb->a)
+		return (ea->a < eb->a) ? -1 : 1;
+
+	return (ea->b < eb->b) ? -1 : (ea->b > eb->b);
+}
+
+static void print_stats_hist(FILE *out, const char *name, const uint64_t *hist)
+{
+	char label[32];
+	uint32_t i;
+
+	fprintf(out, "\n%s:\n", name);
+	for (i = 0; i < STATS_HIST_BUCKETS; i++) {
+		if (!hist[i])
+			continue;
+
+		if (!i)
+			sprintf(label, "1");
+		else if (i == STATS_HIST_BUCKETS - 1)
+			sprintf(label, "%lu+", 1UL << i);
+		else
+			sprintf(label, "%lu-%lu", 1UL << i, (2UL << i) - 1);
+
+		fprintf(out, "  %15s: %lu\n", label, (unsigned long)hist[i]);
+	}
+}
+
+static void print_frame_stats(FILE *out, struct frame_stats *stats,
+		struct ca0132_data *data)
+{
+	const struct hda_verb_info *verb_info;
+	const struct scp_cmd_info *scp_info;
+	struct stats_entry *entries;
+	uint64_t node_cnt[STATS_NODE_CNT];
+	uint64_t main_frames, cnt, i, j;
+	struct hda_verb verb;
+
+	if (stats->verb_run)
+		stats_add_hist(stats->verb_run_hist, stats->verb_run);
+
+	main_frames = stats->codec_frames[data->main_codec_id];
+	fprintf(out, "%lu frames, %lu for main codec 0x%02x.\n",
+			(unsigned long)stats->frame_cnt, (unsigned long)main_frames,
+			data->main_codec_id);
+	for (i = 0; i < 0x10; i++) {
+		if (stats->codec_frames[i] && i != data->main_codec_id)
+			fprintf(out, "Codec 0x%02lx: %lu frames, not decoded.\n", (unsigned long)i,
+					(unsigned long)stats->codec_frames[i]);
+	}
+
+	entries = malloc(STATS_NODE_CNT * STATS_VERB_CNT * sizeof(*entries));
+	memset(node_cnt, 0, sizeof(node_cnt));
+	cnt = 0;
+	for (i = 0; i < STATS_NODE_CNT; i++) {
+		for (j = 0; j < STATS_VERB_CNT; j++) {
+			if (!stats->node_verb[i][j])
+				continue;
+
+			node_cnt[i] += stats->node_verb[i][j];
+			entries[cnt].cnt = stats->node_verb[i][j];
+			entries[cnt].a = i;
+			entries[cnt].b = j;
+			cnt++;
+		}
+	}
+
+	fprintf(out, "\nFrames per node:\n");
+	for (i = 0; i < STATS_NODE_CNT; i++) {
+		if (node_cnt[i])
+			fprintf(out, "  node 0x%02lx: %10lu (%5.1f%%)\n", (unsigned long)i,
+					(unsigned long)node_cnt[i], 100.0 * node_cnt[i] / main_frames);
+	}
+
+	qsort(entries, cnt, sizeof(*entries), stats_entry_cmp);
+	fprintf(out, "\nFrames per node/verb:\n");
+	for (i = 0; i < cnt && i < STATS_MAX_VERBS; i++) {
+		memset(&verb, 0, sizeof(verb));
+		verb.node = entries[i].a;
+		verb.verb = entries[i].b;
+		verb_info = NULL;
+		if (verb.node != 0x15 && verb.node != 0x16)
+			verb_info = find_verb_info(&verb);
+
+		fprintf(out, "  node 0x%02x, verb 0x%03x: %10lu (%5.1f%%)%s%s\n",
+				verb.node, verb.verb, (unsigned long)entries[i].cnt,
+				100.0 * entries[i].cnt / main_frames,
+				verb_info ? " " : "", verb_info ? verb_info->name : "");
+	}
+
+	if (cnt > STATS_MAX_VERBS)
+		fprintf(out, "  %lu more.\n", (unsigned long)(cnt - STATS_MAX_VERBS));
+
+	cnt = 0;
+	for (i = 0; i < 0x100; i++) {
+		for (j = 0; j < 0x80; j++) {
+			if (!stats->scp[i][j])
+				continue;
+
+			entries[cnt].cnt = stats->scp[i][j];
+			entries[cnt].a = i;
+			entries[cnt].b = j;
+			cnt++;
+		}
+	}
+
+	qsort(entries, cnt, sizeof(*entries), stats_entry_cmp);
+	fprintf(out, "\nSCP commands (%lu values, %lu aborted, %lu badly formatted):\n",
+			(unsigned long)stats->scp_vals, (unsigned long)stats->scp_aborted,
+			(unsigned long)stats->scp_bad_format);
+	for (i = 0; i < cnt; i++) {
+		scp_info = dsp_get_scp_cmd_info(entries[i].a, entries[i].b);
+		fprintf(out, "  mid 0x%02x, req 0x%02x: %10lu%s%s\n", entries[i].a,
+				entries[i].b, (unsigned long)entries[i].cnt,
+				scp_info ? " " : "", scp_info ? scp_info->name : "");
+	}
+
+	free(entries);
+
+	fprintf(out, "\nHIC accesses:\n");
+	fprintf(out, "  %-20s %10s %10s\n", "region", "writes", "reads");
+	for (i = 0; i < ARRAY_SIZE(hic_regions); i++) {
+		if (stats->hic_writes[i] || stats->hic_reads[i])
+			fprintf(out, "  %-20s %10lu %10lu\n", hic_regions[i].name,
+					(unsigned long)stats->hic_writes[i],
+					(unsigned long)stats->hic_reads[i]);
+	}
+
+	fprintf(out, "\n8051:\n");
+	fprintf(out, "  %lu data runs, %lu bytes, longest %lu.\n",
+			(unsigned long)stats->u_8051_runs, (unsigned long)stats->u_8051_bytes,
+			(unsigned long)stats->u_8051_longest_run);
+	fprintf(out, "  %lu direct writes, %lu reads, %lu PLL PMU writes, %lu stray writes.\n",
+			(unsigned long)stats->u_8051_direct_writes,
+			(unsigned long)stats->u_8051_reads, (unsigned long)stats->pll_pmu_writes,
+			(unsigned long)stats->u_8051_stray_writes);
+
+	print_stats_hist(out, "Repeated verb run lengths", stats->verb_run_hist);
+	print_stats_hist(out, "8051 data run lengths", stats->u_8051_run_hist);
+}
+
+/*
+ * Write an 8051 data run out to its own file in the run directory, named
+ * by exram start address and capture offset.
+ */
+static void write_8051_run(struct ca0132_data *data, const struct frame_event *ev)
+{
+	char *file_name;
+	FILE *file;
+	int ret;
+
+	file_name = malloc(strlen(data->run_dir) + 32);
+	if (!file_name) {
+		fprintf(stderr, "Failed to allocate 8051 data run file name.\n");
+		data->run_dir = NULL;
+		return;
+	}
+
+	sprintf(file_name, "%s/0x%04x-0x%06lx.bin", data->run_dir, ev->addr,
+			(unsigned long)ev->offset);
+
+	file = fopen(file_name, "wb");
+	ret = !file;
+	if (file) {
+		ret = fwrite(ev->buf, 1, ev->len, file) != ev->len;
+		ret |= fclose(file);
+	}
+
+	if (ret) {
+		fprintf(stderr, "Failed to write 8051 data run %s.\n", file_name);
+		data->run_dir = NULL;
+	}
+
+	free(file_name);
+}
+
+static void emit_event(struct ca0132_data *data, struct frame_event *ev)
+{
+	if (data->quiet || (data->filter && !filter_match(data->filter, ev)))
+		return;
+
+	if (ev->type == EVENT_8051_RUN && data->run_dir)
+		write_8051_run(data, ev);
+
+	if (data->stats)
+		stats_add_event(data->stats, ev);
+	else
+		data->sink->write(data->out, ev);
+}
+
+static void print_cur_verb(struct ca0132_data *data)
+{
+	struct frame_event ev;
+
+	event_init(&ev, EVENT_VERB, data, data->cur_addr - 0x4);
+	emit_event(data, &ev);
+}
+
+static void print_scp_write_data(struct ca0132_data *data, uint8_t aborted)
+{
+	struct dsp_data *dsp_data = &data->dsp_data;
+	struct frame_event ev;
+
+	event_init(&ev, EVENT_SCP, data, dsp_data->scp_start_addr);
+	ev.scp = &dsp_data->scp_data;
+	ev.aborted = aborted;
+	ev.cnt = dsp_data->cur_data_cnt;
+	emit_event(data, &ev);
+}
+
+static void print_scp_bad_format(struct ca0132_data *data)
+{
+	struct frame_event ev;
+
+	event_init(&ev, EVENT_SCP_BAD_FORMAT, data, data->cur_addr - 0x4);
+	emit_event(data, &ev);
+}
+
+static uint16_t extract_16_bit_data(struct hda_verb *verb)
+{
+	return ((verb->verb & 0xff) << 8) | verb->data;
+}
+
+static void dsp_scp_clear(struct dsp_data *data)
+{
+	memset(data, 0, sizeof(*data));
+}
+
+static uint8_t dsp_scp_set(struct dsp_data *data)
+{
+	return data->scp_set[0] && data->scp_set[1];
+}
+
+static void dsp_scp_read_check(struct ca0132_data *data)
+{
+	if (data->dsp_data.scp_read_data_set_cnt == 4 && data->dsp_data.scp_post_read_cnt == 2)
+	{
+		print_scp_write_data(data, 0);
+		dsp_scp_clear(&data->dsp_data);
+	}
+}
+
+static void dsp_scp_write_check(struct ca0132_data *data)
+{
+	print_scp_write_data(data, 0);
+	dsp_scp_clear(&data->dsp_data);
+}
+
+static void dsp_scp_check(struct ca0132_data *data)
+{
+	struct dsp_data *dsp_data = &data->dsp_data;
+
+	if (dsp_scp_set(dsp_data)) {
+		if (dsp_data->cur_data_cnt == dsp_data->scp_data.data_size) {
+			if (dsp_data->scp_data.get_flag)
+				dsp_scp_read_check(data);
+			else
+				dsp_scp_write_check(data);
+		}
+	}
+}
+
+static void dsp_scp_handler(struct ca0132_data *data)
+{
+	struct hda_verb *verb = &data->cur_verb;
+	struct dsp_data *dsp_data = &data->dsp_data;
+	uint32_t tmp, tmp1;
+
+	tmp =  verb->verb & 0xf00;
+	switch (tmp) {
+	case VENDOR_DSPIO_SCP_WRITE_DATA_LOW:
+		if (!dsp_scp_set(dsp_data)) {
+			if (dsp_data->scp_set[0])
+			{
+				print_scp_bad_format(data);
+				dsp_scp_clear(dsp_data);
+				break;
+			}
+			dsp_scp_clear(dsp_data);
+			dsp_data->scp_start_addr = data->cur_addr - 0x4;
+			tmp1 = verb->data;
+			tmp1 |= (verb->verb & 0xff) << 8;
+			dsp_data->scp = tmp1;
+			dsp_data->scp_set[0] = 1;
+		} else if (dsp_data->scp_data.data_size != dsp_data->cur_data_cnt) {
+			dsp_data->scp_data_set[0] = dsp_data->scp_data_set[1] = 0;
+			tmp1 = verb->data;
+			tmp1 |= (verb->verb & 0xff) << 8;
+			dsp_data->data = tmp1;
+			dsp_data->scp_data_set[0] = 1;
+		} else {
+			print_scp_write_data(data, 1);
+			dsp_scp_clear(dsp_data);
+			dsp_data->scp_start_addr = data->cur_addr - 0x4;
+			tmp1 = verb->data;
+			tmp1 |= (verb->verb & 0xff) << 8;
+			dsp_data->scp = tmp1;
+			dsp_data->scp_set[0] = 1;
+		}
+		break;
+
+	case VENDOR_DSPIO_SCP_WRITE_DATA_HIGH:
+		if (!dsp_scp_set(dsp_data)) {
+			if (!dsp_data->scp_set[0])
+			{
+				print_scp_bad_format(data);
+				dsp_scp_clear(dsp_data);
+				break;
+			}
+			tmp1 = verb->data;
+			tmp1 |= (verb->verb & 0xff) << 8;
+			dsp_data->scp |= (tmp1 << 16);
+			dsp_data->scp_set[1] = 1;
+			get_scp_data(&dsp_data->scp_data, dsp_data->scp);
+			if (dsp_data->scp_data.data_size >= 4) {
+				print_scp_bad_format(data);
+				dsp_scp_clear(dsp_data);
+				break;
+			}
+		} else if (dsp_data->scp_data.data_size != dsp_data->cur_data_cnt) {
+			if (!dsp_data->scp_data_set[0])
+			{
+				print_scp_bad_format(data);
+				dsp_scp_clear(dsp_data);
+			}
+			tmp1 = verb->data;
+			tmp1 |= (verb->verb & 0xff) << 8;
+			dsp_data->data |= (tmp1 << 16);
+			dsp_data->scp_data_set[1] = 1;
+			if (dsp_data->cur_data_cnt >= 15)
+				break;
+
+			dsp_data->scp_data.val[dsp_data->cur_data_cnt++] = dsp_data->data;
+		}
+
+		break;
+	default:
+		break;
+	}
+
+	dsp_scp_check(data);
+}
+
+static void dsp_verb_handler(struct ca0132_data *data)
+{
+	struct hda_verb *verb = &data->cur_verb;
+	uint32_t tmp;
+
+	tmp = (verb->verb >> 8) & 0xf;
+
+	switch (tmp) {
+	case 0x0:
+	case 0x1:
+		dsp_scp_handler(data);
+		break;
+	case 0x7:
+		switch (verb->verb) {
+		case VENDOR_DSPIO_SCP_POST_READ_DATA:
+			data->dsp_data.scp_read_data_set_cnt++;
+			dsp_scp_handler(data);
+		case VENDOR_DSPIO_SCP_POST_COUNT_QUERY:
+			data->dsp_data.scp_post_read_cnt++;
+			dsp_scp_handler(data);
+			break;
+		default:
+			break;
+		}
+
+		break;
+	case 0xf:
+		switch (verb->verb) {
+		case VENDOR_DSPIO_STATUS:
+			if (dsp_scp_set(&data->dsp_data))
+				break;
+			break;
+		case VENDOR_DSPIO_SCP_READ_DATA:
+			data->dsp_data.scp_read_data_set_cnt++;
+			dsp_scp_handler(data);
+			break;
+		case VENDOR_DSPIO_SCP_READ_COUNT:
+			data->dsp_data.scp_post_read_cnt++;
+			dsp_scp_handler(data);
+			break;
+		default:
 			print_cur_verb(data);
+			break;
 		}
 		break;
+
+	default:
+		print_cur_verb(data);
+		break;
+	}
+
+}
+
+/* ChipIO flag related functions. */
+static void chipio_flag_set(struct ca0132_data *data)
+{
+	struct hda_verb *verb = &data->cur_verb;
+	struct frame_event ev;
+
+	event_init(&ev, EVENT_FLAG_SET, data, data->cur_addr - 0x4);
+	ev.addr = verb->data & 0x7f;
+	ev.val = (verb->data >> 7) & 0x1;
+	emit_event(data, &ev);
+}
+
+/* ChipIO param related functions. */
+static void chipio_param_extract(struct ca0132_data *data)
+{
+	struct hda_verb *verb = &data->cur_verb;
+	struct frame_event ev;
+
+	event_init(&ev, EVENT_PARAM_SET, data, data->cur_addr - 0x4);
+	ev.addr = verb->data & 0x1f;
+	ev.val = verb->data >> 5;
+	emit_event(data, &ev);
+}
+
+static void chipio_param_write(struct ca0132_data *data)
+{
+	struct chipio_data *chipio_data = &data->chipio_data;
+	struct frame_event ev;
+
+	event_init(&ev, EVENT_PARAM_EX_SET, data, chipio_data->param_addr);
+	ev.addr = chipio_data->param;
+	ev.val = data->cur_verb.data;
+	emit_event(data, &ev);
+}
+
+static void chipio_param_get(struct ca0132_data *data)
+{
+	struct frame_event ev;
+
+	event_init(&ev, EVENT_PARAM_GET, data, data->cur_addr - 0x4);
+	ev.addr = data->cur_verb.data;
+	emit_event(data, &ev);
+}
+
+/* ChipIO HIC related functions. */
+static void chipio_hic_clear(struct chipio_data *data)
+{
+	memset(data->addr_set, 0, sizeof(data->addr_set) * 2);
+	memset(data->data_set, 0, sizeof(data->data_set) * 2);
+	data->chipio_addr = data->chipio_data = 0;
+	data->addr_set_start = 0;
+	data->read_set = 0;
+}
+
+static uint8_t chipio_hic_complete(struct chipio_data *data)
+{
+	return ((data->addr_set[0] && data->addr_set[1])
+			&& (data->data_set[0] && data->data_set[1]));
+}
+
+static uint8_t chipio_hic_complete_read(struct chipio_data *data)
+{
+	return ((data->addr_set[0] && data->addr_set[1])
+			&& data->read_set);
+}
+
+static void chipio_hic_check(struct ca0132_data *data)
+{
+	struct chipio_data *chipio_data = &data->chipio_data;
+	struct frame_event ev;
+
+	if (chipio_hic_complete(chipio_data)) {
+		event_init(&ev, EVENT_HIC_WRITE, data, chipio_data->addr_set_start);
+		ev.addr = chipio_data->chipio_addr;
+		ev.val = chipio_data->chipio_data;
+		emit_event(data, &ev);
+
+		chipio_hic_clear(chipio_data);
+	}
+}
+
+static void chipio_hic_check_read(struct ca0132_data *data)
+{
+	struct chipio_data *chipio_data = &data->chipio_data;
+	struct frame_event ev;
+
+	if (chipio_hic_complete_read(chipio_data)) {
+		event_init(&ev, EVENT_HIC_READ, data, chipio_data->addr_set_start);
+		ev.addr = chipio_data->chipio_addr;
+		emit_event(data, &ev);
+
+		chipio_hic_clear(chipio_data);
+	}
+}
+
+
+static void chipio_hic_handler(struct ca0132_data *data)
+{
+	struct chipio_data *chipio_data = &data->chipio_data;
+	struct hda_verb *verb = &data->cur_verb;
+	uint32_t tmp;
+
+	tmp = (verb->verb >> 8) & 0xf;
+	switch (tmp) {
+	case 0x0:
+		chipio_hic_clear(chipio_data);
+		chipio_data->addr_set_start = data->cur_addr - 0x4;
+		chipio_data->chipio_addr = extract_16_bit_data(verb);
+		chipio_data->addr_set[0] = 1;
+		break;
+	case 0x1:
+		chipio_data->chipio_addr |= (extract_16_bit_data(verb) << 16);
+		chipio_data->addr_set[1] = 1;
+
+		break;
+	case 0x3:
+		chipio_data->chipio_data = extract_16_bit_data(verb);
+		chipio_data->data_set[0] = 1;
+		break;
+	case 0x4:
+		chipio_data->chipio_data |= (extract_16_bit_data(verb) << 16);
+		chipio_data->data_set[1] = 1;
+		break;
+	}
+
+	chipio_hic_check(data);
+}
+
+/* ChipIO 8051 related functions. */
+static void chipio_8051_direct_write(struct ca0132_data *data)
+{
+	struct hda_verb *verb = &data->cur_verb;
+	struct frame_event ev;
+
+	event_init(&ev, EVENT_8051_DIRECT_WRITE, data, data->cur_addr - 0x4);
+	ev.addr = verb->data;
+	ev.val = verb->verb & 0xff;
+	emit_event(data, &ev);
+}
+
+static void chipio_8051_data_clear(struct chipio_data *data)
+{
+	data->u_8051_addr_set[0] = data->u_8051_addr_set[1] = 0;
+	data->u_8051_data_set = data->u_8051_pll_set = 0;
+	data->u_8051_addr = data->u_8051_data = 0;
+	data->u_8051_addr_set_start = 0;
+	data->u_8051_data_run_len = 0;
+}
+
+/*
+ * Add a byte to the current data run, growing the run buffer as needed.
+ * Returns 1 if the buffer can't grow, leaving the run as it was.
+ */
+#define U_8051_DATA_RUN_MIN_SIZE 0x100
+static int chipio_8051_data_run_add(struct chipio_data *data, uint8_t val)
+{
+	uint32_t size;
+	uint8_t *tmp;
+
+	if (data->u_8051_data_run_len >= data->u_8051_data_run_size) {
+		if (!data->u_8051_data_run_size)
+			size = U_8051_DATA_RUN_MIN_SIZE;
+		else if (data->u_8051_data_run_size <= UINT32_MAX / 2)
+			size = data->u_8051_data_run_size * 2;
+		else
+			size = 0;
+
+		tmp = size ? realloc(data->u_8051_data_run, size) : NULL;
+		if (!tmp) {
+			fprintf(stderr, "Failed to grow 8051 data run past %u bytes, ending it early.\n",
+					data->u_8051_data_run_len);
+			return 1;
+		}
+
+		data->u_8051_data_run = tmp;
+		data->u_8051_data_run_size = size;
+	}
+
+	data->u_8051_data_run[data->u_8051_data_run_len++] = val;
+
+	return 0;
+}
+
+static uint8_t chipio_8051_complete_addr(struct chipio_data *data)
+{
+	return data->u_8051_addr_set[0] && data->u_8051_addr_set[1];
+}
+
+static void chipio_8051_print_data_run(struct ca0132_data *data)
+{
+	struct chipio_data *chipio_data = &data->chipio_data;
+	struct frame_event ev;
+
+	event_init(&ev, EVENT_8051_RUN, data, chipio_data->u_8051_addr_set_start);
+	ev.addr = chipio_data->u_8051_addr;
+	ev.buf = chipio_data->u_8051_data_run;
+	ev.len = chipio_data->u_8051_data_run_len;
+	emit_event(data, &ev);
+}
+
+/* A data run still going at the end of the capture. */
+static void chipio_8051_finish_data_run(struct ca0132_data *data)
+{
+	if (data->chipio_data.u_8051_data_run_len) {
+		chipio_8051_print_data_run(data);
+		chipio_8051_data_clear(&data->chipio_data);
+	}
+}
+
+static void chipio_8051_print_read(struct ca0132_data *data)
+{
+	struct chipio_data *chipio_data = &data->chipio_data;
+	struct frame_event ev;
+
+	event_init(&ev, EVENT_8051_READ, data, chipio_data->u_8051_addr_set_start);
+	ev.addr = chipio_data->u_8051_addr;
+	emit_event(data, &ev);
+}
+
+static void chipio_8051_handler(struct ca0132_data *data)
+{
+	struct chipio_data *chipio_data = &data->chipio_data;
+	struct hda_verb *verb = &data->cur_verb;
+	struct frame_event ev;
+
+	if (verb->verb != VENDOR_CHIPIO_8051_DATA_WRITE && chipio_data->u_8051_data_run_len)
+	{
+		chipio_8051_print_data_run(data);
+		chipio_8051_data_clear(chipio_data);
+	}
+
+	switch (verb->verb) {
+	case VENDOR_CHIPIO_8051_ADDRESS_LOW:
+		chipio_data->u_8051_addr_set_start = data->cur_addr - 0x4;
+		chipio_data->u_8051_addr = verb->data;
+		chipio_data->u_8051_addr_set[0] = 1;
+
+		break;
+	case VENDOR_CHIPIO_8051_ADDRESS_HIGH:
+		if (chipio_data->u_8051_addr_set[0]) {
+			chipio_data->u_8051_addr |= (verb->data << 8);
+			chipio_data->u_8051_addr_set[1] = 1;
+		} else {
+			chipio_8051_data_clear(chipio_data);
+		}
+		break;
+	case VENDOR_CHIPIO_8051_DATA_WRITE:
+		if (chipio_8051_complete_addr(chipio_data))
+		{
+			chipio_data->u_8051_addr_set[0] = chipio_data->u_8051_addr_set[1] = 0;
+			if (chipio_8051_data_run_add(chipio_data, verb->data))
+				chipio_8051_data_clear(chipio_data);
+		} else if (chipio_data->u_8051_data_run_len) {
+			if (chipio_8051_data_run_add(chipio_data, verb->data))
+				chipio_8051_finish_data_run(data);
+		} else {
+			event_init(&ev, EVENT_8051_STRAY_WRITE, data, data->cur_addr - 0x4);
+			emit_event(data, &ev);
+		}
+
+		break;
+	case VENDOR_CHIPIO_PLL_PMU_WRITE:
+		if (chipio_data->u_8051_addr_set[0])
+		{
+			event_init(&ev, EVENT_PLL_PMU_WRITE, data,
+					chipio_data->u_8051_addr_set_start);
+			ev.addr = chipio_data->u_8051_addr;
+			ev.val = verb->data;
+			emit_event(data, &ev);
+		} else {
+			print_cur_verb(data);
+		}
+
+		chipio_8051_data_clear(chipio_data);
+
+		break;
+	case VENDOR_CHIPIO_8051_DATA_READ:
+		if (chipio_8051_complete_addr(chipio_data)) {
+			chipio_8051_print_read(data);
+			chipio_8051_data_clear(chipio_data);
+		} else {
+			print_cur_verb(data);
+		}
+		break;
+	}
+
+	if (verb->verb != VENDOR_CHIPIO_8051_DATA_WRITE && chipio_data->u_8051_data_run_len)
+	{
+		chipio_8051_print_data_run(data);
+		chipio_8051_data_clear(chipio_data);
+	}
+}
+
+static void chipio_verb_handler(struct ca0132_data *data)
+{
+	struct chipio_data *chipio_data = &data->chipio_data;
+	struct hda_verb *verb = &data->cur_verb;
+	struct frame_event ev;
+	uint32_t tmp;
+
+	tmp = (verb->verb >> 8) & 0xf;
+
+	switch (tmp) {
+	case 0x2:
+		print_cur_verb(data);
+		break;
+
+	case 0x0:
+	case 0x1:
+	case 0x3:
+	case 0x4:
+		chipio_hic_handler(data);
+		break;
+
+	case 0x5:
+		chipio_8051_direct_write(data);
+		break;
+	case 0xd:
+		print_cur_verb(data);
+		break;
+
+	case 0x7:
+		switch (verb->verb) {
+		case VENDOR_CHIPIO_FLAG_SET:
+			chipio_flag_set(data);
+			break;
+		case VENDOR_CHIPIO_PARAM_SET:
+			chipio_param_extract(data);
+			break;
+		case VENDOR_CHIPIO_PARAM_GET:
+			chipio_param_get(data);
+			break;
+		case VENDOR_CHIPIO_PARAM_EX_ID_SET:
+			chipio_data->param_set = 1;
+			chipio_data->param = verb->data;
+			chipio_data->param_addr = data->cur_addr - 0x4;
+			break;
+		case VENDOR_CHIPIO_PARAM_EX_VALUE_SET:
+			if (chipio_data->param_set) {
+				chipio_param_write(data);
+			}
+			chipio_data->param_set = 0;
+			break;
+		case VENDOR_CHIPIO_HIC_POST_READ:
+			if (chipio_data->addr_set[0] && chipio_data->addr_set[1])
+				chipio_data->read_set = 1;
+			break;
+		case VENDOR_CHIPIO_PORT_FREE_SET:
+			count_dsp_downloads(data);
+			chipio_data->port_free_count++;
+			if (chipio_data->port_free_count == chipio_data->dsp_downloads) {
+				event_init(&ev, EVENT_DSP_DOWNLOAD_END, data, data->cur_addr - 0x4);
+				emit_event(data, &ev);
+			}
+			break;
+		case VENDOR_CHIPIO_8051_ADDRESS_LOW:
+		case VENDOR_CHIPIO_8051_ADDRESS_HIGH:
+		case VENDOR_CHIPIO_8051_DATA_WRITE:
+		case VENDOR_CHIPIO_PLL_PMU_WRITE:
+			chipio_8051_handler(data);
+			break;
+		default:
+			print_cur_verb(data);
+			break;
+		}
+		break;
+	case 0xf:
+		switch (verb->verb) {
+		case VENDOR_CHIPIO_8051_DATA_READ:
+			chipio_8051_handler(data);
+			break;
+		case VENDOR_CHIPIO_HIC_READ_DATA:
+			chipio_hic_check_read(data);
+			break;
+		case VENDOR_CHIPIO_STATUS:
+			if ((chipio_data->addr_set[0] && chipio_data->addr_set[1]) || chipio_data->param_set)
+				break;
+			else
+				print_cur_verb(data);
+			break;
+		default:
+			print_cur_verb(data);
+			break;
+		}
+		break;
+
+	default:
+		print_cur_verb(data);
+		break;
+	}
+
+}
+
+static void node_pincfg_set(struct ca0132_data *data)
+{
+	struct hda_verb *verb = &data->cur_verb;
+	struct generic_node *node = &data->nodes[verb->node];
+	struct frame_event ev;
+	uint32_t tmp, shift;
+
+	shift = verb->verb - AC_VERB_SET_CONFIG_DEFAULT_BYTES_0;
+	tmp = 0xff << (shift * 0x8);
+	node->pincfg &= ~tmp;
+
+	node->pincfg |= verb->data << (shift * 0x8);
+	node->pincfg_set |= 1 << shift;
+
+	if (verb->verb == AC_VERB_SET_CONFIG_DEFAULT_BYTES_3) {
+		if (node->pincfg_set != 0xf)
+			data->pincfg_partial_end = data->frame_pos;
+
+		event_init(&ev, EVENT_PINCFG, data, data->cur_addr - 0x4);
+		ev.val = node->pincfg;
+		emit_event(data, &ev);
+	}
+}
+
+static void node_pinctl_set(struct ca0132_data *data)
+{
+	struct hda_verb *verb = &data->cur_verb;
+	struct generic_node *node = &data->nodes[verb->node];
+	struct frame_event ev;
+
+	node->pin_ctl = verb->data;
+	node->pin_ctl_set = 1;
+	event_init(&ev, EVENT_PINCTL, data, data->cur_addr - 0x4);
+	ev.val = node->pin_ctl;
+	emit_event(data, &ev);
+}
+
+static void node_amp_set(struct ca0132_data *data)
+{
+	struct hda_verb *verb = &data->cur_verb;
+	struct frame_event ev;
+
+	event_init(&ev, EVENT_AMP, data, data->cur_addr - 0x4);
+	ev.val = verb->data | ((verb->verb & 0xff) << 8);
+	emit_event(data, &ev);
+}
+
+static void default_node_verb_handler(struct ca0132_data *data)
+{
+	struct hda_verb *verb = &data->cur_verb;
+	uint32_t tmp;
+
+	tmp = (verb->verb >> 8) & 0xf;
+
+	switch (tmp) {
+	case 0x3:
+		node_amp_set(data);
+		break;
+	case 0x7:
+		switch (verb->verb) {
+		case AC_VERB_SET_CONFIG_DEFAULT_BYTES_0:
+		case AC_VERB_SET_CONFIG_DEFAULT_BYTES_1:
+		case AC_VERB_SET_CONFIG_DEFAULT_BYTES_2:
+		case AC_VERB_SET_CONFIG_DEFAULT_BYTES_3:
+			print_cur_verb(data);
+			node_pincfg_set(data);
+			break;
+		case AC_VERB_SET_PIN_WIDGET_CONTROL:
+			node_pinctl_set(data);
+			break;
+		default:
+			print_cur_verb(data);
+			break;
+		}
+
+		break;
+	default:
+		print_cur_verb(data);
+		break;
+	}
+}
+
+/*static void check_verb(uint32_t corb_data)*/
+static void check_verb(struct ca0132_data *data)
+{
+	struct hda_verb *verb = &data->cur_verb;
+
+	switch (verb->node) {
+	case 0x16:
+		dsp_verb_handler(data);
+		break;
+
+	case 0x15:
+		chipio_verb_handler(data);
+		break;
+
+	default:
+		default_node_verb_handler(data);
+		break;
+	}
+}
+
+static void decode_cur_verb(struct ca0132_data *data)
+{
+	if (data->stats)
+		stats_add_frame(data->stats, data);
+
+	if (data->cur_verb.codec == data->main_codec_id)
+		check_verb(data);
+}
+
+static int map_frames(struct ca0132_data *data, const char *file_name)
+{
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd = open(file_name, O_RDONLY);
+	if (fd < 0)
+		return 1;
+
+	if (fstat(fd, &st)) {
+		close(fd);
+		return 1;
+	}
+
+	data->capture_st = st;
+	data->frame_cnt = st.st_size / sizeof(uint32_t);
+	data->map_size = st.st_size;
+	if (!data->frame_cnt) {
+		close(fd);
+		return 0;
+	}
+
+	map = mmap(NULL, data->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 1;
+
+	madvise(map, data->map_size, MADV_SEQUENTIAL);
+	data->frames = map;
+
+	return 0;
+}
+
+/*
+ * Sidecar index. Built in one pass over the capture the first time it's
+ * opened, and reused as long as the capture's size and modification time
+ * match. Holds:
+ * -Posting lists of the blocks of frames each codec/node/verb shows up in.
+ *  4-bit verbs are keyed only on their top nibble.
+ * -SCP transactions sent to the main codec's DSP, with their first and
+ *  last frame, target ID and request.
+ * -8051 exram write runs, with their start address and length.
+ * -Frames of each DSP download's PORT_FREE_SET, from any codec, matching
+ *  count_dsp_downloads().
+ */
+#define INDEX_MAGIC         "CA0132IX"
+#define INDEX_VERSION       1
+#define INDEX_BLOCK_FRAMES  0x400
+#define INDEX_HASH_MIN_BITS 10
+#define INDEX_SCP_GET_TAIL  8
+
+struct frame_index_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t block_frames;
+	uint64_t capture_size;
+	int64_t capture_mtime_sec;
+	int64_t capture_mtime_nsec;
+
+	uint32_t main_codec_id;
+	uint32_t key_cnt;
+	uint64_t block_cnt;
+	uint64_t scp_cnt;
+	uint64_t run_cnt;
+	uint64_t download_cnt;
+};
+
+struct frame_index_key {
+	uint32_t key;
+	uint32_t cnt;
+	uint64_t first;
+};
+
+struct frame_index_scp {
+	uint64_t start, end;
+	uint8_t mid, req, get_flag, data_size;
+	uint32_t reserved;
+};
+
+struct frame_index_run {
+	uint64_t start, end;
+	uint32_t addr, len;
+};
+
+struct frame_index {
+	struct frame_index_hdr hdr;
+	void *map;
+	size_t map_size;
+
+	struct frame_index_key *keys;
+	uint32_t *blocks;
+	struct frame_index_scp *scps;
+	struct frame_index_run *runs;
+	uint64_t *downloads;
+};
+
+/* Per key block lists while building. */
+struct index_build_key {
+	uint8_t used;
+	uint32_t key;
+	uint32_t last_block;
+	uint32_t *blocks;
+	uint32_t cnt, size;
+};
+
+/*
+ * Keys are kept in an open addressed hash table, which is doubled in size
+ * when it's 3/4 full.
+ */
+struct index_build {
+	struct index_build_key *table;
+	uint32_t hash_bits, key_cnt;
+	uint8_t err;
+	uint64_t scp_size, run_size, download_size;
+
+	/* SCP header/data tracking. */
+	uint32_t scp_state, scp_hdr, scp_words;
+	struct frame_index_scp cur_scp;
+
+	/* 8051 address/data run tracking. */
+	uint8_t addr_set[2], in_run;
+	struct frame_index_run cur_run;
+};
+
+static int index_grow(void **arr, uint64_t *size, uint64_t cnt, size_t elem_size)
+{
+	uint64_t new_size;
+	void *tmp;
+
+	if (cnt < *size)
+		return 0;
+
+	new_size = *size ? *size * 2 : 0x100;
+	tmp = realloc(*arr, new_size * elem_size);
+	if (!tmp)
+		return 1;
+
+	*arr = tmp;
+	*size = new_size;
+
+	return 0;
+}
+
+static uint32_t frame_index_get_key(uint32_t frame)
+{
+	uint32_t verb = (frame >> 8) & 0xfff;
+
+	if ((verb >> 8) != 0x7 && (verb >> 8) != 0xf)
+		verb &= 0xf00;
+
+	return (frame & (FRAME_CODEC_MASK | FRAME_NODE_MASK)) | (verb << 8);
+}
+
+static struct index_build_key *index_find_key(struct index_build_key *table,
+		uint32_t hash_bits, uint32_t key)
+{
+	uint32_t i, mask = (1 << hash_bits) - 1;
+
+	i = ((key >> 8) * 0x9e3779b1) >> (32 - hash_bits);
+	while (table[i].used && table[i].key != key)
+		i = (i + 1) & mask;
+
+	return &table[i];
+}
+
+static int index_grow_table(struct index_build *build)
+{
+	struct index_build_key *table, *ent;
+	uint32_t i, bits = build->hash_bits + 1;
+
+	table = calloc(1 << bits, sizeof(*table));
+	if (!table)
+		return 1;
+
+	for (i = 0; i < (1U << build->hash_bits); i++) {
+		if (!build->table[i].used)
+			continue;
+
+		ent = index_find_key(table, bits, build->table[i].key);
+		*ent = build->table[i];
+	}
+
+	free(build->table);
+	build->table = table;
+	build->hash_bits = bits;
+
+	return 0;
+}
+
+static void index_add_block(struct index_build *build, uint32_t key, uint32_t block)
+{
+	struct index_build_key *ent;
+	uint32_t *blocks;
+
+	ent = index_find_key(build->table, build->hash_bits, key);
+	if (!ent->used) {
+		if (build->key_cnt + 1 > (3U << build->hash_bits) / 4) {
+			if (index_grow_table(build)) {
+				build->err = 1;
+				return;
+			}
+
+			ent = index_find_key(build->table, build->hash_bits, key);
+		}
+
+		ent->used = 1;
+		ent->key = key;
+		build->key_cnt++;
+	} else if (ent->last_block == block) {
+		return;
+	}
+
+	if (ent->cnt >= ent->size) {
+		blocks = realloc(ent->blocks, (ent->size ? ent->size * 2 : 0x10) * sizeof(*blocks));
+		if (!blocks) {
+			build->err = 1;
+			return;
+		}
+
+		ent->blocks = blocks;
+		ent->size = ent->size ? ent->size * 2 : 0x10;
+	}
+
+	ent->blocks[ent->cnt++] = block;
+	ent->last_block = block;
+}
+
+static void index_add_scp(struct frame_index *index, struct index_build *build,
+		uint64_t end)
+{
+	build->cur_scp.end = end;
+	build->scp_state = 0;
+	if (index_grow((void **)&index->scps, &build->scp_size, index->hdr.scp_cnt,
+			sizeof(*index->scps))) {
+		build->err = 1;
+		return;
+	}
+
+	index->scps[index->hdr.scp_cnt++] = build->cur_scp;
+}
+
+/* Follows the SCP write protocol, the same way dsp_scp_handler() does. */
+static void index_track_scp(struct frame_index *index, struct index_build *build,
+		uint64_t pos, uint32_t frame)
+{
+	uint32_t verb = (frame >> 16) & 0xf, payload = frame & 0xffff;
+
+	if (verb > 1)
+		return;
+
+	switch (build->scp_state) {
+	case 0:
+		if (verb)
+			break;
+
+		memset(&build->cur_scp, 0, sizeof(build->cur_scp));
+		build->cur_scp.start = pos;
+		build->scp_hdr = payload;
+		build->scp_state = 1;
+		break;
+	case 1:
+		if (!verb) {
+			build->scp_state = 0;
+			break;
+		}
+
+		build->scp_hdr |= payload << 16;
+		build->cur_scp.data_size = (build->scp_hdr >> 27) & 0x1f;
+		build->cur_scp.get_flag = (build->scp_hdr >> 16) & 0x01;
+		build->cur_scp.req = (build->scp_hdr >> 17) & 0x7f;
+		build->cur_scp.mid = build->scp_hdr & 0xff;
+		build->scp_words = build->cur_scp.data_size;
+		if (build->scp_words >= 4)
+			build->scp_state = 0;
+		else if (!build->scp_words)
+			index_add_scp(index, build, pos);
+		else
+			build->scp_state = 2;
+		break;
+	case 2:
+		if (!verb)
+			build->scp_state = 3;
+		break;
+	case 3:
+		if (!verb)
+			break;
+
+		if (!--build->scp_words)
+			index_add_scp(index, build, pos);
+		else
+			build->scp_state = 2;
+		break;
+	}
+}
+
+static void index_end_run(struct frame_index *index, struct index_build *build,
+		uint64_t end)
+{
+	if (!build->in_run)
+		return;
+
+	build->cur_run.end = end;
+	build->in_run = 0;
+	if (index_grow((void **)&index->runs, &build->run_size, index->hdr.run_cnt,
+			sizeof(*index->runs))) {
+		build->err = 1;
+		return;
+	}
+
+	index->runs[index->hdr.run_cnt++] = build->cur_run;
+}
+
+/* Follows 8051 exram write runs, the same way chipio_8051_handler() does. */
+static void index_track_8051(struct frame_index *index, struct index_build *build,
+		uint64_t pos, uint32_t frame)
+{
+	uint32_t verb = (frame >> 8) & 0xfff, val = frame & 0xff;
+
+	switch (verb) {
+	case VENDOR_CHIPIO_8051_ADDRESS_LOW:
+		index_end_run(index, build, pos);
+		build->cur_run.start = pos;
+		build->cur_run.addr = val;
+		build->addr_set[0] = 1;
+		build->addr_set[1] = 0;
+		break;
+	case VENDOR_CHIPIO_8051_ADDRESS_HIGH:
+		index_end_run(index, build, pos);
+		if (build->addr_set[0]) {
+			build->cur_run.addr |= val << 8;
+			build->addr_set[1] = 1;
+		} else {
+			build->addr_set[0] = build->addr_set[1] = 0;
+		}
+		break;
+	case VENDOR_CHIPIO_8051_DATA_WRITE:
+		if (build->addr_set[0] && build->addr_set[1]) {
+			build->addr_set[0] = build->addr_set[1] = 0;
+			build->cur_run.len = 1;
+			build->in_run = 1;
+		} else if (build->in_run) {
+			build->cur_run.len++;
+		}
+		break;
+	case VENDOR_CHIPIO_PLL_PMU_WRITE:
+	case VENDOR_CHIPIO_8051_DATA_READ:
+		index_end_run(index, build, pos);
+		build->addr_set[0] = build->addr_set[1] = 0;
+		break;
+	}
+}
+
+static int index_key_cmp(const void *a, const void *b)
+{
+	const struct index_build_key *key_a = a, *key_b = b;
+
+	if (key_a->used != key_b->used)
+		return key_a->used ? -1 : 1;
+
+	if (key_a->key != key_b->key)
+		return (key_a->key < key_b->key) ? -1 : 1;
+
+	return 0;
+}
+
+static void frame_index_free(struct frame_index *index)
+{
+	if (index->map) {
+		munmap(index->map, index->map_size);
+	} else {
+		free(index->keys);
+		free(index->blocks);
+		free(index->scps);
+		free(index->runs);
+		free(index->downloads);
+	}
+
+	memset(index, 0, sizeof(*index));
+}
+
+static int frame_index_build(struct ca0132_data *data, struct frame_index *index)
+{
+	struct index_build build;
+	struct index_build_key *ent;
+	uint32_t frame, codec, node, key, prev_key, block, prev_block, i, table_size;
+	uint64_t pos;
+
+	memset(index, 0, sizeof(*index));
+	memset(&build, 0, sizeof(build));
+	build.hash_bits = INDEX_HASH_MIN_BITS;
+	build.table = calloc(1 << build.hash_bits, sizeof(*build.table));
+	if (!build.table)
+		return 1;
+
+	prev_key = ~0;
+	prev_block = ~0;
+	for (pos = 0; pos < data->frame_cnt && !build.err; pos++) {
+		frame = data->frames[pos];
+		key = frame_index_get_key(frame);
+		block = pos / INDEX_BLOCK_FRAMES;
+		if (key != prev_key || block != prev_block)
+			index_add_block(&build, key, block);
+
+		prev_key = key;
+		prev_block = block;
+
+		codec = (frame >> 28) & 0x0f;
+		node = (frame >> 20) & 0x7f;
+		if ((frame & FRAME_NODE_VERB_MASK) ==
+				FRAME_NODE_VERB(0x15, VENDOR_CHIPIO_PORT_FREE_SET)) {
+			if (index_grow((void **)&index->downloads, &build.download_size,
+					index->hdr.download_cnt, sizeof(*index->downloads))) {
+				build.err = 1;
+				break;
+			}
+
+			index->downloads[index->hdr.download_cnt++] = pos;
+		}
+
+		if (codec != data->main_codec_id)
+			continue;
+
+		if (node == 0x16)
+			index_track_scp(index, &build, pos, frame);
+		else if (node == 0x15)
+			index_track_8051(index, &build, pos, frame);
+	}
+
+	if (data->frame_cnt && !build.err)
+		index_end_run(index, &build, data->frame_cnt - 1);
+
+	/* Flatten the hash table into a sorted key directory. */
+	table_size = 1 << build.hash_bits;
+	qsort(build.table, table_size, sizeof(*build.table), index_key_cmp);
+	for (i = 0; i < table_size && build.table[i].used; i++)
+		index->hdr.block_cnt += build.table[i].cnt;
+
+	index->hdr.key_cnt = i;
+	if (!build.err) {
+		index->keys = calloc(index->hdr.key_cnt + 1, sizeof(*index->keys));
+		index->blocks = malloc((index->hdr.block_cnt + 1) * sizeof(*index->blocks));
+		if (!index->keys || !index->blocks)
+			build.err = 1;
+	}
+
+	pos = 0;
+	for (i = 0; i < index->hdr.key_cnt; i++) {
+		ent = &build.table[i];
+		if (!build.err) {
+			index->keys[i].key = ent->key;
+			index->keys[i].cnt = ent->cnt;
+			index->keys[i].first = pos;
+			memcpy(&index->blocks[pos], ent->blocks, ent->cnt * sizeof(*ent->blocks));
+			pos += ent->cnt;
+		}
+
+		free(ent->blocks);
+	}
+
+	free(build.table);
+	if (build.err) {
+		frame_index_free(index);
+		return 1;
+	}
+
+	memcpy(index->hdr.magic, INDEX_MAGIC, sizeof(index->hdr.magic));
+	index->hdr.version = INDEX_VERSION;
+	index->hdr.block_frames = INDEX_BLOCK_FRAMES;
+	index->hdr.capture_size = data->capture_st.st_size;
+	index->hdr.capture_mtime_sec = data->capture_st.st_mtim.tv_sec;
+	index->hdr.capture_mtime_nsec = data->capture_st.st_mtim.tv_nsec;
+	index->hdr.main_codec_id = data->main_codec_id;
+
+	return 0;
+}
+
+/*
+ * The block list is padded to 8 bytes, so that everything after it is
+ * aligned when the index is mapped.
+ */
+static int frame_index_write(struct frame_index *index, const char *file_name)
+{
+	struct frame_index_hdr *hdr = &index->hdr;
+	uint32_t pad = 0;
+	FILE *file;
+	int ret;
+
+	file = fopen(file_name, "wb");
+	if (!file)
+		return 1;
+
+	ret = fwrite(hdr, sizeof(*hdr), 1, file) != 1;
+	ret |= fwrite(index->keys, sizeof(*index->keys), hdr->key_cnt, file) != hdr->key_cnt;
+	ret |= fwrite(index->blocks, sizeof(*index->blocks), hdr->block_cnt, file) != hdr->block_cnt;
+	if (hdr->block_cnt & 1)
+		ret |= fwrite(&pad, sizeof(pad), 1, file) != 1;
+
+	ret |= fwrite(index->scps, sizeof(*index->scps), hdr->scp_cnt, file) != hdr->scp_cnt;
+	ret |= fwrite(index->runs, sizeof(*index->runs), hdr->run_cnt, file) != hdr->run_cnt;
+	ret |= fwrite(index->downloads, sizeof(*index->downloads), hdr->download_cnt,
+			file) != hdr->download_cnt;
+	ret |= fclose(file) != 0;
+
+	if (ret)
+		unlink(file_name);
+
+	return ret;
+}
+
+/* Returns 1 if there's no usable index for this capture. */
+static int frame_index_read(struct ca0132_data *data, struct frame_index *index,
+		const char *file_name)
+{
+	const struct frame_index_hdr *hdr;
+	uint64_t size;
+	struct stat st;
+	uint8_t *map;
+	int fd;
+
+	memset(index, 0, sizeof(*index));
+	fd = open(file_name, O_RDONLY);
+	if (fd < 0)
+		return 1;
+
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(*hdr)) {
+		close(fd);
+		return 1;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return 1;
+
+	hdr = (const struct frame_index_hdr *)map;
+	size = sizeof(*hdr) + (hdr->key_cnt * sizeof(*index->keys)) +
+		(((hdr->block_cnt + 1) & ~1ULL) * sizeof(*index->blocks)) +
+		(hdr->scp_cnt * sizeof(*index->scps)) +
+		(hdr->run_cnt * sizeof(*index->runs)) +
+		(hdr->download_cnt * sizeof(*index->downloads));
+	if (memcmp(hdr->magic, INDEX_MAGIC, sizeof(hdr->magic)) ||
+			hdr->version != INDEX_VERSION ||
+			hdr->block_frames != INDEX_BLOCK_FRAMES ||
+			hdr->capture_size != (uint64_t)data->capture_st.st_size ||
+			hdr->capture_mtime_sec != data->capture_st.st_mtim.tv_sec ||
+			hdr->capture_mtime_nsec != data->capture_st.st_mtim.tv_nsec ||
+			size != (uint64_t)st.st_size) {
+		munmap(map, st.st_size);
+		return 1;
+	}
+
+	index->hdr = *hdr;
+	index->map = map;
+	index->map_size = st.st_size;
+
+	map += sizeof(*hdr);
+	index->keys = (struct frame_index_key *)map;
+	map += hdr->key_cnt * sizeof(*index->keys);
+	index->blocks = (uint32_t *)map;
+	map += ((hdr->block_cnt + 1) & ~1ULL) * sizeof(*index->blocks);
+	index->scps = (struct frame_index_scp *)map;
+	map += hdr->scp_cnt * sizeof(*index->scps);
+	index->runs = (struct frame_index_run *)map;
+	map += hdr->run_cnt * sizeof(*index->runs);
+	index->downloads = (uint64_t *)map;
+
+	return 0;
+}
+
+/*
+ * Use the index if it's up to date, otherwise build it and try to save it
+ * for next time. Not being able to save it isn't an error.
+ */
+static int frame_index_open(struct ca0132_data *data, struct frame_index *index,
+		const char *file_name)
+{
+	if (!frame_index_read(data, index, file_name)) {
+		data->main_codec_id = index->hdr.main_codec_id;
+		return 0;
+	}
+
+	find_main_codec(data);
+	if (frame_index_build(data, index))
+		return 1;
+
+	if (frame_index_write(index, file_name))
+		fprintf(stderr, "Failed to write index %s.\n", file_name);
+
+	return 0;
+}
+
+static int index_block_cmp(const void *a, const void *b)
+{
+	uint32_t block_a = *(const uint32_t *)a, block_b = *(const uint32_t *)b;
+
+	return (block_a > block_b) - (block_a < block_b);
+}
+
+/* 4-bit verb keys don't have the lower byte of the verb. */
+static int index_key_matches(uint32_t key, const struct frame_pattern *pat)
+{
+	uint32_t mask = pat->mask, verb = (key >> 16) & 0xf;
+
+	if (verb != 0x7 && verb != 0xf)
+		mask &= ~0xff00;
+
+	return !((key ^ pat->match) & mask);
+}
+
+/*
+ * Find the frames matching a pattern, only scanning the blocks that have a
+ * codec/node/verb key that could match it.
+ */
+static void frame_index_scan_hits(struct ca0132_data *data,
+		struct frame_index *index, const struct frame_pattern *pat,
+		struct frame_hits *hits)
+{
+	const struct frame_index_key *key;
+	uint64_t i, j, cnt, start, end;
+	uint32_t *blocks;
+
+	cnt = 0;
+	for (i = 0; i < index->hdr.key_cnt; i++) {
+		if (index_key_matches(index->keys[i].key, pat))
+			cnt += index->keys[i].cnt;
+	}
+
+	blocks = malloc((cnt + 1) * sizeof(*blocks));
+	cnt = 0;
+	for (i = 0; i < index->hdr.key_cnt; i++) {
+		key = &index->keys[i];
+		if (!index_key_matches(key->key, pat))
+			continue;
+
+		memcpy(&blocks[cnt], &index->blocks[key->first], key->cnt * sizeof(*blocks));
+		cnt += key->cnt;
+	}
+
+	qsort(blocks, cnt, sizeof(*blocks), index_block_cmp);
+
+	/* Scan each run of consecutive blocks at once. */
+	for (i = 0; i < cnt; i = j) {
+		for (j = i + 1; j < cnt && blocks[j] <= blocks[j - 1] + 1; j++)
+			;
+
+		start = (uint64_t)blocks[i] * INDEX_BLOCK_FRAMES;
+		end = ((uint64_t)blocks[j - 1] + 1) * INDEX_BLOCK_FRAMES;
+		if (end > data->frame_cnt)
+			end = data->frame_cnt;
+
+		frame_scan_hits(data->frames, start, end, pat, hits);
+	}
+
+	free(blocks);
+}
+
+struct decode_opts {
+	struct frame_pattern pat;
+	uint32_t context;
+	char *scan;
+	char *filter;
+	char *format;
+	uint32_t threads;
+	uint8_t stream;
+	uint8_t stats;
+	char *run_dir;
+
+	char *index_file;
+	uint8_t no_index;
+
+	uint8_t mid_set, req_set, exram_set;
+	uint32_t mid, req, exram;
+};
+
+struct frame_window {
+	uint64_t start, end;
+};
+
+static void usage(char *pname)
+{
+	fprintf(stderr, "usage: %s <allCORBframes-location> [codec=<n>] [node=<n>] [verb=<n>]\n", pname);
+	fprintf(stderr, "       [mid=<n> [req=<n>]] [exram=<addr>] [context=<frames>]\n");
+	fprintf(stderr, "       [index=<file>] [noindex] [scan=avx2|sse2|scalar]\n");
+	fprintf(stderr, "       [filter=<expr>] [format=text|json|binary] [threads=<n>] [stream]\n");
+	fprintf(stderr, "       [stats] [runs=<dir>]\n");
+}
+
+static void reset_decode_state(struct ca0132_data *data)
+{
+	dsp_scp_clear(&data->dsp_data);
+	chipio_hic_clear(&data->chipio_data);
+	chipio_8051_data_clear(&data->chipio_data);
+	data->chipio_data.param_set = 0;
+}
+
+static void decode_frames(struct ca0132_data *data, uint64_t start, uint64_t end)
+{
+	data->frame_pos = start;
+	data->frame_end = end;
+	data->cur_addr = start * sizeof(uint32_t);
+	data->at_end = 0;
+
+	while (1) {
+		get_next_verb(data);
+		if (data->at_end)
+			break;
+
+		decode_cur_verb(data);
+	}
+}
+
+/*
+ * Parallel decoding. The capture is split into segments which are decoded
+ * on worker threads into memory, then written out in order. Each worker
+ * starts with fresh decoder state a number of warm-up frames before its
+ * segment, decoding them without output so the SCP/HIC/8051 state machines
+ * resync. The state is saved at checkpoints through the segment.
+ *
+ * When merging, the state left by the previous segment is compared with
+ * the state the worker had at the start of its segment. If they differ,
+ * the segment is decoded serially from the real state until it matches one
+ * of the worker's checkpoints, and the worker's output is used from there.
+ * The output is the same as a serial decode either way.
+ *
+ * Only state that affects the output is compared. Node pincfg/pin_ctl
+ * values and leftover param and 8051 addresses can be set once at the
+ * start of a capture, and the warm-up never sees them. Pin control values
+ * are never printed from state, and pincfg bytes only need to match if the
+ * worker set them, or it printed a pincfg with bytes it never saw. These
+ * are carried forward from the real state when merging.
+ */
+#define DECODE_SEGMENT_MIN_FRAMES  0x40000
+#define DECODE_SEGMENT_MAX_FRAMES  0x400000
+#define DECODE_WARMUP_FRAMES       0x1000
+#define DECODE_CHECKPOINT_FRAMES   0x1000
+
+/*
+ * The 8051 data run is copied out, and the run buffer pointer and size in
+ * chipio_data are cleared.
+ */
+struct decode_state {
+	struct dsp_data dsp_data;
+	struct chipio_data chipio_data;
+	struct generic_node nodes[NODE_COUNT];
+	uint8_t *u_8051_data_run;
+};
+
+struct decode_checkpoint {
+	uint64_t frame;
+	size_t out_len;
+	struct decode_state state;
+};
+
+struct decode_segment {
+	struct ca0132_data data;
+	uint64_t start, end;
+	const struct frame_hits *port_frees;
+
+	FILE *out;
+	char *buf;
+	size_t buf_len;
+
+	struct decode_checkpoint *cps;
+	uint64_t cp_cnt;
+	struct decode_state end_state;
+
+	pthread_t thread;
+};
+
+static void save_decode_state(struct ca0132_data *data, struct decode_state *state)
+{
+	uint32_t len = data->chipio_data.u_8051_data_run_len;
+
+	state->dsp_data = data->dsp_data;
+	state->chipio_data = data->chipio_data;
+	state->chipio_data.u_8051_data_run = NULL;
+	state->chipio_data.u_8051_data_run_size = 0;
+	memcpy(state->nodes, data->nodes, sizeof(state->nodes));
+
+	state->u_8051_data_run = NULL;
+	if (len) {
+		state->u_8051_data_run = malloc(len);
+		if (!state->u_8051_data_run) {
+			fprintf(stderr, "Failed to save 8051 data run, dropping it.\n");
+			state->chipio_data.u_8051_data_run_len = 0;
+			return;
+		}
+
+		memcpy(state->u_8051_data_run, data->chipio_data.u_8051_data_run, len);
+	}
+}
+
+static void load_decode_state(struct ca0132_data *data, const struct decode_state *state)
+{
+	struct chipio_data *chipio_data = &data->chipio_data;
+	uint8_t *run = chipio_data->u_8051_data_run;
+	uint32_t size = chipio_data->u_8051_data_run_size;
+	uint32_t i;
+
+	data->dsp_data = state->dsp_data;
+	data->chipio_data = state->chipio_data;
+
+	chipio_data->u_8051_data_run = run;
+	chipio_data->u_8051_data_run_size = size;
+	chipio_data->u_8051_data_run_len = 0;
+	for (i = 0; i < state->chipio_data.u_8051_data_run_len; i++) {
+		if (chipio_8051_data_run_add(chipio_data, state->u_8051_data_run[i]))
+			break;
+	}
+}
+
+static uint32_t pincfg_set_mask(uint8_t pincfg_set)
+{
+	uint32_t i, mask = 0;
+
+	for (i = 0; i < 4; i++) {
+		if (pincfg_set & (1 << i))
+			mask |= 0xff << (i * 8);
+	}
+
+	return mask;
+}
+
+/* Clear the chipio state that no longer affects the output. */
+static void chipio_state_strip(struct chipio_data *data)
+{
+	data->u_8051_data_run = NULL;
+	data->u_8051_data_run_size = 0;
+
+	if (!data->param_set) {
+		data->param = 0;
+		data->param_addr = 0;
+	}
+
+	if (!data->u_8051_addr_set[0] && !data->u_8051_data_run_len) {
+		data->u_8051_addr = 0;
+		data->u_8051_addr_set_start = 0;
+	}
+}
+
+static int decode_state_equal(struct ca0132_data *data, const struct decode_state *state,
+		uint8_t full_pincfg)
+{
+	struct chipio_data chipio_a = data->chipio_data;
+	struct chipio_data chipio_b = state->chipio_data;
+	uint32_t i, mask;
+
+	chipio_state_strip(&chipio_a);
+	chipio_state_strip(&chipio_b);
+	if (memcmp(&data->dsp_data, &state->dsp_data, sizeof(state->dsp_data)) ||
+			memcmp(&chipio_a, &chipio_b, sizeof(chipio_b)))
+		return 0;
+
+	if (chipio_a.u_8051_data_run_len &&
+			memcmp(data->chipio_data.u_8051_data_run, state->u_8051_data_run,
+				chipio_a.u_8051_data_run_len))
+		return 0;
+
+	for (i = 0; i < NODE_COUNT; i++) {
+		mask = full_pincfg ? ~0U : pincfg_set_mask(state->nodes[i].pincfg_set);
+		if ((data->nodes[i].pincfg ^ state->nodes[i].pincfg) & mask)
+			return 0;
+	}
+
+	return 1;
+}
+
+/*
+ * Take the node values a segment set, and param/8051 addresses that still
+ * affect the output, from its end state. Everything else in data is kept.
+ */
+static void merge_decode_state(struct ca0132_data *data, const struct decode_state *state)
+{
+	const struct chipio_data *end = &state->chipio_data;
+	struct chipio_data prev = data->chipio_data;
+	struct generic_node *node;
+	uint32_t i, mask;
+
+	load_decode_state(data, state);
+	if (!end->param_set) {
+		data->chipio_data.param = prev.param;
+		data->chipio_data.param_addr = prev.param_addr;
+	}
+
+	if (!end->u_8051_addr_set[0] && !end->u_8051_data_run_len) {
+		data->chipio_data.u_8051_addr = prev.u_8051_addr;
+		data->chipio_data.u_8051_addr_set_start = prev.u_8051_addr_set_start;
+	}
+
+	for (i = 0; i < NODE_COUNT; i++) {
+		node = &data->nodes[i];
+		mask = pincfg_set_mask(state->nodes[i].pincfg_set);
+		node->pincfg = (node->pincfg & ~mask) | (state->nodes[i].pincfg & mask);
+		node->pincfg_set |= state->nodes[i].pincfg_set;
+		if (state->nodes[i].pin_ctl_set) {
+			node->pin_ctl = state->nodes[i].pin_ctl;
+			node->pin_ctl_set = 1;
+		}
+	}
+}
+
+/* Find every PORT_FREE_SET verb the decoder will see, in frame order. */
+static void find_port_frees(struct ca0132_data *data, struct frame_hits *hits)
+{
+	struct frame_pattern pat;
+
+	pat.mask = FRAME_CODEC_MASK | FRAME_NODE_VERB_MASK;
+	pat.match = (data->main_codec_id << 28) |
+		FRAME_NODE_VERB(0x15, VENDOR_CHIPIO_PORT_FREE_SET);
+	memset(hits, 0, sizeof(*hits));
+	frame_scan_hits(data->frames, 0, data->frame_cnt, &pat, hits);
+}
+
+/* Count the PORT_FREE_SET verbs the decoder would have seen before pos. */
+static uint32_t count_port_frees(const struct frame_hits *hits, uint64_t pos)
+{
+	uint64_t low, high, mid;
+
+	low = 0;
+	high = hits->cnt;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (hits->idx[mid] < pos)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+static void *decode_segment_thread(void *arg)
+{
+	struct decode_segment *seg = arg;
+	struct ca0132_data *data = &seg->data;
+	uint64_t pos, end, warmup;
+	uint32_t downloads;
+
+	downloads = data->chipio_data.dsp_downloads;
+	memset(&data->dsp_data, 0, sizeof(data->dsp_data));
+	memset(&data->chipio_data, 0, sizeof(data->chipio_data));
+	memset(data->nodes, 0, sizeof(data->nodes));
+	data->pincfg_partial_end = 0;
+	data->chipio_data.dsp_downloads = downloads;
+	data->chipio_data.dsp_downloads_counted = 1;
+
+	warmup = (seg->start > DECODE_WARMUP_FRAMES) ? seg->start - DECODE_WARMUP_FRAMES : 0;
+	data->chipio_data.port_free_count = count_port_frees(seg->port_frees, warmup);
+	data->quiet = 1;
+	decode_frames(data, warmup, seg->start);
+	data->quiet = 0;
+
+	seg->out = open_memstream(&seg->buf, &seg->buf_len);
+	data->out = seg->out;
+
+	seg->cp_cnt = 0;
+	seg->cps = malloc(((seg->end - seg->start) / DECODE_CHECKPOINT_FRAMES + 1) *
+			sizeof(*seg->cps));
+	if (!seg->cps) {
+		/* Leave the segment to be decoded serially when merging. */
+		fclose(seg->out);
+		seg->end_state.u_8051_data_run = NULL;
+		free(data->chipio_data.u_8051_data_run);
+		return NULL;
+	}
+
+	for (pos = seg->start; pos < seg->end; pos = end) {
+		end = pos + DECODE_CHECKPOINT_FRAMES;
+		if (end > seg->end)
+			end = seg->end;
+
+		fflush(seg->out);
+		seg->cps[seg->cp_cnt].frame = pos;
+		seg->cps[seg->cp_cnt].out_len = seg->buf_len;
+		save_decode_state(data, &seg->cps[seg->cp_cnt].state);
+		seg->cp_cnt++;
+
+		decode_frames(data, pos, end);
+	}
+
+	fclose(seg->out);
+	save_decode_state(data, &seg->end_state);
+	free(data->chipio_data.u_8051_data_run);
+
+	return NULL;
+}
+
+/*
+ * Write out a segment's output, decoding it serially from the real decoder
+ * state in data until it matches one of the segment's checkpoints.
+ */
+static void merge_segment(struct ca0132_data *data, struct decode_segment *seg)
+{
+	uint64_t i, end;
+	uint8_t full_pincfg;
+
+	if (!seg->cps) {
+		decode_frames(data, seg->start, seg->end);
+		return;
+	}
+
+	for (i = 0; i < seg->cp_cnt; i++) {
+		full_pincfg = seg->cps[i].frame < seg->data.pincfg_partial_end;
+		if (decode_state_equal(data, &seg->cps[i].state, full_pincfg)) {
+			fwrite(seg->buf + seg->cps[i].out_len, 1,
+					seg->buf_len - seg->cps[i].out_len, data->out);
+			merge_decode_state(data, &seg->end_state);
+			return;
+		}
+
+		end = (i + 1 < seg->cp_cnt) ? seg->cps[i + 1].frame : seg->end;
+		decode_frames(data, seg->cps[i].frame, end);
+	}
+}
+
+static void decode_frames_parallel(struct ca0132_data *data, uint32_t threads)
+{
+	struct decode_segment *segs;
+	struct frame_hits port_frees;
+	uint64_t seg_frames, pos, j;
+	uint32_t i, cnt;
+
+	seg_frames = data->frame_cnt / threads;
+	if (seg_frames > DECODE_SEGMENT_MAX_FRAMES)
+		seg_frames = DECODE_SEGMENT_MAX_FRAMES;
+
+	if (threads < 2 || seg_frames < DECODE_SEGMENT_MIN_FRAMES) {
+		decode_frames(data, 0, data->frame_cnt);
+		chipio_8051_finish_data_run(data);
+		return;
 	}
 
-	if (verb->verb != VENDOR_CHIPIO_8051_DATA_WRITE && chipio_data->u_8051_data_run_len)
-	{
-		chipio_8051_print_data_run(chipio_data);
-		chipio_8051_data_clear(chipio_data);
+	count_dsp_downloads(data);
+	find_port_frees(data, &port_frees);
+
+	/*
+	 * Segments are decoded a round of one per thread at a time, so only a
+	 * round's output is ever held in memory.
+	 */
+	segs = calloc(threads, sizeof(*segs));
+	if (!segs) {
+		fprintf(stderr, "Failed to allocate decode segments, decoding serially.\n");
+		free(port_frees.idx);
+		decode_frames(data, 0, data->frame_cnt);
+		chipio_8051_finish_data_run(data);
+		return;
 	}
+
+	for (pos = 0; pos < data->frame_cnt; ) {
+		for (cnt = 0; cnt < threads && pos < data->frame_cnt; cnt++) {
+			segs[cnt].data = *data;
+			segs[cnt].port_frees = &port_frees;
+			segs[cnt].start = pos;
+			segs[cnt].end = pos + seg_frames;
+			if (segs[cnt].end > data->frame_cnt)
+				segs[cnt].end = data->frame_cnt;
+
+			pos = segs[cnt].end;
+			pthread_create(&segs[cnt].thread, NULL, decode_segment_thread, &segs[cnt]);
+		}
+
+		for (i = 0; i < cnt; i++) {
+			pthread_join(segs[i].thread, NULL);
+			merge_segment(data, &segs[i]);
+			free(segs[i].buf);
+			for (j = 0; j < segs[i].cp_cnt; j++)
+				free(segs[i].cps[j].state.u_8051_data_run);
+
+			free(segs[i].cps);
+			free(segs[i].end_state.u_8051_data_run);
+		}
+	}
+
+	free(segs);
+	free(port_frees.idx);
+	chipio_8051_finish_data_run(data);
 }
 
-static void chipio_verb_handler(struct ca0132_data *data)
+/*
+ * Streaming decode, for reading a capture from a pipe as it's written. Only
+ * a small buffer of frames is kept, and there's no pre-pass over the
+ * capture. Unless a codec is given, the main codec is whichever codec last
+ * sent CT_EXTENSIONS_ENABLE so far. The END_DSP_DOWNLOAD marker needs the
+ * download count of the whole capture, so it isn't printed.
+ */
+#define STREAM_BUF_FRAMES     0x4000
+#define STREAM_FLUSH_INTERVAL 0.1
+
+static void decode_stream_frames(struct ca0132_data *data, uint64_t base,
+		uint64_t cnt, uint8_t find_codec)
 {
-	struct chipio_data *chipio_data = &data->chipio_data;
-	struct hda_verb *verb = &data->cur_verb;
-	uint32_t tmp;
+	data->frame_pos = 0;
+	data->frame_end = cnt;
+	data->cur_addr = base * sizeof(uint32_t);
+	data->at_end = 0;
 
-	tmp = (verb->verb >> 8) & 0xf;
+	while (1) {
+		get_next_verb(data);
+		if (data->at_end)
+			break;
 
-	switch (tmp) {
-	case 0x2:
-		print_cur_verb(data);
-		break;
+		if (find_codec && (data->cur_data & FRAME_NODE_VERB_MASK) ==
+				FRAME_NODE_VERB(0x15, CHIPIO_CT_EXTENSIONS_ENABLE))
+			data->main_codec_id = data->cur_verb.codec;
 
-	case 0x0:
-	case 0x1:
-	case 0x3:
-	case 0x4:
-		chipio_hic_handler(data);
-		break;
+		decode_cur_verb(data);
+	}
+}
 
-	case 0x5:
-		chipio_8051_direct_write(data);
-		break;
-	case 0xd:
-		print_cur_verb(data);
-		break;
+static int decode_stream(struct ca0132_data *data, int fd, uint8_t find_codec)
+{
+	const size_t buf_size = STREAM_BUF_FRAMES * sizeof(uint32_t);
+	double last_flush, cur_time;
+	size_t fill, used, want;
+	uint64_t base;
+	uint32_t *buf;
+	ssize_t len;
+	int ret = 0;
+
+	buf = malloc(buf_size);
+	if (!buf) {
+		fprintf(stderr, "Failed to allocate stream buffer.\n");
+		return 1;
+	}
 
-	case 0x7:
-		switch (verb->verb) {
-		case VENDOR_CHIPIO_FLAG_SET:
-			chipio_flag_set(data);
-			break;
-		case VENDOR_CHIPIO_PARAM_SET:
-			chipio_param_extract(data);
-			break;
-		case VENDOR_CHIPIO_PARAM_GET:
-			chipio_param_get(data);
-			break;
-		case VENDOR_CHIPIO_PARAM_EX_ID_SET:
-			chipio_data->param_set = 1;
-			chipio_data->param = verb->data;
-			chipio_data->param_addr = data->cur_addr - 0x4;
-			break;
-		case VENDOR_CHIPIO_PARAM_EX_VALUE_SET:
-			if (chipio_data->param_set) {
-				chipio_param_write(data);
-			}
-			chipio_data->param_set = 0;
-			break;
-		case VENDOR_CHIPIO_HIC_POST_READ:
-			if (chipio_data->addr_set[0] && chipio_data->addr_set[1])
-				chipio_data->read_set = 1;
-			break;
-		case VENDOR_CHIPIO_PORT_FREE_SET:
-			chipio_data->port_free_count++;
-			if (chipio_data->port_free_count == chipio_data->dsp_downloads)
-				printf("\n----------END_DSP_DOWNLOAD------------\n\n");
-			break;
-		case VENDOR_CHIPIO_8051_ADDRESS_LOW:
-		case VENDOR_CHIPIO_8051_ADDRESS_HIGH:
-		case VENDOR_CHIPIO_8051_DATA_WRITE:
-		case VENDOR_CHIPIO_PLL_PMU_WRITE:
-			chipio_8051_handler(data);
-			break;
-		default:
-			print_cur_verb(data);
+	data->frames = buf;
+	data->chipio_data.dsp_downloads_counted = 1;
+
+	base = fill = 0;
+	last_flush = get_monotonic_time();
+	while (1) {
+		want = buf_size - fill;
+		len = read(fd, (uint8_t *)buf + fill, want);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+
+			perror("read");
+			ret = 1;
 			break;
 		}
-		break;
-	case 0xf:
-		switch (verb->verb) {
-		case VENDOR_CHIPIO_8051_DATA_READ:
-			chipio_8051_handler(data);
-			break;
-		case VENDOR_CHIPIO_HIC_READ_DATA:
-			chipio_hic_check_read(chipio_data);
-			break;
-		case VENDOR_CHIPIO_STATUS:
-			if ((chipio_data->addr_set[0] && chipio_data->addr_set[1]) || chipio_data->param_set)
-				break;
-			else
-				print_cur_verb(data);
-			break;
-		default:
-			print_cur_verb(data);
+
+		if (!len)
 			break;
-		}
-		break;
 
-	default:
-		print_cur_verb(data);
-		break;
+		fill += len;
+		decode_stream_frames(data, base, fill / sizeof(uint32_t), find_codec);
+
+		/* Keep any partial frame for the next read. */
+		used = fill - (fill % sizeof(uint32_t));
+		base += used / sizeof(uint32_t);
+		memmove(buf, (uint8_t *)buf + used, fill - used);
+		fill -= used;
+
+		/*
+		 * Flush when the reader has caught up with the writer, or
+		 * at least every flush interval.
+		 */
+		cur_time = get_monotonic_time();
+		if ((size_t)len < want ||
+				cur_time - last_flush >= STREAM_FLUSH_INTERVAL) {
+			fflush(data->out);
+			last_flush = cur_time;
+		}
 	}
 
+	chipio_8051_finish_data_run(data);
+	fflush(data->out);
+	data->frames = NULL;
+	free(buf);
+
+	return ret;
 }
 
-static void node_pincfg_set(struct ca0132_data *data)
+/*
+ * Decode each matching frame, starting context frames before it. Windows
+ * that overlap are decoded as one, otherwise decoder state is reset at the
+ * start of each window. The matching frame itself is always printed, marked
+ * with a '>', as some verbs don't print anything when decoded.
+ */
+static void decode_frame_hits(struct ca0132_data *data,
+		const struct frame_pattern *pat, uint32_t context)
 {
-	struct hda_verb *verb = &data->cur_verb;
-	struct generic_node *node = &data->nodes[verb->node];
-	uint32_t tmp, shift;
+	struct frame_event ev;
+	struct frame_hits hits;
+	uint64_t i, start, prev_end;
 
-	shift = verb->verb - AC_VERB_SET_CONFIG_DEFAULT_BYTES_0;
-	tmp = 0xff << (shift * 0x8);
-	node->pincfg &= ~tmp;
+	memset(&hits, 0, sizeof(hits));
+	if (data->index)
+		frame_index_scan_hits(data, data->index, pat, &hits);
+	else
+		frame_scan_hits(data->frames, 0, data->frame_cnt, pat, &hits);
 
-	node->pincfg |= verb->data << (shift * 0x8);
+	prev_end = 0;
+	for (i = 0; i < hits.cnt; i++) {
+		start = (hits.idx[i] > context) ? hits.idx[i] - context : 0;
+		if (start < prev_end) {
+			start = prev_end;
+		} else {
+			/* An 8051 run still open at the end of a window is complete. */
+			chipio_8051_finish_data_run(data);
+			if (i)
+				emit_window_break(data);
 
-	if (verb->verb == AC_VERB_SET_CONFIG_DEFAULT_BYTES_3)
-		printf("Node 0x%02x pincfg 0x%08x.\n", verb->node, node->pincfg);
-}
+			reset_decode_state(data);
+		}
 
-static void get_pinctl_vals(uint32_t pinctl, uint32_t *hp_enable,
-		uint32_t *out_enable, uint32_t *in_enable, uint32_t *vref)
-{
-	*hp_enable  = !!((pinctl >> 7) & 0x1);
-	*out_enable = !!((pinctl >> 6) & 0x1);
-	*in_enable  = !!((pinctl >> 5) & 0x1);
-	*vref = pinctl & 0x7;
+		decode_frames(data, start, hits.idx[i]);
+
+		data->frame_end = hits.idx[i] + 1;
+		data->at_end = 0;
+		get_next_verb(data);
+		event_init(&ev, EVENT_VERB, data, data->cur_addr - 0x4);
+		ev.marked = 1;
+		emit_event(data, &ev);
+		decode_cur_verb(data);
+
+		prev_end = hits.idx[i] + 1;
+	}
+
+	chipio_8051_finish_data_run(data);
+
+	fprintf(stderr, "%lu matching frames, %s scan.\n", (unsigned long)hits.cnt,
+			frame_scan_get_str());
+	free(hits.idx);
 }
 
-static void node_pinctl_set(struct ca0132_data *data)
+/* Decode windows in order, windows that overlap are decoded as one. */
+static void decode_windows(struct ca0132_data *data, struct frame_window *windows,
+		uint64_t cnt)
 {
-	struct hda_verb *verb = &data->cur_verb;
-	struct generic_node *node = &data->nodes[verb->node];
-	uint32_t hp, out, in, vref;
+	uint64_t i, start, prev_end;
 
-	node->pin_ctl = verb->data;
-	get_pinctl_vals(verb->data, &hp, &out, &in, &vref);
-	printf("0x%06x: codec 0x%02x, node 0x%02x, pinctl 0x%02x.\n", data->cur_addr - 0x4, verb->codec, verb->node,
-			node->pin_ctl);
-	printf("pinctl: HP-Enable %d, Out-Enable %d, In-Enable %d, vref 0x%02x.\n", hp, out, in, vref);
+	prev_end = 0;
+	for (i = 0; i < cnt; i++) {
+		start = windows[i].start;
+		if (windows[i].end > data->frame_cnt)
+			windows[i].end = data->frame_cnt;
+
+		if (windows[i].end <= prev_end)
+			continue;
+
+		if (start < prev_end) {
+			start = prev_end;
+		} else {
+			/* An 8051 run still open at the end of a window is complete. */
+			chipio_8051_finish_data_run(data);
+			if (i)
+				emit_window_break(data);
+
+			reset_decode_state(data);
+		}
+
+		decode_frames(data, start, windows[i].end);
+		prev_end = windows[i].end;
+	}
+
+	chipio_8051_finish_data_run(data);
 }
 
-#define AMP_DIR_OUT_SET_MASK 0x8000
-#define AMP_CH_LEFT_SET_MASK 0x2000
-static void node_amp_set(struct ca0132_data *data)
+static int frame_window_cmp(const void *a, const void *b)
 {
-	struct hda_verb *verb = &data->cur_verb;
-	const char *channel, *dir;
-	uint32_t payload;
-
-	payload = verb->data;
-	payload |= (verb->verb & 0xff) << 8;
+	const struct frame_window *win_a = a;
+	const struct frame_window *win_b = b;
 
-	if (payload & AMP_DIR_OUT_SET_MASK)
-		dir = "OUT";
-	else
-		dir = "IN";
+	if (win_a->start != win_b->start)
+		return (win_a->start < win_b->start) ? -1 : 1;
 
-	if (payload & AMP_CH_LEFT_SET_MASK)
-		channel = "LEFT";
-	else
-		channel = "RIGHT";
+	if (win_a->end != win_b->end)
+		return (win_a->end < win_b->end) ? -1 : 1;
 
-	printf("0x%06x: codec 0x%02x, node 0x%02x, dir %s, ch %s, mute %d, gain 0x%02x.\n", data->cur_addr - 0x4, verb->codec, verb->node,
-			dir, channel, !!(payload & 0x80), payload & 0x7f);
+	return 0;
 }
 
-static void default_node_verb_handler(struct ca0132_data *data)
+/*
+ * Decode the SCP transactions with a matching target ID/request, and the
+ * 8051 exram write runs that cover the given address. Get transactions
+ * also decode a few frames after the header/data, to pick up the reads of
+ * the response.
+ */
+static void decode_index_records(struct ca0132_data *data, struct decode_opts *opts)
 {
-	struct hda_verb *verb = &data->cur_verb;
-	uint32_t tmp;
+	struct frame_index *index = data->index;
+	struct frame_window *windows;
+	struct frame_index_scp *scp;
+	struct frame_index_run *run;
+	uint64_t i, cnt;
+
+	windows = malloc((index->hdr.scp_cnt + index->hdr.run_cnt + 1) * sizeof(*windows));
+	if (!windows) {
+		fprintf(stderr, "Failed to allocate record windows.\n");
+		return;
+	}
 
-	tmp = (verb->verb >> 8) & 0xf;
+	cnt = 0;
+	for (i = 0; opts->mid_set && i < index->hdr.scp_cnt; i++) {
+		scp = &index->scps[i];
+		if (scp->mid != opts->mid || (opts->req_set && scp->req != opts->req))
+			continue;
 
-	switch (tmp) {
-	case 0x3:
-		node_amp_set(data);
-		break;
-	case 0x7:
-		switch (verb->verb) {
-		case AC_VERB_SET_CONFIG_DEFAULT_BYTES_0:
-		case AC_VERB_SET_CONFIG_DEFAULT_BYTES_1:
-		case AC_VERB_SET_CONFIG_DEFAULT_BYTES_2:
-		case AC_VERB_SET_CONFIG_DEFAULT_BYTES_3:
-			print_cur_verb(data);
-			node_pincfg_set(data);
-			break;
-		case AC_VERB_SET_PIN_WIDGET_CONTROL:
-			node_pinctl_set(data);
-			break;
-		default:
-			print_cur_verb(data);
-			break;
-		}
+		windows[cnt].start = scp->start;
+		windows[cnt].end = scp->end + 1;
+		if (scp->get_flag)
+			windows[cnt].end += INDEX_SCP_GET_TAIL;
 
-		break;
-	default:
-		print_cur_verb(data);
-		break;
+		cnt++;
+	}
+
+	for (i = 0; opts->exram_set && i < index->hdr.run_cnt; i++) {
+		run = &index->runs[i];
+		if (opts->exram < run->addr || opts->exram >= run->addr + run->len)
+			continue;
+
+		windows[cnt].start = run->start;
+		windows[cnt].end = run->end + 1;
+		cnt++;
 	}
+
+	/* SCP and run windows interleave, decode_windows needs them in order. */
+	qsort(windows, cnt, sizeof(*windows), frame_window_cmp);
+	decode_windows(data, windows, cnt);
+	fprintf(stderr, "%lu matching records.\n", (unsigned long)cnt);
+	free(windows);
 }
 
-/*static void check_verb(uint32_t corb_data)*/
-static void check_verb(struct ca0132_data *data)
+static int is_stream_file(const char *file_name)
 {
-	struct hda_verb *verb = &data->cur_verb;
+	struct stat st;
 
-	switch (verb->node) {
-	case 0x16:
-		dsp_verb_handler(data);
-		break;
+	if (stat(file_name, &st))
+		return 0;
 
-	case 0x15:
-		chipio_verb_handler(data);
-		break;
+	return !S_ISREG(st.st_mode);
+}
 
-	default:
-		default_node_verb_handler(data);
-		break;
+static int stream_capture(struct ca0132_data *data, struct decode_opts *opts,
+		const char *file_name)
+{
+	int fd, ret;
+
+	if (!strcmp(file_name, "-")) {
+		fd = STDIN_FILENO;
+	} else {
+		fd = open(file_name, O_RDONLY);
+		if (fd < 0) {
+			printf("Failed to open file %s!\n", file_name);
+			return 1;
+		}
 	}
+
+	if (opts->pat.mask & FRAME_CODEC_MASK)
+		data->main_codec_id = opts->pat.match >> 28;
+
+	if (data->sink->begin && !data->stats)
+		data->sink->begin(data->out);
+
+	ret = decode_stream(data, fd, !(opts->pat.mask & FRAME_CODEC_MASK));
+	if (fd != STDIN_FILENO)
+		close(fd);
+
+	if (data->stats)
+		print_frame_stats(data->out, data->stats, data);
+
+	free(data->chipio_data.u_8051_data_run);
+
+	return ret;
 }
 
-static void count_dsp_downloads(struct ca0132_data *data)
+static int get_opt_val(const char *arg, const char *name, uint32_t *val)
 {
-	struct hda_verb *verb = &data->cur_verb;
+	size_t len = strlen(name);
 
-	while (!data->at_end) {
-		get_next_verb(data);
+	if (strncmp(arg, name, len) || arg[len] != '=')
+		return 0;
 
-		if (verb->node == 0x15 && verb->verb == VENDOR_CHIPIO_PORT_FREE_SET)
-			data->chipio_data.dsp_downloads++;
+	*val = strtol(&arg[len + 1], NULL, 0);
+
+	return 1;
+}
 
-		if (verb->node == 0x15 && verb->verb == CHIPIO_CT_EXTENSIONS_ENABLE)
-			data->main_codec_id = verb->codec;
+static int parse_opts(struct decode_opts *opts, int argc, char **argv)
+{
+	struct frame_pattern *pat = &opts->pat;
+	uint32_t val;
+	int i;
+
+	memset(opts, 0, sizeof(*opts));
+	opts->context = DEFAULT_HIT_CONTEXT;
+	opts->threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	for (i = 2; i < argc; i++) {
+		if (get_opt_val(argv[i], "codec", &val)) {
+			pat->mask |= FRAME_CODEC_MASK;
+			pat->match |= (val << 28) & FRAME_CODEC_MASK;
+		} else if (get_opt_val(argv[i], "node", &val)) {
+			pat->mask |= FRAME_NODE_MASK;
+			pat->match |= (val << 20) & FRAME_NODE_MASK;
+		} else if (get_opt_val(argv[i], "verb", &val)) {
+			/* 4-bit verbs only match the top nibble. */
+			if (val <= 0xf) {
+				pat->mask |= FRAME_VERB_4BIT_MASK;
+				pat->match |= (val << 16) & FRAME_VERB_4BIT_MASK;
+			} else {
+				pat->mask |= FRAME_VERB_MASK;
+				pat->match |= (val << 8) & FRAME_VERB_MASK;
+			}
+		} else if (get_opt_val(argv[i], "mid", &opts->mid)) {
+			opts->mid_set = 1;
+		} else if (get_opt_val(argv[i], "req", &opts->req)) {
+			opts->req_set = 1;
+		} else if (get_opt_val(argv[i], "exram", &opts->exram)) {
+			opts->exram_set = 1;
+		} else if (get_opt_val(argv[i], "context", &val)) {
+			opts->context = val;
+		} else if (get_opt_val(argv[i], "threads", &opts->threads)) {
+			continue;
+		} else if (!strncmp(argv[i], "runs=", 5)) {
+			opts->run_dir = &argv[i][5];
+		} else if (!strncmp(argv[i], "format=", 7)) {
+			opts->format = &argv[i][7];
+		} else if (!strncmp(argv[i], "filter=", 7)) {
+			opts->filter = &argv[i][7];
+		} else if (!strncmp(argv[i], "scan=", 5)) {
+			opts->scan = &argv[i][5];
+		} else if (!strncmp(argv[i], "index=", 6)) {
+			opts->index_file = &argv[i][6];
+		} else if (!strcmp(argv[i], "noindex")) {
+			opts->no_index = 1;
+		} else if (!strcmp(argv[i], "stream")) {
+			opts->stream = 1;
+		} else if (!strcmp(argv[i], "stats")) {
+			opts->stats = 1;
+		} else {
+			return 1;
+		}
 	}
 
-	rewind(data->frames);
-	data->cur_addr = 0;
-	data->at_end = 0;
+	if (opts->req_set && !opts->mid_set)
+		return 1;
+
+	return 0;
 }
 
 int main(int argc, char **argv)
 {
 	struct ca0132_data main_data;
+	struct event_filter filter;
+	struct frame_index index;
+	struct decode_opts opts;
+	char *index_file = NULL;
 
 	memset(&main_data, 0, sizeof(main_data));
 
-	if (argc < 1) {
-		printf("Usage: %s <allCORBframes-location>\n", argv[0]);
+	if (argc < 2 || parse_opts(&opts, argc, argv)) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (frame_scan_init(opts.scan)) {
+		fprintf(stderr, "Scan %s isn't supported.\n", opts.scan);
+		return 1;
+	}
+
+	main_data.out = stdout;
+	main_data.sink = find_event_sink(opts.format);
+	if (!main_data.sink) {
+		fprintf(stderr, "Format %s isn't supported.\n", opts.format);
 		return 1;
 	}
 
-	main_data.frames = fopen(argv[1], "r");
-	if (!main_data.frames) {
+	if (opts.filter) {
+		if (filter_compile(&filter, opts.filter))
+			return 1;
+
+		main_data.filter = &filter;
+	}
+
+	/*
+	 * Stats are gathered and runs are written in decode order, so they're
+	 * only done serially.
+	 */
+	if (opts.stats) {
+		main_data.stats = calloc(1, sizeof(*main_data.stats));
+		opts.threads = 1;
+	}
+
+	if (opts.run_dir) {
+		main_data.run_dir = opts.run_dir;
+		opts.threads = 1;
+	}
+
+	if (!strcmp(argv[1], "-") || opts.stream || is_stream_file(argv[1])) {
+		if ((opts.pat.mask & ~FRAME_CODEC_MASK) || opts.mid_set || opts.exram_set) {
+			fprintf(stderr, "Only codec= and filter= queries work when streaming.\n");
+			return 1;
+		}
+
+		return stream_capture(&main_data, &opts, argv[1]);
+	}
+
+	if (map_frames(&main_data, argv[1])) {
 		printf("Failed to open file %s!\n", argv[1]);
 		return 1;
 	}
 
+	/* Index record queries need an index, even if it isn't saved. */
+	if (!opts.no_index) {
+		if (opts.index_file) {
+			index_file = strdup(opts.index_file);
+		} else {
+			index_file = malloc(strlen(argv[1]) + 5);
+			sprintf(index_file, "%s.idx", argv[1]);
+		}
+
+		if (!frame_index_open(&main_data, &index, index_file))
+			main_data.index = &index;
+	} else if (opts.mid_set || opts.exram_set) {
+		find_main_codec(&main_data);
+		if (!frame_index_build(&main_data, &index))
+			main_data.index = &index;
+	} else {
+		find_main_codec(&main_data);
+	}
+
+	/* Queries without an index fall back to scanning the capture. */
+	if ((!opts.no_index || opts.mid_set || opts.exram_set) && !main_data.index) {
+		fprintf(stderr, "Failed to build index.\n");
+		if (opts.mid_set || opts.exram_set)
+			return 1;
+	}
+
+	if (main_data.index) {
+		main_data.chipio_data.dsp_downloads = index.hdr.download_cnt;
+		main_data.chipio_data.dsp_downloads_counted = 1;
+	}
+
+	if (opts.pat.mask & FRAME_CODEC_MASK)
+		main_data.main_codec_id = opts.pat.match >> 28;
 
+	if (main_data.sink->begin && !main_data.stats)
+		main_data.sink->begin(main_data.out);
 
-	count_dsp_downloads(&main_data);
+	if (opts.mid_set || opts.exram_set)
+		decode_index_records(&main_data, &opts);
+	else if (opts.pat.mask)
+		decode_frame_hits(&main_data, &opts.pat, opts.context);
+	else
+		decode_frames_parallel(&main_data, opts.threads);
 
-	while (!main_data.at_end) {
-		get_next_verb(&main_data);
-		if (main_data.cur_verb.codec == main_data.main_codec_id)
-			check_verb(&main_data);
+	if (main_data.stats) {
+		print_frame_stats(main_data.out, main_data.stats, &main_data);
+		free(main_data.stats);
 	}
 
-	fclose(main_data.frames);
+	if (main_data.index)
+		frame_index_free(&index);
+
+	free(main_data.chipio_data.u_8051_data_run);
+	free(index_file);
+	if (main_data.frames)
+		munmap((void *)main_data.frames, main_data.map_size);
 
 	return 0;
 }
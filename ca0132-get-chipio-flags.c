@@ -2,18 +2,106 @@
  * ca0132-get-chipio-flags.c:
  * Prints out all ChipIO flags, with their associated strings and where or not
  * they're enabled/disabled.
+ *
+ * All flags are read with a single verb. 'watch' keeps reading them, and
+ * prints any flags that flip. 'params' prints all ChipIO ParamID values.
  */
 #include "ca0132_defs.h"
 
 static void usage(char *pname)
 {
-        fprintf(stderr, "usage: %s <hwdep-device>\n", pname);
+        fprintf(stderr, "usage: %s <hwdep-device> [params]\n", pname);
+        fprintf(stderr, "       %s <hwdep-device> watch [rate-hz] [sample-cnt]\n", pname);
+}
+
+static double get_snapshot_time(const struct chipio_flag_snapshot *snap)
+{
+	return snap->time.tv_sec + (snap->time.tv_nsec / 1000000000.0);
+}
+
+static void print_flags(int fd)
+{
+	struct chipio_flag_snapshot snap;
+	uint32_t i;
+
+	chipio_get_flag_snapshot(fd, &snap);
+	for (i = 0; i < CHIPIO_FLAG_CNT; i++) {
+		printf("Flag %s, set %d.\n", chipio_get_flag_str(i),
+				(snap.flags >> i) & 0x01);
+	}
+}
+
+static void print_params(int fd)
+{
+	uint32_t params[0x100];
+	uint8_t vals[0x100];
+	uint32_t i, cnt;
+
+	for (cnt = 0; chipio_get_param_str(cnt) && cnt < ARRAY_SIZE(params); cnt++)
+		params[cnt] = cnt;
+
+	chipio_get_control_params(fd, params, cnt, vals);
+	for (i = 0; i < cnt; i++) {
+		printf("Param 0x%02x %s, val 0x%02x.\n", params[i],
+				chipio_get_param_str(params[i]), vals[i]);
+	}
+}
+
+static int flag_sample(struct watch_loop *loop, void *cur, double *time)
+{
+	chipio_get_flag_snapshot(loop->fd, cur);
+	*time = get_snapshot_time(cur);
+
+	return 0;
+}
+
+static uint32_t print_flag_changes(struct watch_loop *loop, const void *prev_snap,
+		const void *cur_snap, double time)
+{
+	const struct chipio_flag_snapshot *prev = prev_snap;
+	const struct chipio_flag_snapshot *cur = cur_snap;
+	uint32_t i, diff, changes;
+
+	changes = 0;
+	diff = prev->flags ^ cur->flags;
+	for (i = 0; i < CHIPIO_FLAG_CNT; i++) {
+		if (!((diff >> i) & 0x01))
+			continue;
+
+		printf("[%11.6f] Flag %s, set %d -> %d.\n", time,
+				chipio_get_flag_str(i), (prev->flags >> i) & 0x01,
+				(cur->flags >> i) & 0x01);
+		changes++;
+	}
+
+	if (diff)
+		fflush(stdout);
+
+	return changes;
+}
+
+static void watch_flags(int fd, uint32_t rate, uint32_t sample_cnt)
+{
+	struct chipio_flag_snapshot snaps[2];
+	struct watch_loop loop = {
+		.fd            = fd,
+		.rate          = rate,
+		.sample_cnt    = sample_cnt,
+		.sample        = flag_sample,
+		.print_changes = print_flag_changes,
+	};
+	double start;
+
+	flag_sample(&loop, &snaps[0], &start);
+	printf("Watching flags, current 0x%07x.\n", snaps[0].flags);
+	fflush(stdout);
+
+	watch_loop_run(&loop, &snaps[0], &snaps[1], start);
 }
 
 int main(int argc, char **argv)
 {
         int fd, ret;
-	uint32_t i;
 
 	if (argc < 2) {
 		usage(argv[0]);
@@ -24,13 +112,15 @@ int main(int argc, char **argv)
 	if (ret)
 		return ret;
 
-	for (i = 0; i < 0x19; i++) {
-		printf("Flag %s, set %d.\n", chipio_get_flag_str(i),
-				chipio_get_control_flag(fd, i));
-	}
+	if (argc > 2 && !strcmp(argv[2], "watch"))
+		watch_flags(fd, (argc > 3) ? strtol(argv[3], NULL, 0) : 0,
+				(argc > 4) ? strtol(argv[4], NULL, 0) : 0);
+	else if (argc > 2 && !strcmp(argv[2], "params"))
+		print_params(fd);
+	else
+		print_flags(fd);
 
         close(fd);
 
         return 0;
 }
-
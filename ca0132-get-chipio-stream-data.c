@@ -1,6 +1,10 @@
 /*
  * ca0132-get-chipio-stream-data.c:
  * Prints out all chipio streams and their associated values.
+ *
+ * In watch mode, only the fields that matter for stream setup are read, as
+ * fast as possible or at a fixed rate, and any changes between samples are
+ * printed with a timestamp.
  */
 #include "ca0132_defs.h"
 
@@ -20,26 +24,58 @@ struct chipio_stream_data {
 	uint16_t hda_stream_format;
 };
 
+#define STREAM_CNT        0x26
+#define STREAM_ENTRY_SIZE 0x0a
+#define STREAM_TABLE_ADDR 0x72f
+
+struct stream_watch_field {
+	const char *name;
+	uint32_t offset;
+	uint32_t size;
+};
+
+/* Stream table entry fields checked in watch mode. */
+static const struct stream_watch_field watch_fields[] = {
+	{ "SourceConnID",  1, 1 },
+	{ "DestConnID",    3, 1 },
+	{ "Active",        5, 1 },
+	{ "HDA StreamID",  7, 1 },
+	{ "HDA StreamFmt", 8, 2 },
+};
+
+struct stream_watch_sample {
+	uint8_t table[STREAM_CNT * STREAM_ENTRY_SIZE];
+	struct stream_ports ports;
+};
+
 static void usage(char *pname)
 {
-        fprintf(stderr, "usage: %s <hwdep-device>\n", pname);
+        fprintf(stderr, "usage: %s <hwdep-device> [watch] [rate-hz] [sample-cnt]\n", pname);
 }
 
-static void get_stream_ports(int fd, struct stream_ports *data)
+static int add_stream_ports_reads(struct chipio_read_plan *plan,
+		struct stream_ports *data)
 {
-	chipio_8051_read_exram_data_range(fd, 0x1578, 0x26, data->start_port);
-	chipio_8051_read_exram_data_range(fd, 0x159d, 0x26, data->end_port);
+	return chipio_read_plan_add(plan, CHIPIO_SPACE_EXRAM, 0x1578, 0x26, data->start_port) ||
+		chipio_read_plan_add(plan, CHIPIO_SPACE_EXRAM, 0x159d, 0x26, data->end_port);
 }
 
-static void get_stream_data(int fd, struct chipio_stream_data *stream,
+static int get_stream_data(int fd, struct chipio_stream_data *stream,
 	       struct stream_ports *ports)
 {
+	struct chipio_read_plan plan;
 	uint32_t i, offset, tmp;
 	uint8_t buf[0x17c];
 
-	/* Buffer to store the streamID table. */
+	/* Buffer to store the streamID table, read along with the ports. */
 	memset(buf, 0, sizeof(buf));
-	chipio_8051_read_exram_data_range(fd, 0x72f, 0x26 * 0x0a, buf);
+	chipio_read_plan_init(&plan, 0);
+	if (chipio_read_plan_add(&plan, CHIPIO_SPACE_EXRAM, STREAM_TABLE_ADDR,
+			STREAM_CNT * STREAM_ENTRY_SIZE, buf) ||
+			add_stream_ports_reads(&plan, ports) ||
+			chipio_read_plan_run(fd, &plan))
+		return 1;
+
 	for (i = 0; i < 0x26; i++) {
 		offset = i * 0x0a;
 
@@ -57,7 +93,7 @@ static void get_stream_data(int fd, struct chipio_stream_data *stream,
 		stream[i].hda_stream_format = tmp;
 	}
 
-	get_stream_ports(fd, ports);
+	return 0;
 }
 
 static void print_stream_data(struct chipio_stream_data *stream,
@@ -87,13 +123,126 @@ static void print_stream_data(struct chipio_stream_data *stream,
 	}
 }
 
+/* Only read the watched fields of each entry, and the port tables. */
+static int get_watch_sample(int fd, struct stream_watch_sample *sample)
+{
+	const struct stream_watch_field *field;
+	struct chipio_read_plan plan;
+	uint32_t i, j, offset;
+
+	chipio_read_plan_init(&plan, 0);
+	for (i = 0; i < STREAM_CNT; i++) {
+		for (j = 0; j < ARRAY_SIZE(watch_fields); j++) {
+			field = &watch_fields[j];
+			offset = (i * STREAM_ENTRY_SIZE) + field->offset;
+			if (chipio_read_plan_add(&plan, CHIPIO_SPACE_EXRAM,
+					STREAM_TABLE_ADDR + offset, field->size,
+					&sample->table[offset]))
+				return 1;
+		}
+	}
+
+	if (add_stream_ports_reads(&plan, &sample->ports))
+		return 1;
+
+	return chipio_read_plan_run(fd, &plan);
+}
+
+static uint32_t get_watch_field_val(const struct stream_watch_sample *sample,
+		uint32_t stream, const struct stream_watch_field *field)
+{
+	const uint8_t *data = &sample->table[(stream * STREAM_ENTRY_SIZE) + field->offset];
+
+	if (field->size == 2)
+		return data[0] | (data[1] << 8);
+
+	return data[0];
+}
+
+static int watch_sample(struct watch_loop *loop, void *cur, double *time)
+{
+	if (get_watch_sample(loop->fd, cur))
+		return 1;
+
+	*time = get_monotonic_time();
+
+	return 0;
+}
+
+static uint32_t print_watch_changes(struct watch_loop *loop, const void *prev_sample,
+		const void *cur_sample, double time)
+{
+	const struct stream_watch_sample *prev = prev_sample;
+	const struct stream_watch_sample *cur = cur_sample;
+	const struct stream_watch_field *field;
+	uint32_t i, j, old_val, new_val, cnt;
+
+	cnt = 0;
+	for (i = 0; i < STREAM_CNT; i++) {
+		for (j = 0; j < ARRAY_SIZE(watch_fields); j++) {
+			field = &watch_fields[j];
+			old_val = get_watch_field_val(prev, i, field);
+			new_val = get_watch_field_val(cur, i, field);
+			if (old_val == new_val)
+				continue;
+
+			printf("[%11.6f] Stream 0x%02x %-13s 0x%0*x -> 0x%0*x\n", time, i,
+					field->name, field->size * 2, old_val,
+					field->size * 2, new_val);
+			cnt++;
+		}
+
+		if (prev->ports.start_port[i] != cur->ports.start_port[i] ||
+				prev->ports.end_port[i] != cur->ports.end_port[i]) {
+			printf("[%11.6f] Stream 0x%02x %-13s 0x%02x-0x%02x -> 0x%02x-0x%02x\n",
+					time, i, "Ports", prev->ports.start_port[i],
+					prev->ports.end_port[i], cur->ports.start_port[i],
+					cur->ports.end_port[i]);
+			cnt++;
+		}
+	}
+
+	if (cnt)
+		fflush(stdout);
+
+	return cnt;
+}
+
+/*
+ * Sample the stream table until sample_cnt samples have been taken, or
+ * forever if it's 0. A rate of 0 samples as fast as the verb interface
+ * allows.
+ */
+static int watch_stream_data(int fd, uint32_t rate, uint32_t sample_cnt)
+{
+	struct stream_watch_sample samples[2];
+	struct watch_loop loop = {
+		.fd            = fd,
+		.rate          = rate,
+		.sample_cnt    = sample_cnt,
+		.sample        = watch_sample,
+		.print_changes = print_watch_changes,
+	};
+	double start;
+
+	memset(samples, 0, sizeof(samples));
+	if (watch_sample(&loop, &samples[0], &start))
+		return 1;
+
+	printf("Watching %d streams, %d fields each.\n", STREAM_CNT,
+			(int)ARRAY_SIZE(watch_fields) + 1);
+	fflush(stdout);
+
+	return watch_loop_run(&loop, &samples[0], &samples[1], start);
+}
+
 int main(int argc, char **argv)
 {
 	struct chipio_stream_data stream[0x26];
 	struct stream_ports ports;
   	int fd, ret;
 
-	if (argc < 1) {
+	if (argc < 2) {
 		usage(argv[0]);
 		return 1;
 	}
@@ -102,13 +251,26 @@ int main(int argc, char **argv)
 	if (ret)
 		return ret;
 
+	if (argc > 2 && !strcmp(argv[2], "watch")) {
+		ret = watch_stream_data(fd, (argc > 3) ? strtol(argv[3], NULL, 0) : 0,
+				(argc > 4) ? strtol(argv[4], NULL, 0) : 0);
+		if (ret)
+			printf("Failed to read stream data.\n");
+
+		close(fd);
+		return ret;
+	}
+
 	memset(&ports, 0, sizeof(ports));
 	memset(stream, 0, sizeof(stream));
 
-	get_stream_data(fd, stream, &ports);
-	print_stream_data(stream, &ports);
+	ret = get_stream_data(fd, stream, &ports);
+	if (ret)
+		printf("Failed to read stream data.\n");
+	else
+		print_stream_data(stream, &ports);
 
 	close(fd);
 
-        return 0;
+        return ret;
 }
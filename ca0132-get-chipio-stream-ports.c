@@ -2,52 +2,235 @@
  * ca0132-get-chipio-stream-ports.c:
  * Prints out all currently active ChipIO streams that are using the audio
  * router at HCI address 0x190000, and prints the associated values.
+ *
+ * The port ranges of all active streams are read in as few HIC reads as
+ * possible, ranges that are adjacent or close to each other are merged into
+ * one auto-incrementing read. 'all' reads every port in a single read, and
+ * 'watch' keeps reading the active ports and prints any that change.
  */
 #include "ca0132_defs.h"
 
+#define STREAM_CNT     0x26
+#define PORT_CNT       0x100
+#define PORT_BASE_ADDR 0x190000
+
+/*
+ * Setting a new HIC address costs about as many verbs as reading a word, so
+ * reading through a gap of a word is no worse than starting a new read.
+ */
+#define PORT_READ_GAP 1
+
 struct stream_ports {
-	uint8_t start_port[0x26];
-	uint8_t end_port[0x26];
+	uint8_t start_port[STREAM_CNT];
+	uint8_t end_port[STREAM_CNT];
+};
+
+struct port_sample {
+	struct stream_ports ports;
+	uint32_t val[PORT_CNT];
+	uint32_t reads;
 };
 
 static void usage(char *pname)
 {
-        fprintf(stderr, "usage: %s <hwdep-device>\n", pname);
+        fprintf(stderr, "usage: %s <hwdep-device> [all]\n", pname);
+        fprintf(stderr, "       %s <hwdep-device> watch [rate-hz] [sample-cnt]\n", pname);
+}
+
+static int get_stream_ports(int fd, struct stream_ports *data)
+{
+	struct chipio_read_plan plan;
+
+	chipio_read_plan_init(&plan, 0);
+	if (chipio_read_plan_add(&plan, CHIPIO_SPACE_EXRAM, 0x1578, STREAM_CNT, data->start_port) ||
+	    chipio_read_plan_add(&plan, CHIPIO_SPACE_EXRAM, 0x159d, STREAM_CNT, data->end_port))
+		return 1;
+
+	return chipio_read_plan_run(fd, &plan);
+}
+
+static uint32_t stream_is_active(const struct stream_ports *data, uint32_t stream)
+{
+	if ((data->start_port[stream] == 0xff) || (data->end_port[stream] == 0xff))
+		return 0;
+
+	if (data->end_port[stream] < data->start_port[stream])
+		return 0;
+
+	return 1;
+}
+
+/*
+ * Read the ports of every active stream into val, indexed by port number.
+ * The number of HIC reads it took is stored in reads, if it isn't NULL.
+ */
+static int read_active_ports(int fd, struct stream_ports *data, uint32_t *val,
+		uint32_t *reads)
+{
+	struct chipio_read_plan plan;
+	uint32_t i, start, cnt;
+
+	chipio_read_plan_init(&plan, PORT_READ_GAP);
+	for (i = 0; i < STREAM_CNT; i++) {
+		if (!stream_is_active(data, i))
+			continue;
+
+		start = data->start_port[i];
+		cnt = data->end_port[i] - start + 1;
+		if (chipio_read_plan_add(&plan, CHIPIO_SPACE_HIC,
+				PORT_BASE_ADDR + (start * 0x04), cnt, &val[start]))
+			return 1;
+	}
+
+	if (chipio_read_plan_run(fd, &plan))
+		return 1;
+
+	if (reads)
+		*reads = plan.span_cnt;
+
+	return 0;
+}
+
+static void print_stream_ports(struct stream_ports *data, uint32_t *val,
+		uint32_t stream)
+{
+	uint32_t i, start, cnt;
+
+	start = data->start_port[stream];
+	cnt = data->end_port[stream] - start;
+	printf("Stream 0x%02x, start 0x%02x, cnt %d.\n", stream, start, cnt + 1);
+
+	for (i = start; i < (start + cnt + 1); i++)
+		printf("    port 0x%06x: 0x%08x\n", PORT_BASE_ADDR + (i * 0x04), val[i]);
 }
 
-static void get_stream_ports(int fd, struct stream_ports *data)
+static int check_stream_ports(int fd, struct stream_ports *data)
 {
-	chipio_8051_read_exram_data_range(fd, 0x1578, 0x26, data->start_port);
-	chipio_8051_read_exram_data_range(fd, 0x159d, 0x26, data->end_port);
+	uint32_t val[PORT_CNT];
+	uint32_t i;
+
+	memset(val, 0, sizeof(val));
+	if (read_active_ports(fd, data, val, NULL))
+		return 1;
+
+	for (i = 0; i < STREAM_CNT; i++) {
+		if (!stream_is_active(data, i))
+			continue;
+
+		print_stream_ports(data, val, i);
+	}
+
+	return 0;
 }
 
-static void print_stream_ports(int fd, struct stream_ports *data, uint32_t stream)
+/* Read the entire port table in one go, and note which stream owns each. */
+static void dump_all_ports(int fd, struct stream_ports *data)
 {
-	uint32_t cur_addr = 0x190000;
-	uint32_t i, cnt;
-
-	cur_addr += (data->start_port[stream] * 0x04);
-	cnt = data->end_port[stream] - data->start_port[stream];
-	printf("Stream 0x%02x, start 0x%02x, cnt %d.\n", stream,
-			data->start_port[stream], cnt + 1);
-
-	for (i = 0; i < (cnt + 1); i++) {
-		printf("    port 0x%06x: 0x%08x\n", cur_addr,
-				chipio_hic_read_at_addr(fd, cur_addr));
-		cur_addr += 0x04;
+	uint32_t val[PORT_CNT];
+	uint32_t i, j;
+
+	chipio_hic_read_data_range(fd, PORT_BASE_ADDR, PORT_CNT, val);
+
+	for (i = 0; i < PORT_CNT; i++) {
+		printf("port 0x%06x: 0x%08x", PORT_BASE_ADDR + (i * 0x04), val[i]);
+		for (j = 0; j < STREAM_CNT; j++) {
+			if (stream_is_active(data, j) && i >= data->start_port[j] &&
+					i <= data->end_port[j])
+				printf(", stream 0x%02x", j);
+		}
+
+		printf("\n");
 	}
 }
 
-static void check_stream_ports(int fd, struct stream_ports *data)
+static int get_port_sample(int fd, struct port_sample *sample)
+{
+	memset(sample, 0, sizeof(*sample));
+	if (get_stream_ports(fd, &sample->ports))
+		return 1;
+
+	return read_active_ports(fd, &sample->ports, sample->val, &sample->reads);
+}
+
+static uint32_t port_is_active(const struct stream_ports *data, uint32_t port)
 {
 	uint32_t i;
 
-	for (i = 0; i < 0x26; i++) {
-		if ((data->start_port[i] == 0xff) || (data->end_port[i] == 0xff))
-				continue;
+	for (i = 0; i < STREAM_CNT; i++) {
+		if (stream_is_active(data, i) && port >= data->start_port[i] &&
+				port <= data->end_port[i])
+			return 1;
+	}
+
+	return 0;
+}
+
+static int port_sample(struct watch_loop *loop, void *cur, double *time)
+{
+	if (get_port_sample(loop->fd, cur))
+		return 1;
+
+	*time = get_monotonic_time();
+
+	return 0;
+}
+
+/* Print any stream range changes, and any changed port values. */
+static uint32_t print_port_changes(struct watch_loop *loop, const void *prev_sample,
+		const void *cur_sample, double time)
+{
+	const struct port_sample *prev = prev_sample;
+	const struct port_sample *cur = cur_sample;
+	uint32_t i, changes;
+
+	changes = 0;
+	for (i = 0; i < STREAM_CNT; i++) {
+		if (prev->ports.start_port[i] == cur->ports.start_port[i] &&
+				prev->ports.end_port[i] == cur->ports.end_port[i])
+			continue;
 
-		print_stream_ports(fd, data, i);
+		printf("[%11.6f] Stream 0x%02x ports 0x%02x-0x%02x -> 0x%02x-0x%02x\n",
+				time, i, prev->ports.start_port[i],
+				prev->ports.end_port[i], cur->ports.start_port[i],
+				cur->ports.end_port[i]);
+		changes++;
 	}
+
+	for (i = 0; i < PORT_CNT; i++) {
+		if (prev->val[i] == cur->val[i] || !port_is_active(&cur->ports, i) ||
+				!port_is_active(&prev->ports, i))
+			continue;
+
+		printf("[%11.6f] port 0x%06x 0x%08x -> 0x%08x\n", time,
+				PORT_BASE_ADDR + (i * 0x04), prev->val[i], cur->val[i]);
+		changes++;
+	}
+
+	if (changes)
+		fflush(stdout);
+
+	return changes;
+}
+
+static int watch_stream_ports(int fd, uint32_t rate, uint32_t sample_cnt)
+{
+	struct port_sample samples[2];
+	struct watch_loop loop = {
+		.fd            = fd,
+		.rate          = rate,
+		.sample_cnt    = sample_cnt,
+		.sample        = port_sample,
+		.print_changes = print_port_changes,
+	};
+	double start;
+
+	if (port_sample(&loop, &samples[0], &start))
+		return 1;
+
+	printf("Watching active ports, %d HIC reads per sample.\n", samples[0].reads);
+	fflush(stdout);
+
+	return watch_loop_run(&loop, &samples[0], &samples[1], start);
 }
 
 int main(int argc, char **argv)
@@ -55,7 +238,7 @@ int main(int argc, char **argv)
 	struct stream_ports data;
         int fd, ret;
 
-	if (argc < 1) {
+	if (argc < 2) {
 		usage(argv[0]);
 		return 1;
 	}
@@ -64,12 +247,30 @@ int main(int argc, char **argv)
 	if (ret)
 		return ret;
 
+	if (argc > 2 && !strcmp(argv[2], "watch")) {
+		ret = watch_stream_ports(fd, (argc > 3) ? strtol(argv[3], NULL, 0) : 0,
+				(argc > 4) ? strtol(argv[4], NULL, 0) : 0);
+		if (ret)
+			printf("Failed to read stream ports.\n");
+
+		close(fd);
+		return ret;
+	}
+
 	memset(&data, 0, sizeof(data));
 
-	get_stream_ports(fd, &data);
-	check_stream_ports(fd, &data);
+	ret = get_stream_ports(fd, &data);
+	if (!ret) {
+		if (argc > 2 && !strcmp(argv[2], "all"))
+			dump_all_ports(fd, &data);
+		else
+			ret = check_stream_ports(fd, &data);
+	}
+
+	if (ret)
+		printf("Failed to read stream ports.\n");
 
 	close(fd);
 
-        return 0;
+        return ret;
 }
@@ -0,0 +1,1112 @@
+/*
+ * ca0132_8051_emu.c:
+ * 8051 emulator for running the ca0132's firmware offline, from save states
+ * created by ca0132-8051-dump-state. Also has the save state read/write
+ * functions.
+ *
+ * Opcodes are dispatched through a table of handlers indexed by the opcode
+ * byte. Interrupts and timers aren't emulated, and SFR's only hold whatever
+ * was last written to them unless hooks are set to model the hardware behind
+ * them.
+ */
+#include "ca0132_defs.h"
+
+/* SFR addresses. */
+#define SFR_P0   0x80
+#define SFR_SP   0x81
+#define SFR_DPL  0x82
+#define SFR_DPH  0x83
+#define SFR_DPL1 0x84
+#define SFR_DPH1 0x85
+#define SFR_DPS  0x86
+#define SFR_P2   0xa0
+#define SFR_PSW  0xd0
+#define SFR_ACC  0xe0
+#define SFR_B    0xf0
+#define SFR_BANK 0xfa
+
+/* PSW bits. */
+#define PSW_CY 0x80
+#define PSW_AC 0x40
+#define PSW_OV 0x04
+#define PSW_P  0x01
+
+#define ACC(dev) ((dev)->sfr[SFR_ACC - 0x80])
+#define PSW(dev) ((dev)->sfr[SFR_PSW - 0x80])
+#define SP(dev)  ((dev)->sfr[SFR_SP - 0x80])
+#define B(dev)   ((dev)->sfr[SFR_B - 0x80])
+
+/*
+ * ChipIO ParamID handlers are called through a table of big endian handler
+ * addresses in XRAM, with the value in IRAM 0x6f. The table location comes
+ * from ParamID 0x24's entry at 0x1759, which ca0132-8051-dump-state
+ * overwrites.
+ */
+#define PARAM_HANDLER_TBL_ADDR (0x1759 - (0x24 * 2))
+#define PARAM_HANDLER_VAL_ADDR 0x6f
+#define PARAM_HANDLER_MAX_INSNS 1000000
+
+typedef void (*emu8051_op_func)(struct emu8051_dev *dev, uint8_t op);
+
+/*
+ * Memory access functions.
+ */
+
+/*
+ * 0x0000-0x7fff is the common program memory, 0x8000-0xdfff is split into
+ * three 8KB windows that can each be mapped to either program memory bank,
+ * and 0xe000-0xffff maps to XRAM. The dump handlers use 0x15 to map every
+ * window to bank 0, and 0x2a for bank 1, so the bank register seems to have
+ * two bits per window.
+ */
+uint8_t emu8051_code_read(struct emu8051_dev *dev, uint16_t addr)
+{
+	uint32_t window, sel;
+
+	if (addr < 0x8000)
+		return dev->pmem[addr];
+
+	if (addr >= 0xe000)
+		return dev->xram[addr];
+
+	window = (addr - 0x8000) >> 13;
+	sel = (dev->sfr[SFR_BANK - 0x80] >> (window * 2)) & 0x03;
+	if (sel == 0x02)
+		return dev->pmem_b1[addr - 0x8000];
+
+	return dev->pmem_b0[addr - 0x8000];
+}
+
+static inline uint8_t fetch(struct emu8051_dev *dev)
+{
+	return emu8051_code_read(dev, dev->pc++);
+}
+
+static uint8_t get_parity(uint8_t val)
+{
+	val ^= val >> 4;
+	val ^= val >> 2;
+	val ^= val >> 1;
+
+	return val & 0x01;
+}
+
+static uint8_t sfr_read(struct emu8051_dev *dev, uint8_t addr)
+{
+	uint8_t val;
+
+	if (addr == SFR_PSW)
+		PSW(dev) = (PSW(dev) & ~PSW_P) | get_parity(ACC(dev));
+
+	val = dev->sfr[addr - 0x80];
+	if (dev->sfr_read)
+		val = dev->sfr_read(dev, addr, val);
+
+	return val;
+}
+
+static void sfr_write(struct emu8051_dev *dev, uint8_t addr, uint8_t val)
+{
+	dev->sfr[addr - 0x80] = val;
+	if (dev->sfr_write)
+		dev->sfr_write(dev, addr, val);
+}
+
+static inline uint8_t direct_read(struct emu8051_dev *dev, uint8_t addr)
+{
+	if (addr < 0x80)
+		return dev->iram[addr];
+
+	return sfr_read(dev, addr);
+}
+
+static inline void direct_write(struct emu8051_dev *dev, uint8_t addr, uint8_t val)
+{
+	if (addr < 0x80)
+		dev->iram[addr] = val;
+	else
+		sfr_write(dev, addr, val);
+}
+
+static inline uint8_t *reg_ptr(struct emu8051_dev *dev, uint8_t reg)
+{
+	return &dev->iram[(PSW(dev) & 0x18) + (reg & 0x07)];
+}
+
+/* Indirect accesses through R0/R1 always go to IRAM, never SFR's. */
+static inline uint8_t *ind_ptr(struct emu8051_dev *dev, uint8_t op)
+{
+	return &dev->iram[*reg_ptr(dev, op & 0x01)];
+}
+
+static uint8_t bit_read(struct emu8051_dev *dev, uint8_t bit)
+{
+	uint8_t addr;
+
+	addr = (bit < 0x80) ? 0x20 + (bit >> 3) : bit & 0xf8;
+
+	return (direct_read(dev, addr) >> (bit & 0x07)) & 0x01;
+}
+
+static void bit_write(struct emu8051_dev *dev, uint8_t bit, uint8_t val)
+{
+	uint8_t addr, tmp;
+
+	addr = (bit < 0x80) ? 0x20 + (bit >> 3) : bit & 0xf8;
+	tmp = direct_read(dev, addr) & ~(1 << (bit & 0x07));
+	if (val)
+		tmp |= 1 << (bit & 0x07);
+
+	direct_write(dev, addr, tmp);
+}
+
+/* The second data pointer is selected with bit 0 of DPS. */
+static uint16_t dptr_get(struct emu8051_dev *dev)
+{
+	uint8_t dpl = (dev->sfr[SFR_DPS - 0x80] & 0x01) ? SFR_DPL1 : SFR_DPL;
+
+	return (dev->sfr[dpl + 1 - 0x80] << 8) | dev->sfr[dpl - 0x80];
+}
+
+static void dptr_set(struct emu8051_dev *dev, uint16_t val)
+{
+	uint8_t dpl = (dev->sfr[SFR_DPS - 0x80] & 0x01) ? SFR_DPL1 : SFR_DPL;
+
+	dev->sfr[dpl - 0x80] = val & 0xff;
+	dev->sfr[dpl + 1 - 0x80] = val >> 8;
+}
+
+static void push(struct emu8051_dev *dev, uint8_t val)
+{
+	SP(dev)++;
+	dev->iram[SP(dev)] = val;
+}
+
+static uint8_t pop(struct emu8051_dev *dev)
+{
+	return dev->iram[SP(dev)--];
+}
+
+static void set_carry(struct emu8051_dev *dev, uint8_t carry)
+{
+	if (carry)
+		PSW(dev) |= PSW_CY;
+	else
+		PSW(dev) &= ~PSW_CY;
+}
+
+static uint8_t get_carry(struct emu8051_dev *dev)
+{
+	return (PSW(dev) & PSW_CY) ? 1 : 0;
+}
+
+static void rel_jmp(struct emu8051_dev *dev, uint8_t rel)
+{
+	dev->pc += (int8_t)rel;
+}
+
+/*
+ * Source operand for ALU ops, selected by the low nibble of the opcode:
+ * immediate, direct, indirect through R0/R1, or R0-R7.
+ */
+static uint8_t get_alu_src(struct emu8051_dev *dev, uint8_t op)
+{
+	switch (op & 0x0f) {
+	case 0x04:
+		return fetch(dev);
+	case 0x05:
+		return direct_read(dev, fetch(dev));
+	case 0x06:
+	case 0x07:
+		return *ind_ptr(dev, op);
+	default:
+		return *reg_ptr(dev, op);
+	}
+}
+
+/*
+ * ALU helpers.
+ */
+static void alu_add(struct emu8051_dev *dev, uint8_t val, uint8_t carry)
+{
+	uint8_t acc = ACC(dev);
+	uint16_t res = acc + val + carry;
+
+	PSW(dev) &= ~(PSW_CY | PSW_AC | PSW_OV);
+	if (res > 0xff)
+		PSW(dev) |= PSW_CY;
+	if ((acc & 0x0f) + (val & 0x0f) + carry > 0x0f)
+		PSW(dev) |= PSW_AC;
+	if (~(acc ^ val) & (acc ^ res) & 0x80)
+		PSW(dev) |= PSW_OV;
+
+	ACC(dev) = res & 0xff;
+}
+
+static void alu_subb(struct emu8051_dev *dev, uint8_t val)
+{
+	uint8_t acc = ACC(dev), carry = get_carry(dev);
+	uint8_t res = acc - val - carry;
+
+	PSW(dev) &= ~(PSW_CY | PSW_AC | PSW_OV);
+	if (acc < val + carry)
+		PSW(dev) |= PSW_CY;
+	if ((acc & 0x0f) < (val & 0x0f) + carry)
+		PSW(dev) |= PSW_AC;
+	if ((acc ^ val) & (acc ^ res) & 0x80)
+		PSW(dev) |= PSW_OV;
+
+	ACC(dev) = res;
+}
+
+/*
+ * Opcode handlers.
+ */
+static void op_nop(struct emu8051_dev *dev, uint8_t op)
+{
+}
+
+static void op_invalid(struct emu8051_dev *dev, uint8_t op)
+{
+	dev->pc--;
+	dev->stop_reason = EMU8051_STOP_INVALID_OP;
+}
+
+static void op_ajmp(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t lo = fetch(dev);
+
+	dev->pc = (dev->pc & 0xf800) | ((op & 0xe0) << 3) | lo;
+}
+
+static void op_acall(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t lo = fetch(dev);
+
+	push(dev, dev->pc & 0xff);
+	push(dev, dev->pc >> 8);
+	dev->pc = (dev->pc & 0xf800) | ((op & 0xe0) << 3) | lo;
+}
+
+static void op_ljmp(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t hi = fetch(dev);
+
+	dev->pc = (hi << 8) | fetch(dev);
+}
+
+static void op_lcall(struct emu8051_dev *dev, uint8_t op)
+{
+	uint16_t addr;
+
+	addr = fetch(dev) << 8;
+	addr |= fetch(dev);
+	push(dev, dev->pc & 0xff);
+	push(dev, dev->pc >> 8);
+	dev->pc = addr;
+}
+
+static void op_ret(struct emu8051_dev *dev, uint8_t op)
+{
+	uint16_t addr;
+
+	addr = pop(dev) << 8;
+	addr |= pop(dev);
+	dev->pc = addr;
+
+	if (dev->ret_sp && SP(dev) == dev->ret_sp)
+		dev->stop_reason = EMU8051_STOP_RETURN;
+}
+
+static void op_rotate(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t acc = ACC(dev), carry;
+
+	switch (op) {
+	case 0x03: /* RR A */
+		ACC(dev) = (acc >> 1) | (acc << 7);
+		break;
+	case 0x13: /* RRC A */
+		carry = get_carry(dev);
+		set_carry(dev, acc & 0x01);
+		ACC(dev) = (acc >> 1) | (carry << 7);
+		break;
+	case 0x23: /* RL A */
+		ACC(dev) = (acc << 1) | (acc >> 7);
+		break;
+	case 0x33: /* RLC A */
+		carry = get_carry(dev);
+		set_carry(dev, acc & 0x80);
+		ACC(dev) = (acc << 1) | carry;
+		break;
+	}
+}
+
+static void op_inc_dec(struct emu8051_dev *dev, uint8_t op)
+{
+	int8_t inc = (op & 0x10) ? -1 : 1;
+	uint8_t addr, *ptr;
+
+	switch (op & 0x0f) {
+	case 0x04:
+		ACC(dev) += inc;
+		return;
+	case 0x05:
+		addr = fetch(dev);
+		direct_write(dev, addr, direct_read(dev, addr) + inc);
+		return;
+	case 0x06:
+	case 0x07:
+		ptr = ind_ptr(dev, op);
+		break;
+	default:
+		ptr = reg_ptr(dev, op);
+		break;
+	}
+
+	*ptr += inc;
+}
+
+static void op_inc_dptr(struct emu8051_dev *dev, uint8_t op)
+{
+	dptr_set(dev, dptr_get(dev) + 1);
+}
+
+/* JBC/JB/JNB. */
+static void op_jbit(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t bit, rel, val;
+
+	bit = fetch(dev);
+	rel = fetch(dev);
+	val = bit_read(dev, bit);
+
+	if (op == 0x30)
+		val = !val;
+	else if (op == 0x10 && val)
+		bit_write(dev, bit, 0);
+
+	if (val)
+		rel_jmp(dev, rel);
+}
+
+/* JC/JNC/JZ/JNZ/SJMP. */
+static void op_jrel(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t rel = fetch(dev), taken;
+
+	switch (op) {
+	case 0x40:
+		taken = get_carry(dev);
+		break;
+	case 0x50:
+		taken = !get_carry(dev);
+		break;
+	case 0x60:
+		taken = !ACC(dev);
+		break;
+	case 0x70:
+		taken = !!ACC(dev);
+		break;
+	default:
+		taken = 1;
+		break;
+	}
+
+	if (taken)
+		rel_jmp(dev, rel);
+}
+
+static void op_add(struct emu8051_dev *dev, uint8_t op)
+{
+	alu_add(dev, get_alu_src(dev, op), 0);
+}
+
+static void op_addc(struct emu8051_dev *dev, uint8_t op)
+{
+	alu_add(dev, get_alu_src(dev, op), get_carry(dev));
+}
+
+static void op_subb(struct emu8051_dev *dev, uint8_t op)
+{
+	alu_subb(dev, get_alu_src(dev, op));
+}
+
+static uint8_t logic_op(uint8_t op, uint8_t a, uint8_t b)
+{
+	switch (op & 0xf0) {
+	case 0x40:
+		return a | b;
+	case 0x50:
+		return a & b;
+	default:
+		return a ^ b;
+	}
+}
+
+/* ORL/ANL/XRL, including the direct address destination forms. */
+static void op_logic(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t addr, val;
+
+	switch (op & 0x0f) {
+	case 0x02:
+		addr = fetch(dev);
+		direct_write(dev, addr, logic_op(op, direct_read(dev, addr), ACC(dev)));
+		break;
+	case 0x03:
+		addr = fetch(dev);
+		val = fetch(dev);
+		direct_write(dev, addr, logic_op(op, direct_read(dev, addr), val));
+		break;
+	default:
+		ACC(dev) = logic_op(op, ACC(dev), get_alu_src(dev, op));
+		break;
+	}
+}
+
+/* ORL/ANL C with a bit or its complement. */
+static void op_logic_c(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t val = bit_read(dev, fetch(dev));
+
+	if (op == 0xa0 || op == 0xb0)
+		val = !val;
+
+	if (op == 0x72 || op == 0xa0)
+		set_carry(dev, get_carry(dev) | val);
+	else
+		set_carry(dev, get_carry(dev) & val);
+}
+
+static void op_jmp_a_dptr(struct emu8051_dev *dev, uint8_t op)
+{
+	dev->pc = dptr_get(dev) + ACC(dev);
+}
+
+static void op_mov_imm(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t addr;
+
+	switch (op & 0x0f) {
+	case 0x04:
+		ACC(dev) = fetch(dev);
+		break;
+	case 0x05:
+		addr = fetch(dev);
+		direct_write(dev, addr, fetch(dev));
+		break;
+	case 0x06:
+	case 0x07:
+		*ind_ptr(dev, op) = fetch(dev);
+		break;
+	default:
+		*reg_ptr(dev, op) = fetch(dev);
+		break;
+	}
+}
+
+static void op_movc(struct emu8051_dev *dev, uint8_t op)
+{
+	uint16_t base = (op == 0x83) ? dev->pc : dptr_get(dev);
+
+	ACC(dev) = emu8051_code_read(dev, base + ACC(dev));
+}
+
+static void op_div(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t acc = ACC(dev), b = B(dev);
+
+	PSW(dev) &= ~(PSW_CY | PSW_OV);
+	if (!b) {
+		PSW(dev) |= PSW_OV;
+		return;
+	}
+
+	ACC(dev) = acc / b;
+	B(dev) = acc % b;
+}
+
+static void op_mul(struct emu8051_dev *dev, uint8_t op)
+{
+	uint16_t res = ACC(dev) * B(dev);
+
+	PSW(dev) &= ~(PSW_CY | PSW_OV);
+	if (res > 0xff)
+		PSW(dev) |= PSW_OV;
+
+	ACC(dev) = res & 0xff;
+	B(dev) = res >> 8;
+}
+
+/* MOV to a direct address, from a direct address, @Ri, or Rn. */
+static void op_mov_to_direct(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t src, dst;
+
+	if (op == 0x85) {
+		src = direct_read(dev, fetch(dev));
+		dst = fetch(dev);
+	} else {
+		dst = fetch(dev);
+		if ((op & 0x0f) < 0x08)
+			src = *ind_ptr(dev, op);
+		else
+			src = *reg_ptr(dev, op);
+	}
+
+	direct_write(dev, dst, src);
+}
+
+/* MOV @Ri/Rn from a direct address. */
+static void op_mov_from_direct(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t val = direct_read(dev, fetch(dev));
+
+	if ((op & 0x0f) < 0x08)
+		*ind_ptr(dev, op) = val;
+	else
+		*reg_ptr(dev, op) = val;
+}
+
+static void op_mov_dptr(struct emu8051_dev *dev, uint8_t op)
+{
+	uint16_t val;
+
+	val = fetch(dev) << 8;
+	val |= fetch(dev);
+	dptr_set(dev, val);
+}
+
+static void op_bit_c(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t bit;
+
+	switch (op) {
+	case 0x92: /* MOV bit, C */
+		bit_write(dev, fetch(dev), get_carry(dev));
+		break;
+	case 0xa2: /* MOV C, bit */
+		set_carry(dev, bit_read(dev, fetch(dev)));
+		break;
+	case 0xb2: /* CPL bit */
+		bit = fetch(dev);
+		bit_write(dev, bit, !bit_read(dev, bit));
+		break;
+	case 0xb3: /* CPL C */
+		set_carry(dev, !get_carry(dev));
+		break;
+	case 0xc2: /* CLR bit */
+		bit_write(dev, fetch(dev), 0);
+		break;
+	case 0xc3: /* CLR C */
+		set_carry(dev, 0);
+		break;
+	case 0xd2: /* SETB bit */
+		bit_write(dev, fetch(dev), 1);
+		break;
+	case 0xd3: /* SETB C */
+		set_carry(dev, 1);
+		break;
+	}
+}
+
+static void op_cjne(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t a, b, rel;
+
+	switch (op & 0x0f) {
+	case 0x04:
+		a = ACC(dev);
+		b = fetch(dev);
+		break;
+	case 0x05:
+		a = ACC(dev);
+		b = direct_read(dev, fetch(dev));
+		break;
+	case 0x06:
+	case 0x07:
+		a = *ind_ptr(dev, op);
+		b = fetch(dev);
+		break;
+	default:
+		a = *reg_ptr(dev, op);
+		b = fetch(dev);
+		break;
+	}
+
+	rel = fetch(dev);
+	set_carry(dev, a < b);
+	if (a != b)
+		rel_jmp(dev, rel);
+}
+
+static void op_push(struct emu8051_dev *dev, uint8_t op)
+{
+	push(dev, direct_read(dev, fetch(dev)));
+}
+
+static void op_pop(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t addr = fetch(dev);
+
+	direct_write(dev, addr, pop(dev));
+}
+
+static void op_swap(struct emu8051_dev *dev, uint8_t op)
+{
+	ACC(dev) = (ACC(dev) << 4) | (ACC(dev) >> 4);
+}
+
+static void op_xch(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t addr, tmp, *ptr;
+
+	if ((op & 0x0f) == 0x05) {
+		addr = fetch(dev);
+		tmp = direct_read(dev, addr);
+		direct_write(dev, addr, ACC(dev));
+		ACC(dev) = tmp;
+		return;
+	}
+
+	ptr = ((op & 0x0f) < 0x08) ? ind_ptr(dev, op) : reg_ptr(dev, op);
+	tmp = *ptr;
+	*ptr = ACC(dev);
+	ACC(dev) = tmp;
+}
+
+static void op_xchd(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t *ptr = ind_ptr(dev, op), tmp;
+
+	tmp = *ptr & 0x0f;
+	*ptr = (*ptr & 0xf0) | (ACC(dev) & 0x0f);
+	ACC(dev) = (ACC(dev) & 0xf0) | tmp;
+}
+
+static void op_da(struct emu8051_dev *dev, uint8_t op)
+{
+	uint16_t acc = ACC(dev);
+
+	if ((acc & 0x0f) > 0x09 || (PSW(dev) & PSW_AC))
+		acc += 0x06;
+
+	if (acc > 0xff)
+		PSW(dev) |= PSW_CY;
+
+	if ((acc & 0x1f0) > 0x90 || (PSW(dev) & PSW_CY))
+		acc += 0x60;
+
+	if (acc > 0xff)
+		PSW(dev) |= PSW_CY;
+
+	ACC(dev) = acc & 0xff;
+}
+
+static void op_djnz(struct emu8051_dev *dev, uint8_t op)
+{
+	uint8_t addr, val, rel;
+
+	if (op == 0xd5) {
+		addr = fetch(dev);
+		val = direct_read(dev, addr) - 1;
+		direct_write(dev, addr, val);
+	} else {
+		val = --(*reg_ptr(dev, op));
+	}
+
+	rel = fetch(dev);
+	if (val)
+		rel_jmp(dev, rel);
+}
+
+/* MOVX @Ri uses P2 for the upper address byte. */
+static uint16_t movx_ri_addr(struct emu8051_dev *dev, uint8_t op)
+{
+	return (dev->sfr[SFR_P2 - 0x80] << 8) | *reg_ptr(dev, op & 0x01);
+}
+
+static void op_movx(struct emu8051_dev *dev, uint8_t op)
+{
+	switch (op) {
+	case 0xe0:
+		ACC(dev) = dev->xram[dptr_get(dev)];
+		break;
+	case 0xe2:
+	case 0xe3:
+		ACC(dev) = dev->xram[movx_ri_addr(dev, op)];
+		break;
+	case 0xf0:
+		dev->xram[dptr_get(dev)] = ACC(dev);
+		break;
+	default:
+		dev->xram[movx_ri_addr(dev, op)] = ACC(dev);
+		break;
+	}
+}
+
+static void op_clr_cpl_a(struct emu8051_dev *dev, uint8_t op)
+{
+	ACC(dev) = (op == 0xe4) ? 0x00 : ~ACC(dev);
+}
+
+static void op_mov_a(struct emu8051_dev *dev, uint8_t op)
+{
+	ACC(dev) = get_alu_src(dev, op);
+}
+
+static void op_mov_from_a(struct emu8051_dev *dev, uint8_t op)
+{
+	switch (op & 0x0f) {
+	case 0x05:
+		direct_write(dev, fetch(dev), ACC(dev));
+		break;
+	case 0x06:
+	case 0x07:
+		*ind_ptr(dev, op) = ACC(dev);
+		break;
+	default:
+		*reg_ptr(dev, op) = ACC(dev);
+		break;
+	}
+}
+
+#define AJMP_ACALL(n) [0x01 + (n * 0x20)] = op_ajmp, [0x11 + (n * 0x20)] = op_acall
+
+static const emu8051_op_func emu8051_ops[0x100] = {
+	AJMP_ACALL(0), AJMP_ACALL(1), AJMP_ACALL(2), AJMP_ACALL(3),
+	AJMP_ACALL(4), AJMP_ACALL(5), AJMP_ACALL(6), AJMP_ACALL(7),
+
+	[0x00] = op_nop,
+	[0x02] = op_ljmp,
+	[0x03] = op_rotate,
+	[0x04 ... 0x0f] = op_inc_dec,
+	[0x10] = op_jbit,
+	[0x12] = op_lcall,
+	[0x13] = op_rotate,
+	[0x14 ... 0x1f] = op_inc_dec,
+	[0x20] = op_jbit,
+	[0x22] = op_ret,
+	[0x23] = op_rotate,
+	[0x24 ... 0x2f] = op_add,
+	[0x30] = op_jbit,
+	[0x32] = op_ret, /* RETI */
+	[0x33] = op_rotate,
+	[0x34 ... 0x3f] = op_addc,
+	[0x40] = op_jrel,
+	[0x42 ... 0x4f] = op_logic,
+	[0x50] = op_jrel,
+	[0x52 ... 0x5f] = op_logic,
+	[0x60] = op_jrel,
+	[0x62 ... 0x6f] = op_logic,
+	[0x70] = op_jrel,
+	[0x72] = op_logic_c,
+	[0x73] = op_jmp_a_dptr,
+	[0x74 ... 0x7f] = op_mov_imm,
+	[0x80] = op_jrel,
+	[0x82] = op_logic_c,
+	[0x83] = op_movc,
+	[0x84] = op_div,
+	[0x85 ... 0x8f] = op_mov_to_direct,
+	[0x90] = op_mov_dptr,
+	[0x92] = op_bit_c,
+	[0x93] = op_movc,
+	[0x94 ... 0x9f] = op_subb,
+	[0xa0] = op_logic_c,
+	[0xa2] = op_bit_c,
+	[0xa3] = op_inc_dptr,
+	[0xa4] = op_mul,
+	[0xa5] = op_invalid,
+	[0xa6 ... 0xaf] = op_mov_from_direct,
+	[0xb0] = op_logic_c,
+	[0xb2 ... 0xb3] = op_bit_c,
+	[0xb4 ... 0xbf] = op_cjne,
+	[0xc0] = op_push,
+	[0xc2 ... 0xc3] = op_bit_c,
+	[0xc4] = op_swap,
+	[0xc5 ... 0xcf] = op_xch,
+	[0xd0] = op_pop,
+	[0xd2 ... 0xd3] = op_bit_c,
+	[0xd4] = op_da,
+	[0xd5] = op_djnz,
+	[0xd6 ... 0xd7] = op_xchd,
+	[0xd8 ... 0xdf] = op_djnz,
+	[0xe0] = op_movx,
+	[0xe2 ... 0xe3] = op_movx,
+	[0xe4] = op_clr_cpl_a,
+	[0xe5 ... 0xef] = op_mov_a,
+	[0xf0] = op_movx,
+	[0xf2 ... 0xf3] = op_movx,
+	[0xf4] = op_clr_cpl_a,
+	[0xf5 ... 0xff] = op_mov_from_a,
+};
+
+/*
+ * Main emulator functions.
+ */
+void emu8051_reset_run_state(struct emu8051_dev *dev)
+{
+	dev->stop_reason = EMU8051_RUNNING;
+	dev->ret_sp = 0;
+}
+
+uint32_t emu8051_step(struct emu8051_dev *dev)
+{
+	uint8_t op = fetch(dev);
+
+	emu8051_ops[op](dev, op);
+	dev->insn_cnt++;
+
+	return dev->stop_reason;
+}
+
+uint32_t emu8051_run(struct emu8051_dev *dev, uint64_t max_insns)
+{
+	uint64_t i;
+	uint8_t op;
+
+	dev->stop_reason = EMU8051_RUNNING;
+	for (i = 0; i < max_insns; i++) {
+		op = fetch(dev);
+		emu8051_ops[op](dev, op);
+		if (dev->stop_reason)
+			break;
+	}
+
+	dev->insn_cnt += (i < max_insns) ? i + 1 : i;
+	if (!dev->stop_reason)
+		dev->stop_reason = EMU8051_STOP_INSN_LIMIT;
+
+	return dev->stop_reason;
+}
+
+/*
+ * Call a function as if with LCALL from the current PC, and run until it
+ * returns. The PC is left where it was if the function returns.
+ */
+uint32_t emu8051_call(struct emu8051_dev *dev, uint16_t addr, uint64_t max_insns)
+{
+	uint8_t prev_ret_sp = dev->ret_sp;
+	uint16_t pc = dev->pc;
+	uint32_t ret;
+
+	dev->ret_sp = SP(dev);
+	push(dev, pc & 0xff);
+	push(dev, pc >> 8);
+	dev->pc = addr;
+
+	ret = emu8051_run(dev, max_insns);
+	if (ret == EMU8051_STOP_RETURN)
+		dev->pc = pc;
+
+	dev->ret_sp = prev_ret_sp;
+
+	return ret;
+}
+
+/*
+ * Emulate a verb sent to the ChipIO node. The 8051 memory access verbs are
+ * handled by hardware, so they act directly on emulated memory. ParamID sets
+ * run the firmware's handler for the ParamID. Returns 1 if the verb isn't
+ * emulated.
+ */
+int emu8051_chipio_verb(struct emu8051_dev *dev, uint32_t verb, uint32_t param,
+		uint32_t *res)
+{
+	uint16_t handler;
+
+	*res = 0;
+	switch (verb) {
+	case CHIPIO_8051_ADDRESS_LOW:
+		dev->chipio_8051_addr = (dev->chipio_8051_addr & 0xff00) | (param & 0xff);
+		break;
+	case CHIPIO_8051_ADDRESS_HIGH:
+		dev->chipio_8051_addr = (dev->chipio_8051_addr & 0x00ff) | ((param & 0xff) << 8);
+		break;
+	case CHIPIO_8051_DATA_WRITE:
+		/* Writes auto increment the address, reads don't. */
+		dev->xram[dev->chipio_8051_addr++] = param & 0xff;
+		break;
+	case CHIPIO_8051_DATA_READ:
+		*res = dev->xram[dev->chipio_8051_addr];
+		break;
+	case CHIPIO_8051_PMEM_READ:
+		*res = emu8051_code_read(dev, dev->chipio_8051_addr);
+		break;
+	case CHIPIO_8051_IRAM_INDIRECT_READ:
+		*res = dev->iram[dev->chipio_8051_addr & 0xff];
+		break;
+	case VENDOR_CHIPIO_8051_IRAM_WRITE:
+		dev->iram[dev->chipio_8051_addr & 0xff] = param & 0xff;
+		break;
+	case CHIPIO_PARAM_EX_ID_SET:
+		dev->chipio_param_id = param & 0x7f;
+		break;
+	case VENDOR_CHIPIO_PARAM_EX_ID_GET:
+		*res = dev->chipio_param_id;
+		break;
+	case CHIPIO_PARAM_EX_VAL_SET:
+		handler = (dev->xram[PARAM_HANDLER_TBL_ADDR + (dev->chipio_param_id * 2)] << 8) |
+			dev->xram[PARAM_HANDLER_TBL_ADDR + (dev->chipio_param_id * 2) + 1];
+		dev->iram[PARAM_HANDLER_VAL_ADDR] = param & 0xff;
+		emu8051_call(dev, handler, PARAM_HANDLER_MAX_INSNS);
+		break;
+	default:
+		return 1;
+	}
+
+	return 0;
+}
+
+static const char *emu8051_stop_strs[] = {
+	"Running", "Returned", "Invalid opcode", "Instruction limit",
+};
+
+const char *emu8051_get_stop_str(uint32_t stop_reason)
+{
+	if (stop_reason < ARRAY_SIZE(emu8051_stop_strs))
+		return emu8051_stop_strs[stop_reason];
+
+	return "Unknown";
+}
+
+/*
+ * Save state functions. Save states are made up of sections, each starting
+ * with a four character tag, in a fixed order.
+ */
+#define SAVE_STATE_BKOP_BLOCK_SIZE 100
+#define SAVE_STATE_BKOP_BLOCKS     11
+
+static const char *save_state_sections[] = {
+	"8051", "PMEM", "PMB0", "PMB1", "XRAM", "IRAM", "SFR ", "BKOP"
+};
+
+enum save_state_section {
+	SAVE_STATE_HEADER,
+	SAVE_STATE_PMEM,
+	SAVE_STATE_PMEM_B0,
+	SAVE_STATE_PMEM_B1,
+	SAVE_STATE_XRAM,
+	SAVE_STATE_IRAM,
+	SAVE_STATE_SFR,
+	SAVE_STATE_BKOP,
+};
+
+/* The simulator's undo buffer entries, only written as placeholders. */
+struct save_state_op_change {
+	uint16_t pc;
+
+	uint8_t changes;
+	uint16_t change_type[6];
+	uint16_t change_val[6];
+};
+
+static void write_section_tag(FILE *file, uint32_t section)
+{
+	fwrite(save_state_sections[section], 4, 1, file);
+}
+
+int emu8051_save_state_write(struct emu8051_dev *dev, char *file_name)
+{
+	struct save_state_op_change tmp_op;
+	FILE *file;
+	uint32_t i, tmp;
+
+	file = fopen(file_name, "w+");
+	if (!file)
+		return 1;
+
+	write_section_tag(file, SAVE_STATE_HEADER);
+	fwrite(&dev->pc, sizeof(uint16_t), 1, file);
+
+	write_section_tag(file, SAVE_STATE_PMEM);
+	fwrite(dev->pmem, sizeof(dev->pmem), 1, file);
+
+	write_section_tag(file, SAVE_STATE_PMEM_B0);
+	fwrite(dev->pmem_b0, sizeof(dev->pmem_b0), 1, file);
+
+	write_section_tag(file, SAVE_STATE_PMEM_B1);
+	fwrite(dev->pmem_b1, sizeof(dev->pmem_b1), 1, file);
+
+	write_section_tag(file, SAVE_STATE_XRAM);
+	fwrite(dev->xram, sizeof(dev->xram), 1, file);
+
+	write_section_tag(file, SAVE_STATE_IRAM);
+	fwrite(dev->iram, sizeof(dev->iram), 1, file);
+
+	write_section_tag(file, SAVE_STATE_SFR);
+	fwrite(dev->sfr, sizeof(dev->sfr), 1, file);
+
+	/*
+	 * Empty undo buffer: current count, number of blocks, start offset,
+	 * then the blocks themselves.
+	 */
+	write_section_tag(file, SAVE_STATE_BKOP);
+	tmp = 0;
+	fwrite(&tmp, sizeof(uint32_t), 1, file);
+	tmp = SAVE_STATE_BKOP_BLOCKS;
+	fwrite(&tmp, sizeof(uint32_t), 1, file);
+	tmp = 0;
+	fwrite(&tmp, sizeof(uint32_t), 1, file);
+
+	memset(&tmp_op, 0, sizeof(tmp_op));
+	for (i = 0; i < SAVE_STATE_BKOP_BLOCKS * SAVE_STATE_BKOP_BLOCK_SIZE; i++)
+		fwrite(&tmp_op, sizeof(tmp_op), 1, file);
+
+	fclose(file);
+
+	return 0;
+}
+
+static int read_section(FILE *file, uint32_t section, void *data, uint32_t size)
+{
+	char tag[4];
+
+	if (fread(tag, sizeof(tag), 1, file) != 1 ||
+			memcmp(tag, save_state_sections[section], sizeof(tag))) {
+		fprintf(stderr, "Save state missing %s section.\n",
+				save_state_sections[section]);
+		return 1;
+	}
+
+	if (fread(data, size, 1, file) != 1) {
+		fprintf(stderr, "Save state %s section is truncated.\n",
+				save_state_sections[section]);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Load a save state. The undo buffer section is ignored. Indexed save
+ * states are handled by ca0132_8051_state.c.
+ */
+int emu8051_save_state_load(struct emu8051_dev *dev, char *file_name)
+{
+	FILE *file;
+	int ret;
+
+	if (emu8051_state_is_indexed(file_name))
+		return emu8051_state_load(dev, file_name);
+
+	file = fopen(file_name, "r");
+	if (!file) {
+		fprintf(stderr, "Failed to open save state.\n");
+		return 1;
+	}
+
+	memset(dev, 0, sizeof(*dev));
+	ret = read_section(file, SAVE_STATE_HEADER, &dev->pc, sizeof(dev->pc)) ||
+	      read_section(file, SAVE_STATE_PMEM, dev->pmem, sizeof(dev->pmem)) ||
+	      read_section(file, SAVE_STATE_PMEM_B0, dev->pmem_b0, sizeof(dev->pmem_b0)) ||
+	      read_section(file, SAVE_STATE_PMEM_B1, dev->pmem_b1, sizeof(dev->pmem_b1)) ||
+	      read_section(file, SAVE_STATE_XRAM, dev->xram, sizeof(dev->xram)) ||
+	      read_section(file, SAVE_STATE_IRAM, dev->iram, sizeof(dev->iram)) ||
+	      read_section(file, SAVE_STATE_SFR, dev->sfr, sizeof(dev->sfr));
+
+	fclose(file);
+
+	return ret;
+}
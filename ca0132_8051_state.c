@@ -0,0 +1,418 @@
+/*
+ * Indexed save state container for the 8051 emulator.
+ *
+ * Layout:
+ * -Header, magic/version/section count.
+ * -Section directory, tag/codec/offset/size/uncompressed size/digest.
+ * -Section data. Uncompressed sections start on a page boundary so they can
+ *  be used directly from an mmap of the file, compressed sections are only
+ *  aligned to 8 bytes.
+ *
+ * The compression is a simple LZ77 variant, with a control byte before each
+ * run. If the top bit is clear, it's followed by (ctrl + 1) literal bytes.
+ * If it's set, it's a match of ((ctrl & 0x7f) + 3) bytes, followed by a
+ * 16-bit little endian distance back into the output.
+ */
+#include "ca0132_defs.h"
+#include <stddef.h>
+#include <sys/mman.h>
+
+#define LZ_MIN_MATCH    3
+#define LZ_MAX_MATCH    (0x7f + LZ_MIN_MATCH)
+#define LZ_MAX_LITERALS 0x80
+#define LZ_MAX_DIST     0xffff
+#define LZ_HASH_BITS    12
+#define LZ_NO_ENTRY     0xffffffff
+
+#define ALIGN_UP(val, align) (((val) + ((align) - 1)) & ~((align) - 1))
+
+struct state_section_info {
+	const char *tag;
+	uint32_t offset;
+	uint32_t size;
+};
+
+/* Sections stored from emu8051_dev, same tags as the old format. */
+static const struct state_section_info state_sections[] = {
+	{ "8051", offsetof(struct emu8051_dev, pc),      sizeof(uint16_t)       },
+	{ "PMEM", offsetof(struct emu8051_dev, pmem),    EMU8051_PMEM_SIZE      },
+	{ "PMB0", offsetof(struct emu8051_dev, pmem_b0), EMU8051_PMEM_BANK_SIZE },
+	{ "PMB1", offsetof(struct emu8051_dev, pmem_b1), EMU8051_PMEM_BANK_SIZE },
+	{ "XRAM", offsetof(struct emu8051_dev, xram),    EMU8051_XRAM_SIZE      },
+	{ "IRAM", offsetof(struct emu8051_dev, iram),    EMU8051_IRAM_SIZE      },
+	{ "SFR ", offsetof(struct emu8051_dev, sfr),     EMU8051_SFR_SIZE       },
+};
+
+static const char *codec_strs[] = { "raw", "lz" };
+
+const char *emu8051_state_get_codec_str(uint32_t codec)
+{
+	if (codec >= ARRAY_SIZE(codec_strs))
+		return "unknown";
+
+	return codec_strs[codec];
+}
+
+/* 64-bit FNV-1a. */
+uint64_t emu8051_state_digest(const uint8_t *data, uint32_t size)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	uint32_t i;
+
+	for (i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/*
+ * LZ compression functions.
+ */
+static uint32_t lz_hash(const uint8_t *data)
+{
+	uint32_t tmp = (data[0] << 16) | (data[1] << 8) | data[2];
+
+	return (tmp * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static int lz_put_literals(const uint8_t *in, uint32_t start, uint32_t end,
+		uint8_t *out, uint32_t out_size, uint32_t *out_pos)
+{
+	uint32_t cnt;
+
+	while (start < end) {
+		cnt = end - start;
+		if (cnt > LZ_MAX_LITERALS)
+			cnt = LZ_MAX_LITERALS;
+
+		if (*out_pos + cnt + 1 > out_size)
+			return 1;
+
+		out[(*out_pos)++] = cnt - 1;
+		memcpy(&out[*out_pos], &in[start], cnt);
+		*out_pos += cnt;
+		start += cnt;
+	}
+
+	return 0;
+}
+
+/* Returns the compressed size, or 0 if it didn't fit in out_size. */
+static uint32_t lz_compress(const uint8_t *in, uint32_t in_size, uint8_t *out,
+		uint32_t out_size)
+{
+	uint32_t table[1 << LZ_HASH_BITS];
+	uint32_t i, lit_start, out_pos, cand, len, hash;
+
+	memset(table, 0xff, sizeof(table));
+	lit_start = 0;
+	out_pos = 0;
+	i = 0;
+	while (i + LZ_MIN_MATCH <= in_size) {
+		hash = lz_hash(&in[i]);
+		cand = table[hash];
+		table[hash] = i;
+
+		if (cand == LZ_NO_ENTRY || (i - cand) > LZ_MAX_DIST ||
+				memcmp(&in[cand], &in[i], LZ_MIN_MATCH)) {
+			i++;
+			continue;
+		}
+
+		len = LZ_MIN_MATCH;
+		while (len < LZ_MAX_MATCH && (i + len) < in_size &&
+				in[cand + len] == in[i + len])
+			len++;
+
+		if (lz_put_literals(in, lit_start, i, out, out_size, &out_pos) ||
+				(out_pos + 3) > out_size)
+			return 0;
+
+		out[out_pos++] = 0x80 | (len - LZ_MIN_MATCH);
+		out[out_pos++] = (i - cand) & 0xff;
+		out[out_pos++] = ((i - cand) >> 8) & 0xff;
+
+		i += len;
+		lit_start = i;
+	}
+
+	if (lz_put_literals(in, lit_start, in_size, out, out_size, &out_pos))
+		return 0;
+
+	return out_pos;
+}
+
+static int lz_decompress(const uint8_t *in, uint32_t in_size, uint8_t *out,
+		uint32_t out_size)
+{
+	uint32_t in_pos, out_pos, len, dist, i;
+	uint8_t ctrl;
+
+	in_pos = 0;
+	out_pos = 0;
+	while (in_pos < in_size) {
+		ctrl = in[in_pos++];
+		if (ctrl & 0x80) {
+			len = (ctrl & 0x7f) + LZ_MIN_MATCH;
+			if ((in_pos + 2) > in_size)
+				return 1;
+
+			dist = in[in_pos] | (in[in_pos + 1] << 8);
+			in_pos += 2;
+			if (!dist || dist > out_pos || (out_pos + len) > out_size)
+				return 1;
+
+			/* Matches can overlap, so copy a byte at a time. */
+			for (i = 0; i < len; i++, out_pos++)
+				out[out_pos] = out[out_pos - dist];
+		} else {
+			len = ctrl + 1;
+			if ((in_pos + len) > in_size || (out_pos + len) > out_size)
+				return 1;
+
+			memcpy(&out[out_pos], &in[in_pos], len);
+			in_pos += len;
+			out_pos += len;
+		}
+	}
+
+	return out_pos != out_size;
+}
+
+/*
+ * Save state writing/reading functions.
+ */
+int emu8051_state_is_indexed(char *file_name)
+{
+	char magic[8];
+	FILE *file;
+	int ret;
+
+	file = fopen(file_name, "r");
+	if (!file)
+		return 0;
+
+	ret = fread(magic, sizeof(magic), 1, file) == 1 &&
+	      !memcmp(magic, EMU8051_STATE_MAGIC, sizeof(magic));
+	fclose(file);
+
+	return ret;
+}
+
+int emu8051_state_write(struct emu8051_dev *dev, char *file_name, uint32_t codec)
+{
+	struct emu8051_state_section secs[ARRAY_SIZE(state_sections)];
+	struct emu8051_state_section *sec;
+	struct emu8051_state_hdr hdr;
+	const uint8_t *data;
+	uint8_t *buf;
+	uint32_t i, offset;
+	FILE *file;
+	int ret = 0;
+
+	file = fopen(file_name, "w");
+	if (!file)
+		return 1;
+
+	buf = malloc(EMU8051_XRAM_SIZE);
+	memset(&hdr, 0, sizeof(hdr));
+	memset(secs, 0, sizeof(secs));
+	memcpy(hdr.magic, EMU8051_STATE_MAGIC, sizeof(hdr.magic));
+	hdr.version = EMU8051_STATE_VERSION;
+	hdr.section_cnt = ARRAY_SIZE(state_sections);
+
+	offset = ALIGN_UP(sizeof(hdr) + sizeof(secs), EMU8051_STATE_ALIGN);
+	for (i = 0; i < ARRAY_SIZE(state_sections); i++) {
+		sec = &secs[i];
+		data = (const uint8_t *)dev + state_sections[i].offset;
+
+		memcpy(sec->tag, state_sections[i].tag, sizeof(sec->tag));
+		sec->raw_size = state_sections[i].size;
+		sec->digest = emu8051_state_digest(data, sec->raw_size);
+		sec->codec = EMU8051_STATE_CODEC_RAW;
+		sec->size = sec->raw_size;
+
+		/* Only keep the compressed data if it's actually smaller. */
+		if (codec == EMU8051_STATE_CODEC_LZ) {
+			sec->size = lz_compress(data, sec->raw_size, buf, sec->raw_size - 1);
+			if (sec->size) {
+				sec->codec = EMU8051_STATE_CODEC_LZ;
+				data = buf;
+			} else {
+				sec->size = sec->raw_size;
+			}
+		}
+
+		if (sec->codec == EMU8051_STATE_CODEC_RAW)
+			offset = ALIGN_UP(offset, EMU8051_STATE_ALIGN);
+
+		sec->offset = offset;
+		if (fseek(file, offset, SEEK_SET) || fwrite(data, sec->size, 1, file) != 1) {
+			ret = 1;
+			goto exit;
+		}
+
+		offset = ALIGN_UP(offset + sec->size, 8);
+	}
+
+	rewind(file);
+	if (fwrite(&hdr, sizeof(hdr), 1, file) != 1 ||
+			fwrite(secs, sizeof(secs), 1, file) != 1)
+		ret = 1;
+
+exit:
+	free(buf);
+	fclose(file);
+
+	return ret;
+}
+
+int emu8051_state_open(struct emu8051_state_file *state, char *file_name)
+{
+	const struct emu8051_state_section *sec;
+	struct stat st;
+	uint32_t i;
+	int fd;
+
+	memset(state, 0, sizeof(*state));
+	fd = open(file_name, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open save state.\n");
+		return 1;
+	}
+
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(*state->hdr)) {
+		fprintf(stderr, "Save state is too small.\n");
+		close(fd);
+		return 1;
+	}
+
+	state->map_size = st.st_size;
+	state->map = mmap(NULL, state->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (state->map == MAP_FAILED) {
+		fprintf(stderr, "Failed to map save state.\n");
+		state->map = NULL;
+		return 1;
+	}
+
+	state->hdr = (const struct emu8051_state_hdr *)state->map;
+	state->sections = (const struct emu8051_state_section *)(state->hdr + 1);
+	if (memcmp(state->hdr->magic, EMU8051_STATE_MAGIC, sizeof(state->hdr->magic)) ||
+			state->hdr->version != EMU8051_STATE_VERSION ||
+			state->hdr->section_cnt > EMU8051_STATE_MAX_SECS ||
+			(sizeof(*state->hdr) + (state->hdr->section_cnt * sizeof(*sec))) >
+			state->map_size) {
+		fprintf(stderr, "Save state has an invalid header.\n");
+		emu8051_state_close(state);
+		return 1;
+	}
+
+	for (i = 0; i < state->hdr->section_cnt; i++) {
+		sec = &state->sections[i];
+		if (((uint64_t)sec->offset + sec->size) > state->map_size ||
+				(sec->codec == EMU8051_STATE_CODEC_RAW && sec->size != sec->raw_size) ||
+				sec->codec > EMU8051_STATE_CODEC_LZ) {
+			fprintf(stderr, "Save state section %.4s is invalid.\n", sec->tag);
+			emu8051_state_close(state);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+void emu8051_state_close(struct emu8051_state_file *state)
+{
+	if (state->map)
+		munmap(state->map, state->map_size);
+
+	memset(state, 0, sizeof(*state));
+}
+
+const struct emu8051_state_section *emu8051_state_find_section(
+		struct emu8051_state_file *state, const char *tag)
+{
+	uint32_t i;
+
+	for (i = 0; i < state->hdr->section_cnt; i++) {
+		if (!memcmp(state->sections[i].tag, tag, sizeof(state->sections[i].tag)))
+			return &state->sections[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Returns a pointer to an uncompressed section's data within the mapping,
+ * or NULL if the section is compressed. The digest isn't checked.
+ */
+const uint8_t *emu8051_state_map_section(struct emu8051_state_file *state,
+		const struct emu8051_state_section *sec)
+{
+	if (sec->codec != EMU8051_STATE_CODEC_RAW)
+		return NULL;
+
+	return state->map + sec->offset;
+}
+
+/* Copy or decompress a section into buf, and check its digest. */
+int emu8051_state_read_section(struct emu8051_state_file *state,
+		const struct emu8051_state_section *sec, void *buf, uint32_t size)
+{
+	const uint8_t *data = state->map + sec->offset;
+
+	if (size != sec->raw_size) {
+		fprintf(stderr, "Save state section %.4s has the wrong size.\n", sec->tag);
+		return 1;
+	}
+
+	if (sec->codec == EMU8051_STATE_CODEC_RAW) {
+		memcpy(buf, data, size);
+	} else if (lz_decompress(data, sec->size, buf, size)) {
+		fprintf(stderr, "Save state section %.4s failed to decompress.\n", sec->tag);
+		return 1;
+	}
+
+	if (emu8051_state_digest(buf, size) != sec->digest) {
+		fprintf(stderr, "Save state section %.4s digest mismatch.\n", sec->tag);
+		return 1;
+	}
+
+	return 0;
+}
+
+int emu8051_state_load(struct emu8051_dev *dev, char *file_name)
+{
+	const struct emu8051_state_section *sec;
+	struct emu8051_state_file state;
+	uint32_t i;
+	int ret = 0;
+
+	if (emu8051_state_open(&state, file_name))
+		return 1;
+
+	memset(dev, 0, sizeof(*dev));
+	for (i = 0; i < ARRAY_SIZE(state_sections); i++) {
+		sec = emu8051_state_find_section(&state, state_sections[i].tag);
+		if (!sec) {
+			fprintf(stderr, "Save state missing %s section.\n",
+					state_sections[i].tag);
+			ret = 1;
+			break;
+		}
+
+		if (emu8051_state_read_section(&state, sec,
+				(uint8_t *)dev + state_sections[i].offset,
+				state_sections[i].size)) {
+			ret = 1;
+			break;
+		}
+	}
+
+	emu8051_state_close(&state);
+
+	return ret;
+}
@@ -189,6 +189,23 @@ static int chipio_hic_set_address(int fd, uint32_t addr)
 	return 0;
 }
 
+/*
+ * Only send the lower 16-bits of the address. Used when the upper 16-bits
+ * are known to already be set, saves a verb and a status check.
+ */
+static int chipio_hic_set_address_lower(int fd, uint32_t addr)
+{
+	if (chipio_get_status(fd))
+		return 1;
+
+	if (chipio_verb_send_with_status(fd, CHIPIO_ADDRESS_LOW, addr & 0xffff)) {
+		printf("%s: Failed to write ADDRESS_LOW.", __func__);
+		return 1;
+	}
+
+	return 0;
+}
+
 void chipio_hic_write_at_addr(int fd, uint32_t addr, uint32_t data)
 {
 	if (chipio_hic_set_address(fd, addr)) {
@@ -320,42 +337,44 @@ uint8_t chipio_8051_read_exram_at_addr(int fd, uint16_t addr)
 /*
  * Since reads don't automatically increment the address, we'll need to do it
  * ourselves. Sending the full 16-bits each time is two verbs, which is
- * slower. So, only send the upper 8 address bits if they change.
+ * slower. So, only send the upper 8 address bits if they change. The upper
+ * bits last sent are kept in cur_upper, so that multiple ranges read in a
+ * row can share them, 0xff means they're unknown.
  */
-void chipio_8051_read_exram_data_range(int fd, uint16_t start_addr, uint16_t count,
-		uint8_t *buf)
+static void chipio_8051_read_range(int fd, uint32_t pmem, uint16_t start_addr,
+		uint16_t count, uint8_t *buf, uint16_t *cur_upper)
 {
-	uint16_t i, cur_upper;
+	uint16_t i;
 
-	cur_upper = 0xff;
 	for (i = 0; i < count; i++) {
-		if (((start_addr + i) & 0xff00) != cur_upper) {
-			cur_upper = (start_addr + i) & 0xff00;
+		if (((start_addr + i) & 0xff00) != *cur_upper) {
+			*cur_upper = (start_addr + i) & 0xff00;
 			chipio_8051_set_addr(fd, start_addr + i);
 		} else {
 			chipio_8051_set_addr_lower(fd, (start_addr + i) & 0xff);
 		}
 
-		buf[i] = chipio_8051_read_exram_data(fd);
+		if (pmem)
+			buf[i] = chipio_8051_read_pmem_data(fd);
+		else
+			buf[i] = chipio_8051_read_exram_data(fd);
 	}
 }
 
-void chipio_8051_read_pmem_data_range(int fd, uint16_t start_addr, uint16_t count,
+void chipio_8051_read_exram_data_range(int fd, uint16_t start_addr, uint16_t count,
 		uint8_t *buf)
 {
-	uint16_t i, cur_upper;
+	uint16_t cur_upper = 0xff;
 
-	cur_upper = 0xff;
-	for (i = 0; i < count; i++) {
-		if (((start_addr + i) & 0xff00) != cur_upper) {
-			cur_upper = (start_addr + i) & 0xff00;
-			chipio_8051_set_addr(fd, start_addr + i);
-		} else {
-			chipio_8051_set_addr_lower(fd, (start_addr + i) & 0xff);
-		}
+	chipio_8051_read_range(fd, 0, start_addr, count, buf, &cur_upper);
+}
 
-		buf[i] = chipio_8051_read_pmem_data(fd);
-	}
+void chipio_8051_read_pmem_data_range(int fd, uint16_t start_addr, uint16_t count,
+		uint8_t *buf)
+{
+	uint16_t cur_upper = 0xff;
+
+	chipio_8051_read_range(fd, 1, start_addr, count, buf, &cur_upper);
 }
 
 /*
@@ -372,6 +391,362 @@ void chipio_8051_write_exram_data_range(int fd, uint16_t start_addr, uint16_t co
 		chipio_8051_set_exram_data(fd, buf[i]);
 }
 
+/*
+ * Read plans. Reads are queued with chipio_read_plan_add(), then
+ * chipio_read_plan_run() sorts them by address space and address, merges
+ * any that overlap or are within the plan's gap of each other, reads each
+ * merged span once, and copies the results out to each request's buffer.
+ * Exram and pmem reads share the 8051 address latch, so the upper address
+ * byte is only resent when it changes over the whole plan.
+ *
+ * Exram and pmem reads set the lower address byte for every byte anyway, so
+ * a gap only helps HIC reads, which auto-increment.
+ */
+void chipio_read_plan_init(struct chipio_read_plan *plan, uint32_t gap)
+{
+	memset(plan, 0, sizeof(*plan));
+	plan->gap = gap;
+}
+
+/*
+ * Length is in bytes for exram/pmem, and in 32-bit words for HIC. Returns
+ * non-zero if the request is invalid or the plan is full.
+ */
+int chipio_read_plan_add(struct chipio_read_plan *plan, uint32_t space,
+		uint32_t addr, uint32_t len, void *buf)
+{
+	struct chipio_read_req *req;
+
+	if (plan->req_cnt >= CHIPIO_READ_PLAN_MAX_REQS || !len ||
+			space > CHIPIO_SPACE_HIC)
+		return 1;
+
+	req = &plan->reqs[plan->req_cnt++];
+	req->space = space;
+	req->addr = addr;
+	req->len = len;
+	req->buf = buf;
+
+	return 0;
+}
+
+static uint32_t read_plan_addr_step(uint32_t space)
+{
+	return (space == CHIPIO_SPACE_HIC) ? 4 : 1;
+}
+
+static int read_plan_cmp(const void *a, const void *b)
+{
+	const struct chipio_read_req *req_a = *(const struct chipio_read_req **)a;
+	const struct chipio_read_req *req_b = *(const struct chipio_read_req **)b;
+
+	if (req_a->space != req_b->space)
+		return (req_a->space < req_b->space) ? -1 : 1;
+
+	if (req_a->addr != req_b->addr)
+		return (req_a->addr < req_b->addr) ? -1 : 1;
+
+	return 0;
+}
+
+static void read_plan_read_span(int fd, uint32_t space, uint32_t addr,
+		uint32_t cnt, uint8_t *buf, uint16_t *cur_upper)
+{
+	switch (space) {
+	case CHIPIO_SPACE_EXRAM:
+		chipio_8051_read_range(fd, 0, addr, cnt, buf, cur_upper);
+		break;
+	case CHIPIO_SPACE_PMEM:
+		chipio_8051_read_range(fd, 1, addr, cnt, buf, cur_upper);
+		break;
+	case CHIPIO_SPACE_HIC:
+		chipio_hic_read_data_range(fd, addr, cnt, (uint32_t *)buf);
+		break;
+	}
+}
+
+/* Returns non-zero if a span buffer can't be allocated. */
+int chipio_read_plan_run(int fd, struct chipio_read_plan *plan)
+{
+	struct chipio_read_req *sorted[CHIPIO_READ_PLAN_MAX_REQS];
+	uint32_t i, j, step, span_start, span_end, req_end;
+	uint16_t cur_upper = 0xff;
+	uint8_t *buf;
+
+	for (i = 0; i < plan->req_cnt; i++)
+		sorted[i] = &plan->reqs[i];
+
+	qsort(sorted, plan->req_cnt, sizeof(*sorted), read_plan_cmp);
+
+	for (i = 0; i < plan->req_cnt; i = j) {
+		step = read_plan_addr_step(sorted[i]->space);
+		span_start = sorted[i]->addr;
+		span_end = span_start + (sorted[i]->len * step);
+
+		for (j = i + 1; j < plan->req_cnt; j++) {
+			if (sorted[j]->space != sorted[i]->space ||
+					sorted[j]->addr > span_end + (plan->gap * step))
+				break;
+
+			req_end = sorted[j]->addr + (sorted[j]->len * step);
+			if (req_end > span_end)
+				span_end = req_end;
+		}
+
+		buf = malloc(span_end - span_start);
+		if (!buf)
+			return 1;
+
+		read_plan_read_span(fd, sorted[i]->space, span_start,
+				(span_end - span_start) / step, buf, &cur_upper);
+		plan->span_cnt++;
+
+		for (; i < j; i++) {
+			memcpy(sorted[i]->buf, &buf[sorted[i]->addr - span_start],
+					sorted[i]->len * step);
+		}
+
+		free(buf);
+	}
+
+	return 0;
+}
+
+/*
+ * Diff write functions. Only write the runs of data that differ from the
+ * current contents of the device, which are either read from the device or
+ * come from a cached image, then verify only the runs that were written.
+ * Runs separated by a gap small enough that writing through it is cheaper
+ * than setting a new address are merged.
+ */
+#define EXRAM_DIFF_MAX_GAP 2
+#define HIC_DIFF_MAX_GAP   1
+
+/*
+ * A cached image is checked by reading back this many blocks spread evenly
+ * across the range before it's trusted.
+ */
+#define DIFF_CACHE_SAMPLE_CNT 8
+#define DIFF_CACHE_SAMPLE_LEN 0x40
+
+/*
+ * Find the next run of differing elements at or after *pos. Returns the
+ * length of the run, with *pos set to its start, or 0 if there are none.
+ */
+static uint32_t get_next_diff_run(const uint8_t *new, const uint8_t *cur,
+		uint32_t elem_size, uint32_t count, uint32_t max_gap, uint32_t *pos)
+{
+	uint32_t start, end, gap;
+
+	start = *pos;
+	while (start < count && !memcmp(&new[start * elem_size],
+				&cur[start * elem_size], elem_size))
+		start++;
+
+	if (start >= count)
+		return 0;
+
+	end = start + 1;
+	gap = 0;
+	while (end + gap < count && gap <= max_gap) {
+		if (memcmp(&new[(end + gap) * elem_size], &cur[(end + gap) * elem_size],
+					elem_size)) {
+			end += gap + 1;
+			gap = 0;
+		} else {
+			gap++;
+		}
+	}
+
+	*pos = start;
+
+	return end - start;
+}
+
+uint32_t chipio_8051_diff_write_exram(int fd, uint16_t start_addr, uint16_t count,
+		const uint8_t *buf, const uint8_t *cur,
+		struct chipio_diff_write_stats *stats)
+{
+	uint8_t readback[0x100];
+	uint32_t pos, len, i, j, chunk;
+
+	memset(stats, 0, sizeof(*stats));
+	pos = 0;
+	while ((len = get_next_diff_run(buf, cur, 1, count, EXRAM_DIFF_MAX_GAP, &pos))) {
+		chipio_8051_write_exram_data_range(fd, start_addr + pos, len, &buf[pos]);
+		stats->run_cnt++;
+		stats->write_cnt += len;
+
+		for (i = 0; i < len; i += chunk) {
+			chunk = len - i;
+			if (chunk > sizeof(readback))
+				chunk = sizeof(readback);
+
+			chipio_8051_read_exram_data_range(fd, start_addr + pos + i,
+					chunk, readback);
+			for (j = 0; j < chunk; j++) {
+				if (readback[j] == buf[pos + i + j])
+					continue;
+
+				printf("Addr 0x%04x: expected 0x%02x, got 0x%02x.\n",
+						start_addr + pos + i + j, buf[pos + i + j],
+						readback[j]);
+				stats->verify_fail++;
+			}
+		}
+
+		pos += len;
+	}
+
+	return stats->verify_fail;
+}
+
+uint32_t chipio_hic_diff_write_data(int fd, uint32_t start_addr, uint32_t count,
+		const uint32_t *buf, const uint32_t *cur,
+		struct chipio_diff_write_stats *stats)
+{
+	uint32_t readback[0x100];
+	uint32_t pos, len, i, j, chunk;
+
+	memset(stats, 0, sizeof(*stats));
+	pos = 0;
+	while ((len = get_next_diff_run((const uint8_t *)buf, (const uint8_t *)cur,
+				sizeof(uint32_t), count, HIC_DIFF_MAX_GAP, &pos))) {
+		chipio_hic_write_data_range(fd, start_addr + (pos * 4), len,
+				(uint32_t *)&buf[pos]);
+		stats->run_cnt++;
+		stats->write_cnt += len;
+
+		for (i = 0; i < len; i += chunk) {
+			chunk = len - i;
+			if (chunk > ARRAY_SIZE(readback))
+				chunk = ARRAY_SIZE(readback);
+
+			chipio_hic_read_data_range(fd, start_addr + ((pos + i) * 4),
+					chunk, readback);
+			for (j = 0; j < chunk; j++) {
+				if (readback[j] == buf[pos + i + j])
+					continue;
+
+				printf("Addr 0x%08x: expected 0x%08x, got 0x%08x.\n",
+						start_addr + ((pos + i + j) * 4),
+						buf[pos + i + j], readback[j]);
+				stats->verify_fail++;
+			}
+		}
+
+		pos += len;
+	}
+
+	return stats->verify_fail;
+}
+
+/*
+ * Get the start of sample block 'i' of a range, and its length in *len.
+ */
+static uint32_t get_diff_cache_sample(uint32_t count, uint32_t i, uint32_t *len)
+{
+	uint32_t pos;
+
+	pos = (uint32_t)(((uint64_t)count * i) / DIFF_CACHE_SAMPLE_CNT);
+	*len = count - pos;
+	if (*len > DIFF_CACHE_SAMPLE_LEN)
+		*len = DIFF_CACHE_SAMPLE_LEN;
+
+	return pos;
+}
+
+/*
+ * Check a cached image against the device by reading back a sample of it.
+ * Returns the number of elements in the sample that don't match, a cache
+ * that fails this is stale and shouldn't be used.
+ */
+uint32_t chipio_8051_check_exram_cache(int fd, uint16_t start_addr,
+		uint16_t count, const uint8_t *cur)
+{
+	uint8_t readback[DIFF_CACHE_SAMPLE_LEN];
+	uint32_t i, j, pos, len, mismatch;
+
+	mismatch = 0;
+	for (i = 0; i < DIFF_CACHE_SAMPLE_CNT; i++) {
+		pos = get_diff_cache_sample(count, i, &len);
+		if (!len)
+			continue;
+
+		chipio_8051_read_exram_data_range(fd, start_addr + pos, len, readback);
+		for (j = 0; j < len; j++) {
+			if (readback[j] != cur[pos + j])
+				mismatch++;
+		}
+	}
+
+	return mismatch;
+}
+
+uint32_t chipio_hic_check_data_cache(int fd, uint32_t start_addr,
+		uint32_t count, const uint32_t *cur)
+{
+	uint32_t readback[DIFF_CACHE_SAMPLE_LEN];
+	uint32_t i, j, pos, len, mismatch;
+
+	mismatch = 0;
+	for (i = 0; i < DIFF_CACHE_SAMPLE_CNT; i++) {
+		pos = get_diff_cache_sample(count, i, &len);
+		if (!len)
+			continue;
+
+		chipio_hic_read_data_range(fd, start_addr + (pos * 4), len, readback);
+		for (j = 0; j < len; j++) {
+			if (readback[j] != cur[pos + j])
+				mismatch++;
+		}
+	}
+
+	return mismatch;
+}
+
+/*
+ * Diff write cache files hold the image last written to a range, after a
+ * header with the start address and size, so the device doesn't need to be
+ * read before the next diff write. Returns 0 if the cache matches the range.
+ */
+int read_diff_cache_file(char *file_name, uint32_t start_addr, void *buf,
+		uint32_t size)
+{
+	uint32_t hdr[2];
+	FILE *file;
+	int ret;
+
+	file = fopen(file_name, "r");
+	if (!file)
+		return 1;
+
+	ret = fread(hdr, sizeof(hdr), 1, file) != 1 || hdr[0] != start_addr ||
+	      hdr[1] != size || fread(buf, size, 1, file) != 1;
+	fclose(file);
+
+	return ret;
+}
+
+int write_diff_cache_file(char *file_name, uint32_t start_addr, const void *buf,
+		uint32_t size)
+{
+	uint32_t hdr[2];
+	FILE *file;
+	int ret;
+
+	file = fopen(file_name, "w");
+	if (!file)
+		return 1;
+
+	hdr[0] = start_addr;
+	hdr[1] = size;
+	ret = fwrite(hdr, sizeof(hdr), 1, file) != 1 || fwrite(buf, size, 1, file) != 1;
+	fclose(file);
+
+	return ret;
+}
+
 /*
  * Set/Get ChipIO flags.
  */
@@ -398,6 +773,18 @@ uint8_t chipio_get_control_flag(int fd, uint32_t flag)
 	return (v.res >> flag) & 0x01;
 }
 
+/* Get every flag with a single verb. */
+void chipio_get_flag_snapshot(int fd, struct chipio_flag_snapshot *snap)
+{
+	struct hda_verb_ioctl v;
+
+	v.verb = HDA_VERB(WIDGET_CHIP_CTRL, CHIPIO_FLAGS_GET, 0);
+	ioctl(fd, HDA_IOCTL_VERB_WRITE, &v);
+
+	clock_gettime(CLOCK_MONOTONIC, &snap->time);
+	snap->flags = v.res & ((1 << CHIPIO_FLAG_CNT) - 1);
+}
+
 /*
  * Set/Get ChipIO paramID values.
  */
@@ -442,6 +829,30 @@ uint8_t chipio_get_control_param(int fd, uint32_t param)
 	return chipio_get_param_val(fd);
 }
 
+/*
+ * Get multiple ParamID values. Each value still needs its own ID set and
+ * value get, but ParamID's that show up more than once are only read once.
+ */
+void chipio_get_control_params(int fd, const uint32_t *params, uint32_t cnt,
+		uint8_t *vals)
+{
+	uint32_t i, j;
+
+	for (i = 0; i < cnt; i++) {
+		for (j = 0; j < i; j++) {
+			if (params[j] == params[i])
+				break;
+		}
+
+		if (j < i) {
+			vals[i] = vals[j];
+			continue;
+		}
+
+		vals[i] = chipio_get_control_param(fd, params[i]);
+	}
+}
+
 /*
  * DSP debug functions.
  */
@@ -486,15 +897,73 @@ void set_dsp_dbg_single_step(int fd, uint32_t enable)
 	chipio_hic_write_at_addr(fd, 0x100e30, tmp);
 }
 
-void dsp_run_steps(int fd, uint32_t step_cnt)
+static double get_timespec_diff(struct timespec *start, struct timespec *end)
 {
-	uint32_t i, tmp;
+	return (end->tv_sec - start->tv_sec) +
+		((end->tv_nsec - start->tv_nsec) / 1000000000.0);
+}
+
+/*
+ * Nothing else changes the debug register while the DSP's are halted, so
+ * read it once and then just keep writing the execute bits. Each write
+ * auto-increments the HIC address, but the upper 16-bits stay the same, so
+ * only the lower address half needs to be re-sent between steps. The debug
+ * register is read back once at the end to make sure the halt/single step
+ * state didn't change underneath us.
+ */
+int dsp_run_steps_batched(int fd, uint32_t step_cnt, struct dsp_step_stats *stats)
+{
+	struct timespec start, end;
+	uint32_t i, dbg_reg, tmp;
+	int ret = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	dbg_reg = chipio_hic_read_at_addr(fd, GLOBDSPDEBGREG);
+	tmp = dbg_reg | 0x0000000f;
+
+	if (chipio_hic_set_address(fd, GLOBDSPDEBGREG)) {
+		printf("%s: Failed to write address, try again.\n", __func__);
+		return 1;
+	}
 
 	for (i = 0; i < step_cnt; i++) {
-		tmp = chipio_hic_read_at_addr(fd, 0x100e30);
-		tmp |= 0x0000000f;
-		chipio_hic_write_at_addr(fd, 0x100e30, tmp);
+		if (i && chipio_hic_set_address_lower(fd, GLOBDSPDEBGREG)) {
+			ret = 1;
+			break;
+		}
+
+		if (chipio_hic_set_data(fd, tmp)) {
+			printf("%s: failed to write data, aborting.\n", __func__);
+			ret = 1;
+			break;
+		}
 	}
+
+	/* Halt and single step bits should be the same as when we started. */
+	tmp = chipio_hic_read_at_addr(fd, GLOBDSPDEBGREG);
+	if ((tmp ^ dbg_reg) & 0x00003cf0) {
+		printf("%s: debug register changed, 0x%08x -> 0x%08x.\n",
+				__func__, dbg_reg, tmp);
+		ret = 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	if (stats) {
+		stats->steps += i;
+		stats->elapsed += get_timespec_diff(&start, &end);
+		if (stats->elapsed > 0.0)
+			stats->steps_per_sec = stats->steps / stats->elapsed;
+		stats->dbg_reg = tmp;
+	}
+
+	return ret;
+}
+
+void dsp_run_steps(int fd, uint32_t step_cnt)
+{
+	dsp_run_steps_batched(fd, step_cnt, NULL);
 }
 
 void dsp_run_steps_at_addr(int fd, uint32_t dsp, uint32_t addr, uint32_t step_cnt)
@@ -503,6 +972,231 @@ void dsp_run_steps_at_addr(int fd, uint32_t dsp, uint32_t addr, uint32_t step_cn
 	dsp_run_steps(fd, step_cnt);
 }
 
+/*
+ * DSP context save/restore functions. Used by programs that overwrite DSP
+ * program memory and registers, so that the DSP can be put back the way it
+ * was on exit instead of needing a suspend/resume cycle.
+ */
+#define DSP_IO_OFFSET(dsp) (0x2000 * (dsp))
+
+void dsp_context_init(struct dsp_context *ctx, uint32_t dsp)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->dsp = dsp;
+}
+
+int dsp_context_add_range(struct dsp_context *ctx, uint32_t addr, uint32_t cnt)
+{
+	struct dsp_ctx_range *range;
+
+	if (ctx->range_cnt >= DSP_CTX_MAX_RANGES) {
+		printf("%s: Too many context ranges.\n", __func__);
+		return 1;
+	}
+
+	range = &ctx->ranges[ctx->range_cnt];
+	range->addr = addr;
+	range->cnt = cnt;
+	range->data = calloc(cnt, sizeof(uint32_t));
+	if (!range->data)
+		return 1;
+
+	ctx->range_cnt++;
+
+	return 0;
+}
+
+/*
+ * Add the DSP's register state: R00-R15, address registers and their
+ * modifiers, condition codes, PC/loop/status stack pointers and top of
+ * stack values, the PC, address register base/length values, and the
+ * interrupt mask. Only the top entry of each hardware stack is visible
+ * through the HIC, so that's all that gets saved.
+ */
+int dsp_context_add_reg_ranges(struct dsp_context *ctx)
+{
+	uint32_t offset = DSP_IO_OFFSET(ctx->dsp);
+
+	if (dsp_context_add_range(ctx, DSP0LOCALHWREG_START + offset,
+			((DSP0XYRAMAGMDFR_END - DSP0LOCALHWREG_START) / 4) + 1))
+		return 1;
+
+	if (dsp_context_add_range(ctx, DSP0CONDCODE + offset,
+			((DSP0PROGCOUNT - DSP0CONDCODE) / 4) + 1))
+		return 1;
+
+	if (dsp_context_add_range(ctx, DSP0XYRAMBASE_START + offset,
+			((DSP0XYRAMLENG_END - DSP0XYRAMBASE_START) / 4) + 1))
+		return 1;
+
+	return dsp_context_add_range(ctx, DSP0INTCONTMASKREG + offset, 1);
+}
+
+/*
+ * Save the X/YRAM words above the A_R7 value the DSP has when the context
+ * is saved. A_R7 is used as the stack pointer by programs that push
+ * registers before clobbering them, so it's only read once the DSP's are
+ * halted.
+ */
+void dsp_context_add_stack_range(struct dsp_context *ctx, uint32_t cnt)
+{
+	ctx->stack_cnt = cnt;
+}
+
+static int dsp_context_add_stack_ranges(int fd, struct dsp_context *ctx)
+{
+	uint32_t a_r7;
+
+	a_r7 = chipio_hic_read_at_addr(fd, DSP0XYRAMAGINDEX_START +
+			DSP_IO_OFFSET(ctx->dsp) + (7 * 4));
+
+	if (dsp_context_add_range(ctx, XRAM_START_ADDRESS + (a_r7 * 4), ctx->stack_cnt))
+		return 1;
+
+	if (dsp_context_add_range(ctx, YRAM_START_ADDRESS + (a_r7 * 4), ctx->stack_cnt)) {
+		free(ctx->ranges[--ctx->range_cnt].data);
+		return 1;
+	}
+
+	return 0;
+}
+
+/* Put back the debug register value from before the context was saved. */
+static void dsp_context_restore_dbg_reg(int fd, struct dsp_context *ctx)
+{
+	if ((ctx->dbg_reg >> 10) & 0xf)
+		chipio_hic_write_at_addr(fd, GLOBDSPDEBGREG, ctx->dbg_reg & 0x0000ffff);
+	else
+		set_dsp_dbg_single_step(fd, 0);
+}
+
+/*
+ * Save the debug register before halting the DSP's, so we know whether or
+ * not to set them running again on restore. Everything else, including the
+ * A_R7 value for the stack range, is read while halted.
+ */
+int dsp_context_save(int fd, struct dsp_context *ctx)
+{
+	struct dsp_ctx_range *range;
+	uint32_t i;
+
+	ctx->dbg_reg = chipio_hic_read_at_addr(fd, GLOBDSPDEBGREG);
+	set_dsp_dbg_single_step(fd, 1);
+
+	if (ctx->stack_cnt && dsp_context_add_stack_ranges(fd, ctx)) {
+		dsp_context_restore_dbg_reg(fd, ctx);
+		return 1;
+	}
+
+	for (i = 0; i < ctx->range_cnt; i++) {
+		range = &ctx->ranges[i];
+		chipio_hic_read_data_range(fd, range->addr, range->cnt, range->data);
+	}
+
+	ctx->saved = 1;
+
+	return 0;
+}
+
+/*
+ * Write everything back while still halted, then put the debug register
+ * back. If the DSP's weren't halted when the context was saved, this lets
+ * them run again.
+ */
+void dsp_context_restore(int fd, struct dsp_context *ctx)
+{
+	struct dsp_ctx_range *range;
+	uint32_t i;
+
+	if (!ctx->saved)
+		return;
+
+	set_dsp_dbg_single_step(fd, 1);
+
+	for (i = 0; i < ctx->range_cnt; i++) {
+		range = &ctx->ranges[i];
+		chipio_hic_write_data_range(fd, range->addr, range->cnt, range->data);
+	}
+
+	dsp_context_restore_dbg_reg(fd, ctx);
+}
+
+void dsp_context_free(struct dsp_context *ctx)
+{
+	uint32_t i;
+
+	for (i = 0; i < ctx->range_cnt; i++)
+		free(ctx->ranges[i].data);
+
+	ctx->range_cnt = 0;
+	ctx->stack_cnt = 0;
+	ctx->saved = 0;
+}
+
+/*
+ * Timing helpers and the watch loop. Times are CLOCK_MONOTONIC seconds.
+ */
+double get_monotonic_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+}
+
+void sleep_until_monotonic(double target)
+{
+	struct timespec ts;
+	double diff;
+
+	diff = target - get_monotonic_time();
+	if (diff <= 0.0)
+		return;
+
+	ts.tv_sec = (time_t)diff;
+	ts.tv_nsec = (long)((diff - ts.tv_sec) * 1000000000.0);
+	nanosleep(&ts, NULL);
+}
+
+/*
+ * Take samples until sample_cnt samples have been taken, counting the one
+ * already in prev that was taken at start, or forever if it's 0. A rate of
+ * 0 samples as fast as possible. prev and cur are swapped between samples.
+ * Stops and returns non-zero if a sample fails.
+ */
+int watch_loop_run(struct watch_loop *loop, void *prev, void *cur, double start)
+{
+	double next, now;
+	uint32_t i, changes;
+	void *tmp;
+
+	next = now = start;
+	changes = 0;
+	for (i = 1; !loop->sample_cnt || i < loop->sample_cnt; i++) {
+		if (loop->rate) {
+			next += 1.0 / loop->rate;
+			sleep_until_monotonic(next);
+		}
+
+		if (loop->sample(loop, cur, &now))
+			return 1;
+
+		changes += loop->print_changes(loop, prev, cur, now - start);
+
+		tmp = prev;
+		prev = cur;
+		cur = tmp;
+	}
+
+	now -= start;
+	if (loop->sample_cnt > 1)
+		printf("%d samples in %.3f seconds, %.1f samples/sec, %d changes.\n",
+				loop->sample_cnt, now, (loop->sample_cnt - 1) / now, changes);
+
+	return 0;
+}
+
 /* Default HDA-verb string getting functions. */
 static const struct hda_verb_info verb_info_table[] = {
 	{ .name     = "AC_VERB_GET_STREAM_FORMAT",
@@ -741,16 +1435,24 @@ static const struct hda_verb_info verb_info_table[] = {
 	}
 };
 
+/*
+ * Direct lookup tables for verb and SCP command info, indexed by verb and
+ * by target ID/request. Entries are the info table index plus one, or zero
+ * if there's no info. They're filled in by init_info_lookup() at startup.
+ */
+#define VERB_INFO_LOOKUP_SIZE  0x1000
+#define SCP_CMD_LOOKUP_MID_CNT 0x100
+#define SCP_CMD_LOOKUP_REQ_CNT 0x80
+
+static uint16_t verb_info_lookup[VERB_INFO_LOOKUP_SIZE];
+static uint16_t scp_cmd_lookup[SCP_CMD_LOOKUP_MID_CNT][SCP_CMD_LOOKUP_REQ_CNT];
+
 const struct hda_verb_info *get_hda_verb_info(uint32_t verb)
 {
-	uint32_t i;
-
-	for (i = 0; i < ARRAY_SIZE(verb_info_table); i++) {
-		if (verb_info_table[i].verb_val == verb)
-			return &verb_info_table[i];
-	}
+	if (verb >= VERB_INFO_LOOKUP_SIZE || !verb_info_lookup[verb])
+		return NULL;
 
-	return NULL;
+	return &verb_info_table[verb_info_lookup[verb] - 1];
 }
 
 /* ChipIO flagID/paramID string get functions. */
@@ -809,7 +1511,7 @@ static const char *control_flag_id[]  = {
 
 const char *chipio_get_flag_str(uint32_t flag)
 {
-	if (flag > ARRAY_SIZE(control_flag_id))
+	if (flag >= ARRAY_SIZE(control_flag_id))
 		return NULL;
 	else
 		return control_flag_id[flag];
@@ -856,7 +1558,7 @@ static const char *control_param_id[]  = {
 
 const char *chipio_get_param_str(uint32_t param)
 {
-	if (param > ARRAY_SIZE(control_param_id))
+	if (param >= ARRAY_SIZE(control_param_id))
 		return NULL;
 	else
 		return control_param_id[param];
@@ -1257,14 +1959,34 @@ static const struct scp_cmd_info scp_cmds[] = {
 
 const struct scp_cmd_info *dsp_get_scp_cmd_info(uint32_t mid, uint32_t req)
 {
-	uint32_t i;
+	if (mid >= SCP_CMD_LOOKUP_MID_CNT || req >= SCP_CMD_LOOKUP_REQ_CNT ||
+			!scp_cmd_lookup[mid][req])
+		return NULL;
 
-	for (i = 0; i < ARRAY_SIZE(scp_cmds); i++) {
-		if (scp_cmds[i].mid == mid && scp_cmds[i].req == req)
-			return &scp_cmds[i];
+	return &scp_cmds[scp_cmd_lookup[mid][req] - 1];
+}
+
+/*
+ * Fill in the lookup tables. If a verb or SCP command is listed more than
+ * once, the first entry is used, the same as a search through the table.
+ */
+static void __attribute__((constructor)) init_info_lookup(void)
+{
+	const struct scp_cmd_info *cmd;
+	uint32_t i, verb;
+
+	for (i = 0; i < ARRAY_SIZE(verb_info_table); i++) {
+		verb = verb_info_table[i].verb_val;
+		if (verb < VERB_INFO_LOOKUP_SIZE && !verb_info_lookup[verb])
+			verb_info_lookup[verb] = i + 1;
 	}
 
-	return NULL;
+	for (i = 0; i < ARRAY_SIZE(scp_cmds); i++) {
+		cmd = &scp_cmds[i];
+		if (cmd->mid < SCP_CMD_LOOKUP_MID_CNT && cmd->req < SCP_CMD_LOOKUP_REQ_CNT &&
+				!scp_cmd_lookup[cmd->mid][cmd->req])
+			scp_cmd_lookup[cmd->mid][cmd->req] = i + 1;
+	}
 }
 
 /*
@@ -52,6 +52,96 @@ struct scp_data {
 	uint32_t val[0x20];
 };
 
+/* Statistics kept by the batched DSP single step engine. */
+struct dsp_step_stats {
+	uint32_t steps;
+	uint32_t dbg_reg;
+
+	double elapsed;
+	double steps_per_sec;
+};
+
+/*
+ * DSP context save/restore. Each range is a run of HIC words that gets read
+ * on save, and written back on restore.
+ */
+#define DSP_CTX_MAX_RANGES 16
+
+struct dsp_ctx_range {
+	uint32_t addr;
+	uint32_t cnt;
+	uint32_t *data;
+};
+
+struct dsp_context {
+	struct dsp_ctx_range ranges[DSP_CTX_MAX_RANGES];
+	uint32_t range_cnt;
+	/* X/YRAM words above A_R7 to save, found once the DSP's are halted. */
+	uint32_t stack_cnt;
+
+	uint32_t dsp;
+	uint32_t dbg_reg;
+	uint8_t saved;
+};
+
+/*
+ * Read plans, for merging many small reads into as few as possible.
+ */
+#define CHIPIO_READ_PLAN_MAX_REQS 0x100
+
+enum chipio_read_space {
+	CHIPIO_SPACE_EXRAM,
+	CHIPIO_SPACE_PMEM,
+	CHIPIO_SPACE_HIC,
+};
+
+struct chipio_read_req {
+	uint32_t space;
+	uint32_t addr;
+	uint32_t len;
+	void *buf;
+};
+
+struct chipio_read_plan {
+	struct chipio_read_req reqs[CHIPIO_READ_PLAN_MAX_REQS];
+	uint32_t req_cnt;
+
+	uint32_t gap;
+	uint32_t span_cnt;
+};
+
+struct chipio_diff_write_stats {
+	uint32_t run_cnt;
+	uint32_t write_cnt;
+	uint32_t verify_fail;
+};
+
+/*
+ * ChipIO flags all come back in one CHIPIO_FLAGS_GET response, a snapshot
+ * holds all of them along with when they were read.
+ */
+#define CHIPIO_FLAG_CNT 0x19
+
+struct chipio_flag_snapshot {
+	uint32_t flags;
+	struct timespec time;
+};
+
+/*
+ * Rate paced watch loop, shared by the tools with a 'watch' mode. sample()
+ * reads a new sample into cur and sets the time it was taken at, returning
+ * non-zero on failure, and print_changes() prints what changed since prev
+ * and returns the count.
+ */
+struct watch_loop {
+	int fd;
+	uint32_t rate, sample_cnt;
+
+	int (*sample)(struct watch_loop *loop, void *cur, double *time);
+	uint32_t (*print_changes)(struct watch_loop *loop, const void *prev,
+			const void *cur, double time);
+};
+
 /* ca0132_base_functions.c function declarations. */
 void ca0132_command_wait();
 int dspio_write(int fd, uint32_t data);
@@ -72,16 +162,51 @@ void chipio_hic_write_data_range(int fd, uint32_t start_addr, uint32_t count,
 void chipio_hic_read_data_range(int fd, uint32_t start_addr, uint32_t count,
 		uint32_t *buf);
 
+uint32_t chipio_8051_diff_write_exram(int fd, uint16_t start_addr, uint16_t count,
+		const uint8_t *buf, const uint8_t *cur,
+		struct chipio_diff_write_stats *stats);
+uint32_t chipio_hic_diff_write_data(int fd, uint32_t start_addr, uint32_t count,
+		const uint32_t *buf, const uint32_t *cur,
+		struct chipio_diff_write_stats *stats);
+uint32_t chipio_8051_check_exram_cache(int fd, uint16_t start_addr,
+		uint16_t count, const uint8_t *cur);
+uint32_t chipio_hic_check_data_cache(int fd, uint32_t start_addr,
+		uint32_t count, const uint32_t *cur);
+void chipio_read_plan_init(struct chipio_read_plan *plan, uint32_t gap);
+int chipio_read_plan_add(struct chipio_read_plan *plan, uint32_t space,
+		uint32_t addr, uint32_t len, void *buf);
+int chipio_read_plan_run(int fd, struct chipio_read_plan *plan);
+int read_diff_cache_file(char *file_name, uint32_t start_addr, void *buf,
+		uint32_t size);
+int write_diff_cache_file(char *file_name, uint32_t start_addr, const void *buf,
+		uint32_t size);
+
 void chipio_set_control_flag(int fd, uint32_t flag, uint32_t set);
 uint8_t chipio_get_control_flag(int fd, uint32_t flag);
 void chipio_set_control_param(int fd, uint32_t param, uint8_t val);
 uint8_t chipio_get_control_param(int fd, uint32_t param);
+void chipio_get_flag_snapshot(int fd, struct chipio_flag_snapshot *snap);
+void chipio_get_control_params(int fd, const uint32_t *params, uint32_t cnt,
+		uint8_t *vals);
+
+double get_monotonic_time(void);
+void sleep_until_monotonic(double target);
+int watch_loop_run(struct watch_loop *loop, void *prev, void *cur, double start);
 
 void set_dsp_pc(int fd, uint32_t dsp, uint32_t addr);
 void set_dsp_dbg_single_step(int fd, uint32_t enable);
 void dsp_run_steps(int fd, uint32_t step_cnt);
+int dsp_run_steps_batched(int fd, uint32_t step_cnt, struct dsp_step_stats *stats);
 void dsp_run_steps_at_addr(int fd, uint32_t dsp, uint32_t addr, uint32_t step_cnt);
 
+void dsp_context_init(struct dsp_context *ctx, uint32_t dsp);
+int dsp_context_add_range(struct dsp_context *ctx, uint32_t addr, uint32_t cnt);
+int dsp_context_add_reg_ranges(struct dsp_context *ctx);
+void dsp_context_add_stack_range(struct dsp_context *ctx, uint32_t cnt);
+int dsp_context_save(int fd, struct dsp_context *ctx);
+void dsp_context_restore(int fd, struct dsp_context *ctx);
+void dsp_context_free(struct dsp_context *ctx);
+
 const struct hda_verb_info *get_hda_verb_info(uint32_t verb);
 const char *chipio_get_flag_str(uint32_t flag);
 const char *chipio_get_param_str(uint32_t param);
@@ -821,3 +946,233 @@ uint32_t get_dsp_op_len(uint32_t op);
 uint8_t get_asm_data_from_str(dsp_asm_data *data, char *asm_str);
 uint32_t get_bits_in_op_words(uint32_t *op_words, uint32_t start,
 		uint32_t len);
+
+/*
+ * DSP disassembler definitions. Ops are printed to out, and ops with a PC
+ * relative operand set offset_addr_op_set, with the target in offset_addr.
+ */
+struct dsp_disasm {
+	FILE *out;
+
+	uint32_t cur_op[4];
+	uint32_t cur_op_len;
+
+	uint32_t cur_addr;
+	char cur_op_str[0x100];
+
+	uint8_t offset_addr_op_set;
+	uint16_t offset_addr;
+};
+
+/* ca0132_dsp_disasm.c defs. */
+void dsp_disasm_print_op(struct dsp_disasm *data, const dsp_op_info *op_info);
+
+/*
+ * DSP instruction set simulator definitions.
+ */
+#define DSP_ISS_PMEM_WORDS   0x10000
+#define DSP_ISS_XYRAM_WORDS  0x10000
+#define DSP_ISS_GPRAM_WORDS  0x200
+#define DSP_ISS_REG_CNT      0x100
+#define DSP_ISS_ACC_CNT      4
+#define DSP_ISS_STACK_DEPTH  16
+#define DSP_ISS_WRITE_MAX    32
+
+enum dsp_iss_stop_reason {
+	DSP_ISS_RUNNING,
+	DSP_ISS_STOP_HALT,
+	DSP_ISS_STOP_UNKNOWN_OP,
+	DSP_ISS_STOP_UNIMPL,
+	DSP_ISS_STOP_STACK,
+	DSP_ISS_STOP_STEP_LIMIT,
+};
+
+/* A resolved operand location, either a register, memory, or a literal. */
+enum dsp_iss_loc_type {
+	DSP_ISS_LOC_NONE,
+	DSP_ISS_LOC_REG,
+	DSP_ISS_LOC_ACC_T1,
+	DSP_ISS_LOC_ACC_T2,
+	DSP_ISS_LOC_XGPRAM,
+	DSP_ISS_LOC_YGPRAM,
+	DSP_ISS_LOC_XRAM,
+	DSP_ISS_LOC_YRAM,
+	DSP_ISS_LOC_LITERAL,
+};
+
+struct dsp_iss_loc {
+	uint32_t type;
+	uint32_t addr;
+};
+
+struct dsp_iss_write {
+	struct dsp_iss_loc loc;
+	uint32_t val;
+};
+
+struct dsp_iss_loop {
+	uint32_t start;
+	uint32_t end;
+	uint32_t cnt;
+};
+
+struct dsp_iss_state {
+	uint32_t pmem[DSP_ISS_PMEM_WORDS];
+	uint32_t xram[DSP_ISS_XYRAM_WORDS];
+	uint32_t yram[DSP_ISS_XYRAM_WORDS];
+	uint32_t xgpram[DSP_ISS_GPRAM_WORDS];
+	uint32_t ygpram[DSP_ISS_GPRAM_WORDS];
+
+	/* Indexed by register operand value, same as dsp_reg_str. */
+	uint32_t regs[DSP_ISS_REG_CNT];
+	/* Upper 32-bits and highest 8-bits of R04/R05/R12/R13. */
+	uint32_t acc_t1[DSP_ISS_ACC_CNT];
+	uint32_t acc_t2[DSP_ISS_ACC_CNT];
+
+	uint32_t pc, next_pc;
+	uint8_t branch_taken;
+	uint8_t int_enable;
+
+	uint32_t pc_stack[DSP_ISS_STACK_DEPTH];
+	struct dsp_iss_loop loop_stack[DSP_ISS_STACK_DEPTH];
+
+	/* Writes are queued, and committed after all operands are read. */
+	struct dsp_iss_write writes[DSP_ISS_WRITE_MAX];
+	uint32_t write_cnt;
+
+	uint32_t dsp_id;
+	uint64_t steps;
+
+	uint32_t stop_reason;
+	char stop_msg[0x80];
+};
+
+/* ca0132_dsp_iss.c defs. */
+struct dsp_iss_state *dsp_iss_create(uint32_t dsp_id);
+void dsp_iss_destroy(struct dsp_iss_state *state);
+void dsp_iss_reset(struct dsp_iss_state *state);
+void dsp_iss_load_pmem(struct dsp_iss_state *state, uint32_t addr,
+		const uint32_t *data, uint32_t cnt);
+uint32_t dsp_iss_step(struct dsp_iss_state *state);
+uint32_t dsp_iss_run(struct dsp_iss_state *state, uint64_t max_steps);
+uint32_t dsp_iss_reg_read(struct dsp_iss_state *state, uint32_t reg);
+int dsp_iss_get_named_val(struct dsp_iss_state *state, const char *name,
+		uint32_t *val);
+int dsp_iss_set_named_val(struct dsp_iss_state *state, const char *name,
+		uint32_t val);
+const char *dsp_iss_get_stop_str(uint32_t stop_reason);
+
+/*
+ * 8051 emulator definitions. The first members of emu8051_dev are what gets
+ * stored in the save states written by ca0132-8051-dump-state.
+ */
+#define EMU8051_PMEM_SIZE      0x8000
+#define EMU8051_PMEM_BANK_SIZE 0x6000
+#define EMU8051_XRAM_SIZE      0x10000
+#define EMU8051_IRAM_SIZE      0x100
+#define EMU8051_SFR_SIZE       0x80
+
+enum emu8051_stop_reason {
+	EMU8051_RUNNING,
+	EMU8051_STOP_RETURN,
+	EMU8051_STOP_INVALID_OP,
+	EMU8051_STOP_INSN_LIMIT,
+};
+
+struct emu8051_dev;
+typedef uint8_t (*emu8051_sfr_read_func)(struct emu8051_dev *dev, uint8_t addr,
+		uint8_t val);
+typedef void (*emu8051_sfr_write_func)(struct emu8051_dev *dev, uint8_t addr,
+		uint8_t val);
+
+struct emu8051_dev {
+	uint16_t pc;
+
+	uint8_t pmem[EMU8051_PMEM_SIZE];
+	uint8_t pmem_b0[EMU8051_PMEM_BANK_SIZE];
+	uint8_t pmem_b1[EMU8051_PMEM_BANK_SIZE];
+
+	uint8_t xram[EMU8051_XRAM_SIZE];
+	uint8_t iram[EMU8051_IRAM_SIZE];
+	uint8_t sfr[EMU8051_SFR_SIZE];
+
+	/* Emulator state, not part of the save state. */
+	uint64_t insn_cnt;
+	uint32_t stop_reason;
+	uint8_t ret_sp;
+
+	/* Optional hooks for modelling hardware behind SFR's. */
+	emu8051_sfr_read_func sfr_read;
+	emu8051_sfr_write_func sfr_write;
+	void *priv;
+
+	/* ChipIO side state. */
+	uint16_t chipio_8051_addr;
+	uint8_t chipio_param_id;
+};
+
+/* ca0132_8051_emu.c defs. */
+int emu8051_save_state_write(struct emu8051_dev *dev, char *file_name);
+int emu8051_save_state_load(struct emu8051_dev *dev, char *file_name);
+void emu8051_reset_run_state(struct emu8051_dev *dev);
+uint8_t emu8051_code_read(struct emu8051_dev *dev, uint16_t addr);
+uint32_t emu8051_step(struct emu8051_dev *dev);
+uint32_t emu8051_run(struct emu8051_dev *dev, uint64_t max_insns);
+uint32_t emu8051_call(struct emu8051_dev *dev, uint16_t addr, uint64_t max_insns);
+int emu8051_chipio_verb(struct emu8051_dev *dev, uint32_t verb, uint32_t param,
+		uint32_t *res);
+const char *emu8051_get_stop_str(uint32_t stop_reason);
+
+/*
+ * Indexed save state container. A header and section directory, followed by
+ * page aligned sections, so uncompressed sections can be used straight from
+ * an mmap of the file. Each section has a digest of its uncompressed data.
+ */
+#define EMU8051_STATE_MAGIC      "CA0132ST"
+#define EMU8051_STATE_VERSION    1
+#define EMU8051_STATE_ALIGN      0x1000
+#define EMU8051_STATE_MAX_SECS   0x20
+
+enum emu8051_state_codec {
+	EMU8051_STATE_CODEC_RAW,
+	EMU8051_STATE_CODEC_LZ,
+};
+
+struct emu8051_state_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t section_cnt;
+};
+
+struct emu8051_state_section {
+	char tag[4];
+	uint32_t codec;
+	uint32_t offset;
+	uint32_t size;
+	uint32_t raw_size;
+	uint32_t reserved;
+	uint64_t digest;
+};
+
+struct emu8051_state_file {
+	uint8_t *map;
+	size_t map_size;
+
+	const struct emu8051_state_hdr *hdr;
+	const struct emu8051_state_section *sections;
+};
+
+/* ca0132_8051_state.c defs. */
+int emu8051_state_is_indexed(char *file_name);
+int emu8051_state_write(struct emu8051_dev *dev, char *file_name, uint32_t codec);
+int emu8051_state_open(struct emu8051_state_file *state, char *file_name);
+void emu8051_state_close(struct emu8051_state_file *state);
+const struct emu8051_state_section *emu8051_state_find_section(
+		struct emu8051_state_file *state, const char *tag);
+const uint8_t *emu8051_state_map_section(struct emu8051_state_file *state,
+		const struct emu8051_state_section *sec);
+int emu8051_state_read_section(struct emu8051_state_file *state,
+		const struct emu8051_state_section *sec, void *buf, uint32_t size);
+int emu8051_state_load(struct emu8051_dev *dev, char *file_name);
+uint64_t emu8051_state_digest(const uint8_t *data, uint32_t size);
+const char *emu8051_state_get_codec_str(uint32_t codec);
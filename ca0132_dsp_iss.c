@@ -0,0 +1,1785 @@
+/*
+ * ca0132_dsp_iss.c:
+ * Host side instruction set simulator for the ca0132's DSP. Ops are decoded
+ * with the same op tables and operand layouts used by the assembler and
+ * disassembler, and executed against a model of PMEM, X/YRAM, GPRAM, and the
+ * DSP's register file.
+ *
+ * Only ops with known behavior are executed, anything else stops the
+ * simulator with DSP_ISS_STOP_UNIMPL. Behavior that has been guessed at is
+ * marked as provisional, and should be checked against recorded
+ * ca0132-dsp-op-test results with ca0132-dsp-iss's validate mode.
+ */
+#include "ca0132_defs.h"
+
+/* Register operand values, see dsp_reg_str in ca0132_dsp_functions.c. */
+#define ISS_REG_R00              0x00
+#define ISS_REG_R04              0x04
+#define ISS_REG_R05              0x05
+#define ISS_REG_R12              0x0c
+#define ISS_REG_R13              0x0d
+#define ISS_REG_A_R0             0x10
+#define ISS_REG_A_R0_MDFR        0x18
+#define ISS_REG_CONST_START      0x20
+#define ISS_REG_CONST_END        0x57
+#define ISS_REG_TIME0_PER_ENB    0x58
+#define ISS_REG_TIME3_COUNTER    0x5f
+#define ISS_REG_IND_START        0x60
+#define ISS_REG_IND_INC_START    0x70
+#define ISS_REG_IND_END          0x7f
+#define ISS_REG_COND             0x80
+#define ISS_REG_PC_STK_PTR       0x82
+#define ISS_REG_CUR_LOOP_ADR     0x84
+#define ISS_REG_CUR_LOOP_CNT     0x85
+#define ISS_REG_TOP_LOOP_CNT     0x86
+#define ISS_REG_TOP_LOOP_ADR     0x87
+#define ISS_REG_LOOP_STACK_PTR   0x88
+#define ISS_REG_PROG_CNT         0x8b
+#define ISS_REG_A_R0_BASE        0xa8
+#define ISS_REG_A_R0_LENG        0xb0
+
+/*
+ * Condition code flag bits in COND_REG. These are provisional, the real bit
+ * positions haven't been confirmed yet.
+ */
+#define ISS_COND_Z 0x01
+#define ISS_COND_N 0x02
+#define ISS_COND_C 0x04
+#define ISS_COND_V 0x08
+#define ISS_COND_MASK (ISS_COND_Z | ISS_COND_N | ISS_COND_C | ISS_COND_V)
+
+/* Branch condition literal that's used everywhere for 'always'. */
+#define ISS_BRANCH_COND_ALWAYS 0x0f
+
+/* A decoded operand, before being resolved against the DSP's state. */
+struct dsp_iss_operand {
+	uint32_t val;
+	uint8_t type;
+	uint8_t dir;
+	uint8_t mdfr;
+	uint8_t parallel_end;
+};
+
+struct dsp_iss_op {
+	const dsp_op_info *info;
+	const char *op_str;
+	uint32_t op, len, addr;
+	uint32_t words[4];
+
+	struct dsp_iss_operand operands[8];
+	uint32_t operand_cnt;
+
+	const dsp_op_info *p_info;
+	const char *p_op_str;
+	struct dsp_iss_operand p_operands[8];
+	uint32_t p_operand_cnt;
+};
+
+/* Operands split up by direction, for a single set of parallel operands. */
+struct dsp_iss_group {
+	const struct dsp_iss_operand *dst, *src, *x, *y, *a;
+};
+
+typedef int (*dsp_iss_op_func)(struct dsp_iss_state *state,
+		const struct dsp_iss_op *op);
+
+static uint32_t iss_const_regs[ISS_REG_CONST_END - ISS_REG_CONST_START + 1];
+static uint8_t iss_const_regs_set;
+
+static uint32_t float_to_bits(float val)
+{
+	uint32_t tmp;
+
+	memcpy(&tmp, &val, sizeof(tmp));
+
+	return tmp;
+}
+
+static float bits_to_float(uint32_t val)
+{
+	float tmp;
+
+	memcpy(&tmp, &val, sizeof(tmp));
+
+	return tmp;
+}
+
+static int32_t sign_extend(uint32_t val, uint32_t bits)
+{
+	uint32_t sign = 1 << (bits - 1);
+
+	val &= (sign << 1) - 1;
+
+	return (int32_t)((val ^ sign) - sign);
+}
+
+static const struct {
+	const char *name;
+	float val;
+} iss_float_consts[] = {
+	{ "CR_F_2",          2.0f },
+	{ "CR_F_PI",         3.14159265f },
+	{ "CR_F_PI_DIV_2",   1.57079633f },
+	{ "CR_F_PI_DIV_4",   0.78539816f },
+	{ "CR_F_1_DIV_PI",   0.31830989f },
+	{ "CR_F_1_DIV_2PI",  0.15915494f },
+	{ "CR_F_0.5",        0.5f },
+	{ "CR_F_1",          1.0f },
+	{ "CR_F_NEG_1",     -1.0f },
+	{ "CR_F_3",          3.0f },
+	{ "CR_F_SQRT_0.5",   0.70710678f },
+};
+
+/*
+ * Fill in the constant register values from their names. CR_B1_* registers
+ * have unknown values, and are left as zero.
+ */
+static void iss_init_const_regs(void)
+{
+	const char *name;
+	uint32_t i, j;
+
+	if (iss_const_regs_set)
+		return;
+
+	for (i = ISS_REG_CONST_START; i <= ISS_REG_CONST_END; i++) {
+		name = get_dsp_operand_str(i);
+
+		if (!strncmp(name, "CR_0x", 5)) {
+			iss_const_regs[i - ISS_REG_CONST_START] =
+				strtoul(name + 3, NULL, 16);
+			continue;
+		}
+
+		for (j = 0; j < ARRAY_SIZE(iss_float_consts); j++) {
+			if (!strcmp(name, iss_float_consts[j].name)) {
+				iss_const_regs[i - ISS_REG_CONST_START] =
+					float_to_bits(iss_float_consts[j].val);
+				break;
+			}
+		}
+	}
+
+	iss_const_regs_set = 1;
+}
+
+static void iss_stop(struct dsp_iss_state *state, uint32_t reason,
+		const char *msg)
+{
+	state->stop_reason = reason;
+	snprintf(state->stop_msg, sizeof(state->stop_msg), "%s", msg);
+}
+
+/*
+ * Accumulator registers R04/R05/R12/R13 have extra upper bits, which are
+ * accessed with the _T1/_T2 op variants.
+ */
+static int32_t iss_get_acc_idx(uint32_t reg)
+{
+	switch (reg) {
+	case ISS_REG_R04:
+		return 0;
+	case ISS_REG_R05:
+		return 1;
+	case ISS_REG_R12:
+		return 2;
+	case ISS_REG_R13:
+		return 3;
+	default:
+		return -1;
+	}
+}
+
+/*
+ * Address register functions. A_Rx_BASE/A_Rx_LENG set up a circular buffer
+ * when the length is non-zero, which post-modify operations wrap around.
+ */
+static uint32_t iss_areg_modify(struct dsp_iss_state *state, uint32_t areg,
+		int32_t inc)
+{
+	int32_t addr, base, len;
+
+	addr = state->regs[ISS_REG_A_R0 + areg] & 0xffff;
+	base = state->regs[ISS_REG_A_R0_BASE + areg] & 0xffff;
+	len = state->regs[ISS_REG_A_R0_LENG + areg] & 0xffff;
+
+	addr += inc;
+	if (len) {
+		if (addr >= base + len)
+			addr -= len;
+		else if (addr < base)
+			addr += len;
+	}
+
+	return addr & 0xffff;
+}
+
+static int32_t iss_get_mdfr(struct dsp_iss_state *state, uint32_t mdfr)
+{
+	return (int16_t)state->regs[ISS_REG_A_R0_MDFR + mdfr];
+}
+
+static void iss_queue_write(struct dsp_iss_state *state,
+		const struct dsp_iss_loc *loc, uint32_t val)
+{
+	if (state->write_cnt >= DSP_ISS_WRITE_MAX)
+		return;
+
+	state->writes[state->write_cnt].loc = *loc;
+	state->writes[state->write_cnt].val = val;
+	state->write_cnt++;
+}
+
+static void iss_queue_reg_write(struct dsp_iss_state *state, uint32_t reg,
+		uint32_t val)
+{
+	struct dsp_iss_loc loc = { DSP_ISS_LOC_REG, reg };
+
+	iss_queue_write(state, &loc, val);
+}
+
+static void iss_queue_areg_inc(struct dsp_iss_state *state, uint32_t areg,
+		int32_t inc)
+{
+	iss_queue_reg_write(state, ISS_REG_A_R0 + areg,
+			iss_areg_modify(state, areg, inc));
+}
+
+/*
+ * Indirect address registers @A_Rx_X_REG/@A_Rx_Y_REG access memory at the
+ * address in A_Rx, with the _INC_ versions incrementing it afterwards.
+ */
+static void iss_get_ind_reg_loc(struct dsp_iss_state *state, uint32_t reg,
+		struct dsp_iss_loc *loc, uint8_t side_effects)
+{
+	uint32_t tmp, areg;
+
+	tmp = reg - ISS_REG_IND_START;
+	areg = (tmp >> 1) & 0x07;
+
+	loc->type = (tmp & 0x01) ? DSP_ISS_LOC_YRAM : DSP_ISS_LOC_XRAM;
+	loc->addr = state->regs[ISS_REG_A_R0 + areg] & 0xffff;
+
+	if (side_effects && reg >= ISS_REG_IND_INC_START)
+		iss_queue_areg_inc(state, areg, 1);
+}
+
+static uint32_t *iss_get_mem_ptr(struct dsp_iss_state *state,
+		const struct dsp_iss_loc *loc)
+{
+	switch (loc->type) {
+	case DSP_ISS_LOC_XRAM:
+		return &state->xram[loc->addr & (DSP_ISS_XYRAM_WORDS - 1)];
+	case DSP_ISS_LOC_YRAM:
+		return &state->yram[loc->addr & (DSP_ISS_XYRAM_WORDS - 1)];
+	case DSP_ISS_LOC_XGPRAM:
+		return &state->xgpram[loc->addr & (DSP_ISS_GPRAM_WORDS - 1)];
+	case DSP_ISS_LOC_YGPRAM:
+		return &state->ygpram[loc->addr & (DSP_ISS_GPRAM_WORDS - 1)];
+	default:
+		return NULL;
+	}
+}
+
+/* Read a register without any side effects. */
+uint32_t dsp_iss_reg_read(struct dsp_iss_state *state, uint32_t reg)
+{
+	struct dsp_iss_loc loc;
+
+	reg &= DSP_ISS_REG_CNT - 1;
+	switch (reg) {
+	case ISS_REG_CONST_START ... ISS_REG_CONST_END:
+		if (!strcmp(get_dsp_operand_str(reg), "CR_DSP_ID"))
+			return state->dsp_id;
+
+		return iss_const_regs[reg - ISS_REG_CONST_START];
+
+	case ISS_REG_TIME0_PER_ENB ... ISS_REG_TIME3_COUNTER:
+		/* Timer counters just count steps. */
+		if (reg & 0x01)
+			return (uint32_t)state->steps;
+
+		return state->regs[reg];
+
+	case ISS_REG_IND_START ... ISS_REG_IND_END:
+		iss_get_ind_reg_loc(state, reg, &loc, 0);
+		return *iss_get_mem_ptr(state, &loc);
+
+	case ISS_REG_PROG_CNT:
+		return state->pc;
+
+	default:
+		return state->regs[reg];
+	}
+}
+
+static uint32_t iss_loc_read(struct dsp_iss_state *state,
+		const struct dsp_iss_loc *loc)
+{
+	struct dsp_iss_loc tmp;
+	int32_t acc;
+
+	switch (loc->type) {
+	case DSP_ISS_LOC_REG:
+		if (loc->addr >= ISS_REG_IND_START && loc->addr <= ISS_REG_IND_END) {
+			iss_get_ind_reg_loc(state, loc->addr, &tmp, 1);
+			return *iss_get_mem_ptr(state, &tmp);
+		}
+
+		return dsp_iss_reg_read(state, loc->addr);
+
+	case DSP_ISS_LOC_ACC_T1:
+	case DSP_ISS_LOC_ACC_T2:
+		acc = iss_get_acc_idx(loc->addr);
+		if (acc < 0)
+			return dsp_iss_reg_read(state, loc->addr);
+
+		if (loc->type == DSP_ISS_LOC_ACC_T1)
+			return state->acc_t1[acc];
+
+		return state->acc_t2[acc];
+
+	case DSP_ISS_LOC_LITERAL:
+		return loc->addr;
+
+	case DSP_ISS_LOC_NONE:
+		return 0;
+
+	default:
+		return *iss_get_mem_ptr(state, loc);
+	}
+}
+
+/*
+ * Queue a write to a location. Indirect address register writes are turned
+ * into memory writes here, so that they use the address register value from
+ * before any of this op's writes are committed.
+ */
+static void iss_loc_write(struct dsp_iss_state *state,
+		const struct dsp_iss_loc *loc, uint32_t val)
+{
+	struct dsp_iss_loc tmp;
+
+	if (loc->type == DSP_ISS_LOC_REG && loc->addr >= ISS_REG_IND_START &&
+			loc->addr <= ISS_REG_IND_END) {
+		iss_get_ind_reg_loc(state, loc->addr, &tmp, 1);
+		iss_queue_write(state, &tmp, val);
+		return;
+	}
+
+	iss_queue_write(state, loc, val);
+}
+
+static void iss_commit_writes(struct dsp_iss_state *state)
+{
+	struct dsp_iss_write *write;
+	uint32_t i, *ptr;
+	int32_t acc;
+
+	for (i = 0; i < state->write_cnt; i++) {
+		write = &state->writes[i];
+
+		switch (write->loc.type) {
+		case DSP_ISS_LOC_REG:
+			switch (write->loc.addr) {
+			case ISS_REG_CONST_START ... ISS_REG_CONST_END:
+			case ISS_REG_PROG_CNT:
+				break;
+			default:
+				state->regs[write->loc.addr] = write->val;
+				break;
+			}
+			break;
+
+		case DSP_ISS_LOC_ACC_T1:
+		case DSP_ISS_LOC_ACC_T2:
+			acc = iss_get_acc_idx(write->loc.addr);
+			if (acc < 0)
+				state->regs[write->loc.addr] = write->val;
+			else if (write->loc.type == DSP_ISS_LOC_ACC_T1)
+				state->acc_t1[acc] = write->val;
+			else
+				state->acc_t2[acc] = write->val & 0xff;
+			break;
+
+		case DSP_ISS_LOC_LITERAL:
+		case DSP_ISS_LOC_NONE:
+			break;
+
+		default:
+			ptr = iss_get_mem_ptr(state, &write->loc);
+			*ptr = write->val;
+			break;
+		}
+	}
+
+	state->write_cnt = 0;
+}
+
+/*
+ * Register operand value mapping, matches the register strings printed by
+ * ca0132-dsp-disassembler.
+ */
+static uint32_t iss_get_reg_operand(uint32_t type, uint32_t val)
+{
+	switch (type) {
+	case OP_OPERAND_REG_2:
+		return val & 0x03;
+	case OP_OPERAND_REG_2_4:
+		return 4 + (val & 0x03);
+	case OP_OPERAND_REG_2_8:
+		return 8 + (val & 0x03);
+	case OP_OPERAND_REG_2_12:
+		return 12 + (val & 0x03);
+	case OP_OPERAND_REG_2_T1:
+		return ((val & 0x02) ? 8 : 12) + (val & 0x01);
+	case OP_OPERAND_REG_2_T2:
+		return ((val & 0x02) ? 0 : 4) + (val & 0x01);
+	case OP_OPERAND_REG_3_X_T1:
+		return ((val & 0x04) ? 0 : 4) + (val & 0x03);
+	case OP_OPERAND_REG_3_Y_T1:
+		return (val > 0x05) ? 12 + (val & 0x01) : val;
+	case OP_OPERAND_REG_3_X_T2:
+		return ((val & 0x04) ? 8 : 12) + (val & 0x03);
+	case OP_OPERAND_REG_3_Y_T2:
+		switch (val) {
+		case 0 ... 3:
+			return 8 + (val & 0x03);
+		case 4 ... 5:
+			return val;
+		default:
+			return 12 + (val & 0x01);
+		}
+	case OP_OPERAND_REG_3_FMA_X_T1:
+		return (val > 5) ? 8 + (val & 0x01) : val;
+	case OP_OPERAND_REG_3_FMA_X_T2:
+		return (val > 5) ? (val & 0x01) : 8 + val;
+	case OP_OPERAND_REG_3_FMA_A_T1:
+		return ((val > 4) ? 12 : 4) + (val & 0x03);
+	case OP_OPERAND_REG_3_FMA_Y_T1:
+	case OP_OPERAND_REG_3:
+		return val & 0x07;
+	case OP_OPERAND_REG_4:
+		return val & 0x0f;
+	case OP_OPERAND_REG_5:
+	case OP_OPERAND_REG_5_MOVX:
+		return val & 0x1f;
+	case OP_OPERAND_REG_7:
+		return val & 0x7f;
+	case OP_OPERAND_REG_3_FMA_Y_T2:
+	case OP_OPERAND_REG_3_8:
+		return (val & 0x07) + 8;
+	case OP_OPERAND_REG_3_ACC:
+		return ((val & 0x04) ? 4 : 12) + (val & 0x03);
+	case OP_OPERAND_REG_3_FMA:
+		switch ((val >> 1) & 0x03) {
+		case 3:
+			return 8 + (val & 0x01);
+		case 2:
+			return 0 + (val & 0x01);
+		case 1:
+			return 12 + (val & 0x01);
+		default:
+			return 4 + (val & 0x01);
+		}
+	default:
+		return val & 0xff;
+	}
+}
+
+/* 11-bit register operands can also address X/YGPRAM. */
+static void iss_get_reg_11_loc(uint32_t val, struct dsp_iss_loc *loc)
+{
+	if (val & 0x400) {
+		loc->type = (val & 0x200) ? DSP_ISS_LOC_YGPRAM : DSP_ISS_LOC_XGPRAM;
+		loc->addr = val & 0xff;
+	} else {
+		loc->type = DSP_ISS_LOC_REG;
+		loc->addr = val & 0xff;
+	}
+}
+
+static void iss_get_reg_11_offset_loc(uint32_t type, uint32_t val,
+		struct dsp_iss_loc *loc)
+{
+	uint32_t tmp0, tmp1;
+
+	if (type == OP_OPERAND_REG_11_4_OFFSET) {
+		tmp0 = val & 0xf;
+		tmp1 = ((val >> 11) & 0xf) + tmp0;
+		tmp0 = (val & 0x7f0) | (tmp1 & 0xf);
+		if ((tmp0 & 0x600) != (val & 0x600)) {
+			tmp0 &= 0x1ff;
+			tmp0 |= (val & 0x600);
+		}
+	} else {
+		tmp0 = val & 0x7ff;
+		tmp1 = (val >> 11) & 0x3ff;
+		if (tmp1 & 0x200)
+			tmp1 |= 0xfc00;
+
+		tmp0 = (tmp0 + (uint16_t)tmp1) & 0xffff;
+	}
+
+	if (tmp0 & 0x400) {
+		loc->type = (tmp0 & 0x800) ? DSP_ISS_LOC_YGPRAM : DSP_ISS_LOC_XGPRAM;
+		loc->addr = tmp0 & 0x3ff;
+	} else {
+		loc->type = DSP_ISS_LOC_REG;
+		loc->addr = tmp0 & 0xff;
+	}
+}
+
+static void iss_set_areg_loc(struct dsp_iss_state *state, uint32_t areg,
+		uint8_t yram, int32_t offset, struct dsp_iss_loc *loc)
+{
+	loc->type = yram ? DSP_ISS_LOC_YRAM : DSP_ISS_LOC_XRAM;
+	loc->addr = (state->regs[ISS_REG_A_R0 + areg] + offset) & 0xffff;
+}
+
+/*
+ * Resolve an operand into a location. Address register post-modify side
+ * effects are queued here, so this should only be called once per operand.
+ */
+static int iss_resolve_operand(struct dsp_iss_state *state,
+		const struct dsp_iss_op *op, const struct dsp_iss_operand *operand,
+		struct dsp_iss_loc *loc)
+{
+	uint32_t val = operand->val;
+	uint32_t areg, mdfr;
+
+	loc->type = DSP_ISS_LOC_LITERAL;
+	loc->addr = 0;
+
+	switch (operand->type) {
+	case OP_OPERAND_REG_2 ... OP_OPERAND_REG_10:
+		loc->type = DSP_ISS_LOC_REG;
+		loc->addr = iss_get_reg_operand(operand->type, val);
+		break;
+
+	case OP_OPERAND_REG_11:
+		iss_get_reg_11_loc(val, loc);
+		break;
+
+	case OP_OPERAND_REG_11_10_OFFSET:
+	case OP_OPERAND_REG_11_4_OFFSET:
+		iss_get_reg_11_offset_loc(operand->type, val, loc);
+		break;
+
+	case OP_OPERAND_A_REG_CALL:
+		loc->type = DSP_ISS_LOC_REG;
+		loc->addr = ISS_REG_A_R0 + (val & 0x07);
+		break;
+
+	case OP_OPERAND_A_REG_CALL_MDFR:
+		loc->type = DSP_ISS_LOC_REG;
+		loc->addr = ISS_REG_A_R0_MDFR + (val & 0x07);
+		break;
+
+	case OP_OPERAND_A_REG:
+		iss_set_areg_loc(state, val & 0x07, val & 0x08, 0, loc);
+		break;
+
+	case OP_OPERAND_A_REG_X:
+	case OP_OPERAND_A_REG_Y:
+		iss_set_areg_loc(state, val & 0x07,
+				operand->type == OP_OPERAND_A_REG_Y, 0, loc);
+		if (val & 0x08)
+			iss_queue_areg_inc(state, val & 0x07, 1);
+		break;
+
+	case OP_OPERAND_A_REG_X_INC:
+	case OP_OPERAND_A_REG_Y_INC:
+		iss_set_areg_loc(state, val & 0x07,
+				operand->type == OP_OPERAND_A_REG_Y_INC, 0, loc);
+		iss_queue_areg_inc(state, val & 0x07, 1);
+		break;
+
+	case OP_OPERAND_A_REG_PLUS_MDFR:
+	case OP_OPERAND_A_REG_X_PLUS_MDFR:
+	case OP_OPERAND_A_REG_Y_PLUS_MDFR:
+		areg = (val >> 3) & 0x07;
+		mdfr = val & 0x07;
+		if (operand->type == OP_OPERAND_A_REG_PLUS_MDFR)
+			iss_set_areg_loc(state, areg, val & 0x40, 0, loc);
+		else
+			iss_set_areg_loc(state, areg,
+				operand->type == OP_OPERAND_A_REG_Y_PLUS_MDFR, 0, loc);
+
+		iss_queue_areg_inc(state, areg, iss_get_mdfr(state, mdfr));
+		break;
+
+	case OP_OPERAND_A_REG_X_MDFR_OFFSET:
+	case OP_OPERAND_A_REG_Y_MDFR_OFFSET:
+		areg = val & 0x07;
+		mdfr = (val >> 3) & 0x07;
+		iss_set_areg_loc(state, areg,
+				operand->type == OP_OPERAND_A_REG_Y_MDFR_OFFSET,
+				iss_get_mdfr(state, mdfr), loc);
+		break;
+
+	case OP_OPERAND_A_REG_INT_7_OFFSET:
+		iss_set_areg_loc(state, val & 0x07, val & 0x08,
+				sign_extend(val >> 4, 7), loc);
+		break;
+
+	case OP_OPERAND_A_REG_INT_17_OFFSET:
+		iss_set_areg_loc(state, val & 0x07, (val & 0x100000) != 0,
+				sign_extend(val >> 3, 17), loc);
+		break;
+
+	case OP_OPERAND_A_REG_X_INT_11_OFFSET:
+	case OP_OPERAND_A_REG_Y_INT_11_OFFSET:
+		iss_set_areg_loc(state, val & 0x07,
+				operand->type == OP_OPERAND_A_REG_Y_INT_11_OFFSET,
+				sign_extend(val >> 3, 11), loc);
+		break;
+
+	case OP_OPERAND_LITERAL_7_INT:
+		loc->addr = sign_extend(val, 7);
+		break;
+
+	case OP_OPERAND_LITERAL_8_INT:
+	case OP_OPERAND_LITERAL_8_INT_PC_OFFSET:
+		loc->addr = sign_extend(val, 8);
+		break;
+
+	case OP_OPERAND_LITERAL_16_INT:
+		loc->addr = sign_extend(val, 16);
+		break;
+
+	case OP_OPERAND_LITERAL_17_INT:
+		loc->addr = sign_extend(val, 17);
+		break;
+
+	case OP_OPERAND_LITERAL_16:
+		if (operand->mdfr == OPERAND_MDFR_16_BIT_UPPER)
+			loc->addr = val << 16;
+		else if (operand->mdfr == OPERAND_MDFR_16_BIT_SIGNED)
+			loc->addr = sign_extend(val, 16);
+		else
+			loc->addr = val & 0xffff;
+		break;
+
+	case OP_OPERAND_LITERAL_16_UPPER:
+		loc->addr = val << 16;
+		break;
+
+	case OP_OPERAND_LITERAL_16_ADDR:
+		loc->type = (val < 0x10000) ? DSP_ISS_LOC_XRAM : DSP_ISS_LOC_YRAM;
+		loc->addr = val & 0xffff;
+		break;
+
+	case OP_OPERAND_LITERAL_8:
+	case OP_OPERAND_LITERAL_11:
+	case OP_OPERAND_LITERAL_32:
+		loc->addr = val;
+		break;
+
+	case OP_OPERAND_NOP:
+		loc->type = DSP_ISS_LOC_NONE;
+		break;
+
+	default:
+		snprintf(state->stop_msg, sizeof(state->stop_msg),
+				"Unimplemented operand type %d in %s at 0x%04x",
+				operand->type, op->op_str, op->addr);
+		state->stop_reason = DSP_ISS_STOP_UNIMPL;
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Op decoding. This follows the same steps as the disassembler, but keeps
+ * operand values instead of printing them.
+ */
+static uint32_t iss_get_operand_bits(const struct dsp_iss_op *op,
+		const operand_loc_descriptor *loc)
+{
+	uint32_t operand, tmp, words[4];
+
+	memcpy(words, op->words, sizeof(words));
+	operand = get_bits_in_op_words(words, loc->part1_bit_start, loc->part1_bits);
+	if (loc->part2_bits) {
+		tmp = get_bits_in_op_words(words, loc->part2_bit_start, loc->part2_bits);
+		operand = (operand << loc->part2_bits) | tmp;
+	}
+
+	return operand;
+}
+
+static const op_operand_loc_layout *iss_find_loc_layout(const struct dsp_iss_op *op,
+		const op_operand_layout *layout)
+{
+	const op_operand_loc_layout *loc_layout = NULL;
+	uint32_t i;
+
+	for (i = 0; i < layout->loc_layout_cnt; i++) {
+		loc_layout = &layout->loc_layouts[i];
+		if (!loc_layout->layout_val_loc.part1_bits)
+			break;
+
+		if (loc_layout->layout_val ==
+				iss_get_operand_bits(op, &loc_layout->layout_val_loc))
+			break;
+	}
+
+	return loc_layout;
+}
+
+static void iss_get_operands(struct dsp_iss_op *op, const dsp_op_info *info,
+		const op_operand_loc_layout *loc_layout,
+		struct dsp_iss_operand *operands, uint32_t *operand_cnt,
+		const char **op_str)
+{
+	const operand_loc_descriptor *loc;
+	uint32_t i, src_mdfr, src_dst_swap, words[4];
+
+	src_dst_swap = info->src_dst_swap;
+	src_mdfr = info->src_mdfr[0];
+	*op_str = info->op_str;
+
+	memcpy(words, op->words, sizeof(words));
+	if (info->mdfr_bit && get_bits_in_op_words(words, info->mdfr_bit, 1)) {
+		switch (info->mdfr_bit_type) {
+		case OP_MDFR_BIT_TYPE_SRC_DST_SWAP:
+			src_dst_swap = 1;
+			break;
+		case OP_MDFR_BIT_TYPE_USE_ALT_MDFR:
+			src_mdfr = info->src_mdfr[1];
+			break;
+		default:
+			break;
+		}
+
+		if (info->alt_op_str)
+			*op_str = info->alt_op_str;
+	}
+
+	*operand_cnt = 0;
+	if (!loc_layout)
+		return;
+
+	for (i = 0; i < loc_layout->operand_cnt; i++) {
+		loc = &loc_layout->operand_loc[i];
+
+		operands[i].val = iss_get_operand_bits(op, loc);
+		operands[i].type = loc->operand_type;
+		operands[i].dir = loc->operand_dir;
+		operands[i].parallel_end = loc->parallel_end;
+		operands[i].mdfr = 0;
+
+		if (src_dst_swap) {
+			if (operands[i].dir == OPERAND_DIR_DST)
+				operands[i].dir = OPERAND_DIR_SRC;
+			else if (operands[i].dir == OPERAND_DIR_SRC)
+				operands[i].dir = OPERAND_DIR_DST;
+		}
+
+		if (operands[i].dir == OPERAND_DIR_SRC || operands[i].dir == OPERAND_DIR_X ||
+				operands[i].dir == OPERAND_DIR_Y)
+			operands[i].mdfr = src_mdfr;
+	}
+
+	*operand_cnt = loc_layout->operand_cnt;
+}
+
+static void iss_decode_p_op(struct dsp_iss_op *op)
+{
+	const op_operand_loc_layout *loc_layout;
+	uint32_t val, layout_id, words[4];
+	const dsp_op_info *p_op;
+
+	memcpy(words, op->words, sizeof(words));
+	val = get_bits_in_op_words(words, 10, 6);
+	if (op->len == 2) {
+		if (val >= 0x3e && get_bits_in_op_words(words, 16, 1))
+			return;
+
+		if (val < 0x30)
+			val &= 0x30;
+	} else {
+		if (val == 0x3f && get_bits_in_op_words(words, 17, 1))
+			return;
+	}
+
+	p_op = get_dsp_p_op_info(val, op->len);
+	if (!p_op)
+		return;
+
+	layout_id = p_op->layout_id[0];
+	if (p_op->mdfr_bit_type == OP_MDFR_BIT_TYPE_USE_ALT_LAYOUT &&
+			get_bits_in_op_words(words, p_op->mdfr_bit, 1))
+		layout_id = p_op->alt_layout_id;
+
+	loc_layout = iss_find_loc_layout(op, get_p_op_layout(layout_id));
+	if (!loc_layout)
+		return;
+
+	op->p_info = p_op;
+	iss_get_operands(op, p_op, loc_layout, op->p_operands, &op->p_operand_cnt,
+			&op->p_op_str);
+}
+
+static int iss_decode_op(struct dsp_iss_state *state, uint32_t addr,
+		struct dsp_iss_op *op)
+{
+	const op_operand_loc_layout *loc_layout = NULL;
+	uint32_t i, layout_id, words[4];
+
+	memset(op, 0, sizeof(*op));
+	op->addr = addr;
+	op->words[0] = state->pmem[addr & (DSP_ISS_PMEM_WORDS - 1)];
+	op->len = get_dsp_op_len(op->words[0]);
+	for (i = 1; i < op->len; i++)
+		op->words[i] = state->pmem[(addr + i) & (DSP_ISS_PMEM_WORDS - 1)];
+
+	if (op->len > 1)
+		op->op = (op->words[0] & 0x007f8000) >> 15;
+	else
+		op->op = (op->words[0] & 0x00ff0000) >> 16;
+
+	op->info = get_dsp_op_info(op->op);
+	if (!op->info) {
+		snprintf(state->stop_msg, sizeof(state->stop_msg),
+				"Unknown op 0x%08x at 0x%04x", op->words[0], addr);
+		state->stop_reason = DSP_ISS_STOP_UNKNOWN_OP;
+		return 1;
+	}
+
+	op->op_str = op->info->op_str;
+	if (!op->info->has_op_layout)
+		return 0;
+
+	layout_id = get_op_layout_id(op->info, op->len);
+	if (layout_id == OP_LAYOUT_NONE)
+		return 0;
+
+	memcpy(words, op->words, sizeof(words));
+	if (op->info->mdfr_bit_type == OP_MDFR_BIT_TYPE_USE_ALT_LAYOUT &&
+			get_bits_in_op_words(words, op->info->mdfr_bit, 1))
+		layout_id = op->info->alt_layout_id;
+
+	if (layout_id == OP_LAYOUT_NOP) {
+		if (op->len > 1)
+			iss_decode_p_op(op);
+
+		return 0;
+	}
+
+	loc_layout = iss_find_loc_layout(op, get_op_layout(layout_id));
+	if (loc_layout && op->len > 1 && loc_layout->supports_opt_args)
+		iss_decode_p_op(op);
+
+	iss_get_operands(op, op->info, loc_layout, op->operands, &op->operand_cnt,
+			&op->op_str);
+
+	return 0;
+}
+
+/*
+ * Get the operands of the next group of parallel operands, starting at
+ * *start. Returns 0 once there are no groups left.
+ */
+static uint32_t iss_get_next_group(const struct dsp_iss_operand *operands,
+		uint32_t operand_cnt, uint32_t *start, struct dsp_iss_group *group)
+{
+	const struct dsp_iss_operand *operand;
+	uint32_t i;
+
+	memset(group, 0, sizeof(*group));
+	if (*start >= operand_cnt)
+		return 0;
+
+	for (i = *start; i < operand_cnt; i++) {
+		operand = &operands[i];
+		switch (operand->dir) {
+		case OPERAND_DIR_DST:
+			group->dst = operand;
+			break;
+		case OPERAND_DIR_SRC:
+			group->src = operand;
+			break;
+		case OPERAND_DIR_X:
+			group->x = operand;
+			break;
+		case OPERAND_DIR_Y:
+			group->y = operand;
+			break;
+		case OPERAND_DIR_A:
+			group->a = operand;
+			break;
+		default:
+			break;
+		}
+
+		if (operand->parallel_end)
+			break;
+	}
+
+	*start = i + 1;
+
+	return 1;
+}
+
+static int iss_read_operand(struct dsp_iss_state *state, const struct dsp_iss_op *op,
+		const struct dsp_iss_operand *operand, uint32_t *val)
+{
+	struct dsp_iss_loc loc;
+
+	if (!operand) {
+		*val = 0;
+		return 0;
+	}
+
+	if (iss_resolve_operand(state, op, operand, &loc))
+		return 1;
+
+	*val = iss_loc_read(state, &loc);
+
+	return 0;
+}
+
+static int iss_write_operand(struct dsp_iss_state *state, const struct dsp_iss_op *op,
+		const struct dsp_iss_operand *operand, uint32_t val)
+{
+	struct dsp_iss_loc loc;
+
+	if (!operand)
+		return 0;
+
+	if (iss_resolve_operand(state, op, operand, &loc))
+		return 1;
+
+	iss_loc_write(state, &loc, val);
+
+	return 0;
+}
+
+static void iss_set_cond_flags(struct dsp_iss_state *state, uint32_t result,
+		uint32_t extra_flags)
+{
+	uint32_t cond;
+
+	cond = state->regs[ISS_REG_COND] & ~ISS_COND_MASK;
+	if (!result)
+		cond |= ISS_COND_Z;
+	if (result & 0x80000000)
+		cond |= ISS_COND_N;
+
+	iss_queue_reg_write(state, ISS_REG_COND, cond | extra_flags);
+}
+
+/*
+ * Branch conditions. Only 'always' is known for certain. The encodings of
+ * the flag tests haven't been checked against ca0132-dsp-op-test records
+ * yet, so any other condition stops the simulator rather than risk taking
+ * the wrong branch.
+ */
+static int iss_check_branch_cond(struct dsp_iss_state *state,
+		const struct dsp_iss_op *op, uint32_t cond, uint8_t *taken)
+{
+	switch (cond) {
+	case ISS_BRANCH_COND_ALWAYS:
+		*taken = 1;
+		return 0;
+	default:
+		snprintf(state->stop_msg, sizeof(state->stop_msg),
+				"Unimplemented branch condition 0x%02x in %s at 0x%04x",
+				cond, op->op_str, op->addr);
+		state->stop_reason = DSP_ISS_STOP_UNIMPL;
+		return 1;
+	}
+}
+
+/* Stack helpers. Stack pointers count up from zero. */
+static int iss_pc_stack_push(struct dsp_iss_state *state, uint32_t pc)
+{
+	uint32_t sp = state->regs[ISS_REG_PC_STK_PTR];
+
+	if (sp >= DSP_ISS_STACK_DEPTH) {
+		iss_stop(state, DSP_ISS_STOP_STACK, "PC stack overflow");
+		return 1;
+	}
+
+	state->pc_stack[sp] = pc;
+	iss_queue_reg_write(state, ISS_REG_PC_STK_PTR, sp + 1);
+
+	return 0;
+}
+
+static int iss_pc_stack_pop(struct dsp_iss_state *state, uint32_t *pc)
+{
+	uint32_t sp = state->regs[ISS_REG_PC_STK_PTR];
+
+	if (!sp || sp > DSP_ISS_STACK_DEPTH) {
+		iss_stop(state, DSP_ISS_STOP_STACK, "PC stack underflow");
+		return 1;
+	}
+
+	*pc = state->pc_stack[sp - 1];
+	iss_queue_reg_write(state, ISS_REG_PC_STK_PTR, sp - 1);
+
+	return 0;
+}
+
+static void iss_set_branch(struct dsp_iss_state *state, uint32_t addr)
+{
+	state->next_pc = addr & 0xffff;
+	state->branch_taken = 1;
+}
+
+/*
+ * Op handlers.
+ */
+static int iss_op_nop(struct dsp_iss_state *state, const struct dsp_iss_op *op)
+{
+	return 0;
+}
+
+static int iss_op_halt(struct dsp_iss_state *state, const struct dsp_iss_op *op)
+{
+	iss_stop(state, DSP_ISS_STOP_HALT, "HALT");
+
+	return 0;
+}
+
+static int iss_op_int_enable(struct dsp_iss_state *state, const struct dsp_iss_op *op)
+{
+	state->int_enable = (op->op == 0x24);
+
+	return 0;
+}
+
+/* JMP/JMPC/CALL with a 16-bit literal address. */
+static int iss_op_branch_lit(struct dsp_iss_state *state, const struct dsp_iss_op *op)
+{
+	uint8_t taken;
+
+	if (op->operand_cnt < 2)
+		return 0;
+
+	if (iss_check_branch_cond(state, op, op->operands[0].val, &taken))
+		return 1;
+
+	if (!taken)
+		return 0;
+
+	if (op->op == 0x04 && iss_pc_stack_push(state, op->addr + op->len))
+		return 1;
+
+	iss_set_branch(state, op->operands[1].val);
+
+	return 0;
+}
+
+/* JMP/CALL to an address register, optionally plus its modifier. */
+static int iss_op_branch_reg(struct dsp_iss_state *state, const struct dsp_iss_op *op)
+{
+	uint32_t i, addr;
+	uint8_t taken;
+
+	if (!op->operand_cnt)
+		return 0;
+
+	if (iss_check_branch_cond(state, op, op->operands[0].val, &taken))
+		return 1;
+
+	if (!taken)
+		return 0;
+
+	addr = 0;
+	for (i = 1; i < op->operand_cnt; i++) {
+		if (op->operands[i].type == OP_OPERAND_A_REG_CALL)
+			addr += state->regs[ISS_REG_A_R0 + (op->operands[i].val & 0x07)];
+		else if (op->operands[i].type == OP_OPERAND_A_REG_CALL_MDFR)
+			addr += iss_get_mdfr(state, op->operands[i].val & 0x07);
+	}
+
+	if (op->op == 0x0f && iss_pc_stack_push(state, op->addr + op->len))
+		return 1;
+
+	iss_set_branch(state, addr);
+
+	return 0;
+}
+
+/* S_JMP/S_JMPC/S_CALL, with an 8-bit offset from the current op. */
+static int iss_op_branch_short(struct dsp_iss_state *state, const struct dsp_iss_op *op)
+{
+	uint8_t taken;
+
+	if (op->operand_cnt < 2)
+		return 0;
+
+	if (iss_check_branch_cond(state, op, op->operands[0].val, &taken))
+		return 1;
+
+	if (!taken)
+		return 0;
+
+	if (op->op == 0x13 && iss_pc_stack_push(state, op->addr + op->len))
+		return 1;
+
+	iss_set_branch(state, op->addr + sign_extend(op->operands[1].val, 8));
+
+	return 0;
+}
+
+static int iss_op_ret(struct dsp_iss_state *state, const struct dsp_iss_op *op)
+{
+	uint32_t pc;
+
+	if (iss_pc_stack_pop(state, &pc))
+		return 1;
+
+	if (op->op == 0x16)
+		state->int_enable = 1;
+
+	iss_set_branch(state, pc);
+
+	return 0;
+}
+
+/*
+ * Hardware loops. The loop body runs from the op after the loop op up to and
+ * including the op at the end address. Provisional, the loop register
+ * behavior hasn't been confirmed.
+ */
+static int iss_op_loop(struct dsp_iss_state *state, const struct dsp_iss_op *op)
+{
+	struct dsp_iss_loop *loop;
+	struct dsp_iss_loc loc;
+	uint32_t sp, cnt, end;
+
+	if (op->operand_cnt < 2)
+		return 0;
+
+	if (iss_resolve_operand(state, op, &op->operands[0], &loc))
+		return 1;
+
+	cnt = iss_loc_read(state, &loc);
+	if (op->operands[1].type == OP_OPERAND_LITERAL_8_INT_PC_OFFSET)
+		end = op->addr + sign_extend(op->operands[1].val, 8);
+	else
+		end = op->operands[1].val;
+
+	/* A zero count skips the loop body entirely. */
+	if (!cnt) {
+		iss_set_branch(state, end + get_dsp_op_len(state->pmem[end & 0xffff]));
+		return 0;
+	}
+
+	sp = state->regs[ISS_REG_LOOP_STACK_PTR];
+	if (sp >= DSP_ISS_STACK_DEPTH) {
+		iss_stop(state, DSP_ISS_STOP_STACK, "Loop stack overflow");
+		return 1;
+	}
+
+	loop = &state->loop_stack[sp];
+	loop->start = (op->addr + op->len) & 0xffff;
+	loop->end = end & 0xffff;
+	loop->cnt = cnt;
+
+	iss_queue_reg_write(state, ISS_REG_TOP_LOOP_ADR, state->regs[ISS_REG_CUR_LOOP_ADR]);
+	iss_queue_reg_write(state, ISS_REG_TOP_LOOP_CNT, state->regs[ISS_REG_CUR_LOOP_CNT]);
+	iss_queue_reg_write(state, ISS_REG_CUR_LOOP_ADR, loop->end);
+	iss_queue_reg_write(state, ISS_REG_CUR_LOOP_CNT, cnt);
+	iss_queue_reg_write(state, ISS_REG_LOOP_STACK_PTR, sp + 1);
+
+	return 0;
+}
+
+static void iss_check_loop_end(struct dsp_iss_state *state, uint32_t addr)
+{
+	struct dsp_iss_loop *loop;
+	uint32_t sp;
+
+	sp = state->regs[ISS_REG_LOOP_STACK_PTR];
+	if (!sp || sp > DSP_ISS_STACK_DEPTH)
+		return;
+
+	loop = &state->loop_stack[sp - 1];
+	if (addr != loop->end)
+		return;
+
+	if (loop->cnt > 1) {
+		loop->cnt--;
+		state->regs[ISS_REG_CUR_LOOP_CNT] = loop->cnt;
+		state->next_pc = loop->start;
+		return;
+	}
+
+	/* Loop finished, pop it. */
+	state->regs[ISS_REG_LOOP_STACK_PTR] = sp - 1;
+	if (sp > 1) {
+		loop = &state->loop_stack[sp - 2];
+		state->regs[ISS_REG_CUR_LOOP_ADR] = loop->end;
+		state->regs[ISS_REG_CUR_LOOP_CNT] = loop->cnt;
+	} else {
+		state->regs[ISS_REG_CUR_LOOP_ADR] = 0;
+		state->regs[ISS_REG_CUR_LOOP_CNT] = 0;
+	}
+}
+
+/*
+ * Moves. _T1/_T2 variants access the upper bits of accumulator registers on
+ * the register side of the move: the source register if there is one,
+ * otherwise the destination register.
+ */
+static uint32_t iss_get_acc_part(const char *op_str)
+{
+	if (strstr(op_str, "_T1"))
+		return DSP_ISS_LOC_ACC_T1;
+	if (strstr(op_str, "_T2"))
+		return DSP_ISS_LOC_ACC_T2;
+
+	return DSP_ISS_LOC_REG;
+}
+
+static int iss_exec_moves(struct dsp_iss_state *state, const struct dsp_iss_op *op,
+		const struct dsp_iss_operand *operands, uint32_t operand_cnt,
+		const char *op_str)
+{
+	struct dsp_iss_loc src, dst;
+	struct dsp_iss_group group;
+	uint32_t start, val, acc_part;
+
+	acc_part = iss_get_acc_part(op_str);
+	start = 0;
+	while (iss_get_next_group(operands, operand_cnt, &start, &group)) {
+		if (!group.dst || !group.src)
+			continue;
+
+		if (iss_resolve_operand(state, op, group.src, &src) ||
+				iss_resolve_operand(state, op, group.dst, &dst))
+			return 1;
+
+		if (acc_part != DSP_ISS_LOC_REG) {
+			if (src.type == DSP_ISS_LOC_REG)
+				src.type = acc_part;
+			else if (dst.type == DSP_ISS_LOC_REG)
+				dst.type = acc_part;
+		}
+
+		val = iss_loc_read(state, &src);
+		switch (group.src->mdfr) {
+		case OPERAND_MDFR_INC:
+			val++;
+			break;
+		case OPERAND_MDFR_DEC:
+			val--;
+			break;
+		case OPERAND_MDFR_RL:
+			val <<= 1;
+			break;
+		case OPERAND_MDFR_RR:
+			val >>= 1;
+			break;
+		default:
+			break;
+		}
+
+		iss_loc_write(state, &dst, val);
+	}
+
+	return 0;
+}
+
+static int iss_op_mov(struct dsp_iss_state *state, const struct dsp_iss_op *op)
+{
+	return iss_exec_moves(state, op, op->operands, op->operand_cnt, op->op_str);
+}
+
+/* MOV_L writes the lower 16-bits of the destination, keeping the upper. */
+static int iss_op_mov_l(struct dsp_iss_state *state, const struct dsp_iss_op *op)
+{
+	struct dsp_iss_group group;
+	struct dsp_iss_loc dst;
+	uint32_t start, val, lit;
+
+	start = 0;
+	while (iss_get_next_group(op->operands, op->operand_cnt, &start, &group)) {
+		if (!group.dst || !group.src)
+			continue;
+
+		if (iss_read_operand(state, op, group.src, &lit) ||
+				iss_resolve_operand(state, op, group.dst, &dst))
+			return 1;
+
+		val = iss_loc_read(state, &dst);
+		iss_loc_write(state, &dst, (val & 0xffff0000) | (lit & 0xffff));
+	}
+
+	return 0;
+}
+
+/* Unary integer/float ops using the MOV layouts. */
+static int iss_op_unary(struct dsp_iss_state *state, const struct dsp_iss_op *op)
+{
+	struct dsp_iss_group group;
+	uint32_t start, val;
+
+	start = 0;
+	while (iss_get_next_group(op->operands, op->operand_cnt, &start, &group)) {
+		if (!group.dst || !group.src)
+			continue;
+
+		if (iss_read_operand(state, op, group.src, &val))
+			return 1;
+
+		switch (op->op) {
+		case 0x90: /* F_ABS */
+			val &= 0x7fffffff;
+			break;
+		case 0xd1: /* CMPL */
+			val = ~val;
+			iss_set_cond_flags(state, val, 0);
+			break;
+		case 0xd2: /* I_ABS */
+			if ((int32_t)val < 0 && val != 0x80000000)
+				val = -val;
+			iss_set_cond_flags(state, val, 0);
+			break;
+		default:
+			break;
+		}
+
+		if (iss_write_operand(state, op, group.dst, val))
+			return 1;
+	}
+
+	return 0;
+}
+
+static uint32_t iss_saturate(int64_t val, uint32_t *flags)
+{
+	if (val > INT32_MAX) {
+		*flags |= ISS_COND_V;
+		return INT32_MAX;
+	}
+
+	if (val < INT32_MIN) {
+		*flags |= ISS_COND_V;
+		return (uint32_t)INT32_MIN;
+	}
+
+	return (uint32_t)val;
+}
+
+/*
+ * Integer ALU ops taking a destination and X/Y sources. The _S suffix
+ * saturates, _O wraps. Carry/borrow use ISS_COND_C.
+ */
+static uint32_t iss_alu_op(struct dsp_iss_state *state, uint32_t op,
+		uint32_t x, uint32_t y, uint32_t *flags)
+{
+	uint32_t carry = (state->regs[ISS_REG_COND] & ISS_COND_C) ? 1 : 0;
+	uint64_t u_res;
+	int64_t s_res;
+
+	switch (op) {
+	case 0x6e: /* ADD_S */
+	case 0x6f: /* ADDC_S */
+	case 0xb0: /* ADD, literal */
+		s_res = (int64_t)(int32_t)x + (int32_t)y;
+		if (op == 0x6f)
+			s_res += carry;
+		u_res = (uint64_t)x + y + ((op == 0x6f) ? carry : 0);
+		if (u_res >> 32)
+			*flags |= ISS_COND_C;
+		if (op == 0xb0) {
+			if (s_res != (int32_t)s_res)
+				*flags |= ISS_COND_V;
+			return (uint32_t)s_res;
+		}
+		return iss_saturate(s_res, flags);
+
+	case 0x70: /* SUB_S */
+	case 0x71: /* SUBB_S */
+		s_res = (int64_t)(int32_t)x - (int32_t)y;
+		if (op == 0x71)
+			s_res -= carry;
+		if ((uint64_t)y + ((op == 0x71) ? carry : 0) > x)
+			*flags |= ISS_COND_C;
+		return iss_saturate(s_res, flags);
+
+	case 0x72: /* ADD_O */
+	case 0x73: /* ADDC_O */
+		u_res = (uint64_t)x + y + ((op == 0x73) ? carry : 0);
+		if (u_res >> 32)
+			*flags |= ISS_COND_C;
+		if (~(x ^ y) & (x ^ (uint32_t)u_res) & 0x80000000)
+			*flags |= ISS_COND_V;
+		return (uint32_t)u_res;
+
+	case 0x74: /* SUB_O */
+	case 0x75: /* SUBB_O */
+	case 0xd3: /* I_CMP */
+	case 0xd4: /* I_CMP, literal */
+		u_res = (uint64_t)x - y - ((op == 0x75) ? carry : 0);
+		if ((uint64_t)y + ((op == 0x75) ? carry : 0) > x)
+			*flags |= ISS_COND_C;
+		if ((x ^ y) & (x ^ (uint32_t)u_res) & 0x80000000)
+			*flags |= ISS_COND_V;
+		return (uint32_t)u_res;
+
+	case 0xcc:
+		return x ^ y;
+	case 0xcd:
+		return x | y;
+	case 0xce:
+		return x & y;
+
+	case 0xe2: /* RO_L */
+	case 0xe4:
+		y &= 0x1f;
+		return y ? (x << y) | (x >> (32 - y)) : x;
+	case 0xe3: /* RO_R */
+	case 0xe5:
+		y &= 0x1f;
+		return y ? (x >> y) | (x << (32 - y)) : x;
+	case 0xe6: /* SH_L */
+	case 0xe8:
+		return (y & 0x3f) > 31 ? 0 : x << (y & 0x1f);
+	case 0xe7: /* SH_R */
+	case 0xe9:
+		return (y & 0x3f) > 31 ? 0 : x >> (y & 0x1f);
+	case 0xea: /* A_SH_L */
+	case 0xec:
+		s_res = (int64_t)(int32_t)x << ((y & 0x3f) > 31 ? 31 : (y & 0x1f));
+		return iss_saturate(s_res, flags);
+	case 0xeb: /* A_SH_R */
+	case 0xed:
+		return (uint32_t)((int32_t)x >> ((y & 0x3f) > 31 ? 31 : (y & 0x1f)));
+
+	case 0xf2: /* SET_BIT */
+	case 0xf3:
+		return x | (1 << (y & 0x1f));
+	case 0xf4: /* CLR_BIT */
+	case 0xf5:
+		return x & ~(1 << (y & 0x1f));
+	case 0xf6: /* TGL_BIT */
+	case 0xf7:
+		return x ^ (1 << (y & 0x1f));
+
+	default:
+		return 0;
+	}
+}
+
+static int iss_op_alu(struct dsp_iss_state *state, const struct dsp_iss_op *op)
+{
+	struct dsp_iss_group group;
+	uint32_t start, x, y, res, flags;
+
+	start = 0;
+	while (iss_get_next_group(op->operands, op->operand_cnt, &start, &group)) {
+		if (!group.x || !group.y)
+			continue;
+
+		if (iss_read_operand(state, op, group.x, &x) ||
+				iss_read_operand(state, op, group.y, &y))
+			return 1;
+
+		flags = 0;
+		res = iss_alu_op(state, op->op, x, y, &flags);
+		iss_set_cond_flags(state, res, flags);
+
+		/* I_CMP only sets flags. Provisional. */
+		if (op->op == 0xd3 || op->op == 0xd4)
+			continue;
+
+		if (iss_write_operand(state, op, group.dst, res))
+			return 1;
+	}
+
+	return 0;
+}
+
+/* Single precision float ops. F_MA is A + (X * Y). */
+static int iss_op_float(struct dsp_iss_state *state, const struct dsp_iss_op *op)
+{
+	struct dsp_iss_group group;
+	uint32_t start, x, y, a;
+	float res;
+
+	start = 0;
+	while (iss_get_next_group(op->operands, op->operand_cnt, &start, &group)) {
+		if (!group.x || !group.y)
+			continue;
+
+		if (iss_read_operand(state, op, group.x, &x) ||
+				iss_read_operand(state, op, group.y, &y) ||
+				iss_read_operand(state, op, group.a, &a))
+			return 1;
+
+		switch (op->op) {
+		case 0x80:
+			res = bits_to_float(a) + (bits_to_float(x) * bits_to_float(y));
+			break;
+		case 0x88:
+			res = bits_to_float(x) + bits_to_float(y);
+			break;
+		case 0x89:
+			res = bits_to_float(x) - bits_to_float(y);
+			break;
+		case 0x8c:
+			res = bits_to_float(x) * bits_to_float(y);
+			break;
+		case 0x8d:
+			res = -(bits_to_float(x) * bits_to_float(y));
+			break;
+		default:
+			res = 0.0f;
+			break;
+		}
+
+		if (iss_write_operand(state, op, group.dst, float_to_bits(res)))
+			return 1;
+	}
+
+	return 0;
+}
+
+static const dsp_iss_op_func iss_op_funcs[0x100] = {
+	[0x00] = iss_op_nop,
+	[0x01] = iss_op_branch_lit,   /* JMP */
+	[0x02] = iss_op_branch_lit,   /* JMPC */
+	[0x04] = iss_op_branch_lit,   /* CALL */
+	[0x07] = iss_op_ret,          /* RET */
+	[0x0c] = iss_op_branch_reg,   /* JMP */
+	[0x0f] = iss_op_branch_reg,   /* CALL */
+	[0x10] = iss_op_branch_short, /* S_JMP */
+	[0x11] = iss_op_branch_short, /* S_JMPC */
+	[0x13] = iss_op_branch_short, /* S_CALL */
+	[0x16] = iss_op_ret,          /* RETI */
+	[0x19] = iss_op_loop,
+	[0x1a] = iss_op_loop,
+	[0x1c] = iss_op_loop,
+	[0x1d] = iss_op_loop,
+	[0x23] = iss_op_halt,
+	[0x24] = iss_op_int_enable,
+	[0x25] = iss_op_int_enable,
+	[0x30 ... 0x37] = iss_op_mov, /* MOVX */
+	[0x6e ... 0x75] = iss_op_alu,
+	[0x76 ... 0x79] = iss_op_mov, /* MOV with INC/DEC/RL/RR */
+	[0x80] = iss_op_float,        /* F_MA */
+	[0x88] = iss_op_float,        /* F_ADD */
+	[0x89] = iss_op_float,        /* F_SUB */
+	[0x8c] = iss_op_float,        /* F_MUL */
+	[0x8d] = iss_op_float,        /* F_NMUL */
+	[0x90] = iss_op_unary,        /* F_ABS */
+	[0xb0] = iss_op_alu,          /* ADD */
+	[0xc0 ... 0xc2] = iss_op_mov, /* MOV literal */
+	[0xc3 ... 0xc5] = iss_op_mov_l,
+	[0xc6 ... 0xc7] = iss_op_mov, /* MOV_U */
+	[0xc8 ... 0xca] = iss_op_mov,
+	[0xcc ... 0xce] = iss_op_alu, /* XOR/OR/AND */
+	[0xd1 ... 0xd2] = iss_op_unary,
+	[0xd3 ... 0xd4] = iss_op_alu, /* I_CMP */
+	[0xe2 ... 0xed] = iss_op_alu, /* Rotates and shifts. */
+	[0xf2 ... 0xf7] = iss_op_alu, /* Bit set/clear/toggle. */
+};
+
+/* All parallel ops are moves, other than conditional execution. */
+static int iss_exec_p_op(struct dsp_iss_state *state, const struct dsp_iss_op *op)
+{
+	if (!strcmp(op->p_info->op_str, "EXEC_COND_P")) {
+		snprintf(state->stop_msg, sizeof(state->stop_msg),
+				"Unimplemented parallel op EXEC_COND_P at 0x%04x", op->addr);
+		state->stop_reason = DSP_ISS_STOP_UNIMPL;
+		return 1;
+	}
+
+	return iss_exec_moves(state, op, op->p_operands, op->p_operand_cnt,
+			op->p_op_str);
+}
+
+/*
+ * Main simulator functions.
+ */
+uint32_t dsp_iss_step(struct dsp_iss_state *state)
+{
+	dsp_iss_op_func func;
+	struct dsp_iss_op op;
+
+	if (state->stop_reason)
+		return state->stop_reason;
+
+	if (iss_decode_op(state, state->pc, &op))
+		return state->stop_reason;
+
+	func = iss_op_funcs[op.op & 0xff];
+	if (!func) {
+		snprintf(state->stop_msg, sizeof(state->stop_msg),
+				"Unimplemented op %s at 0x%04x", op.op_str, op.addr);
+		state->stop_reason = DSP_ISS_STOP_UNIMPL;
+		return state->stop_reason;
+	}
+
+	state->write_cnt = 0;
+	state->branch_taken = 0;
+	state->next_pc = (state->pc + op.len) & 0xffff;
+
+	if (op.p_info && iss_exec_p_op(state, &op))
+		return state->stop_reason;
+
+	if (func(state, &op))
+		return state->stop_reason;
+
+	iss_commit_writes(state);
+	if (!state->branch_taken)
+		iss_check_loop_end(state, op.addr + op.len - 1);
+
+	state->pc = state->next_pc;
+	state->steps++;
+
+	return state->stop_reason;
+}
+
+uint32_t dsp_iss_run(struct dsp_iss_state *state, uint64_t max_steps)
+{
+	uint64_t i;
+
+	for (i = 0; i < max_steps; i++) {
+		if (dsp_iss_step(state))
+			return state->stop_reason;
+	}
+
+	iss_stop(state, DSP_ISS_STOP_STEP_LIMIT, "Step limit reached");
+
+	return state->stop_reason;
+}
+
+void dsp_iss_reset(struct dsp_iss_state *state)
+{
+	uint32_t dsp_id = state->dsp_id;
+
+	memset(state, 0, sizeof(*state));
+	state->dsp_id = dsp_id;
+	state->int_enable = 1;
+}
+
+struct dsp_iss_state *dsp_iss_create(uint32_t dsp_id)
+{
+	struct dsp_iss_state *state;
+
+	iss_init_const_regs();
+
+	state = calloc(1, sizeof(*state));
+	if (!state)
+		return NULL;
+
+	state->dsp_id = dsp_id;
+	dsp_iss_reset(state);
+
+	return state;
+}
+
+void dsp_iss_destroy(struct dsp_iss_state *state)
+{
+	free(state);
+}
+
+void dsp_iss_load_pmem(struct dsp_iss_state *state, uint32_t addr,
+		const uint32_t *data, uint32_t cnt)
+{
+	uint32_t i;
+
+	for (i = 0; i < cnt; i++)
+		state->pmem[(addr + i) & (DSP_ISS_PMEM_WORDS - 1)] = data[i];
+}
+
+/*
+ * Named value access, using the register names from ca0132-dsp-op-test's
+ * register dumps. Along with the regular register names, this handles
+ * accumulator parts such as 'R04_T1', and 'XGPRAM_000' style GPRAM names.
+ */
+static int iss_get_named_loc(const char *name, struct dsp_iss_loc *loc)
+{
+	char buf[0x40];
+	uint32_t reg;
+	int32_t acc;
+
+	if (!strncmp(name, "XGPRAM_", 7) || !strncmp(name, "YGPRAM_", 7)) {
+		loc->type = (name[0] == 'X') ? DSP_ISS_LOC_XGPRAM : DSP_ISS_LOC_YGPRAM;
+		loc->addr = strtoul(name + 7, NULL, 10);
+		return 0;
+	}
+
+	snprintf(buf, sizeof(buf), "%s", name);
+	if (strlen(buf) == 6 && (!strcmp(buf + 3, "_T1") || !strcmp(buf + 3, "_T2"))) {
+		loc->type = (buf[5] == '1') ? DSP_ISS_LOC_ACC_T1 : DSP_ISS_LOC_ACC_T2;
+		buf[3] = '\0';
+		if (!get_dsp_operand_str_val(buf, &reg))
+			return 1;
+
+		acc = iss_get_acc_idx(reg);
+		if (acc < 0)
+			return 1;
+
+		loc->addr = reg;
+		return 0;
+	}
+
+	if (!get_dsp_operand_str_val(buf, &reg))
+		return 1;
+
+	loc->type = DSP_ISS_LOC_REG;
+	loc->addr = reg;
+
+	return 0;
+}
+
+int dsp_iss_get_named_val(struct dsp_iss_state *state, const char *name,
+		uint32_t *val)
+{
+	struct dsp_iss_loc loc;
+
+	if (iss_get_named_loc(name, &loc))
+		return 1;
+
+	if (loc.type == DSP_ISS_LOC_REG)
+		*val = dsp_iss_reg_read(state, loc.addr);
+	else
+		*val = iss_loc_read(state, &loc);
+
+	return 0;
+}
+
+int dsp_iss_set_named_val(struct dsp_iss_state *state, const char *name,
+		uint32_t val)
+{
+	struct dsp_iss_loc loc, tmp;
+
+	if (iss_get_named_loc(name, &loc))
+		return 1;
+
+	if (loc.type == DSP_ISS_LOC_REG && loc.addr >= ISS_REG_IND_START &&
+			loc.addr <= ISS_REG_IND_END) {
+		iss_get_ind_reg_loc(state, loc.addr, &tmp, 0);
+		loc = tmp;
+	}
+
+	state->write_cnt = 0;
+	iss_queue_write(state, &loc, val);
+	iss_commit_writes(state);
+
+	return 0;
+}
+
+static const char *iss_stop_strs[] = {
+	"Running", "Halted", "Unknown op", "Unimplemented", "Stack error",
+	"Step limit",
+};
+
+const char *dsp_iss_get_stop_str(uint32_t stop_reason)
+{
+	if (stop_reason < ARRAY_SIZE(iss_stop_strs))
+		return iss_stop_strs[stop_reason];
+
+	return "Unknown";
+}